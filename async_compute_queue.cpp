@@ -0,0 +1,208 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "async_compute_queue.h"
+
+bool AsyncComputeQueue::create(const VulkanDevice *vk, VkQueue queue, uint32_t queueFamilyIdx)
+{
+    m_vk = vk;
+    m_queue = queue;
+
+    m_getSemaphoreCounterValue = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(
+                vk->f->vkGetDeviceProcAddr(vk->dev, "vkGetSemaphoreCounterValueKHR"));
+    m_waitSemaphores = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(
+                vk->f->vkGetDeviceProcAddr(vk->dev, "vkWaitSemaphoresKHR"));
+    if (!m_getSemaphoreCounterValue || !m_waitSemaphores) {
+        qWarning("VK_KHR_timeline_semaphore is not enabled");
+        return false;
+    }
+
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = queueFamilyIdx;
+    VkResult err = vk->df->vkCreateCommandPool(vk->dev, &poolInfo, nullptr, &m_pool);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to create command pool: %d", err);
+        return false;
+    }
+
+    VkSemaphoreTypeCreateInfoKHR typeInfo = {};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+    typeInfo.initialValue = 0;
+    VkSemaphoreCreateInfo semInfo = {};
+    semInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semInfo.pNext = &typeInfo;
+    err = vk->df->vkCreateSemaphore(vk->dev, &semInfo, nullptr, &m_timeline);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to create timeline semaphore: %d", err);
+        vk->df->vkDestroyCommandPool(vk->dev, m_pool, nullptr);
+        m_pool = VK_NULL_HANDLE;
+        m_timeline = VK_NULL_HANDLE;
+        return false;
+    }
+
+    return true;
+}
+
+void AsyncComputeQueue::destroy()
+{
+    if (!m_timeline)
+        return;
+
+    wait(m_lastSubmitted);
+
+    // freed together with the pool
+    m_submissions.clear();
+    m_recording = VK_NULL_HANDLE;
+
+    m_vk->df->vkDestroyCommandPool(m_vk->dev, m_pool, nullptr);
+    m_pool = VK_NULL_HANDLE;
+    m_vk->df->vkDestroySemaphore(m_vk->dev, m_timeline, nullptr);
+    m_timeline = VK_NULL_HANDLE;
+}
+
+VkCommandBuffer AsyncComputeQueue::begin()
+{
+    Q_ASSERT(!m_recording);
+
+    const uint64_t completed = completedValue();
+    for (int i = 0; i < m_submissions.count(); ++i) {
+        if (m_submissions[i].value <= completed) {
+            m_recording = m_submissions[i].cb;
+            m_submissions.removeAt(i);
+            m_vk->df->vkResetCommandBuffer(m_recording, 0);
+            break;
+        }
+    }
+
+    if (!m_recording) {
+        VkCommandBufferAllocateInfo cbInfo = {};
+        cbInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        cbInfo.commandPool = m_pool;
+        cbInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        cbInfo.commandBufferCount = 1;
+        VkResult err = m_vk->df->vkAllocateCommandBuffers(m_vk->dev, &cbInfo, &m_recording);
+        if (err != VK_SUCCESS) {
+            qWarning("Failed to allocate command buffer: %d", err);
+            m_recording = VK_NULL_HANDLE;
+            return VK_NULL_HANDLE;
+        }
+    }
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    m_vk->df->vkBeginCommandBuffer(m_recording, &beginInfo);
+
+    return m_recording;
+}
+
+uint64_t AsyncComputeQueue::submit()
+{
+    Q_ASSERT(m_recording);
+
+    VkCommandBuffer cb = m_recording;
+    m_recording = VK_NULL_HANDLE;
+
+    VkResult err = m_vk->df->vkEndCommandBuffer(cb);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to end command buffer: %d", err);
+        m_submissions.append({ cb, 0 });
+        return 0;
+    }
+
+    const uint64_t signalValue = m_lastSubmitted + 1;
+    VkTimelineSemaphoreSubmitInfoKHR timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &cb;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &m_timeline;
+
+    err = m_vk->df->vkQueueSubmit(m_queue, 1, &submitInfo, VK_NULL_HANDLE);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to submit to the compute queue: %d", err);
+        m_submissions.append({ cb, 0 });
+        return 0;
+    }
+
+    m_lastSubmitted = signalValue;
+    m_submissions.append({ cb, signalValue });
+    return signalValue;
+}
+
+uint64_t AsyncComputeQueue::completedValue() const
+{
+    uint64_t value = 0;
+    if (m_timeline)
+        m_getSemaphoreCounterValue(m_vk->dev, m_timeline, &value);
+    return value;
+}
+
+void AsyncComputeQueue::wait(uint64_t value) const
+{
+    if (!m_timeline || !value)
+        return;
+
+    VkSemaphoreWaitInfoKHR waitInfo = {};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &m_timeline;
+    waitInfo.pValues = &value;
+    m_waitSemaphores(m_vk->dev, &waitInfo, UINT64_MAX);
+}
@@ -0,0 +1,96 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef ASYNC_COMPUTE_QUEUE_H
+#define ASYNC_COMPUTE_QUEUE_H
+
+#include "vulkan_device.h"
+#include <QVector>
+
+// Records and submits work to a queue other than the one QRhi renders with.
+// Completion is tracked with a single timeline semaphore: every submit()
+// signals the next value, which can then be polled every frame without
+// blocking. Command buffers are recycled once their submission completed.
+
+class AsyncComputeQueue
+{
+public:
+    bool create(const VulkanDevice *vk, VkQueue queue, uint32_t queueFamilyIdx);
+    void destroy();
+    bool isValid() const { return m_timeline != VK_NULL_HANDLE; }
+
+    // returns a command buffer in recording state
+    VkCommandBuffer begin();
+    // submits what was recorded since begin(), returns the timeline value that
+    // gets signaled when the work has completed (0 on failure)
+    uint64_t submit();
+
+    uint64_t completedValue() const;
+    bool isComplete(uint64_t value) const { return completedValue() >= value; }
+    void wait(uint64_t value) const;
+
+private:
+    struct Submission {
+        VkCommandBuffer cb;
+        uint64_t value;
+    };
+
+    const VulkanDevice *m_vk = nullptr;
+    VkQueue m_queue = VK_NULL_HANDLE;
+    VkCommandPool m_pool = VK_NULL_HANDLE;
+    VkSemaphore m_timeline = VK_NULL_HANDLE;
+    PFN_vkGetSemaphoreCounterValueKHR m_getSemaphoreCounterValue = nullptr;
+    PFN_vkWaitSemaphoresKHR m_waitSemaphores = nullptr;
+    uint64_t m_lastSubmitted = 0;
+    VkCommandBuffer m_recording = VK_NULL_HANDLE;
+    QVector<Submission> m_submissions;
+};
+
+#endif
@@ -0,0 +1,98 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "benchmark_runner.h"
+#include "gpu_timer.h"
+#include <QDebug>
+
+void BenchmarkRunner::add(const Benchmark &benchmark)
+{
+    if (benchmark.phaseCount > 0)
+        m_queue.append(benchmark);
+}
+
+void BenchmarkRunner::step()
+{
+    if (m_queue.isEmpty())
+        return;
+
+    const Benchmark &b(m_queue.first());
+    ++m_frame;
+    if (m_frame == 1) {
+        if (m_phase == 0)
+            qDebug("benchmark %s: %d phase(s)", b.name.constData(), b.phaseCount);
+        if (b.begin)
+            b.begin(m_phase);
+    }
+    if (b.frame)
+        b.frame(m_phase);
+
+    if (m_frame == WARMUP_FRAMES) {
+        if (b.warmedUp)
+            b.warmedUp(m_phase);
+        if (m_timer)
+            m_timer->resetStatistics();
+    }
+    if (m_frame == WARMUP_FRAMES + MEASURED_FRAMES && b.measured)
+        b.measured(m_phase);
+    if (m_frame < WARMUP_FRAMES + MEASURED_FRAMES + b.settleFrames)
+        return;
+    if (b.settled)
+        b.settled(m_phase);
+
+    m_frame = 0;
+    if (++m_phase < b.phaseCount)
+        return;
+
+    m_phase = 0;
+    if (b.report)
+        b.report();
+    m_queue.removeFirst();
+}
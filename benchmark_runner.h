@@ -0,0 +1,96 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef BENCHMARK_RUNNER_H
+#define BENCHMARK_RUNNER_H
+
+#include <QByteArray>
+#include <QVector>
+#include <functional>
+
+class GpuTimer;
+
+// Runs the queued benchmarks one after the other, one step() per frame. Each
+// phase renders WARMUP_FRAMES + MEASURED_FRAMES frames; the GPU timer
+// statistics get reset after the warmup, so that they cover the measured
+// frames when measured() is called. All callbacks are optional.
+
+class BenchmarkRunner
+{
+public:
+    static const int WARMUP_FRAMES = 30;
+    static const int MEASURED_FRAMES = 300;
+
+    struct Benchmark {
+        QByteArray name;
+        int phaseCount = 1;
+        std::function<void(int phase)> begin; // on the first frame of the phase
+        std::function<void(int phase)> frame; // on every frame of the phase
+        std::function<void(int phase)> warmedUp; // before the statistics get reset
+        std::function<void(int phase)> measured;
+        // for results the frames still in flight have yet to deliver
+        int settleFrames = 0;
+        std::function<void(int phase)> settled;
+        std::function<void()> report; // after the last phase
+    };
+
+    void setGpuTimer(GpuTimer *timer) { m_timer = timer; }
+    void add(const Benchmark &benchmark);
+    bool isRunning() const { return !m_queue.isEmpty(); }
+    void step();
+
+private:
+    GpuTimer *m_timer = nullptr;
+    QVector<Benchmark> m_queue;
+    int m_phase = 0;
+    int m_frame = 0;
+};
+
+#endif
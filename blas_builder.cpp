@@ -0,0 +1,191 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "blas_builder.h"
+
+static inline VkDeviceSize alignUp(VkDeviceSize v, VkDeviceSize byteAlign)
+{
+    return (v + byteAlign - 1) & ~(byteAlign - 1);
+}
+
+void BlasBuilder::create(const VulkanDevice *vk, PFN_vkCmdBuildAccelerationStructureNV cmdBuildAccelerationStructure,
+                         VkDeviceSize scratchBudget, VkDeviceSize scratchAlignment)
+{
+    m_vk = vk;
+    m_cmdBuild = cmdBuildAccelerationStructure;
+    m_scratchBudget = scratchBudget;
+    m_scratchAlignment = qMax<VkDeviceSize>(1, scratchAlignment);
+}
+
+void BlasBuilder::destroy()
+{
+    if (!m_vk)
+        return;
+
+    for (const PendingRelease &r : m_pendingRelease)
+        m_vk->destroyBuffer(r.buf, r.mem);
+    m_pendingRelease.clear();
+
+    if (m_scratchBuf) {
+        m_vk->destroyBuffer(m_scratchBuf, m_scratchMem);
+        m_scratchBuf = VK_NULL_HANDLE;
+        m_scratchMem = VK_NULL_HANDLE;
+        m_scratchSize = 0;
+    }
+
+    m_pending.clear();
+}
+
+void BlasBuilder::addBuild(const Build &build)
+{
+    m_pending.append({ build, false });
+}
+
+void BlasBuilder::addUpdate(const Build &build)
+{
+    m_pending.append({ build, true });
+}
+
+bool BlasBuilder::ensureScratch(VkDeviceSize size, int frameSlot)
+{
+    for (int i = m_pendingRelease.count() - 1; i >= 0; --i) {
+        const PendingRelease &r(m_pendingRelease[i]);
+        if (r.frameSlot == frameSlot) {
+            m_vk->destroyBuffer(r.buf, r.mem);
+            m_pendingRelease.removeAt(i);
+        }
+    }
+
+    if (size <= m_scratchSize)
+        return true;
+
+    // the previous frame may still be building with the old one
+    if (m_scratchBuf)
+        m_pendingRelease.append({ m_scratchBuf, m_scratchMem, (frameSlot + 1) % MAX_FRAMES_IN_FLIGHT });
+
+    m_scratchBuf = VK_NULL_HANDLE;
+    m_scratchMem = VK_NULL_HANDLE;
+    m_scratchSize = 0;
+    VkResult err = m_vk->createBuffer(size, VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                      &m_scratchBuf, &m_scratchMem, MemoryTracker::Scratch);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to create BLAS scratch buffer of %llu bytes: %d", size, err);
+        return false;
+    }
+    m_scratchSize = size;
+    return true;
+}
+
+void BlasBuilder::record(VkCommandBuffer cb, int frameSlot)
+{
+    m_lastStats = Statistics();
+    if (m_pending.isEmpty())
+        return;
+
+    // split into waves, a wave ends where its scratch would exceed the budget
+    // (a single build larger than the budget still gets a wave of its own)
+    QVector<int> waveStart;
+    QVector<VkDeviceSize> scratchOffsets(m_pending.count());
+    VkDeviceSize waveScratch = 0;
+    VkDeviceSize maxWaveScratch = 0;
+    for (int i = 0; i < m_pending.count(); ++i) {
+        const VkDeviceSize size = alignUp(m_pending[i].build.scratchSize, m_scratchAlignment);
+        if (waveStart.isEmpty() || (waveScratch > 0 && waveScratch + size > m_scratchBudget)) {
+            waveStart.append(i);
+            waveScratch = 0;
+        }
+        scratchOffsets[i] = waveScratch;
+        waveScratch += size;
+        maxWaveScratch = qMax(maxWaveScratch, waveScratch);
+    }
+    waveStart.append(m_pending.count());
+
+    if (!ensureScratch(maxWaveScratch, frameSlot))
+        return;
+
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    const VkAccessFlags accelAccess = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV;
+    memoryBarrier.srcAccessMask = accelAccess;
+    memoryBarrier.dstAccessMask = accelAccess;
+
+    // scratch memory may have been used by the previous frame's builds
+    m_vk->df->vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV,
+                                   0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+    for (int w = 0; w < waveStart.count() - 1; ++w) {
+        if (w > 0) {
+            // because scratch is reused
+            m_vk->df->vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV,
+                                           0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+        }
+        for (int i = waveStart[w]; i < waveStart[w + 1]; ++i) {
+            const Build &b(m_pending[i].build);
+            const bool update = m_pending[i].update;
+            VkAccelerationStructureInfoNV buildInfo = {};
+            buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
+            buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_NV;
+            buildInfo.flags = b.flags;
+            buildInfo.geometryCount = b.geometryCount;
+            buildInfo.pGeometries = b.geometries;
+            m_cmdBuild(cb, &buildInfo, VK_NULL_HANDLE, 0, update ? VK_TRUE : VK_FALSE,
+                       b.blas, update ? b.blas : VK_NULL_HANDLE, m_scratchBuf, scratchOffsets[i]);
+            if (update)
+                ++m_lastStats.updateCount;
+        }
+    }
+
+    m_lastStats.buildCount = m_pending.count();
+    m_lastStats.waveCount = waveStart.count() - 1;
+    m_lastStats.peakScratchSize = maxWaveScratch;
+    m_lastStats.scratchBufferSize = m_scratchSize;
+
+    m_pending.clear();
+}
@@ -0,0 +1,131 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef BLAS_BUILDER_H
+#define BLAS_BUILDER_H
+
+#include "vulkan_device.h"
+#include <QVector>
+
+// Records many bottom level acceleration structure builds into one command
+// buffer. Each build in a wave gets its own, disjoint range of the scratch
+// buffer, so the builds within a wave have no dependencies on each other and
+// need no barriers in between. When the total scratch size would exceed the
+// budget the builds are split into multiple waves, separated by a single
+// barrier since they reuse the same scratch memory. No barrier is issued
+// after the last wave; that is up to the caller, typically one before the
+// TLAS build.
+//
+// Updates (refits) of acceleration structures built with
+// VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_NV go through the same
+// waves, updating the structure in place.
+
+class BlasBuilder
+{
+public:
+    struct Build {
+        VkAccelerationStructureNV blas;
+        const VkGeometryNV *geometries;
+        uint32_t geometryCount;
+        VkBuildAccelerationStructureFlagsNV flags;
+        VkDeviceSize scratchSize; // from VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_BUILD_SCRATCH_NV
+                                  // (or UPDATE_SCRATCH_NV for updates)
+    };
+
+    struct Statistics {
+        int buildCount = 0; // including the updates
+        int updateCount = 0;
+        int waveCount = 0;
+        VkDeviceSize peakScratchSize = 0;
+        VkDeviceSize scratchBufferSize = 0;
+    };
+
+    static const int MAX_FRAMES_IN_FLIGHT = 2;
+
+    void create(const VulkanDevice *vk, PFN_vkCmdBuildAccelerationStructureNV cmdBuildAccelerationStructure,
+                VkDeviceSize scratchBudget, VkDeviceSize scratchAlignment);
+    void destroy();
+
+    void addBuild(const Build &build);
+    // geometries must be the same as in the last build, only the vertex data may differ
+    void addUpdate(const Build &build);
+    bool hasPendingBuilds() const { return !m_pending.isEmpty(); }
+
+    // cb must belong to the frame in frameSlot
+    void record(VkCommandBuffer cb, int frameSlot);
+
+    const Statistics &lastStatistics() const { return m_lastStats; }
+
+private:
+    bool ensureScratch(VkDeviceSize size, int frameSlot);
+
+    struct PendingBuild {
+        Build build;
+        bool update;
+    };
+    struct PendingRelease {
+        VkBuffer buf;
+        VkDeviceMemory mem;
+        int frameSlot;
+    };
+
+    const VulkanDevice *m_vk = nullptr;
+    PFN_vkCmdBuildAccelerationStructureNV m_cmdBuild = nullptr;
+    VkDeviceSize m_scratchBudget = 0;
+    VkDeviceSize m_scratchAlignment = 256;
+    VkBuffer m_scratchBuf = VK_NULL_HANDLE;
+    VkDeviceMemory m_scratchMem = VK_NULL_HANDLE;
+    VkDeviceSize m_scratchSize = 0;
+    QVector<PendingRelease> m_pendingRelease;
+    QVector<PendingBuild> m_pending;
+    Statistics m_lastStats;
+};
+
+#endif
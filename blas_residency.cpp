@@ -0,0 +1,126 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "blas_residency.h"
+#include <algorithm>
+
+void BlasResidency::create(const QVector<VkDeviceSize> &blasSizes, VkDeviceSize budget)
+{
+    m_entries.clear();
+    m_entries.resize(blasSizes.count());
+    for (int i = 0; i < blasSizes.count(); ++i)
+        m_entries[i].size = blasSizes[i];
+    m_enabled = budget > 0;
+    m_budget = budget;
+    m_usedBytes = 0;
+    m_residentCount = 0;
+    m_frame = 0;
+    m_stats = Statistics();
+}
+
+void BlasResidency::evict(int mesh, QVector<int> *evicted)
+{
+    Entry &e(m_entries[mesh]);
+    e.resident = false;
+    m_usedBytes -= e.size;
+    --m_residentCount;
+    ++m_stats.evictions;
+    evicted->append(mesh);
+}
+
+void BlasResidency::update(const QVector<int> &visible, QVector<int> *streamIn, QVector<int> *evict)
+{
+    ++m_frame;
+    QVector<int> missing;
+    for (int mesh : visible) {
+        Entry &e(m_entries[mesh]);
+        if (e.lastVisibleFrame == m_frame)
+            continue;
+        e.lastVisibleFrame = m_frame;
+        ++m_stats.lookups;
+        if (e.resident)
+            ++m_stats.hits;
+        else
+            missing.append(mesh);
+    }
+
+    if (missing.isEmpty() && m_usedBytes <= m_budget)
+        return;
+
+    // Only gathered and sorted when something has to go. Taken from the
+    // back, so the least recently visible one comes first.
+    m_candidates.clear();
+    for (int i = 0; i < m_entries.count(); ++i) {
+        if (m_entries[i].resident && m_entries[i].lastVisibleFrame != m_frame)
+            m_candidates.append(i);
+    }
+    std::sort(m_candidates.begin(), m_candidates.end(), [this](int a, int b) {
+        return m_entries[a].lastVisibleFrame > m_entries[b].lastVisibleFrame;
+    });
+
+    // the budget may have shrunk
+    while (m_usedBytes > m_budget && !m_candidates.isEmpty())
+        this->evict(m_candidates.takeLast(), evict);
+
+    for (int mesh : missing) {
+        Entry &e(m_entries[mesh]);
+        while (m_usedBytes + e.size > m_budget && !m_candidates.isEmpty())
+            this->evict(m_candidates.takeLast(), evict);
+        if (m_usedBytes + e.size > m_budget) {
+            ++m_stats.deferred;
+            continue;
+        }
+        e.resident = true;
+        m_usedBytes += e.size;
+        ++m_residentCount;
+        ++m_stats.streamedIn;
+        streamIn->append(mesh);
+    }
+}
@@ -0,0 +1,113 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef BLAS_RESIDENCY_H
+#define BLAS_RESIDENCY_H
+
+#include <QVector>
+#include <vulkan/vulkan.h>
+
+// Keeps the bottom level acceleration structures of the meshes within a
+// memory budget. This is only the bookkeeping: every frame the caller passes
+// in the meshes referenced by visible instances and gets back the ones to
+// build (stream in) and the ones to release. Room is made by evicting the
+// least recently visible meshes; what is visible in the current frame is
+// never evicted, so a visible mesh that does not fit stays missing until
+// something else goes out of view (or the budget grows).
+
+class BlasResidency
+{
+public:
+    struct Statistics {
+        qint64 lookups = 0; // visible meshes, summed over the frames
+        qint64 hits = 0; // of those, the ones that were resident already
+        int streamedIn = 0;
+        int evictions = 0;
+        int deferred = 0; // visible, but did not fit into the budget
+    };
+
+    // budget 0 disables residency management: everything is always resident
+    void create(const QVector<VkDeviceSize> &blasSizes, VkDeviceSize budget);
+    bool isEnabled() const { return m_enabled; }
+
+    void setBudget(VkDeviceSize budget) { m_budget = budget; }
+    VkDeviceSize budget() const { return m_budget; }
+    VkDeviceSize usedBytes() const { return m_usedBytes; }
+    int meshCount() const { return m_entries.count(); }
+    int residentCount() const { return m_residentCount; }
+    bool isResident(int mesh) const { return !isEnabled() || m_entries[mesh].resident; }
+
+    // visible may contain duplicates. The meshes in streamIn and evict are
+    // already marked (non-)resident when this returns.
+    void update(const QVector<int> &visible, QVector<int> *streamIn, QVector<int> *evict);
+
+    const Statistics &statistics() const { return m_stats; }
+    void resetStatistics() { m_stats = Statistics(); }
+
+private:
+    void evict(int mesh, QVector<int> *evicted);
+
+    struct Entry {
+        VkDeviceSize size = 0;
+        quint64 lastVisibleFrame = 0;
+        bool resident = false;
+    };
+
+    QVector<Entry> m_entries;
+    bool m_enabled = false;
+    VkDeviceSize m_budget = 0;
+    VkDeviceSize m_usedBytes = 0;
+    int m_residentCount = 0;
+    quint64 m_frame = 0;
+    QVector<int> m_candidates; // evictable meshes, most recently visible first
+    Statistics m_stats;
+};
+
+#endif
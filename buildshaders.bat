@@ -1,5 +1,17 @@
 qsb fsquad.vert -o fsquad.vert.qsb
 qsb fsquad.frag -o fsquad.frag.qsb
+qsb gbuffer.vert -o gbuffer.vert.qsb
+qsb gbuffer.frag -o gbuffer.frag.qsb
 glslangValidator -V -o raygen.spv raygen.rgen
 glslangValidator -V -o closesthit.spv closesthit.rchit
 glslangValidator -V -o miss.spv miss.rmiss
+glslangValidator -V -o miss_occlusion.spv miss_occlusion.rmiss
+glslangValidator -V -o closesthit_sphere.spv closesthit_sphere.rchit
+glslangValidator -V -o intersection_sphere.spv intersection_sphere.rint
+glslangValidator -V -o anyhit.spv anyhit.rahit
+glslangValidator -V -DINLINE_SHADING -o raygen_inline.spv raygen.rgen
+glslangValidator -V -DINLINE_SHADING -o closesthit_inline.spv closesthit.rchit
+glslangValidator -V -DINLINE_SHADING -o miss_inline.spv miss.rmiss
+glslangValidator -V -DHYBRID -o raygen_hybrid.spv raygen.rgen
+glslangValidator -V -o denoise.spv denoise.comp
+glslangValidator -V -o deform.spv deform.comp
@@ -0,0 +1,195 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "cpu_profiler.h"
+
+CpuProfiler::~CpuProfiler()
+{
+    stop();
+}
+
+bool CpuProfiler::start()
+{
+    if (m_enabled)
+        return true;
+
+    if (!m_traceFileName.isEmpty()) {
+        m_traceFile.setFileName(m_traceFileName);
+        if (!m_traceFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qWarning("Failed to open %s for writing the CPU trace", qPrintable(m_traceFileName));
+        } else {
+            m_traceFile.write("[\n");
+            m_firstTraceEvent = true;
+        }
+    }
+
+    m_head = 0;
+    m_tail = 0;
+    m_dropped = 0;
+    m_histograms.clear();
+    m_phaseOrder.clear();
+    m_clock.start();
+    m_running = true;
+    m_thread.reset(QThread::create([this] {
+        while (m_running.load(std::memory_order_acquire)) {
+            drain();
+            QThread::msleep(5);
+        }
+    }));
+    m_thread->start(QThread::LowPriority);
+    m_enabled = true;
+    return true;
+}
+
+void CpuProfiler::stop()
+{
+    if (!m_enabled)
+        return;
+
+    m_enabled = false;
+    m_running.store(false, std::memory_order_release);
+    m_thread->wait();
+    m_thread.reset();
+    // whatever came in after the thread's last round
+    drain();
+
+    if (m_traceFile.isOpen()) {
+        m_traceFile.write("\n]\n");
+        m_traceFile.close();
+        qDebug("CPU trace written to %s", qPrintable(m_traceFileName));
+    }
+    logHistograms();
+}
+
+void CpuProfiler::record(const char *name, qint64 beginNs, qint64 endNs)
+{
+    const quint32 head = m_head.load(std::memory_order_relaxed);
+    const quint32 tail = m_tail.load(std::memory_order_acquire);
+    if (head - tail >= RING_SIZE) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    m_ring[head & (RING_SIZE - 1)] = { name, beginNs, endNs, m_frame };
+    m_head.store(head + 1, std::memory_order_release);
+}
+
+void CpuProfiler::drain()
+{
+    quint32 tail = m_tail.load(std::memory_order_relaxed);
+    const quint32 head = m_head.load(std::memory_order_acquire);
+    for ( ; tail != head; ++tail) {
+        const Sample &s(m_ring[tail & (RING_SIZE - 1)]);
+        const qint64 ns = s.endNs - s.beginNs;
+        const QByteArray name = QByteArray::fromRawData(s.name, int(qstrlen(s.name)));
+        auto it = m_histograms.find(name);
+        if (it == m_histograms.end()) {
+            it = m_histograms.insert(name, Histogram());
+            it->minNs = ns;
+            m_phaseOrder.append(name);
+        }
+        Histogram &h(*it);
+        ++h.count;
+        h.totalNs += ns;
+        h.minNs = qMin(h.minNs, ns);
+        h.maxNs = qMax(h.maxNs, ns);
+        int bucket = 0;
+        for (qint64 us = ns / 2000; us && bucket < BUCKET_COUNT - 1; us >>= 1)
+            ++bucket;
+        ++h.buckets[bucket];
+
+        if (m_traceFile.isOpen())
+            writeTraceEvent(s);
+    }
+    m_tail.store(tail, std::memory_order_release);
+}
+
+void CpuProfiler::writeTraceEvent(const Sample &s)
+{
+    // complete events, timestamps and durations in microseconds
+    char buf[256];
+    const int len = qsnprintf(buf, sizeof(buf),
+                              "%s{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                              "\"pid\":1,\"tid\":1,\"args\":{\"frame\":%u}}",
+                              m_firstTraceEvent ? "" : ",\n", s.name,
+                              s.beginNs / 1000.0, (s.endNs - s.beginNs) / 1000.0, s.frame);
+    m_traceFile.write(buf, qMin(len, int(sizeof(buf)) - 1));
+    m_firstTraceEvent = false;
+}
+
+// the upper end of the bucket the p-th sample falls into
+double CpuProfiler::Histogram::percentileMs(double p) const
+{
+    const qint64 target = qint64(p * count);
+    qint64 seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        seen += buckets[i];
+        if (seen > target)
+            return (2 << i) / 1000.0;
+    }
+    return maxNs / 1000000.0;
+}
+
+void CpuProfiler::logHistograms() const
+{
+    for (const QByteArray &name : m_phaseOrder) {
+        const Histogram &h(m_histograms[name]);
+        QByteArray buckets;
+        for (int i = 0; i < BUCKET_COUNT; ++i) {
+            if (h.buckets[i])
+                buckets += QByteArray(" <") + QByteArray::number(2 << i) + "us:" + QByteArray::number(h.buckets[i]);
+        }
+        qDebug("cpu profile [%s]: %lld samples, avg %.3f ms, min %.3f ms, max %.3f ms, p50 < %.3f ms, p99 < %.3f ms,%s",
+               name.constData(), h.count, h.totalNs / 1000000.0 / h.count, h.minNs / 1000000.0, h.maxNs / 1000000.0,
+               h.percentileMs(0.5), h.percentileMs(0.99), buckets.constData());
+    }
+    const quint64 dropped = m_dropped.load(std::memory_order_relaxed);
+    if (dropped)
+        qDebug("cpu profile: %llu samples dropped due to the ring being full", dropped);
+}
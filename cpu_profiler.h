@@ -0,0 +1,151 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef CPU_PROFILER_H
+#define CPU_PROFILER_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QThread>
+#include <QVector>
+#include <atomic>
+#include <memory>
+
+// CPU-side timing of the phases of a frame (waiting in beginFrame, recording,
+// endFrame and present, ...). The render thread puts the samples into a
+// fixed size single producer, single consumer ring without taking any locks,
+// samples are dropped when the ring is full. A separate thread drains it
+// into per phase histograms, logged when stopping, and optionally into a
+// Chrome trace event file (chrome://tracing, ui.perfetto.dev). While not
+// started, a Scope costs a single branch.
+
+class CpuProfiler
+{
+public:
+    ~CpuProfiler();
+
+    // "" (the default) means no trace file
+    void setTraceFileName(const QString &fileName) { m_traceFileName = fileName; }
+
+    bool start();
+    void stop();
+    bool isEnabled() const { return m_enabled; }
+
+    qint64 now() const { return m_clock.nsecsElapsed(); }
+    // name must stay valid forever, i.e. should be a string literal
+    void record(const char *name, qint64 beginNs, qint64 endNs);
+    void nextFrame() { ++m_frame; }
+
+    class Scope
+    {
+    public:
+        Scope(CpuProfiler *profiler, const char *name)
+            : m_profiler(profiler->isEnabled() ? profiler : nullptr),
+              m_name(name)
+        {
+            if (m_profiler)
+                m_begin = m_profiler->now();
+        }
+        ~Scope()
+        {
+            if (m_profiler)
+                m_profiler->record(m_name, m_begin, m_profiler->now());
+        }
+
+    private:
+        Q_DISABLE_COPY(Scope)
+        CpuProfiler *m_profiler;
+        const char *m_name;
+        qint64 m_begin = 0;
+    };
+
+private:
+    struct Sample {
+        const char *name;
+        qint64 beginNs;
+        qint64 endNs;
+        quint32 frame;
+    };
+    // log2 buckets of microseconds: [0, 2), [2, 4), [4, 8), ...
+    static const int BUCKET_COUNT = 24;
+    struct Histogram {
+        qint64 count = 0;
+        qint64 totalNs = 0;
+        qint64 minNs = 0;
+        qint64 maxNs = 0;
+        qint64 buckets[BUCKET_COUNT] = {};
+        double percentileMs(double p) const;
+    };
+
+    void drain();
+    void writeTraceEvent(const Sample &s);
+    void logHistograms() const;
+
+    static const quint32 RING_SIZE = 4096; // power of two
+    Sample m_ring[RING_SIZE];
+    std::atomic<quint32> m_head { 0 }; // written by the render thread only
+    std::atomic<quint32> m_tail { 0 }; // written by the drain thread only
+    std::atomic<quint64> m_dropped { 0 };
+    std::atomic<bool> m_running { false };
+    bool m_enabled = false;
+    quint32 m_frame = 0;
+    QElapsedTimer m_clock;
+    std::unique_ptr<QThread> m_thread;
+
+    // only touched by the drain thread while running
+    QString m_traceFileName;
+    QFile m_traceFile;
+    bool m_firstTraceEvent = true;
+    QHash<QByteArray, Histogram> m_histograms;
+    QVector<QByteArray> m_phaseOrder;
+};
+
+#endif
@@ -0,0 +1,292 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "denoiser.h"
+
+static const float COLOR_PHI = 1.0f;
+static const float NORMAL_PHI = 64.0f;
+static const float DEPTH_PHI = 0.1f;
+
+struct DenoisePushConstants // as in denoise.comp
+{
+    qint32 stepWidth;
+    float colorPhi;
+    float normalPhi;
+    float depthPhi;
+};
+
+bool Denoiser::create(const VulkanDevice *vk, const QByteArray &spirv, int framesInFlight)
+{
+    m_vk = vk;
+    m_framesInFlight = framesInFlight;
+    if (spirv.isEmpty())
+        return true;
+
+    VkDescriptorSetLayoutBinding bindings[3] = {};
+    for (uint32_t i = 0; i < 3; ++i) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 3;
+    layoutInfo.pBindings = bindings;
+    VkResult err = vk->df->vkCreateDescriptorSetLayout(vk->dev, &layoutInfo, nullptr, &m_setLayout);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to create denoiser descriptor set layout: %d", err);
+        return false;
+    }
+
+    const VkPushConstantRange pushConstantRange = { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DenoisePushConstants) };
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &m_setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    err = vk->df->vkCreatePipelineLayout(vk->dev, &pipelineLayoutInfo, nullptr, &m_pipelineLayout);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to create denoiser pipeline layout: %d", err);
+        return false;
+    }
+
+    VkShaderModuleCreateInfo shaderInfo = {};
+    shaderInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderInfo.codeSize = size_t(spirv.size());
+    shaderInfo.pCode = reinterpret_cast<const quint32 *>(spirv.constData());
+    VkShaderModule shaderModule;
+    err = vk->df->vkCreateShaderModule(vk->dev, &shaderInfo, nullptr, &shaderModule);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to create denoiser shader module: %d", err);
+        return false;
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = m_pipelineLayout;
+    err = vk->df->vkCreateComputePipelines(vk->dev, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline);
+    vk->df->vkDestroyShaderModule(vk->dev, shaderModule, nullptr);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to create denoiser pipeline: %d", err);
+        m_pipeline = VK_NULL_HANDLE;
+        return false;
+    }
+
+    const uint32_t setCount = uint32_t(2 * framesInFlight);
+    const VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3 * setCount };
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = setCount;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    err = vk->df->vkCreateDescriptorPool(vk->dev, &poolInfo, nullptr, &m_descPool);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to create denoiser descriptor pool: %d", err);
+        return false;
+    }
+
+    QVector<VkDescriptorSetLayout> setLayouts(int(setCount), m_setLayout);
+    m_descSets.resize(int(setCount));
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = m_descPool;
+    allocInfo.descriptorSetCount = setCount;
+    allocInfo.pSetLayouts = setLayouts.constData();
+    err = vk->df->vkAllocateDescriptorSets(vk->dev, &allocInfo, m_descSets.data());
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to allocate denoiser descriptor sets: %d", err);
+        return false;
+    }
+
+    return true;
+}
+
+void Denoiser::releaseImage(const Image &image)
+{
+    m_vk->destroyImage(image.image, image.mem, image.view);
+}
+
+void Denoiser::destroy()
+{
+    if (!m_vk)
+        return;
+
+    releaseImage(m_temp);
+    releaseImage(m_guide);
+    for (const Image &image : m_retiredImages)
+        releaseImage(image);
+    m_temp = Image();
+    m_guide = Image();
+    m_retiredImages.clear();
+    m_size = QSize();
+    m_layerCount = 0;
+
+    m_vk->df->vkDestroyDescriptorPool(m_vk->dev, m_descPool, nullptr);
+    m_descPool = VK_NULL_HANDLE;
+    m_descSets.clear();
+    m_vk->df->vkDestroyPipeline(m_vk->dev, m_pipeline, nullptr);
+    m_pipeline = VK_NULL_HANDLE;
+    m_vk->df->vkDestroyPipelineLayout(m_vk->dev, m_pipelineLayout, nullptr);
+    m_pipelineLayout = VK_NULL_HANDLE;
+    m_vk->df->vkDestroyDescriptorSetLayout(m_vk->dev, m_setLayout, nullptr);
+    m_setLayout = VK_NULL_HANDLE;
+    m_vk = nullptr;
+}
+
+void Denoiser::prepare(const QSize &size, int layerCount)
+{
+    for (int i = m_retiredImages.count() - 1; i >= 0; --i) {
+        if (--m_retiredImages[i].framesUntilRelease == 0) {
+            releaseImage(m_retiredImages[i]);
+            m_retiredImages.remove(i);
+        }
+    }
+
+    const QSize imageSize = isEnabled() ? size : QSize(1, 1);
+    if (imageSize == m_size && layerCount == m_layerCount)
+        return;
+
+    for (Image *image : { &m_temp, &m_guide }) {
+        if (image->image) {
+            image->framesUntilRelease = m_framesInFlight;
+            m_retiredImages.append(*image);
+            *image = Image();
+        }
+    }
+    m_size = imageSize;
+    m_layerCount = layerCount;
+
+    const uint32_t w = uint32_t(imageSize.width());
+    const uint32_t h = uint32_t(imageSize.height());
+    VkResult err = m_vk->createImage(w, h, uint32_t(layerCount), VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT,
+                                     &m_guide.image, &m_guide.mem, &m_guide.view);
+    if (err != VK_SUCCESS)
+        qFatal("Failed to create denoiser guide image: %d", err);
+    m_guide.state.image = m_guide.image;
+    if (isEnabled()) {
+        err = m_vk->createImage(w, h, uint32_t(layerCount), VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_STORAGE_BIT,
+                                &m_temp.image, &m_temp.mem, &m_temp.view);
+        if (err != VK_SUCCESS)
+            qFatal("Failed to create denoiser image: %d", err);
+        m_temp.state.image = m_temp.image;
+    }
+}
+
+VkImageView Denoiser::traceTarget(VkImageView colorView) const
+{
+    return isEnabled() && (m_iterationCount % 2) ? m_temp.view : colorView;
+}
+
+void Denoiser::declareTrace(FrameGraph *graph, FrameGraph::Resource *color)
+{
+    const VkPipelineStageFlags stage = VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV;
+    graph->access(&m_guide.state, stage, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL);
+    FrameGraph::Resource *target = isEnabled() && (m_iterationCount % 2) ? &m_temp.state : color;
+    graph->access(target, stage, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL);
+}
+
+void Denoiser::record(VkCommandBuffer cb, FrameGraph *graph, int frameSlot,
+                      VkImageView colorView, FrameGraph::Resource *color)
+{
+    if (!isEnabled())
+        return;
+
+    VkDescriptorSet *sets = m_descSets.data() + frameSlot * 2;
+    VkDescriptorImageInfo imageInfos[3] = {};
+    imageInfos[0] = { VK_NULL_HANDLE, colorView, VK_IMAGE_LAYOUT_GENERAL };
+    imageInfos[1] = { VK_NULL_HANDLE, m_temp.view, VK_IMAGE_LAYOUT_GENERAL };
+    imageInfos[2] = { VK_NULL_HANDLE, m_guide.view, VK_IMAGE_LAYOUT_GENERAL };
+    VkWriteDescriptorSet writes[6] = {};
+    for (int i = 0; i < 6; ++i) {
+        const int set = i / 3;
+        const int binding = i % 3;
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = sets[set];
+        writes[i].dstBinding = uint32_t(binding);
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        // set 0 filters color into temp, set 1 temp into color
+        writes[i].pImageInfo = binding == 2 ? &imageInfos[2] : &imageInfos[binding ^ set];
+    }
+    m_vk->df->vkUpdateDescriptorSets(m_vk->dev, 6, writes, 0, nullptr);
+
+    const VkPipelineStageFlags stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    const VkAccessFlags readWrite = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    graph->access(color, stage, readWrite, VK_IMAGE_LAYOUT_GENERAL);
+    graph->access(&m_temp.state, stage, readWrite, VK_IMAGE_LAYOUT_GENERAL);
+    graph->access(&m_guide.state, stage, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL);
+    graph->flush(cb);
+
+    // between the iterations, not worth going through the graph
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    m_vk->df->vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    for (int i = 0; i < m_iterationCount; ++i) {
+        // the last iteration must write the color image
+        const int set = (i + m_iterationCount) % 2;
+        m_vk->df->vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &sets[set], 0, nullptr);
+        const DenoisePushConstants pc = { 1 << i, COLOR_PHI / float(1 << i), NORMAL_PHI, DEPTH_PHI };
+        m_vk->df->vkCmdPushConstants(cb, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pc), &pc);
+        m_vk->df->vkCmdDispatch(cb, uint32_t(m_size.width() + 7) / 8, uint32_t(m_size.height() + 7) / 8, uint32_t(m_layerCount));
+        if (i < m_iterationCount - 1) {
+            m_vk->df->vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                           0, 1, &barrier, 0, nullptr, 0, nullptr);
+        }
+    }
+}
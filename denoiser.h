@@ -0,0 +1,131 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include "vulkan_device.h"
+#include "frame_graph.h"
+#include <QByteArray>
+#include <QSize>
+#include <QVector>
+
+// Edge-avoiding a-trous wavelet filter (denoise.comp) for the traced image,
+// run as a number of compute dispatches between the trace and the
+// composition. Each iteration is a 5x5 kernel with the taps 2^i pixels
+// apart, weighted by how close the color, normal and hit distance of a tap
+// are to the center. The normals and hit distances come from the guide image
+// written by the raygen shader.
+//
+// The iterations ping-pong between the color image and a temporary one, so
+// with an odd iteration count the trace goes to the temporary image to have
+// the result end up in the color image without a copy.
+//
+// The guide image always exists since the raygen shader statically uses it.
+// While disabled (0 iterations, or no filter), it is 1x1 and the stores to it
+// are discarded as out of bounds.
+
+class Denoiser
+{
+public:
+    // with an empty spirv there is no filter, only the guide image
+    bool create(const VulkanDevice *vk, const QByteArray &spirv, int framesInFlight);
+    void destroy();
+    bool isValid() const { return m_pipeline != VK_NULL_HANDLE; }
+
+    void setIterationCount(int count) { m_iterationCount = count; }
+    int iterationCount() const { return m_iterationCount; }
+    bool isEnabled() const { return m_iterationCount > 0 && m_pipeline != VK_NULL_HANDLE; }
+
+    // Call every frame before using the image views. (Re)creates the images
+    // when size or layerCount changed, the old ones get released once the
+    // frames in flight are done with them.
+    void prepare(const QSize &size, int layerCount);
+
+    // to be used as the raygen shader's output (colorView is where the
+    // final result is wanted) and guide image
+    VkImageView traceTarget(VkImageView colorView) const;
+    VkImageView guideView() const { return m_guide.view; }
+
+    // Declares the trace's writes to the guide image and to the trace target
+    // (the temporary image or color).
+    void declareTrace(FrameGraph *graph, FrameGraph::Resource *color);
+
+    // Records the iterations. The color image (colorView, color) has the
+    // result, in GENERAL layout.
+    void record(VkCommandBuffer cb, FrameGraph *graph, int frameSlot,
+                VkImageView colorView, FrameGraph::Resource *color);
+
+private:
+    struct Image {
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory mem = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        FrameGraph::Resource state;
+        int framesUntilRelease = 0;
+    };
+    void releaseImage(const Image &image);
+
+    const VulkanDevice *m_vk = nullptr;
+    int m_framesInFlight = 0;
+    int m_iterationCount = 0;
+    VkDescriptorSetLayout m_setLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool m_descPool = VK_NULL_HANDLE;
+    QVector<VkDescriptorSet> m_descSets; // 2 per frame slot: color -> temp, temp -> color
+    QSize m_size;
+    int m_layerCount = 0;
+    Image m_temp;
+    Image m_guide;
+    QVector<Image> m_retiredImages;
+};
+
+#endif
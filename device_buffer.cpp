@@ -0,0 +1,246 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "device_buffer.h"
+#include "staging_ring.h"
+#include <QVarLengthArray>
+
+bool DeviceBuffer::create(const VulkanDevice *vk, Placement placement, VkDeviceSize size, VkBufferUsageFlags usage,
+                          int framesInFlight, VkDeviceSize updateGranularity, MemoryTracker::Category category)
+{
+    Q_ASSERT(framesInFlight <= MAX_FRAMES_IN_FLIGHT);
+
+    m_vk = vk;
+    m_placement = placement;
+    m_size = size;
+    m_granularity = updateGranularity;
+    m_framesInFlight = framesInFlight;
+    m_uploadedBytes = 0;
+
+    // the contents are kept when recreating with a different placement
+    const VkDeviceSize oldSize = VkDeviceSize(m_data.size());
+    m_data.resize(int(size));
+    if (size > oldSize)
+        memset(m_data.data() + oldSize, 0, size_t(size - oldSize));
+
+    const int bufferCount = placement == HostVisible ? framesInFlight : 1;
+    const VkMemoryPropertyFlags memFlags = placement == HostVisible
+            ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+            : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    if (placement == DeviceLocal)
+        usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+    for (int i = 0; i < bufferCount; ++i) {
+        VkResult err = vk->createBuffer(size, usage, memFlags, &m_buf[i], &m_mem[i], category);
+        if (err != VK_SUCCESS) {
+            qWarning("Failed to create buffer: %d", err);
+            return false;
+        }
+        if (placement == HostVisible) {
+            err = vk->df->vkMapMemory(vk->dev, m_mem[i], 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void **>(&m_p[i]));
+            if (err != VK_SUCCESS) {
+                qWarning("Failed to map buffer: %d", err);
+                return false;
+            }
+        }
+        m_dirty[i].clear();
+        m_dirty[i].append({ 0, size });
+    }
+
+    return true;
+}
+
+void DeviceBuffer::destroy()
+{
+    if (!m_vk)
+        return;
+
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        if (m_buf[i]) {
+            if (m_p[i])
+                m_vk->df->vkUnmapMemory(m_vk->dev, m_mem[i]);
+            m_vk->destroyBuffer(m_buf[i], m_mem[i]);
+        }
+        m_buf[i] = VK_NULL_HANDLE;
+        m_mem[i] = VK_NULL_HANDLE;
+        m_p[i] = nullptr;
+        m_dirty[i].clear();
+    }
+    m_directWriteBuf = VK_NULL_HANDLE;
+}
+
+void DeviceBuffer::update(VkDeviceSize offset, const void *data, VkDeviceSize size)
+{
+    Q_ASSERT(offset + size <= m_size);
+    const quint8 *src = static_cast<const quint8 *>(data);
+    quint8 *dst = reinterpret_cast<quint8 *>(m_data.data());
+
+    // walk in granularity-sized chunks and only record the ones that differ
+    VkDeviceSize pos = offset;
+    const VkDeviceSize end = offset + size;
+    while (pos < end) {
+        const VkDeviceSize chunkEnd = qMin(end, (pos / m_granularity + 1) * m_granularity);
+        const size_t n = size_t(chunkEnd - pos);
+        if (memcmp(dst + pos, src + (pos - offset), n)) {
+            memcpy(dst + pos, src + (pos - offset), n);
+            markDirty(pos, n);
+        }
+        pos = chunkEnd;
+    }
+}
+
+void DeviceBuffer::markDirty(VkDeviceSize offset, VkDeviceSize size)
+{
+    const int listCount = m_placement == HostVisible ? m_framesInFlight : 1;
+    for (int i = 0; i < listCount; ++i) {
+        QVector<Range> &dirty(m_dirty[i]);
+        // coalesce with the previous range when adjacent or overlapping
+        if (!dirty.isEmpty()) {
+            Range &last(dirty.last());
+            if (offset >= last.offset && offset <= last.offset + last.size) {
+                last.size = qMax(last.offset + last.size, offset + size) - last.offset;
+                continue;
+            }
+        }
+        dirty.append({ offset, size });
+    }
+}
+
+quint8 *DeviceBuffer::beginDirectWrite(int frameSlot, StagingRing *staging)
+{
+    if (m_placement == HostVisible) {
+        m_dirty[frameSlot].clear();
+        m_uploadedBytes += m_size;
+        return m_p[frameSlot];
+    }
+
+    m_dirty[0].clear();
+    return staging->allocate(m_size, &m_directWriteBuf, &m_directWriteOffset);
+}
+
+bool DeviceBuffer::hasPendingChanges(int frameSlot) const
+{
+    if (m_placement == DeviceLocal && m_directWriteBuf)
+        return true;
+    return !m_dirty[m_placement == HostVisible ? frameSlot : 0].isEmpty();
+}
+
+void DeviceBuffer::flush(VkCommandBuffer cb, int frameSlot, StagingRing *staging,
+                         VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+    const quint8 *src = reinterpret_cast<const quint8 *>(m_data.constData());
+
+    if (m_placement == HostVisible) {
+        // the previous user of this slot has completed so just write
+        for (const Range &r : m_dirty[frameSlot]) {
+            memcpy(m_p[frameSlot] + r.offset, src + r.offset, size_t(r.size));
+            m_uploadedBytes += r.size;
+        }
+        m_dirty[frameSlot].clear();
+        return;
+    }
+
+    QVector<Range> &dirty(m_dirty[0]);
+    if (dirty.isEmpty() && !m_directWriteBuf)
+        return;
+
+    // the previous frame may still be reading; only an execution dependency is needed for that
+    m_vk->df->vkCmdPipelineBarrier(cb, dstStage, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                                   0, nullptr, 0, nullptr, 0, nullptr);
+
+    QVarLengthArray<VkBufferCopy, 16> copies;
+    VkBuffer stagingBuf = VK_NULL_HANDLE;
+    if (m_directWriteBuf) {
+        // the whole buffer was written by the caller already
+        stagingBuf = m_directWriteBuf;
+        copies.append({ m_directWriteOffset, 0, m_size });
+        m_uploadedBytes += m_size;
+        m_directWriteBuf = VK_NULL_HANDLE;
+    }
+    int uploaded = 0;
+    for (; uploaded < dirty.count(); ++uploaded) {
+        const Range &r(dirty[uploaded]);
+        VkBuffer buf;
+        VkDeviceSize stagingOffset;
+        quint8 *p = staging->allocate(r.size, &buf, &stagingOffset);
+        if (!p) {
+            // finish what was started, the rest stays dirty for the next flush()
+            qWarning("Out of staging memory, deferring %d of %d dirty ranges",
+                     dirty.count() - uploaded, dirty.count());
+            break;
+        }
+        if (stagingBuf && buf != stagingBuf) {
+            // the ring grew in the middle, issue what we have so far
+            m_vk->df->vkCmdCopyBuffer(cb, stagingBuf, m_buf[0], uint32_t(copies.count()), copies.constData());
+            copies.clear();
+        }
+        stagingBuf = buf;
+        memcpy(p, src + r.offset, size_t(r.size));
+        copies.append({ stagingOffset, r.offset, r.size });
+        m_uploadedBytes += r.size;
+    }
+
+    if (!copies.isEmpty())
+        m_vk->df->vkCmdCopyBuffer(cb, stagingBuf, m_buf[0], uint32_t(copies.count()), copies.constData());
+
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = dstAccess;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = m_buf[0];
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    m_vk->df->vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0,
+                                   0, nullptr, 1, &barrier, 0, nullptr);
+
+    dirty.remove(0, uploaded);
+}
@@ -0,0 +1,134 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef DEVICE_BUFFER_H
+#define DEVICE_BUFFER_H
+
+#include "vulkan_device.h"
+#include <QByteArray>
+#include <QVector>
+
+class StagingRing;
+
+// A buffer read by the GPU (instance data, shader binding table, ...) with a
+// CPU-side copy of its contents. update() compares against that copy and
+// only the chunks that actually changed get uploaded in flush().
+//
+// With DeviceLocal placement there is a single buffer in device local memory
+// and flush() records copies from a StagingRing. With HostVisible placement
+// (meant for UMA devices, where staging is pointless) there is one
+// persistently mapped buffer per frame in flight, similarly to QRhi's Dynamic
+// buffers, and flush() just writes to the current one.
+
+class DeviceBuffer
+{
+public:
+    enum Placement {
+        HostVisible,
+        DeviceLocal
+    };
+
+    static const int MAX_FRAMES_IN_FLIGHT = 2;
+
+    bool create(const VulkanDevice *vk, Placement placement, VkDeviceSize size, VkBufferUsageFlags usage,
+                int framesInFlight, VkDeviceSize updateGranularity = 64,
+                MemoryTracker::Category category = MemoryTracker::Buffers);
+    void destroy();
+    bool isValid() const { return m_vk && m_buf[0]; }
+
+    Placement placement() const { return m_placement; }
+    VkDeviceSize size() const { return m_size; }
+
+    void update(VkDeviceSize offset, const void *data, VkDeviceSize size);
+
+    // Returns a pointer for writing all size() bytes of the buffer directly,
+    // for contents that get regenerated every frame anyway (e.g. animated
+    // instances), skipping the CPU-side copy and the diffing. With HostVisible
+    // this is the mapped buffer of frameSlot, with DeviceLocal it is staging
+    // memory that the next flush() copies from. The CPU-side copy is not
+    // updated, so do not mix this with update() on the same buffer.
+    quint8 *beginDirectWrite(int frameSlot, StagingRing *staging);
+
+    bool hasPendingChanges(int frameSlot) const;
+
+    // Makes the pending changes visible to subsequent reads in dstStage with
+    // dstAccess. cb must be a command buffer for the frame in frameSlot.
+    void flush(VkCommandBuffer cb, int frameSlot, StagingRing *staging,
+               VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+    VkBuffer buffer(int frameSlot) const { return m_placement == HostVisible ? m_buf[frameSlot] : m_buf[0]; }
+
+    // number of bytes written to the GPU-visible buffers so far
+    quint64 uploadedBytes() const { return m_uploadedBytes; }
+
+private:
+    struct Range {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+    };
+    void markDirty(VkDeviceSize offset, VkDeviceSize size);
+
+    const VulkanDevice *m_vk = nullptr;
+    Placement m_placement = DeviceLocal;
+    VkDeviceSize m_size = 0;
+    VkDeviceSize m_granularity = 64;
+    int m_framesInFlight = 0;
+    VkBuffer m_buf[MAX_FRAMES_IN_FLIGHT] = {};
+    VkDeviceMemory m_mem[MAX_FRAMES_IN_FLIGHT] = {};
+    quint8 *m_p[MAX_FRAMES_IN_FLIGHT] = {};
+    QByteArray m_data;
+    // per frame slot with HostVisible, only [0] is used with DeviceLocal
+    QVector<Range> m_dirty[MAX_FRAMES_IN_FLIGHT];
+    quint64 m_uploadedBytes = 0;
+    VkBuffer m_directWriteBuf = VK_NULL_HANDLE;
+    VkDeviceSize m_directWriteOffset = 0;
+};
+
+#endif
@@ -0,0 +1,266 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "frame_capture.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QImage>
+
+bool FrameCapture::create(const VulkanDevice *vk, const QString &directory, int framesInFlight,
+                          int frameLimit, int bufferCount)
+{
+    if (!QDir().mkpath(directory)) {
+        qWarning("Failed to create capture directory %s", qPrintable(directory));
+        return false;
+    }
+
+    m_vk = vk;
+    m_directory = directory;
+    m_framesInFlight = framesInFlight;
+    m_frameLimit = frameLimit;
+    m_frameNumber = 0;
+    // at least the frames in flight, plus one for the worker to be busy with
+    m_slots.resize(qMax(bufferCount, framesInFlight + 1));
+
+    // the CPU reads the whole image, uncached memory would make that slow
+    m_memFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    for (uint32_t i = 0; i < vk->memProps.memoryTypeCount; ++i) {
+        const VkMemoryPropertyFlags cachedFlags = m_memFlags | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        if ((vk->memProps.memoryTypes[i].propertyFlags & cachedFlags) == cachedFlags) {
+            m_memFlags = cachedFlags;
+            break;
+        }
+    }
+
+    // one thread keeps the frames in order
+    m_pool.setMaxThreadCount(1);
+
+    resetStatistics();
+    return true;
+}
+
+void FrameCapture::destroy()
+{
+    if (!m_vk)
+        return;
+
+    m_pool.waitForDone();
+
+    for (Slot &slot : m_slots) {
+        if (slot.buf) {
+            m_vk->df->vkUnmapMemory(m_vk->dev, slot.mem);
+            m_vk->destroyBuffer(slot.buf, slot.mem);
+        }
+    }
+    m_slots.clear();
+    m_encodedSlots.clear();
+    m_vk = nullptr;
+}
+
+bool FrameCapture::ensureBufferSize(int slotIndex, VkDeviceSize size)
+{
+    Slot &slot(m_slots[slotIndex]);
+    if (slot.size >= size)
+        return true;
+
+    // the slot is free, so neither the GPU nor the worker uses the old one
+    if (slot.buf) {
+        m_vk->df->vkUnmapMemory(m_vk->dev, slot.mem);
+        m_vk->destroyBuffer(slot.buf, slot.mem);
+        slot.buf = VK_NULL_HANDLE;
+        slot.mem = VK_NULL_HANDLE;
+        slot.p = nullptr;
+        slot.size = 0;
+    }
+
+    VkResult err = m_vk->createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, m_memFlags, &slot.buf, &slot.mem);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to create capture buffer: %d", err);
+        return false;
+    }
+
+    void *p = nullptr;
+    err = m_vk->df->vkMapMemory(m_vk->dev, slot.mem, 0, VK_WHOLE_SIZE, 0, &p);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to map capture buffer: %d", err);
+        m_vk->destroyBuffer(slot.buf, slot.mem);
+        slot.buf = VK_NULL_HANDLE;
+        slot.mem = VK_NULL_HANDLE;
+        return false;
+    }
+
+    slot.p = static_cast<const quint8 *>(p);
+    slot.size = size;
+    slot.readback = FrameGraph::Resource();
+    return true;
+}
+
+void FrameCapture::beginFrame()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QVector<int> encodedSlots;
+    {
+        QMutexLocker lock(&m_mutex);
+        encodedSlots.swap(m_encodedSlots);
+    }
+    for (int i : encodedSlots)
+        m_slots[i].state = Slot::Free;
+
+    for (int i = 0; i < m_slots.count(); ++i) {
+        Slot &slot(m_slots[i]);
+        if (slot.state == Slot::InFlight && --slot.framesUntilReady == 0) {
+            slot.state = Slot::Encoding;
+            const int frameNumber = slot.frameNumber;
+            m_pool.start([this, i, frameNumber] { encode(i, frameNumber); });
+        }
+    }
+
+    QMutexLocker lock(&m_mutex);
+    m_stats.renderThreadNs += timer.nsecsElapsed();
+}
+
+bool FrameCapture::record(VkCommandBuffer cb, FrameGraph *graph, FrameGraph::Resource *image, const QSize &size)
+{
+    if (!wantsFrame())
+        return false;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // dropped frames still use up a number, they show up as gaps in the file names
+    const int frameNumber = m_frameNumber++;
+    int slotIndex = -1;
+    for (int i = 0; i < m_slots.count(); ++i) {
+        if (m_slots[i].state == Slot::Free) {
+            slotIndex = i;
+            break;
+        }
+    }
+
+    const VkDeviceSize byteSize = VkDeviceSize(size.width()) * VkDeviceSize(size.height()) * 4;
+    if (slotIndex < 0 || !ensureBufferSize(slotIndex, byteSize)) {
+        QMutexLocker lock(&m_mutex);
+        ++m_stats.dropped;
+        m_stats.renderThreadNs += timer.nsecsElapsed();
+        return false;
+    }
+
+    Slot &slot(m_slots[slotIndex]);
+    slot.state = Slot::InFlight;
+    slot.imageSize = size;
+    slot.frameNumber = frameNumber;
+    slot.framesUntilReady = m_framesInFlight;
+
+    graph->access(image, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    graph->access(&slot.readback, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+    graph->flush(cb);
+
+    VkBufferImageCopy copy = {};
+    copy.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    copy.imageExtent = { uint32_t(size.width()), uint32_t(size.height()), 1 };
+    m_vk->df->vkCmdCopyImageToBuffer(cb, image->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buf, 1, &copy);
+
+    graph->access(&slot.readback, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+
+    QMutexLocker lock(&m_mutex);
+    m_stats.renderThreadNs += timer.nsecsElapsed();
+    return true;
+}
+
+// on the worker thread
+void FrameCapture::encode(int slotIndex, int frameNumber)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // the render thread does not touch the slot until it is handed back
+    const Slot &slot(m_slots.at(slotIndex));
+    const QImage image(slot.p, slot.imageSize.width(), slot.imageSize.height(),
+                       slot.imageSize.width() * 4, QImage::Format_RGBA8888);
+    // whatever ends up in alpha is not what is on screen
+    const QString fileName = m_directory + QString::asprintf("/frame_%06d.png", frameNumber);
+    const bool ok = image.convertToFormat(QImage::Format_RGB888).save(fileName);
+    if (!ok)
+        qWarning("Failed to write %s", qPrintable(fileName));
+
+    QMutexLocker lock(&m_mutex);
+    m_encodedSlots.append(slotIndex);
+    if (ok) {
+        ++m_stats.written;
+        m_stats.encodeNs += timer.nsecsElapsed();
+    } else {
+        ++m_stats.failed;
+    }
+}
+
+bool FrameCapture::isFinished() const
+{
+    if (wantsFrame())
+        return false;
+    for (const Slot &slot : m_slots) {
+        if (slot.state != Slot::Free)
+            return false;
+    }
+    return true;
+}
+
+FrameCapture::Statistics FrameCapture::statistics() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_stats;
+}
+
+void FrameCapture::resetStatistics()
+{
+    QMutexLocker lock(&m_mutex);
+    m_stats = Statistics();
+}
@@ -0,0 +1,140 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include "vulkan_device.h"
+#include "frame_graph.h"
+#include <QMutex>
+#include <QSize>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+
+// Writes the rendered frames to disk without stalling the render loop. The
+// copy of the image into one of a ring of persistently mapped, host visible
+// buffers is recorded on the frame's command buffer. The buffer is only
+// looked at when the frame slot comes around again (by then QRhi has waited
+// for its fence), and the PNG encoding happens on a worker thread. When the
+// worker falls behind and no buffer is free, the frame is dropped instead of
+// waiting for one.
+
+class FrameCapture
+{
+public:
+    struct Statistics {
+        int written = 0;
+        int dropped = 0; // no free buffer when recording
+        int failed = 0; // could not be written
+        qint64 renderThreadNs = 0; // beginFrame() and record()
+        qint64 encodeNs = 0; // on the worker thread, for the written frames
+    };
+
+    // frameLimit 0 captures until destroyed
+    bool create(const VulkanDevice *vk, const QString &directory, int framesInFlight,
+                int frameLimit = 0, int bufferCount = 4);
+    // waits for the frames being encoded, the ones still in flight are lost
+    void destroy();
+    bool isValid() const { return m_vk != nullptr; }
+
+    // to be called at the start of every frame
+    void beginFrame();
+
+    // Records the copy of image. The host read of the copy is only declared,
+    // it gets synchronized with the graph's next flush. Returns false when
+    // the frame got dropped or the limit has been reached.
+    bool record(VkCommandBuffer cb, FrameGraph *graph, FrameGraph::Resource *image, const QSize &size);
+
+    bool wantsFrame() const { return !m_frameLimit || m_frameNumber < m_frameLimit; }
+    // the limit has been reached and everything got written (or dropped)
+    bool isFinished() const;
+    int frameNumber() const { return m_frameNumber; }
+
+    Statistics statistics() const;
+    void resetStatistics();
+
+private:
+    bool ensureBufferSize(int slot, VkDeviceSize size);
+    void encode(int slot, int frameNumber);
+
+    struct Slot {
+        enum State {
+            Free,
+            InFlight, // the copy is recorded, the frame has not completed yet
+            Encoding // owned by the worker thread
+        };
+        State state = Free;
+        VkBuffer buf = VK_NULL_HANDLE;
+        VkDeviceMemory mem = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        const quint8 *p = nullptr;
+        FrameGraph::Resource readback;
+        QSize imageSize;
+        int frameNumber = 0;
+        int framesUntilReady = 0;
+    };
+
+    const VulkanDevice *m_vk = nullptr;
+    QString m_directory;
+    int m_framesInFlight = 0;
+    int m_frameLimit = 0;
+    int m_frameNumber = 0;
+    VkMemoryPropertyFlags m_memFlags = 0;
+    QVector<Slot> m_slots;
+    QThreadPool m_pool;
+
+    // shared with the worker thread
+    mutable QMutex m_mutex;
+    QVector<int> m_encodedSlots;
+    Statistics m_stats;
+};
+
+#endif
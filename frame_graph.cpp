@@ -0,0 +1,204 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "frame_graph.h"
+
+static const VkAccessFlags WRITE_ACCESS = VK_ACCESS_SHADER_WRITE_BIT
+        | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+        | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+        | VK_ACCESS_TRANSFER_WRITE_BIT
+        | VK_ACCESS_HOST_WRITE_BIT
+        | VK_ACCESS_MEMORY_WRITE_BIT
+        | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV;
+
+void FrameGraph::externalAccess(Resource *r, VkPipelineStageFlags stages, VkAccessFlags access)
+{
+    // treated as a write, whatever it was, so that the next use waits for it
+    r->writeStages = stages;
+    r->writeAccess = access & WRITE_ACCESS;
+    r->readStages = 0;
+    r->visibleStages = 0;
+    r->visibleAccess = 0;
+}
+
+void FrameGraph::importTexture(Resource *r, QRhiTexture *texture, VkPipelineStageFlags stages, VkAccessFlags access)
+{
+    const VkImage image = VkImage(texture->nativeTexture().object);
+    if (r->image != image || r->texture != texture) {
+        // a new texture, or the old one got recreated (resized)
+        *r = Resource();
+        r->image = image;
+        r->texture = texture;
+    }
+    r->layout = VkImageLayout(texture->nativeTexture().layout);
+    externalAccess(r, stages, access);
+}
+
+void FrameGraph::access(Resource *r, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout layout)
+{
+    if (r->image && layout == VK_IMAGE_LAYOUT_UNDEFINED)
+        qWarning("FrameGraph: no layout given for image %p", static_cast<void *>(r->image));
+
+    if (r->pendingIndex >= 0) {
+        PendingAccess &p(m_pending[r->pendingIndex]);
+        if (r->image && p.layout != layout)
+            qWarning("FrameGraph: image %p is used in two different layouts in one pass", static_cast<void *>(r->image));
+        p.stages |= stages;
+        p.access |= access;
+        return;
+    }
+
+    r->pendingIndex = m_pending.count();
+    m_pending.append({ r, stages, access, layout });
+}
+
+void FrameGraph::flush(VkCommandBuffer cb)
+{
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    QVarLengthArray<VkImageMemoryBarrier, 16> imageBarriers;
+
+    for (const PendingAccess &p : m_pending) {
+        Resource *r = p.resource;
+        r->pendingIndex = -1;
+
+        const bool write = (p.access & WRITE_ACCESS) != 0;
+        // a layout transition is a write as well
+        const bool transition = r->image && p.layout != r->layout;
+        VkPipelineStageFlags src = 0;
+        VkAccessFlags srcAccess = 0;
+        if (write || transition) {
+            // wait for the last write and the reads since; the host's
+            // reads are ordered by the fences already
+            src = r->writeStages | (r->readStages & ~VK_PIPELINE_STAGE_HOST_BIT);
+            srcAccess = r->writeAccess;
+        } else if (r->writeStages && ((p.stages & ~r->visibleStages) || (p.access & ~r->visibleAccess))) {
+            src = r->writeStages;
+            srcAccess = r->writeAccess;
+        }
+
+        if (src || transition) {
+            ++m_stats.dependencies;
+            if (!src)
+                src = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            VkImageMemoryBarrier imageBarrier = {};
+            VkMemoryBarrier resourceBarrier = {};
+            if (r->image) {
+                imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                imageBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+                imageBarrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+                imageBarrier.image = r->image;
+                imageBarrier.oldLayout = r->layout;
+                imageBarrier.newLayout = p.layout;
+                imageBarrier.srcAccessMask = srcAccess;
+                imageBarrier.dstAccessMask = p.access;
+                imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            } else {
+                resourceBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                resourceBarrier.srcAccessMask = srcAccess;
+                resourceBarrier.dstAccessMask = p.access;
+            }
+            if (m_batching) {
+                srcStages |= src;
+                dstStages |= p.stages;
+                if (r->image) {
+                    imageBarriers.append(imageBarrier);
+                } else {
+                    memoryBarrier.srcAccessMask |= resourceBarrier.srcAccessMask;
+                    memoryBarrier.dstAccessMask |= resourceBarrier.dstAccessMask;
+                }
+            } else {
+                record(cb, src, p.stages, r->image ? nullptr : &resourceBarrier, &imageBarrier, r->image ? 1 : 0);
+            }
+        }
+
+        if (write || transition) {
+            r->writeStages = p.stages;
+            r->writeAccess = p.access & WRITE_ACCESS;
+            // the transition itself is visible to the access it was made for
+            r->readStages = write ? 0 : p.stages;
+            r->visibleStages = write ? 0 : p.stages;
+            r->visibleAccess = write ? 0 : p.access;
+        } else {
+            r->readStages |= p.stages;
+            r->visibleStages |= p.stages;
+            r->visibleAccess |= p.access;
+        }
+        if (transition) {
+            r->layout = p.layout;
+            if (r->texture)
+                r->texture->setNativeLayout(p.layout);
+        }
+    }
+    m_pending.clear();
+
+    if (dstStages) {
+        const bool hasMemoryBarrier = memoryBarrier.srcAccessMask || memoryBarrier.dstAccessMask;
+        record(cb, srcStages, dstStages, hasMemoryBarrier ? &memoryBarrier : nullptr,
+               imageBarriers.constData(), imageBarriers.count());
+    }
+}
+
+void FrameGraph::record(VkCommandBuffer cb, VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages,
+                        const VkMemoryBarrier *memoryBarrier, const VkImageMemoryBarrier *imageBarriers, int imageBarrierCount)
+{
+    m_vk->df->vkCmdPipelineBarrier(cb, srcStages, dstStages, 0,
+                                   memoryBarrier ? 1 : 0, memoryBarrier,
+                                   0, nullptr,
+                                   uint32_t(imageBarrierCount), imageBarrierCount ? imageBarriers : nullptr);
+    ++m_stats.barrierCalls;
+    m_stats.imageBarriers += imageBarrierCount;
+    if (memoryBarrier)
+        ++m_stats.memoryBarriers;
+}
@@ -0,0 +1,142 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef FRAME_GRAPH_H
+#define FRAME_GRAPH_H
+
+#include "vulkan_device.h"
+#include <QtGui/private/qrhivulkan_p.h>
+#include <QVarLengthArray>
+
+// Barrier and layout tracking for the natively recorded passes (acceleration
+// structure builds, trace, denoise, the hand-over to QRhi's composition).
+// Each pass declares how it is about to access its resources with access(),
+// then flush() records whatever is needed to satisfy all the declarations
+// of the pass as a single vkCmdPipelineBarrier: the source scopes come from
+// what the resources were last used for, images are transitioned from the
+// layout they are actually in, and reads that an earlier barrier already
+// made the last write visible to need nothing.
+//
+// Buffers and acceleration structures are synchronized with one global
+// memory barrier per flush, images with image barriers (whole image, color
+// aspect). Synchronization within a pass (between the dispatches of the
+// denoiser, or the waves of BlasBuilder) stays with the pass.
+//
+// QRhi tracks the layout of its own textures. importTexture() takes that
+// over before a pass uses such a texture, and every layout the graph
+// transitions the texture to is reported back with setNativeLayout().
+
+class FrameGraph
+{
+public:
+    // The synchronization state of a buffer, acceleration structure or
+    // (when image is set) image. A default constructed one is something
+    // nothing has accessed yet.
+    struct Resource {
+        VkImage image = VK_NULL_HANDLE;
+        QRhiTexture *texture = nullptr; // when owned by QRhi, see importTexture()
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags writeStages = 0; // of the last write
+        VkAccessFlags writeAccess = 0;
+        VkPipelineStageFlags readStages = 0; // since the last write
+        VkPipelineStageFlags visibleStages = 0; // the last write is visible to these
+        VkAccessFlags visibleAccess = 0;
+        int pendingIndex = -1;
+    };
+
+    struct Statistics {
+        int frames = 0;
+        int dependencies = 0; // accesses that had to wait for or be made visible after an earlier one
+        int barrierCalls = 0;
+        int imageBarriers = 0;
+        int memoryBarriers = 0;
+    };
+
+    void create(const VulkanDevice *vk) { m_vk = vk; }
+
+    // Without batching every dependency gets its own vkCmdPipelineBarrier,
+    // which is what writing them by hand pass by pass tends to end up with.
+    void setBatching(bool enabled) { m_batching = enabled; }
+
+    // The resource was last accessed outside the graph (by QRhi, by another
+    // queue, or by the host); the next use waits for that and makes it visible.
+    void externalAccess(Resource *r, VkPipelineStageFlags stages, VkAccessFlags access);
+    // Same, for a QRhi texture that QRhi last used in stages with access,
+    // with the layout taken from QRhi. Call before every pass using it.
+    void importTexture(Resource *r, QRhiTexture *texture, VkPipelineStageFlags stages, VkAccessFlags access);
+
+    // Declares an access by the next pass. layout is required for images.
+    // Declaring the same resource again before the flush merges the two.
+    void access(Resource *r, VkPipelineStageFlags stages, VkAccessFlags access,
+                VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED);
+    void flush(VkCommandBuffer cb);
+
+    // to be called once per frame, only for the statistics
+    void endFrame() { ++m_stats.frames; }
+    const Statistics &statistics() const { return m_stats; }
+    void resetStatistics() { m_stats = Statistics(); }
+
+private:
+    struct PendingAccess {
+        Resource *resource;
+        VkPipelineStageFlags stages;
+        VkAccessFlags access;
+        VkImageLayout layout;
+    };
+    void record(VkCommandBuffer cb, VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages,
+                const VkMemoryBarrier *memoryBarrier, const VkImageMemoryBarrier *imageBarriers, int imageBarrierCount);
+
+    const VulkanDevice *m_vk = nullptr;
+    bool m_batching = true;
+    QVarLengthArray<PendingAccess, 16> m_pending;
+    Statistics m_stats;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#version 440
+
+layout(location = 0) in vec3 v_worldPos;
+layout(location = 1) in vec3 v_normal;
+layout(location = 2) in vec2 v_uv;
+layout(location = 3) flat in int v_instance;
+
+// the same as the Surface in raygen.rgen
+layout(location = 0) out vec4 albedo;
+layout(location = 1) out vec4 normalDistance;
+
+layout(std140, binding = 0) uniform buf {
+    mat4 viewProjection;
+    vec4 eye;
+};
+
+struct Instance
+{
+    mat4 world;
+    mat4 normalMatrix;
+    vec4 baseColor;
+    vec4 uvScale;
+};
+
+layout(std430, binding = 1) readonly buffer Instances { Instance instances[]; };
+
+layout(binding = 2) uniform sampler2D materialTexture;
+
+void main()
+{
+    const Instance instance = instances[v_instance];
+    // textureLod, as in shading.glsl
+    const vec3 texColor = textureLod(materialTexture, v_uv * instance.uvScale.x, 0.0).rgb;
+    albedo = vec4(instance.baseColor.rgb * texColor, 1.0);
+    // the distance is the hit distance of the primary ray, 0 (the clear
+    // value) means a miss
+    normalDistance = vec4(normalize(v_normal), length(v_worldPos - eye.xyz));
+}
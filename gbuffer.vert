@@ -0,0 +1,43 @@
+#version 440
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 uv;
+
+layout(location = 0) out vec3 v_worldPos;
+layout(location = 1) out vec3 v_normal;
+layout(location = 2) out vec2 v_uv;
+layout(location = 3) flat out int v_instance;
+
+layout(std140, binding = 0) uniform buf {
+    mat4 viewProjection;
+    vec4 eye;
+};
+
+// Laid out as GBufferPass::Instance. world is the same transform as in the
+// TLAS (Y down, position dequantization included).
+struct Instance
+{
+    mat4 world;
+    mat4 normalMatrix;
+    vec4 baseColor;
+    vec4 uvScale;
+};
+
+layout(std430, binding = 1) readonly buffer Instances { Instance instances[]; };
+
+out gl_PerVertex { vec4 gl_Position; };
+
+void main()
+{
+    // one draw per instance, with firstInstance selecting it
+    const Instance instance = instances[gl_InstanceIndex];
+    const vec4 worldPos = instance.world * vec4(position, 1.0);
+    v_worldPos = worldPos.xyz;
+    v_normal = mat3(instance.normalMatrix) * normal;
+    v_uv = uv;
+    v_instance = gl_InstanceIndex;
+    // Not corrected with clipSpaceCorrMatrix(): the same matrices as for
+    // the rays, so that pixels map to the same rays as in raygen.rgen.
+    gl_Position = viewProjection * worldPos;
+}
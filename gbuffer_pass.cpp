@@ -0,0 +1,276 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "gbuffer_pass.h"
+
+static const QRhiTexture::Format attachmentFormats[] = { QRhiTexture::RGBA16F, QRhiTexture::RGBA32F };
+static const VkFormat attachmentVkFormats[] = { VK_FORMAT_R16G16B16A16_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+
+void GBufferPass::create(QRhi *rhi, const VulkanDevice *vk, int framesInFlight,
+                         const QShader &vs, const QShader &fs, int instanceCount,
+                         const std::vector<std::unique_ptr<QRhiTexture>> &materialTextures,
+                         VkDeviceSize positionStride)
+{
+    m_rhi = rhi;
+    m_vk = vk;
+    m_framesInFlight = framesInFlight;
+    m_size = QSize(1, 1);
+
+    for (int i = 0; i < AttachmentCount; ++i) {
+        m_textures[i].reset(rhi->newTexture(attachmentFormats[i], m_size, 1,
+                                            QRhiTexture::RenderTarget | QRhiTexture::UsedWithLoadStore));
+        m_textures[i]->create();
+    }
+    createViews();
+
+    if (!instanceCount)
+        return;
+
+    m_depth.reset(rhi->newRenderBuffer(QRhiRenderBuffer::DepthStencil, m_size));
+    m_depth->create();
+    QRhiTextureRenderTargetDescription rtDesc;
+    rtDesc.setColorAttachments({ QRhiColorAttachment(m_textures[Albedo].get()),
+                                 QRhiColorAttachment(m_textures[NormalDistance].get()) });
+    rtDesc.setDepthStencilBuffer(m_depth.get());
+    m_rt.reset(rhi->newTextureRenderTarget(rtDesc));
+    m_rp.reset(m_rt->newCompatibleRenderPassDescriptor());
+    m_rt->setRenderPassDescriptor(m_rp.get());
+    m_rt->create();
+
+    m_ubuf.reset(rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, 64 + 16));
+    m_ubuf->create();
+    m_instanceBuf.reset(rhi->newBuffer(QRhiBuffer::Static, QRhiBuffer::StorageBuffer, instanceCount * int(sizeof(Instance))));
+    m_instanceBuf->create();
+
+    // same as the ray tracing's m_materialSampler
+    m_sampler.reset(rhi->newSampler(QRhiSampler::Linear, QRhiSampler::Linear, QRhiSampler::None,
+                                    QRhiSampler::Repeat, QRhiSampler::Repeat));
+    m_sampler->create();
+
+    m_srbs.resize(materialTextures.size());
+    for (size_t i = 0; i < materialTextures.size(); ++i) {
+        m_srbs[i].reset(rhi->newShaderResourceBindings());
+        m_srbs[i]->setBindings({
+            QRhiShaderResourceBinding::uniformBuffer(0, QRhiShaderResourceBinding::VertexStage | QRhiShaderResourceBinding::FragmentStage,
+                                                     m_ubuf.get()),
+            QRhiShaderResourceBinding::bufferLoad(1, QRhiShaderResourceBinding::VertexStage | QRhiShaderResourceBinding::FragmentStage,
+                                                  m_instanceBuf.get()),
+            QRhiShaderResourceBinding::sampledTexture(2, QRhiShaderResourceBinding::FragmentStage,
+                                                      materialTextures[i].get(), m_sampler.get())
+        });
+        m_srbs[i]->create();
+    }
+
+    m_ps.reset(rhi->newGraphicsPipeline());
+    m_ps->setShaderStages({
+        { QRhiShaderStage::Vertex, vs },
+        { QRhiShaderStage::Fragment, fs }
+    });
+    QRhiVertexInputLayout inputLayout;
+    inputLayout.setBindings({
+        { quint32(positionStride) },
+        { 5 * sizeof(float) }
+    });
+    inputLayout.setAttributes({
+        { 0, 0, QRhiVertexInputAttribute::Float3, 0 },
+        { 1, 1, QRhiVertexInputAttribute::Float3, 0 },
+        { 1, 2, QRhiVertexInputAttribute::Float2, 3 * sizeof(float) }
+    });
+    m_ps->setVertexInputLayout(inputLayout);
+    m_ps->setTargetBlends({ QRhiGraphicsPipeline::TargetBlend(), QRhiGraphicsPipeline::TargetBlend() });
+    m_ps->setDepthTest(true);
+    m_ps->setDepthWrite(true);
+    // The rays cull back faces, but which winding that is here depends on
+    // the Y flip in the instance transform. With closed meshes the depth
+    // test gives the same result, only open geometry seen from behind
+    // differs.
+    m_ps->setCullMode(QRhiGraphicsPipeline::None);
+    m_ps->setShaderResourceBindings(m_srbs[0].get());
+    m_ps->setRenderPassDescriptor(m_rp.get());
+    m_ps->create();
+}
+
+void GBufferPass::destroy()
+{
+    if (!m_vk)
+        return;
+
+    for (VkImageView &v : m_views) {
+        m_vk->df->vkDestroyImageView(m_vk->dev, v, nullptr);
+        v = VK_NULL_HANDLE;
+    }
+    for (const RetiredView &retired : m_retiredViews)
+        m_vk->df->vkDestroyImageView(m_vk->dev, retired.view, nullptr);
+    m_retiredViews.clear();
+
+    m_ps.reset();
+    m_srbs.clear();
+    m_sampler.reset();
+    m_instanceBuf.reset();
+    m_ubuf.reset();
+    m_rt.reset();
+    m_rp.reset();
+    m_depth.reset();
+    for (std::unique_ptr<QRhiTexture> &t : m_textures)
+        t.reset();
+    m_vk = nullptr;
+}
+
+void GBufferPass::createViews()
+{
+    for (int i = 0; i < AttachmentCount; ++i) {
+        if (m_views[i])
+            m_retiredViews.append({ m_views[i], m_framesInFlight });
+        VkImageViewCreateInfo viewInfo = {};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = VkImage(m_textures[i]->nativeTexture().object);
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = attachmentVkFormats[i];
+        viewInfo.components.r = VK_COMPONENT_SWIZZLE_R;
+        viewInfo.components.g = VK_COMPONENT_SWIZZLE_G;
+        viewInfo.components.b = VK_COMPONENT_SWIZZLE_B;
+        viewInfo.components.a = VK_COMPONENT_SWIZZLE_A;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.layerCount = 1;
+        m_vk->df->vkCreateImageView(m_vk->dev, &viewInfo, nullptr, &m_views[i]);
+    }
+}
+
+void GBufferPass::prepare(const QSize &size)
+{
+    for (int i = m_retiredViews.count() - 1; i >= 0; --i) {
+        if (--m_retiredViews[i].framesUntilRelease == 0) {
+            m_vk->df->vkDestroyImageView(m_vk->dev, m_retiredViews[i].view, nullptr);
+            m_retiredViews.remove(i);
+        }
+    }
+
+    // without a pipeline the images stay 1x1, nothing reads them
+    if (!m_ps || size == m_size)
+        return;
+
+    m_size = size;
+    for (std::unique_ptr<QRhiTexture> &t : m_textures) {
+        t->setPixelSize(size);
+        t->create();
+    }
+    m_depth->setPixelSize(size);
+    m_depth->create();
+    m_rt->create();
+    createViews();
+}
+
+quint64 GBufferPass::textureBytes() const
+{
+    if (!m_textures[Albedo])
+        return 0;
+    // RGBA16F, RGBA32F, and D24S8 or D32S8 for the depth
+    const quint64 pixelBytes = 8 + 16 + (m_depth ? 4 : 0);
+    return quint64(m_size.width()) * quint64(m_size.height()) * pixelBytes;
+}
+
+// the device local ones, the uniform buffer is next to nothing
+quint64 GBufferPass::bufferBytes() const
+{
+    return m_instanceBuf ? quint64(m_instanceBuf->size()) : 0;
+}
+
+void GBufferPass::updateCamera(QRhiResourceUpdateBatch *u, const QMatrix4x4 &viewProjection, const QVector3D &eye)
+{
+    if (!m_ubuf)
+        return;
+    const float eye4[4] = { eye.x(), eye.y(), eye.z(), 1.0f };
+    u->updateDynamicBuffer(m_ubuf.get(), 0, 64, viewProjection.constData());
+    u->updateDynamicBuffer(m_ubuf.get(), 64, 16, eye4);
+}
+
+void GBufferPass::updateInstances(QRhiResourceUpdateBatch *u, const QVector<Instance> &instances)
+{
+    if (!m_instanceBuf)
+        return;
+    u->uploadStaticBuffer(m_instanceBuf.get(), 0, instances.count() * int(sizeof(Instance)), instances.constData());
+}
+
+void GBufferPass::record(QRhiCommandBuffer *cb, const QVector<Draw> &draws, QRhiResourceUpdateBatch *u)
+{
+    // the distance of 0 marks a miss
+    cb->beginPass(m_rt.get(), Qt::transparent, { 1.0f, 0 }, u);
+    cb->setGraphicsPipeline(m_ps.get());
+    cb->setViewport({ 0, 0, float(m_size.width()), float(m_size.height()) });
+    for (int i = 0; i < draws.count(); ++i) {
+        const Draw &draw(draws[i]);
+        cb->setShaderResources(m_srbs[size_t(draw.texture)].get());
+        const QRhiCommandBuffer::VertexInput vertexInputs[] = { { draw.vbuf, 0 }, { draw.attrBuf, 0 } };
+        cb->setVertexInput(0, 2, vertexInputs, draw.ibuf, 0, QRhiCommandBuffer::IndexUInt32);
+        cb->drawIndexed(draw.indexCount, 1, 0, 0, quint32(i));
+    }
+    cb->endPass();
+}
+
+void GBufferPass::declareTrace(FrameGraph *graph)
+{
+    for (int i = 0; i < AttachmentCount; ++i) {
+        // whatever QRhi left it in (undefined when never rendered to)
+        graph->importTexture(&m_states[i], m_textures[i].get(),
+                             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+        graph->access(&m_states[i], VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_ACCESS_SHADER_READ_BIT,
+                      VK_IMAGE_LAYOUT_GENERAL);
+    }
+}
+
+void GBufferPass::declareRasterization(FrameGraph *graph)
+{
+    // the next frame's pass must not overwrite what the trace still reads
+    for (int i = 0; i < AttachmentCount; ++i) {
+        graph->access(&m_states[i], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+    }
+}
@@ -0,0 +1,154 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef GBUFFER_PASS_H
+#define GBUFFER_PASS_H
+
+#include "vulkan_device.h"
+#include "frame_graph.h"
+#include <QtGui/private/qrhivulkan_p.h>
+#include <QtGui/private/qshader_p.h>
+#include <QMatrix4x4>
+#include <QVector>
+#include <memory>
+#include <vector>
+
+// Rasterizes the primary visibility of the scene with QRhi into a G-buffer
+// (gbuffer.vert, gbuffer.frag) for the hybrid mode, where the raygen shader
+// then only traces the secondary rays. Two color attachments: albedo, and
+// world space normal with the distance from the eye (the hit distance of the
+// corresponding primary ray, 0 for a miss). There is one draw per instance
+// with firstInstance selecting its Instance record.
+//
+// The images also exist (as 1x1) when not rasterizing anything, since the
+// ray tracing pipeline has the hybrid raygen shader using them.
+
+class GBufferPass
+{
+public:
+    // laid out as Instance in gbuffer.vert
+    struct Instance {
+        float world[16];
+        float normalMatrix[16];
+        float baseColor[4];
+        float uvScale[4];
+    };
+    struct Draw {
+        QRhiBuffer *vbuf; // float positions
+        QRhiBuffer *attrBuf; // normal xyz, uv
+        QRhiBuffer *ibuf;
+        quint32 indexCount;
+        int texture;
+    };
+
+    // Without a pipeline (instanceCount 0), only the images get created.
+    void create(QRhi *rhi, const VulkanDevice *vk, int framesInFlight,
+                const QShader &vs, const QShader &fs, int instanceCount,
+                const std::vector<std::unique_ptr<QRhiTexture>> &materialTextures,
+                VkDeviceSize positionStride);
+    void destroy();
+    bool hasPipeline() const { return m_ps != nullptr; }
+
+    // Call every frame before using the image views. Resizes the images,
+    // the old views get released once the frames in flight are done with
+    // them.
+    void prepare(const QSize &size);
+    QSize size() const { return m_size; }
+
+    void updateCamera(QRhiResourceUpdateBatch *u, const QMatrix4x4 &viewProjection, const QVector3D &eye);
+    void updateInstances(QRhiResourceUpdateBatch *u, const QVector<Instance> &instances);
+
+    // Records the render pass, draws[i] is instance i. u (if any) is
+    // committed at the start of the pass.
+    void record(QRhiCommandBuffer *cb, const QVector<Draw> &draws, QRhiResourceUpdateBatch *u = nullptr);
+
+    // what QRhi allocated for this pass, for MemoryTracker
+    quint64 textureBytes() const;
+    quint64 bufferBytes() const;
+
+    VkImageView albedoView() const { return m_views[Albedo]; }
+    VkImageView normalDistanceView() const { return m_views[NormalDistance]; }
+
+    // Declares the reads of the raygen shader (in GENERAL layout), and after
+    // the trace, the hand-over back to QRhi's render pass.
+    void declareTrace(FrameGraph *graph);
+    void declareRasterization(FrameGraph *graph);
+
+private:
+    enum Attachment {
+        Albedo,
+        NormalDistance,
+        AttachmentCount
+    };
+    void createViews();
+
+    QRhi *m_rhi = nullptr;
+    const VulkanDevice *m_vk = nullptr;
+    int m_framesInFlight = 0;
+    QSize m_size;
+    std::unique_ptr<QRhiTexture> m_textures[AttachmentCount];
+    FrameGraph::Resource m_states[AttachmentCount];
+    VkImageView m_views[AttachmentCount] = {};
+    struct RetiredView {
+        VkImageView view;
+        int framesUntilRelease;
+    };
+    QVector<RetiredView> m_retiredViews;
+    std::unique_ptr<QRhiRenderBuffer> m_depth;
+    std::unique_ptr<QRhiTextureRenderTarget> m_rt;
+    std::unique_ptr<QRhiRenderPassDescriptor> m_rp;
+    std::unique_ptr<QRhiBuffer> m_ubuf;
+    std::unique_ptr<QRhiBuffer> m_instanceBuf;
+    std::unique_ptr<QRhiSampler> m_sampler;
+    std::vector<std::unique_ptr<QRhiShaderResourceBindings>> m_srbs; // per material texture
+    std::unique_ptr<QRhiGraphicsPipeline> m_ps;
+};
+
+#endif
@@ -0,0 +1,240 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "geometry_registry.h"
+#include <QThread>
+#include <QElapsedTimer>
+
+// xxHash64, see https://github.com/Cyan4973/xxHash
+static const quint64 PRIME1 = 0x9E3779B185EBCA87ULL;
+static const quint64 PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+static const quint64 PRIME3 = 0x165667B19E3779F9ULL;
+static const quint64 PRIME4 = 0x85EBCA77C2B2AE63ULL;
+static const quint64 PRIME5 = 0x27D4EB2F165667C5ULL;
+
+static inline quint64 rotl(quint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline quint64 read64(const uchar *p)
+{
+    quint64 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline quint32 read32(const uchar *p)
+{
+    quint32 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline quint64 xxhRound(quint64 acc, quint64 input)
+{
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+static inline quint64 xxhMergeRound(quint64 acc, quint64 val)
+{
+    acc ^= xxhRound(0, val);
+    return acc * PRIME1 + PRIME4;
+}
+
+quint64 GeometryRegistry::hash(const void *data, size_t size, quint64 seed)
+{
+    const uchar *p = static_cast<const uchar *>(data);
+    const uchar *end = p + size;
+    quint64 h;
+
+    if (size >= 32) {
+        // four independent lanes over 32 byte stripes
+        const uchar *limit = end - 32;
+        quint64 v1 = seed + PRIME1 + PRIME2;
+        quint64 v2 = seed + PRIME2;
+        quint64 v3 = seed;
+        quint64 v4 = seed - PRIME1;
+        do {
+            v1 = xxhRound(v1, read64(p));
+            v2 = xxhRound(v2, read64(p + 8));
+            v3 = xxhRound(v3, read64(p + 16));
+            v4 = xxhRound(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = xxhMergeRound(h, v1);
+        h = xxhMergeRound(h, v2);
+        h = xxhMergeRound(h, v3);
+        h = xxhMergeRound(h, v4);
+    } else {
+        h = seed + PRIME5;
+    }
+    h += quint64(size);
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= xxhRound(0, read64(p));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+    }
+    if (p + 4 <= end) {
+        h ^= quint64(read32(p)) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= quint64(*p) * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+quint64 GeometryRegistry::hash(const SceneMesh &mesh)
+{
+    quint64 h = hash(mesh.vertices.constData(), size_t(mesh.vertices.count()) * sizeof(float), 0);
+    h = hash(mesh.indices.constData(), size_t(mesh.indices.count()) * sizeof(quint32), h);
+    return hash(mesh.spheres.constData(), size_t(mesh.spheres.count()) * sizeof(float), h);
+}
+
+static qint64 meshBytes(const SceneMesh &mesh)
+{
+    return qint64(mesh.vertices.count()) * qint64(sizeof(float))
+            + qint64(mesh.indices.count()) * qint64(sizeof(quint32))
+            + qint64(mesh.spheres.count()) * qint64(sizeof(float));
+}
+
+static bool sameContents(const SceneMesh &a, const SceneMesh &b)
+{
+    return a.vertices == b.vertices && a.indices == b.indices && a.spheres == b.spheres;
+}
+
+GeometryRegistry::GeometryRegistry()
+{
+    // the calling thread does one share of the work
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+}
+
+GeometryRegistry::~GeometryRegistry()
+{
+    m_pool.waitForDone();
+}
+
+QVector<int> GeometryRegistry::addMeshes(const QVector<SceneMesh> &meshes)
+{
+    QElapsedTimer timer;
+    timer.start();
+    m_lastStats = Statistics();
+    m_lastStats.meshCount = meshes.count();
+
+    // not worth waking up threads for a few meshes
+    static const int MIN_MESHES_PER_THREAD = 16;
+    const int count = meshes.count();
+    const int chunkCount = qBound(1, count / MIN_MESHES_PER_THREAD, m_pool.maxThreadCount() + 1);
+    const int chunkSize = (count + chunkCount - 1) / qMax(1, chunkCount);
+    QVector<quint64> hashes(count);
+    quint64 *dst = hashes.data();
+    auto hashRange = [&meshes, dst](int first, int n) {
+        for (int i = first; i < first + n; ++i)
+            dst[i] = hash(meshes[i]);
+    };
+    for (int chunk = 1; chunk < chunkCount; ++chunk) {
+        const int first = chunk * chunkSize;
+        const int n = qMin(chunkSize, count - first);
+        if (n <= 0)
+            break;
+        m_pool.start([hashRange, first, n] { hashRange(first, n); });
+    }
+    hashRange(0, qMin(chunkSize, count));
+    m_pool.waitForDone();
+    m_lastStats.hashNs = timer.nsecsElapsed();
+    m_lastStats.threadCount = chunkCount;
+
+    QVector<int> ids(count);
+    for (int i = 0; i < count; ++i) {
+        const SceneMesh &mesh(meshes[i]);
+        m_lastStats.hashedBytes += meshBytes(mesh);
+        int id = -1;
+        for (auto it = m_byHash.constFind(hashes[i]); it != m_byHash.constEnd() && it.key() == hashes[i]; ++it) {
+            if (sameContents(m_geometries[it.value()].mesh, mesh)) {
+                id = it.value();
+                break;
+            }
+        }
+        if (id < 0) {
+            id = m_geometries.count();
+            m_geometries.append({ mesh, hashes[i], 0 });
+            m_byHash.insert(hashes[i], id);
+        }
+        ++m_geometries[id].refCount;
+        ids[i] = id;
+    }
+
+    return ids;
+}
+
+bool GeometryRegistry::release(int geometry)
+{
+    Geometry &g(m_geometries[geometry]);
+    Q_ASSERT(g.refCount > 0);
+    if (--g.refCount > 0)
+        return false;
+
+    // the id stays taken, so the others remain valid
+    m_byHash.remove(g.hash, geometry);
+    g.mesh = SceneMesh();
+    return true;
+}
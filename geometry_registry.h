@@ -0,0 +1,106 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef GEOMETRY_REGISTRY_H
+#define GEOMETRY_REGISTRY_H
+
+#include "scene.h"
+#include <QHash>
+#include <QThreadPool>
+
+// Identifies meshes with the same contents, however many times they were
+// loaded. Meshes are hashed (vertices, indices and spheres, with a 64-bit
+// xxHash) on worker threads, then looked up by hash and compared in full
+// to rule out collisions. Each distinct mesh is a geometry with a reference
+// count, the number of meshes added that had its contents; the mesh data is
+// kept (implicitly shared) until the last reference is released.
+
+class GeometryRegistry
+{
+public:
+    struct Statistics {
+        int meshCount = 0; // added
+        qint64 hashedBytes = 0;
+        qint64 hashNs = 0; // wall clock, all threads
+        int threadCount = 0;
+    };
+
+    GeometryRegistry();
+    ~GeometryRegistry();
+
+    static quint64 hash(const SceneMesh &mesh);
+    static quint64 hash(const void *data, size_t size, quint64 seed);
+
+    // Adds a reference to the geometry of each mesh, registering the ones
+    // not seen before, and returns the geometry ids. Ids are assigned in
+    // order of first appearance, starting from geometryCount().
+    QVector<int> addMeshes(const QVector<SceneMesh> &meshes);
+    // true when that was the last reference
+    bool release(int geometry);
+
+    int geometryCount() const { return m_geometries.count(); }
+    int refCount(int geometry) const { return m_geometries[geometry].refCount; }
+    const SceneMesh &mesh(int geometry) const { return m_geometries[geometry].mesh; }
+
+    const Statistics &lastStatistics() const { return m_lastStats; } // of the last addMeshes()
+
+private:
+    struct Geometry {
+        SceneMesh mesh;
+        quint64 hash;
+        int refCount;
+    };
+    QVector<Geometry> m_geometries;
+    QMultiHash<quint64, int> m_byHash;
+    QThreadPool m_pool;
+    Statistics m_lastStats;
+};
+
+#endif
@@ -0,0 +1,157 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "gpu_timer.h"
+
+bool GpuTimer::create(const VulkanDevice *vk, int framesInFlight, int maxRegionsPerFrame)
+{
+    m_vk = vk;
+    m_framesInFlight = framesInFlight;
+    m_maxRegions = maxRegionsPerFrame;
+    m_regions.resize(framesInFlight);
+
+    VkQueryPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = uint32_t(framesInFlight * maxRegionsPerFrame * 2);
+    VkResult err = vk->df->vkCreateQueryPool(vk->dev, &poolInfo, nullptr, &m_pool);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to create timestamp query pool: %d", err);
+        return false;
+    }
+
+    return true;
+}
+
+void GpuTimer::destroy()
+{
+    if (m_pool) {
+        m_vk->df->vkDestroyQueryPool(m_vk->dev, m_pool, nullptr);
+        m_pool = VK_NULL_HANDLE;
+    }
+    m_regions.clear();
+    m_stats.clear();
+}
+
+void GpuTimer::collect(int frameSlot)
+{
+    const double nsPerTick = double(m_vk->props.limits.timestampPeriod);
+    for (const Region &r : m_regions[frameSlot]) {
+        if (!r.ended)
+            continue;
+        quint64 timestamps[2];
+        VkResult err = m_vk->df->vkGetQueryPoolResults(m_vk->dev, m_pool, r.query, 2, sizeof(timestamps), timestamps,
+                                                       sizeof(quint64), VK_QUERY_RESULT_64_BIT);
+        if (err != VK_SUCCESS)
+            continue;
+        Stat &stat(m_stats[r.name]);
+        stat.totalMs += (timestamps[1] - timestamps[0]) * nsPerTick / 1000000.0;
+        stat.count += 1;
+    }
+    m_regions[frameSlot].clear();
+}
+
+void GpuTimer::beginFrame(VkCommandBuffer cb, int frameSlot)
+{
+    if (!m_pool)
+        return;
+
+    m_currentFrameSlot = frameSlot;
+    collect(frameSlot);
+
+    const uint32_t firstQuery = uint32_t(frameSlot * m_maxRegions * 2);
+    m_vk->df->vkCmdResetQueryPool(cb, m_pool, firstQuery, uint32_t(m_maxRegions * 2));
+}
+
+void GpuTimer::begin(VkCommandBuffer cb, const char *name)
+{
+    if (!m_pool)
+        return;
+
+    QVector<Region> &regions(m_regions[m_currentFrameSlot]);
+    if (regions.count() >= m_maxRegions)
+        return;
+
+    const uint32_t query = uint32_t((m_currentFrameSlot * m_maxRegions + regions.count()) * 2);
+    regions.append({ QByteArray(name), query, false });
+    m_vk->df->vkCmdWriteTimestamp(cb, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_pool, query);
+}
+
+void GpuTimer::end(VkCommandBuffer cb, const char *name)
+{
+    if (!m_pool)
+        return;
+
+    QVector<Region> &regions(m_regions[m_currentFrameSlot]);
+    for (int i = regions.count() - 1; i >= 0; --i) {
+        Region &r(regions[i]);
+        if (!r.ended && r.name == name) {
+            r.ended = true;
+            m_vk->df->vkCmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_pool, r.query + 1);
+            return;
+        }
+    }
+}
+
+double GpuTimer::averageMs(const char *name) const
+{
+    const Stat stat = m_stats.value(QByteArray(name));
+    return stat.count ? stat.totalMs / stat.count : 0.0;
+}
+
+int GpuTimer::sampleCount(const char *name) const
+{
+    return m_stats.value(QByteArray(name)).count;
+}
+
+void GpuTimer::resetStatistics()
+{
+    m_stats.clear();
+}
@@ -0,0 +1,103 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include "vulkan_device.h"
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+
+// Timestamp query based timing of named regions of a frame's command buffer.
+// The results for a frame slot are collected when the slot is used again (at
+// which point QRhi has already waited for its fence), so there is no stall.
+// Results are accumulated until resetStatistics().
+
+class GpuTimer
+{
+public:
+    bool create(const VulkanDevice *vk, int framesInFlight, int maxRegionsPerFrame = 16);
+    void destroy();
+    bool isValid() const { return m_pool != VK_NULL_HANDLE; }
+
+    // to be called before any begin() in the frame, outside a render pass
+    void beginFrame(VkCommandBuffer cb, int frameSlot);
+
+    void begin(VkCommandBuffer cb, const char *name);
+    void end(VkCommandBuffer cb, const char *name);
+
+    double averageMs(const char *name) const;
+    int sampleCount(const char *name) const;
+    void resetStatistics();
+
+private:
+    void collect(int frameSlot);
+
+    struct Region {
+        QByteArray name;
+        uint32_t query;
+        bool ended;
+    };
+    struct Stat {
+        double totalMs = 0;
+        int count = 0;
+    };
+
+    const VulkanDevice *m_vk = nullptr;
+    VkQueryPool m_pool = VK_NULL_HANDLE;
+    int m_framesInFlight = 0;
+    int m_maxRegions = 0;
+    int m_currentFrameSlot = 0;
+    QVector<QVector<Region>> m_regions;
+    QHash<QByteArray, Stat> m_stats;
+};
+
+#endif
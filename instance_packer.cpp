@@ -0,0 +1,259 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "instance_packer.h"
+#include <QThread>
+#include <QtCore/private/qsimd_p.h>
+
+void InstanceTransforms::resize(int count)
+{
+    m_count = count;
+    for (QVector<float> &c : m_components)
+        c.resize(count);
+    m_customIndexAndMask.resize(count);
+    m_hitGroupOffsetAndFlags.resize(count);
+    m_blasHandles.resize(count);
+}
+
+void InstanceTransforms::setTransform(int index, const QMatrix4x4 &m)
+{
+    for (int row = 0; row < 3; ++row) {
+        for (int col = 0; col < 4; ++col)
+            m_components[row * 4 + col][index] = m(row, col);
+    }
+}
+
+void InstanceTransforms::setInstance(int index, quint32 customIndex, quint32 mask, quint32 hitGroupOffset, quint32 flags)
+{
+    m_customIndexAndMask[index] = (customIndex & 0xFFFFFF) | (mask << 24);
+    m_hitGroupOffsetAndFlags[index] = (hitGroupOffset & 0xFFFFFF) | (flags << 24);
+}
+
+InstancePacker::InstancePacker()
+{
+    setThreadCount(0);
+    m_simd = hasAvx2();
+}
+
+InstancePacker::~InstancePacker()
+{
+    m_pool.waitForDone();
+}
+
+void InstancePacker::setThreadCount(int count)
+{
+    m_threadCount = count > 0 ? count : qMax(1, QThread::idealThreadCount());
+    // the calling thread does one share of the work
+    m_pool.setMaxThreadCount(qMax(1, m_threadCount - 1));
+}
+
+bool InstancePacker::hasAvx2()
+{
+#if QT_COMPILER_SUPPORTS_HERE(AVX2)
+    return qCpuHasFeature(AVX2);
+#else
+    return false;
+#endif
+}
+
+static void packRangeScalar(const InstanceTransforms &t, int first, int count, quint8 *dst)
+{
+    const float *c[InstanceTransforms::COMPONENTS];
+    for (int i = 0; i < InstanceTransforms::COMPONENTS; ++i)
+        c[i] = t.components(i);
+    const quint32 *customIndexAndMask = t.customIndexAndMask();
+    const quint32 *hitGroupOffsetAndFlags = t.hitGroupOffsetAndFlags();
+    const quint64 *blasHandles = t.blasHandles();
+
+    for (int i = first; i < first + count; ++i) {
+        float transform[InstanceTransforms::COMPONENTS];
+        for (int j = 0; j < InstanceTransforms::COMPONENTS; ++j)
+            transform[j] = c[j][i];
+        memcpy(dst, transform, sizeof(transform));
+        memcpy(dst + 48, customIndexAndMask + i, 4);
+        memcpy(dst + 52, hitGroupOffsetAndFlags + i, 4);
+        memcpy(dst + 56, blasHandles + i, 8);
+        dst += InstancePacker::INSTANCE_SIZE;
+    }
+}
+
+#if QT_COMPILER_SUPPORTS_HERE(AVX2)
+// 8 instances per iteration: 12 loads of 8 floats, transposed into 8 rows of
+// 12 floats. Each instance is a full 64 byte line, written with non-temporal
+// stores when aligned, which is what mapped write-combined memory wants.
+QT_FUNCTION_TARGET(AVX2)
+static void packRangeAvx2(const InstanceTransforms &t, int first, int count, quint8 *dst)
+{
+    const float *c[InstanceTransforms::COMPONENTS];
+    for (int i = 0; i < InstanceTransforms::COMPONENTS; ++i)
+        c[i] = t.components(i);
+    const quint32 *customIndexAndMask = t.customIndexAndMask();
+    const quint32 *hitGroupOffsetAndFlags = t.hitGroupOffsetAndFlags();
+    const quint64 *blasHandles = t.blasHandles();
+    const bool aligned = (quintptr(dst) & 31) == 0;
+
+    const int end = first + count;
+    int i = first;
+    for (; i + 8 <= end; i += 8) {
+        // rows 0 and 1 of the transforms: an 8x8 transpose
+        const __m256 r0 = _mm256_loadu_ps(c[0] + i);
+        const __m256 r1 = _mm256_loadu_ps(c[1] + i);
+        const __m256 r2 = _mm256_loadu_ps(c[2] + i);
+        const __m256 r3 = _mm256_loadu_ps(c[3] + i);
+        const __m256 r4 = _mm256_loadu_ps(c[4] + i);
+        const __m256 r5 = _mm256_loadu_ps(c[5] + i);
+        const __m256 r6 = _mm256_loadu_ps(c[6] + i);
+        const __m256 r7 = _mm256_loadu_ps(c[7] + i);
+        const __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+        const __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+        const __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+        const __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+        const __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+        const __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+        const __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+        const __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+        const __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        const __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        const __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        const __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+        const __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+        const __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+        const __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+        const __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+        const __m256 rows01[8] = {
+            _mm256_permute2f128_ps(s0, s4, 0x20),
+            _mm256_permute2f128_ps(s1, s5, 0x20),
+            _mm256_permute2f128_ps(s2, s6, 0x20),
+            _mm256_permute2f128_ps(s3, s7, 0x20),
+            _mm256_permute2f128_ps(s0, s4, 0x31),
+            _mm256_permute2f128_ps(s1, s5, 0x31),
+            _mm256_permute2f128_ps(s2, s6, 0x31),
+            _mm256_permute2f128_ps(s3, s7, 0x31)
+        };
+
+        // row 2: a 4x8 transpose, instance k and k + 4 share a register
+        const __m256 r8 = _mm256_loadu_ps(c[8] + i);
+        const __m256 r9 = _mm256_loadu_ps(c[9] + i);
+        const __m256 r10 = _mm256_loadu_ps(c[10] + i);
+        const __m256 r11 = _mm256_loadu_ps(c[11] + i);
+        const __m256 a0 = _mm256_unpacklo_ps(r8, r9);
+        const __m256 a1 = _mm256_unpackhi_ps(r8, r9);
+        const __m256 a2 = _mm256_unpacklo_ps(r10, r11);
+        const __m256 a3 = _mm256_unpackhi_ps(r10, r11);
+        const __m256 row2[4] = {
+            _mm256_shuffle_ps(a0, a2, _MM_SHUFFLE(1, 0, 1, 0)),
+            _mm256_shuffle_ps(a0, a2, _MM_SHUFFLE(3, 2, 3, 2)),
+            _mm256_shuffle_ps(a1, a3, _MM_SHUFFLE(1, 0, 1, 0)),
+            _mm256_shuffle_ps(a1, a3, _MM_SHUFFLE(3, 2, 3, 2))
+        };
+
+        for (int k = 0; k < 8; ++k) {
+            quint8 *p = dst + (i - first + k) * InstancePacker::INSTANCE_SIZE;
+            const __m128 r2 = k < 4 ? _mm256_castps256_ps128(row2[k]) : _mm256_extractf128_ps(row2[k - 4], 1);
+            const __m128i tail = _mm_set_epi64x(qint64(blasHandles[i + k]),
+                                                qint64(quint64(hitGroupOffsetAndFlags[i + k]) << 32 | customIndexAndMask[i + k]));
+            if (aligned) {
+                _mm256_stream_ps(reinterpret_cast<float *>(p), rows01[k]);
+                _mm_stream_ps(reinterpret_cast<float *>(p + 32), r2);
+                _mm_stream_si128(reinterpret_cast<__m128i *>(p + 48), tail);
+            } else {
+                _mm256_storeu_ps(reinterpret_cast<float *>(p), rows01[k]);
+                _mm_storeu_ps(reinterpret_cast<float *>(p + 32), r2);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(p + 48), tail);
+            }
+        }
+    }
+
+    if (aligned)
+        _mm_sfence();
+
+    if (i < end)
+        packRangeScalar(t, i, end - i, dst + (i - first) * InstancePacker::INSTANCE_SIZE);
+}
+#endif
+
+void InstancePacker::packRange(const InstanceTransforms &transforms, int first, int count, quint8 *dst, bool simd)
+{
+#if QT_COMPILER_SUPPORTS_HERE(AVX2)
+    if (simd) {
+        packRangeAvx2(transforms, first, count, dst);
+        return;
+    }
+#else
+    Q_UNUSED(simd);
+#endif
+    packRangeScalar(transforms, first, count, dst);
+}
+
+void InstancePacker::pack(const InstanceTransforms &transforms, void *dst)
+{
+    quint8 *p = static_cast<quint8 *>(dst);
+    const int count = transforms.count();
+
+    // not worth waking up threads for small counts
+    static const int MIN_INSTANCES_PER_THREAD = 4096;
+    const int chunkCount = qBound(1, count / MIN_INSTANCES_PER_THREAD, m_threadCount);
+    // multiple of 8 so only the last chunk has a scalar tail
+    const int chunkSize = ((count + chunkCount - 1) / chunkCount + 7) & ~7;
+
+    for (int chunk = 1; chunk < chunkCount; ++chunk) {
+        const int first = chunk * chunkSize;
+        const int n = qMin(chunkSize, count - first);
+        if (n <= 0)
+            break;
+        const bool simd = m_simd;
+        m_pool.start([&transforms, first, n, p, simd] {
+            packRange(transforms, first, n, p + first * INSTANCE_SIZE, simd);
+        });
+    }
+
+    packRange(transforms, 0, qMin(chunkSize, count), p, m_simd);
+    m_pool.waitForDone();
+}
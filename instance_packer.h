@@ -0,0 +1,127 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef INSTANCE_PACKER_H
+#define INSTANCE_PACKER_H
+
+#include <QVector>
+#include <QMatrix4x4>
+#include <QThreadPool>
+
+// TLAS instances in structure-of-arrays form: animating them touches
+// contiguous floats, and converting to the 64 byte VkGeometryInstanceNV
+// layout (4x3 row major transform, custom index and mask, hit group offset
+// and flags, BLAS handle) vectorizes well.
+
+class InstanceTransforms
+{
+public:
+    static const int COMPONENTS = 12; // 3 rows of 4
+
+    void resize(int count);
+    int count() const { return m_count; }
+
+    // the top 3 rows of m
+    void setTransform(int index, const QMatrix4x4 &m);
+    void setInstance(int index, quint32 customIndex, quint32 mask, quint32 hitGroupOffset, quint32 flags);
+    void setBlasHandle(int index, quint64 blasHandle) { m_blasHandles[index] = blasHandle; }
+    void setHitGroupOffset(int index, quint32 hitGroupOffset) {
+        m_hitGroupOffsetAndFlags[index] = (m_hitGroupOffsetAndFlags[index] & 0xFF000000) | (hitGroupOffset & 0xFFFFFF);
+    }
+    void setMask(int index, quint32 mask) {
+        m_customIndexAndMask[index] = (m_customIndexAndMask[index] & 0xFFFFFF) | (mask << 24);
+    }
+
+    // component c (row * 4 + column) of all instances
+    float *components(int c) { return m_components[c].data(); }
+    const float *components(int c) const { return m_components[c].constData(); }
+    const quint32 *customIndexAndMask() const { return m_customIndexAndMask.constData(); }
+    const quint32 *hitGroupOffsetAndFlags() const { return m_hitGroupOffsetAndFlags.constData(); }
+    const quint64 *blasHandles() const { return m_blasHandles.constData(); }
+
+private:
+    int m_count = 0;
+    QVector<float> m_components[COMPONENTS];
+    QVector<quint32> m_customIndexAndMask;
+    QVector<quint32> m_hitGroupOffsetAndFlags;
+    QVector<quint64> m_blasHandles;
+};
+
+// Writes InstanceTransforms into GeometryInstance records, typically straight
+// into a mapped (write-combined) instance buffer. Large counts are split
+// across worker threads, each running an AVX2 kernel when the CPU has it.
+
+class InstancePacker
+{
+public:
+    static const int INSTANCE_SIZE = 64;
+
+    InstancePacker();
+    ~InstancePacker();
+
+    // 0 means QThread::idealThreadCount()
+    void setThreadCount(int count);
+    int threadCount() const { return m_threadCount; }
+    void setSimdEnabled(bool enabled) { m_simd = enabled && hasAvx2(); }
+    bool isSimdEnabled() const { return m_simd; }
+
+    // writes transforms.count() * INSTANCE_SIZE bytes to dst
+    void pack(const InstanceTransforms &transforms, void *dst);
+
+    static bool hasAvx2();
+    static void packRange(const InstanceTransforms &transforms, int first, int count, quint8 *dst, bool simd);
+
+private:
+    QThreadPool m_pool;
+    int m_threadCount = 1;
+    bool m_simd = false;
+};
+
+#endif
@@ -49,6 +49,7 @@
 ****************************************************************************/
 
 #include <QGuiApplication>
+#include <QCommandLineParser>
 #include "raytracing_window.h"
 
 int main(int argc, char **argv)
@@ -56,23 +57,285 @@ int main(int argc, char **argv)
     QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
     QGuiApplication app(argc, argv);
 
+    QCommandLineParser cmdLineParser;
+    cmdLineParser.addHelpOption();
+    QCommandLineOption bufferPlacementOption("buffer-placement",
+                                             "Where the instance and shader binding table buffers live: auto, host or device.",
+                                             "placement", "auto");
+    cmdLineParser.addOption(bufferPlacementOption);
+    QCommandLineOption benchmarkPlacementOption("benchmark-placement",
+                                                "Compare TLAS build and trace times with host visible and device local instance/SBT buffers.");
+    cmdLineParser.addOption(benchmarkPlacementOption);
+    QCommandLineOption meshesOption("meshes", "Replace the triangle with a grid of <count> distinct meshes.", "count");
+    cmdLineParser.addOption(meshesOption);
+    QCommandLineOption scratchBudgetOption("scratch-budget", "Scratch memory budget for batched BLAS builds in megabytes.", "MB", "32");
+    cmdLineParser.addOption(scratchBudgetOption);
+    QCommandLineOption asyncBuildsOption("async-builds",
+                                         "Rebuild the acceleration structures on a separate compute queue and swap them in when done.");
+    cmdLineParser.addOption(asyncBuildsOption);
+    QCommandLineOption materialsOption("materials", "Use <count> distinct materials, each with its own texture.", "count");
+    cmdLineParser.addOption(materialsOption);
+    QCommandLineOption bindlessStressOption("bindless-stress",
+                                            "Trace thousands of meshes with as many materials via the bindless descriptor arrays and report the timings.");
+    cmdLineParser.addOption(bindlessStressOption);
+    QCommandLineOption positionsOption("positions",
+                                       "Vertex position format for the BLAS input: float, snorm16 (halves the position memory of large meshes, at some precision) or snorm16-decode (quantized, but decoded to float on upload).",
+                                       "format", "float");
+    cmdLineParser.addOption(positionsOption);
+    QCommandLineOption instancesOption("instances", "Replicate the scene's instances until there are <count> of them.", "count");
+    cmdLineParser.addOption(instancesOption);
+    QCommandLineOption animateInstancesOption("animate-instances",
+                                              "Move the instances every frame, repacking the instance buffer and rebuilding the TLAS.");
+    cmdLineParser.addOption(animateInstancesOption);
+    QCommandLineOption benchmarkPackingOption("benchmark-packing",
+                                              "Report how many instances per millisecond the scalar and AVX2 instance packing manage, single and multithreaded.");
+    cmdLineParser.addOption(benchmarkPackingOption);
+    QCommandLineOption lodsOption("lods", "Generate <count> levels of detail per mesh and select one per instance based on projected size.", "count");
+    cmdLineParser.addOption(lodsOption);
+    QCommandLineOption benchmarkLodOption("benchmark-lod",
+                                          "Compare triangles referenced and trace time with level of detail selection off and on.");
+    cmdLineParser.addOption(benchmarkLodOption);
+    QCommandLineOption cpuProfileOption("cpu-profile",
+                                        "Time the CPU side of the frame phases and log histograms of them on exit.");
+    cmdLineParser.addOption(cpuProfileOption);
+    QCommandLineOption cpuTraceOption("cpu-trace", "Like --cpu-profile, and write the samples to <file> as a Chrome trace.", "file");
+    cmdLineParser.addOption(cpuTraceOption);
+    QCommandLineOption viewsOption("views", "Open <count> windows showing the same scene from different angles, sharing the device, "
+                                   "acceleration structures and pipeline, and report the memory used.", "count");
+    cmdLineParser.addOption(viewsOption);
+    QCommandLineOption multiViewOption("multiview", "Trace <count> views (up to 8) in one launch into a layered image: "
+                                       "6 = cubemap faces, 2 = stereo pair, otherwise views around the scene.", "count");
+    cmdLineParser.addOption(multiViewOption);
+    QCommandLineOption benchmarkMultiViewOption("benchmark-multiview", "Compare tracing the views with one launch per view "
+                                                "against a single launch (implies --multiview 6 unless specified).");
+    cmdLineParser.addOption(benchmarkMultiViewOption);
+    QCommandLineOption sppOption("spp", "Trace <count> jittered samples per pixel instead of one through the pixel center.", "count");
+    cmdLineParser.addOption(sppOption);
+    QCommandLineOption denoiseOption("denoise", "Run <iterations> (up to 5) of the edge-aware a-trous filter on the traced image.", "iterations");
+    cmdLineParser.addOption(denoiseOption);
+    QCommandLineOption benchmarkDenoiseOption("benchmark-denoise", "Report the cost of the denoiser per frame at 1920x1080 and 3840x2160.");
+    cmdLineParser.addOption(benchmarkDenoiseOption);
+    QCommandLineOption inlineShadingOption("inline-shading", "Shade in the raygen shader, with the closest hit shader only "
+                                           "reporting what was hit.");
+    cmdLineParser.addOption(inlineShadingOption);
+    QCommandLineOption benchmarkInlineShadingOption("benchmark-inline-shading", "Compare the trace time with shading in the "
+                                                    "closest hit shader and in the raygen shader at 720p, 1080p and 4K.");
+    cmdLineParser.addOption(benchmarkInlineShadingOption);
+    QCommandLineOption secondaryOption("secondary", "Trace shadow and ambient occlusion rays from the primary hits.");
+    cmdLineParser.addOption(secondaryOption);
+    QCommandLineOption hybridOption("hybrid", "Rasterize the primary visibility into a G-buffer and trace only the secondary rays.");
+    cmdLineParser.addOption(hybridOption);
+    QCommandLineOption benchmarkHybridOption("benchmark-hybrid", "Compare traced primary rays against the rasterized G-buffer "
+                                             "(implies --secondary).");
+    cmdLineParser.addOption(benchmarkHybridOption);
+    QCommandLineOption benchmarkOcclusionOption("benchmark-occlusion", "Compare shadow and AO rays running the closest hit "
+                                                "shader against the occlusion ray type (implies --secondary).");
+    cmdLineParser.addOption(benchmarkOcclusionOption);
+    QCommandLineOption spheresOption("spheres", "Trace <count> procedural spheres (AABBs with an intersection shader) "
+                                     "instead of the meshes.", "count");
+    cmdLineParser.addOption(spheresOption);
+    QCommandLineOption triangulatedSpheresOption("triangulated-spheres", "Trace the spheres as triangle meshes instead.");
+    cmdLineParser.addOption(triangulatedSpheresOption);
+    QCommandLineOption benchmarkSpheresOption("benchmark-spheres", "Compare the memory, build and trace time of procedural "
+                                              "and triangulated spheres (implies --spheres 1000000 unless specified).");
+    cmdLineParser.addOption(benchmarkSpheresOption);
+    QCommandLineOption blasBudgetOption("blas-budget", "Keep only the BLASes of the visible meshes within <MB> megabytes, "
+                                        "evicting the least recently visible ones.", "MB");
+    cmdLineParser.addOption(blasBudgetOption);
+    QCommandLineOption tileWorkersOption("tile-workers", "Trace on the CPU instead, in tiles, split between <count> "
+                                         "worker processes.", "count");
+    cmdLineParser.addOption(tileWorkersOption);
+    QCommandLineOption benchmarkTileWorkersOption("benchmark-tile-workers", "Compare the CPU frame time with 1 to <count> "
+                                                  "tile worker processes.", "count");
+    cmdLineParser.addOption(benchmarkTileWorkersOption);
+    QCommandLineOption captureOption("capture", "Write the rendered frames as PNG files to <directory>, "
+                                     "without waiting for them (frames get dropped when the encoder falls behind).", "directory");
+    cmdLineParser.addOption(captureOption);
+    QCommandLineOption captureFramesOption("capture-frames", "Stop capturing after <count> frames.", "count");
+    cmdLineParser.addOption(captureFramesOption);
+    QCommandLineOption barrierStatsOption("barrier-stats", "Report the barriers of the ray tracing passes per frame.");
+    cmdLineParser.addOption(barrierStatsOption);
+    QCommandLineOption unbatchedBarriersOption("unbatched-barriers", "Record one barrier per dependency instead of "
+                                               "one per pass (implies --barrier-stats).");
+    cmdLineParser.addOption(unbatchedBarriersOption);
+    QCommandLineOption alphaTestOption("alpha-test", "Cut holes into every other material's texture and alpha test them "
+                                       "in an any-hit shader, which only runs on the triangles the texture does not "
+                                       "make fully opaque or transparent.");
+    cmdLineParser.addOption(alphaTestOption);
+    QCommandLineOption benchmarkAlphaOption("benchmark-alpha", "Compare the any-hit invocations and trace time of the "
+                                            "classified alpha tested meshes against making all their triangles "
+                                            "non-opaque (implies --alpha-test).");
+    cmdLineParser.addOption(benchmarkAlphaOption);
+    QCommandLineOption deformOption("deform", "Skin the meshes in a compute shader every frame and refit their BLASes.");
+    cmdLineParser.addOption(deformOption);
+    QCommandLineOption rebuildIntervalOption("rebuild-interval", "Rebuild the deformed meshes' BLASes every <frames> "
+                                             "frames instead of refitting them (default 60, 0 = never).", "frames");
+    cmdLineParser.addOption(rebuildIntervalOption);
+    QCommandLineOption benchmarkDeformOption("benchmark-deform", "Report the skinning, BLAS refit and rebuild times with "
+                                             "an increasing number of deformed vertices (implies --deform, and --meshes 4096 "
+                                             "unless specified).");
+    cmdLineParser.addOption(benchmarkDeformOption);
+    QCommandLineOption duplicateMeshesOption("duplicate-meshes", "Load every mesh <copies> times, as if from separate files, "
+                                             "each copy with instances of its own. Identical meshes share their buffers and BLAS.",
+                                             "copies");
+    cmdLineParser.addOption(duplicateMeshesOption);
+    QCommandLineOption benchmarkDedupOption("benchmark-dedup", "Compare the BLAS build time with one BLAS per mesh loaded "
+                                            "against sharing them between identical meshes, and report the memory saved "
+                                            "(implies --duplicate-meshes 16 and --meshes 256 unless specified).");
+    cmdLineParser.addOption(benchmarkDedupOption);
+    QCommandLineOption memoryReportOption("memory-report", "Write the device memory in use and its peak, per category "
+                                          "and per heap, as JSON to <file> periodically and on exit.", "file");
+    cmdLineParser.addOption(memoryReportOption);
+    QCommandLineOption memoryReportIntervalOption("memory-report-interval", "Rewrite the memory report every <frames> "
+                                                  "frames (default 300).", "frames");
+    cmdLineParser.addOption(memoryReportIntervalOption);
+    // what the tile workers get started with, see TileCoordinator
+    QCommandLineOption tileWorkerOption("tile-worker", "Run as a tile worker for the coordinator at <server>.", "server");
+    tileWorkerOption.setFlags(QCommandLineOption::HiddenFromHelp);
+    cmdLineParser.addOption(tileWorkerOption);
+    cmdLineParser.process(app);
+
+    RaytracingOptions options;
+    const QString placement = cmdLineParser.value(bufferPlacementOption);
+    if (placement == QLatin1String("host"))
+        options.bufferPlacement = RaytracingOptions::HostVisiblePlacement;
+    else if (placement == QLatin1String("device"))
+        options.bufferPlacement = RaytracingOptions::DeviceLocalPlacement;
+    options.benchmarkPlacement = cmdLineParser.isSet(benchmarkPlacementOption);
+    if (cmdLineParser.isSet(meshesOption))
+        options.meshCount = qMax(1, cmdLineParser.value(meshesOption).toInt());
+    options.scratchBudget = VkDeviceSize(qMax(1, cmdLineParser.value(scratchBudgetOption).toInt())) * 1024 * 1024;
+    options.asyncBuilds = cmdLineParser.isSet(asyncBuildsOption);
+    if (cmdLineParser.isSet(materialsOption))
+        options.materialCount = qMax(1, cmdLineParser.value(materialsOption).toInt());
+    options.bindlessStress = cmdLineParser.isSet(bindlessStressOption);
+    const QString positions = cmdLineParser.value(positionsOption);
+    if (positions == QLatin1String("snorm16"))
+        options.positionFormat = RaytracingOptions::Snorm16Positions;
+    else if (positions == QLatin1String("snorm16-decode"))
+        options.positionFormat = RaytracingOptions::Snorm16DecodedPositions;
+    if (cmdLineParser.isSet(instancesOption))
+        options.instanceCount = qMax(1, cmdLineParser.value(instancesOption).toInt());
+    options.animateInstances = cmdLineParser.isSet(animateInstancesOption);
+    options.benchmarkPacking = cmdLineParser.isSet(benchmarkPackingOption);
+    if (options.benchmarkPacking && !options.instanceCount)
+        options.instanceCount = 1000000;
+    if (cmdLineParser.isSet(lodsOption))
+        options.lodCount = qBound(1, cmdLineParser.value(lodsOption).toInt(), 8);
+    options.benchmarkLod = cmdLineParser.isSet(benchmarkLodOption);
+    options.cpuTraceFile = cmdLineParser.value(cpuTraceOption);
+    options.cpuProfile = cmdLineParser.isSet(cpuProfileOption) || !options.cpuTraceFile.isEmpty();
+    if (options.benchmarkLod) {
+        if (options.lodCount < 2)
+            options.lodCount = 4;
+        if (!options.meshCount)
+            options.meshCount = 4096;
+    }
+    if (cmdLineParser.isSet(multiViewOption))
+        options.multiViewCount = qBound(1, cmdLineParser.value(multiViewOption).toInt(), int(RaytracingWindow::MAX_VIEWS));
+    options.benchmarkMultiView = cmdLineParser.isSet(benchmarkMultiViewOption);
+    if (options.benchmarkMultiView && options.multiViewCount < 2)
+        options.multiViewCount = 6;
+    if (cmdLineParser.isSet(sppOption))
+        options.samplesPerPixel = qBound(1, cmdLineParser.value(sppOption).toInt(), 64);
+    if (cmdLineParser.isSet(denoiseOption))
+        options.denoiseIterations = qBound(0, cmdLineParser.value(denoiseOption).toInt(), 5);
+    options.benchmarkDenoise = cmdLineParser.isSet(benchmarkDenoiseOption);
+    options.inlineShading = cmdLineParser.isSet(inlineShadingOption);
+    options.benchmarkInlineShading = cmdLineParser.isSet(benchmarkInlineShadingOption);
+    options.hybrid = cmdLineParser.isSet(hybridOption);
+    options.benchmarkHybrid = cmdLineParser.isSet(benchmarkHybridOption);
+    options.benchmarkOcclusion = cmdLineParser.isSet(benchmarkOcclusionOption);
+    options.secondaryRays = cmdLineParser.isSet(secondaryOption) || options.benchmarkHybrid || options.benchmarkOcclusion;
+    if (cmdLineParser.isSet(spheresOption))
+        options.sphereCount = qMax(1, cmdLineParser.value(spheresOption).toInt());
+    options.triangulatedSpheres = cmdLineParser.isSet(triangulatedSpheresOption);
+    options.benchmarkSpheres = cmdLineParser.isSet(benchmarkSpheresOption);
+    if (options.benchmarkSpheres && !options.sphereCount)
+        options.sphereCount = 1000000;
+    if (cmdLineParser.isSet(blasBudgetOption))
+        options.blasBudget = VkDeviceSize(qMax(1, cmdLineParser.value(blasBudgetOption).toInt())) * 1024 * 1024;
+    if (cmdLineParser.isSet(tileWorkersOption))
+        options.tileWorkerCount = qBound(1, cmdLineParser.value(tileWorkersOption).toInt(), 64);
+    if (cmdLineParser.isSet(benchmarkTileWorkersOption))
+        options.benchmarkTileWorkers = qBound(1, cmdLineParser.value(benchmarkTileWorkersOption).toInt(), 64);
+    options.arguments = app.arguments().mid(1);
+    options.captureDirectory = cmdLineParser.value(captureOption);
+    if (cmdLineParser.isSet(captureFramesOption))
+        options.captureFrameCount = qMax(1, cmdLineParser.value(captureFramesOption).toInt());
+    options.unbatchedBarriers = cmdLineParser.isSet(unbatchedBarriersOption);
+    options.barrierStats = cmdLineParser.isSet(barrierStatsOption) || options.unbatchedBarriers;
+    options.benchmarkAlpha = cmdLineParser.isSet(benchmarkAlphaOption);
+    options.alphaTest = cmdLineParser.isSet(alphaTestOption) || options.benchmarkAlpha;
+    options.benchmarkDeform = cmdLineParser.isSet(benchmarkDeformOption);
+    options.deform = cmdLineParser.isSet(deformOption) || options.benchmarkDeform;
+    if (cmdLineParser.isSet(rebuildIntervalOption))
+        options.rebuildInterval = qMax(0, cmdLineParser.value(rebuildIntervalOption).toInt());
+    if (options.benchmarkDeform && !options.meshCount)
+        options.meshCount = 4096;
+    if (cmdLineParser.isSet(duplicateMeshesOption))
+        options.duplicateMeshes = qBound(1, cmdLineParser.value(duplicateMeshesOption).toInt(), 1024);
+    options.benchmarkDedup = cmdLineParser.isSet(benchmarkDedupOption);
+    if (options.benchmarkDedup) {
+        if (options.duplicateMeshes < 2)
+            options.duplicateMeshes = 16;
+        if (!options.meshCount)
+            options.meshCount = 256;
+    }
+    options.memoryReportFile = cmdLineParser.value(memoryReportOption);
+    if (cmdLineParser.isSet(memoryReportIntervalOption))
+        options.memoryReportInterval = qMax(1, cmdLineParser.value(memoryReportIntervalOption).toInt());
+    if (options.bindlessStress) {
+        if (!options.meshCount)
+            options.meshCount = 4096;
+        if (!options.materialCount)
+            options.materialCount = options.meshCount;
+    }
+
+    if (cmdLineParser.isSet(tileWorkerOption))
+        return runTileWorker(cmdLineParser.value(tileWorkerOption), options);
+
     QVulkanInstance inst;
     inst.setLayers({ "VK_LAYER_LUNARG_standard_validation" });
     inst.setExtensions({ "VK_KHR_get_physical_device_properties2" });
     if (!inst.create())
         qFatal("Failed to create Vulkan instance");
 
-    RaytracingWindow w;
-    w.setVulkanInstance(&inst);
+    const int viewCount = cmdLineParser.isSet(viewsOption) ? qBound(1, cmdLineParser.value(viewsOption).toInt(), 16) : 1;
 
-    w.resize(1280, 720);
-    w.setTitle(QCoreApplication::applicationName());
-    w.show();
+    // the first window owns the device and the scene and must be destroyed last
+    RaytracingContext context;
+    std::vector<std::unique_ptr<RaytracingWindow>> windows;
+    for (int i = 0; i < viewCount; ++i) {
+        windows.emplace_back(new RaytracingWindow);
+        RaytracingWindow *w = windows.back().get();
+        RaytracingOptions windowOptions = options;
+        if (viewCount > 1 && !options.captureDirectory.isEmpty())
+            windowOptions.captureDirectory += QLatin1String("/view") + QString::number(i + 1);
+        w->setOptions(windowOptions);
+        w->setVulkanInstance(&inst);
+        if (viewCount > 1) {
+            context.addWindow(w);
+            w->setViewRotation(360.0f * i / viewCount);
+            w->resize(640, 360);
+            w->setTitle(QCoreApplication::applicationName() + QLatin1String(" - view ") + QString::number(i + 1));
+        } else {
+            w->resize(1280, 720);
+            w->setTitle(QCoreApplication::applicationName());
+        }
+        // one profiler (and trace file) is enough, that of the owner
+        options.cpuProfile = false;
+    }
+    for (const std::unique_ptr<RaytracingWindow> &w : windows)
+        w->show();
 
     int ret = app.exec();
 
-    if (w.handle())
-        w.releaseSwapChain();
+    while (!windows.empty()) {
+        if (windows.back()->handle())
+            windows.back()->releaseSwapChain();
+        windows.pop_back();
+    }
 
     return ret;
 }
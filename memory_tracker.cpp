@@ -0,0 +1,345 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "memory_tracker.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QDateTime>
+
+uint qHash(const MemoryTracker::ExternalKey &key, uint seed)
+{
+    return qHash(key.owner, seed) ^ uint(key.category << 8) ^ uint(key.heap);
+}
+
+static inline quint64 memoryKey(VkDeviceMemory mem)
+{
+    // a pointer or a 64-bit integer, depending on the platform
+    return (quint64) mem;
+}
+
+static inline double toMB(quint64 bytes)
+{
+    return bytes / (1024.0 * 1024.0);
+}
+
+const char *MemoryTracker::categoryName(Category category)
+{
+    switch (category) {
+    case AccelerationStructures:
+        return "accelerationStructures";
+    case Scratch:
+        return "scratch";
+    case Instances:
+        return "instances";
+    case ShaderBindingTable:
+        return "shaderBindingTable";
+    case Staging:
+        return "staging";
+    case Buffers:
+        return "buffers";
+    case Images:
+        return "images";
+    case RhiBuffers:
+        return "rhiBuffers";
+    case RhiTextures:
+        return "rhiTextures";
+    default:
+        break;
+    }
+    return "unknown";
+}
+
+void MemoryTracker::create(const VkPhysicalDeviceMemoryProperties &memProps)
+{
+    QMutexLocker lock(&m_mutex);
+    m_heapCount = int(memProps.memoryHeapCount);
+    for (int i = 0; i < m_heapCount; ++i) {
+        m_heaps[i] = Heap();
+        m_heaps[i].size = memProps.memoryHeaps[i].size;
+        m_heaps[i].flags = memProps.memoryHeaps[i].flags;
+    }
+    m_memoryTypeCount = memProps.memoryTypeCount;
+    for (uint32_t i = 0; i < m_memoryTypeCount; ++i)
+        m_memoryTypes[i] = memProps.memoryTypes[i];
+    for (Usage &usage : m_categories)
+        usage = Usage();
+    m_total = Usage();
+    m_allocations.clear();
+    m_external.clear();
+}
+
+VkDeviceSize MemoryTracker::heapSize(int heap) const
+{
+    return heap >= 0 && heap < m_heapCount ? m_heaps[heap].size : 0;
+}
+
+VkMemoryHeapFlags MemoryTracker::heapFlags(int heap) const
+{
+    return heap >= 0 && heap < m_heapCount ? m_heaps[heap].flags : 0;
+}
+
+int MemoryTracker::heapOfMemoryType(uint32_t memoryTypeIndex) const
+{
+    return memoryTypeIndex < m_memoryTypeCount ? int(m_memoryTypes[memoryTypeIndex].heapIndex) : -1;
+}
+
+int MemoryTracker::heapOf(VkMemoryPropertyFlags memFlags) const
+{
+    for (uint32_t i = 0; i < m_memoryTypeCount; ++i) {
+        if ((m_memoryTypes[i].propertyFlags & memFlags) == memFlags)
+            return int(m_memoryTypes[i].heapIndex);
+    }
+    return -1;
+}
+
+void MemoryTracker::add(Usage *usage, quint64 bytes)
+{
+    usage->current += bytes;
+    usage->peak = qMax(usage->peak, usage->current);
+}
+
+void MemoryTracker::add(Category category, int heap, quint64 bytes)
+{
+    add(&m_categories[category], bytes);
+    add(&m_total, bytes);
+    if (heap < 0 || heap >= m_heapCount)
+        return;
+
+    Heap &h(m_heaps[heap]);
+    add(&h.categories[category], bytes);
+    add(&h.total, bytes);
+
+    const VkDeviceSize limit = h.budget ? qMin(h.budget, h.size) : h.size;
+    if (!h.warned && h.total.current > limit * WARNING_FRACTION) {
+        h.warned = true;
+        qWarning("Memory heap %d: %.1f MB tracked, more than %d%% of its %s of %.1f MB",
+                 heap, toMB(h.total.current), int(WARNING_FRACTION * 100),
+                 h.budget ? "budget" : "size", toMB(limit));
+    }
+}
+
+void MemoryTracker::subtract(Category category, int heap, quint64 bytes)
+{
+    m_categories[category].current -= bytes;
+    m_total.current -= bytes;
+    if (heap < 0 || heap >= m_heapCount)
+        return;
+
+    m_heaps[heap].categories[category].current -= bytes;
+    m_heaps[heap].total.current -= bytes;
+}
+
+void MemoryTracker::allocated(VkDeviceMemory mem, Category category, uint32_t memoryTypeIndex, VkDeviceSize size)
+{
+    if (!mem)
+        return;
+
+    QMutexLocker lock(&m_mutex);
+    const Allocation a = { category, heapOfMemoryType(memoryTypeIndex), quint64(size) };
+    m_allocations.insert(memoryKey(mem), a);
+    add(a.category, a.heap, a.size);
+}
+
+void MemoryTracker::freed(VkDeviceMemory mem)
+{
+    if (!mem)
+        return;
+
+    QMutexLocker lock(&m_mutex);
+    auto it = m_allocations.find(memoryKey(mem));
+    if (it == m_allocations.end())
+        return;
+
+    subtract(it->category, it->heap, it->size);
+    m_allocations.erase(it);
+}
+
+void MemoryTracker::setExternalBytes(const void *owner, Category category, int heap, quint64 bytes)
+{
+    QMutexLocker lock(&m_mutex);
+    quint64 &b(m_external[{ owner, int(category), heap }]);
+    if (bytes > b)
+        add(category, heap, bytes - b);
+    else
+        subtract(category, heap, b - bytes);
+    b = bytes;
+}
+
+void MemoryTracker::setBudget(const VkDeviceSize *heapBudget, const VkDeviceSize *heapUsage)
+{
+    QMutexLocker lock(&m_mutex);
+    for (int i = 0; i < m_heapCount; ++i) {
+        m_heaps[i].budget = heapBudget[i];
+        m_heaps[i].budgetUsage = heapUsage[i];
+    }
+}
+
+MemoryTracker::Usage MemoryTracker::usage(int heap) const
+{
+    QMutexLocker lock(&m_mutex);
+    return heap >= 0 && heap < m_heapCount ? m_heaps[heap].total : Usage();
+}
+
+MemoryTracker::Usage MemoryTracker::usage(int heap, Category category) const
+{
+    QMutexLocker lock(&m_mutex);
+    return heap >= 0 && heap < m_heapCount ? m_heaps[heap].categories[category] : Usage();
+}
+
+MemoryTracker::Usage MemoryTracker::usage(Category category) const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_categories[category];
+}
+
+MemoryTracker::Usage MemoryTracker::total() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_total;
+}
+
+int MemoryTracker::allocationCount() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_allocations.count();
+}
+
+static QJsonObject usageToJson(const MemoryTracker::Usage &usage)
+{
+    QJsonObject obj;
+    // doubles, the only numbers QJsonValue has, are exact up to 2^53
+    obj.insert(QLatin1String("current"), double(usage.current));
+    obj.insert(QLatin1String("peak"), double(usage.peak));
+    return obj;
+}
+
+// {
+//   "timestamp": ..., "allocations": n,
+//   "total": { "current": bytes, "peak": bytes },
+//   "categories": { "accelerationStructures": { "current", "peak" }, ... },
+//   "heaps": [ { "index", "size", "deviceLocal", "budget", "budgetUsage",
+//                "fractionOfSize", "current", "peak", "categories": { ... } }, ... ]
+// }
+// with budget and budgetUsage only present with VK_EXT_memory_budget.
+QJsonObject MemoryTracker::toJson() const
+{
+    QMutexLocker lock(&m_mutex);
+    QJsonObject root;
+    root.insert(QLatin1String("timestamp"), QDateTime::currentDateTime().toString(Qt::ISODateWithMs));
+    root.insert(QLatin1String("allocations"), m_allocations.count());
+    root.insert(QLatin1String("total"), usageToJson(m_total));
+
+    QJsonObject categories;
+    for (int c = 0; c < CategoryCount; ++c)
+        categories.insert(QLatin1String(categoryName(Category(c))), usageToJson(m_categories[c]));
+    root.insert(QLatin1String("categories"), categories);
+
+    QJsonArray heaps;
+    for (int i = 0; i < m_heapCount; ++i) {
+        const Heap &h(m_heaps[i]);
+        QJsonObject heap = usageToJson(h.total);
+        heap.insert(QLatin1String("index"), i);
+        heap.insert(QLatin1String("size"), double(h.size));
+        heap.insert(QLatin1String("deviceLocal"), bool(h.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT));
+        heap.insert(QLatin1String("fractionOfSize"), h.size ? double(h.total.current) / h.size : 0.0);
+        if (h.budget) {
+            heap.insert(QLatin1String("budget"), double(h.budget));
+            heap.insert(QLatin1String("budgetUsage"), double(h.budgetUsage));
+        }
+        QJsonObject heapCategories;
+        for (int c = 0; c < CategoryCount; ++c) {
+            if (h.categories[c].peak)
+                heapCategories.insert(QLatin1String(categoryName(Category(c))), usageToJson(h.categories[c]));
+        }
+        heap.insert(QLatin1String("categories"), heapCategories);
+        heaps.append(heap);
+    }
+    root.insert(QLatin1String("heaps"), heaps);
+    return root;
+}
+
+bool MemoryTracker::writeJson(const QString &fileName) const
+{
+    // replaced atomically, for whatever is polling the file
+    QSaveFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly)) {
+        qWarning("Failed to open %s: %s", qPrintable(fileName), qPrintable(f.errorString()));
+        return false;
+    }
+    f.write(QJsonDocument(toJson()).toJson());
+    if (!f.commit()) {
+        qWarning("Failed to write %s: %s", qPrintable(fileName), qPrintable(f.errorString()));
+        return false;
+    }
+    return true;
+}
+
+void MemoryTracker::log() const
+{
+    QMutexLocker lock(&m_mutex);
+    for (int i = 0; i < m_heapCount; ++i) {
+        const Heap &h(m_heaps[i]);
+        if (!h.total.peak)
+            continue;
+        QByteArray categories;
+        for (int c = 0; c < CategoryCount; ++c) {
+            if (h.categories[c].current) {
+                categories += QByteArray(categories.isEmpty() ? "" : ", ") + categoryName(Category(c))
+                        + ' ' + QByteArray::number(toMB(h.categories[c].current), 'f', 1);
+            }
+        }
+        qDebug("memory heap %d (%s, %.1f MB): %.1f MB, peak %.1f MB, %.1f%% of the heap%s%s%s",
+               i, h.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT ? "device local" : "host",
+               toMB(h.size), toMB(h.total.current), toMB(h.total.peak),
+               h.size ? 100.0 * h.total.current / h.size : 0.0,
+               categories.isEmpty() ? "" : " (", categories.constData(), categories.isEmpty() ? "" : ")");
+    }
+}
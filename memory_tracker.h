@@ -0,0 +1,162 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef MEMORY_TRACKER_H
+#define MEMORY_TRACKER_H
+
+#include <QVulkanInstance>
+#include <QHash>
+#include <QMutex>
+#include <QJsonObject>
+
+// Accounts for device memory by category and by heap, with the current and
+// the peak number of bytes for each. Everything allocated through
+// VulkanDevice::allocateMemory() (so createBuffer() and createImage() as
+// well) is tracked per VkDeviceMemory. What QRhi allocates on its own is not
+// visible from here, so the windows report their QRhi buffers and textures
+// as totals via setExternalBytes() instead.
+//
+// The heaps are compared against their size and, with VK_EXT_memory_budget,
+// against the budget the implementation reports (which also covers other
+// processes). A warning gets logged once per heap when the tracked bytes go
+// over WARNING_FRACTION of that. Thread safe.
+
+class MemoryTracker
+{
+public:
+    enum Category {
+        AccelerationStructures,
+        Scratch,
+        Instances,
+        ShaderBindingTable,
+        Staging,
+        Buffers, // other native buffers
+        Images, // native images
+        RhiBuffers,
+        RhiTextures,
+        CategoryCount
+    };
+    static const char *categoryName(Category category);
+
+    struct Usage {
+        quint64 current = 0;
+        quint64 peak = 0;
+    };
+
+    static constexpr double WARNING_FRACTION = 0.9;
+
+    void create(const VkPhysicalDeviceMemoryProperties &memProps);
+
+    int heapCount() const { return m_heapCount; }
+    VkDeviceSize heapSize(int heap) const;
+    VkMemoryHeapFlags heapFlags(int heap) const;
+    int heapOfMemoryType(uint32_t memoryTypeIndex) const;
+    // the heap of the first memory type with all of memFlags, -1 if none
+    int heapOf(VkMemoryPropertyFlags memFlags) const;
+
+    void allocated(VkDeviceMemory mem, Category category, uint32_t memoryTypeIndex, VkDeviceSize size);
+    void freed(VkDeviceMemory mem);
+    // replaces what owner reported for category on heap before
+    void setExternalBytes(const void *owner, Category category, int heap, quint64 bytes);
+
+    // VK_EXT_memory_budget's view of all heaps, 0 when unknown
+    void setBudget(const VkDeviceSize *heapBudget, const VkDeviceSize *heapUsage);
+
+    Usage usage(int heap) const;
+    Usage usage(int heap, Category category) const;
+    Usage usage(Category category) const; // all heaps
+    Usage total() const;
+    int allocationCount() const;
+
+    QJsonObject toJson() const;
+    bool writeJson(const QString &fileName) const;
+    void log() const;
+
+private:
+    void add(Category category, int heap, quint64 bytes);
+    void subtract(Category category, int heap, quint64 bytes);
+    static void add(Usage *usage, quint64 bytes);
+
+    struct Heap {
+        VkDeviceSize size = 0;
+        VkMemoryHeapFlags flags = 0;
+        VkDeviceSize budget = 0;
+        VkDeviceSize budgetUsage = 0;
+        Usage total;
+        Usage categories[CategoryCount];
+        bool warned = false;
+    };
+    struct Allocation {
+        Category category;
+        int heap;
+        quint64 size;
+    };
+    struct ExternalKey {
+        const void *owner;
+        int category;
+        int heap;
+        bool operator==(const ExternalKey &other) const {
+            return owner == other.owner && category == other.category && heap == other.heap;
+        }
+    };
+    friend uint qHash(const ExternalKey &key, uint seed);
+
+    mutable QMutex m_mutex;
+    int m_heapCount = 0;
+    Heap m_heaps[VK_MAX_MEMORY_HEAPS];
+    uint32_t m_memoryTypeCount = 0;
+    VkMemoryType m_memoryTypes[VK_MAX_MEMORY_TYPES];
+    Usage m_categories[CategoryCount];
+    Usage m_total;
+    QHash<quint64, Allocation> m_allocations; // by VkDeviceMemory
+    QHash<ExternalKey, quint64> m_external;
+};
+
+#endif
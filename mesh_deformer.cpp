@@ -0,0 +1,277 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "mesh_deformer.h"
+#include <QMatrix4x4>
+#include <QtMath>
+
+struct DeformPushConstants // as in deform.comp
+{
+    quint32 vertexCount;
+    quint32 firstBone;
+};
+
+static const int FLOATS_PER_REST_VERTEX = 8; // RestVertex in deform.comp
+static const float BEND_ANGLE = 20.0f; // degrees per joint, at most
+static const float BEND_SPEED = 2.0f; // radians per second
+
+QByteArray MeshDeformer::restVertices(const SceneMesh &mesh, float *minY, float *maxY)
+{
+    const int vertexCount = mesh.vertexCount();
+    const float *v = mesh.vertices.constData();
+    *minY = vertexCount ? v[1] : 0.0f;
+    *maxY = *minY;
+    for (int i = 1; i < vertexCount; ++i) {
+        *minY = qMin(*minY, v[i * SceneMesh::FLOATS_PER_VERTEX + 1]);
+        *maxY = qMax(*maxY, v[i * SceneMesh::FLOATS_PER_VERTEX + 1]);
+    }
+    const float boneScale = (BONES_PER_MESH - 1) / qMax(*maxY - *minY, 1e-6f);
+
+    QByteArray data(vertexCount * FLOATS_PER_REST_VERTEX * int(sizeof(float)), Qt::Uninitialized);
+    float *p = reinterpret_cast<float *>(data.data());
+    for (int i = 0; i < vertexCount; ++i) {
+        const float *vertex = v + i * SceneMesh::FLOATS_PER_VERTEX;
+        *p++ = vertex[0];
+        *p++ = vertex[1];
+        *p++ = vertex[2];
+        *p++ = (vertex[1] - *minY) * boneScale;
+        *p++ = vertex[3];
+        *p++ = vertex[4];
+        *p++ = vertex[5];
+        *p++ = 0.0f;
+    }
+    return data;
+}
+
+bool MeshDeformer::create(const VulkanDevice *vk, const QByteArray &spirv, const QVector<Mesh> &meshes, int framesInFlight)
+{
+    m_vk = vk;
+    m_meshes = meshes;
+
+    VkDescriptorSetLayoutBinding bindings[4] = {};
+    for (uint32_t i = 0; i < 4; ++i) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 4;
+    layoutInfo.pBindings = bindings;
+    VkResult err = vk->df->vkCreateDescriptorSetLayout(vk->dev, &layoutInfo, nullptr, &m_setLayout);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to create deformer descriptor set layout: %d", err);
+        return false;
+    }
+
+    const VkPushConstantRange pushConstantRange = { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DeformPushConstants) };
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &m_setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    err = vk->df->vkCreatePipelineLayout(vk->dev, &pipelineLayoutInfo, nullptr, &m_pipelineLayout);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to create deformer pipeline layout: %d", err);
+        return false;
+    }
+
+    VkShaderModuleCreateInfo shaderInfo = {};
+    shaderInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderInfo.codeSize = size_t(spirv.size());
+    shaderInfo.pCode = reinterpret_cast<const quint32 *>(spirv.constData());
+    VkShaderModule shaderModule;
+    err = vk->df->vkCreateShaderModule(vk->dev, &shaderInfo, nullptr, &shaderModule);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to create deformer shader module: %d", err);
+        return false;
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = m_pipelineLayout;
+    err = vk->df->vkCreateComputePipelines(vk->dev, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline);
+    vk->df->vkDestroyShaderModule(vk->dev, shaderModule, nullptr);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to create deformer pipeline: %d", err);
+        m_pipeline = VK_NULL_HANDLE;
+        return false;
+    }
+
+    const VkDeviceSize boneBufSize = VkDeviceSize(framesInFlight) * VkDeviceSize(meshes.count()) * BONES_PER_MESH * 16 * sizeof(float);
+    err = vk->createBuffer(boneBufSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                           &m_boneBuf, &m_boneBufMem);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to create bone buffer: %d", err);
+        return false;
+    }
+    err = vk->df->vkMapMemory(vk->dev, m_boneBufMem, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void **>(&m_bones));
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to map bone buffer: %d", err);
+        return false;
+    }
+
+    const uint32_t setCount = uint32_t(meshes.count());
+    const VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 * setCount };
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = setCount;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    err = vk->df->vkCreateDescriptorPool(vk->dev, &poolInfo, nullptr, &m_descPool);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to create deformer descriptor pool: %d", err);
+        return false;
+    }
+
+    QVector<VkDescriptorSetLayout> setLayouts(int(setCount), m_setLayout);
+    m_descSets.resize(int(setCount));
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = m_descPool;
+    allocInfo.descriptorSetCount = setCount;
+    allocInfo.pSetLayouts = setLayouts.constData();
+    err = vk->df->vkAllocateDescriptorSets(vk->dev, &allocInfo, m_descSets.data());
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to allocate deformer descriptor sets: %d", err);
+        return false;
+    }
+
+    // the buffers never change, the frame slot's bones are selected with firstBone
+    for (int i = 0; i < meshes.count(); ++i) {
+        const Mesh &mesh(meshes[i]);
+        const VkDescriptorBufferInfo bufferInfos[4] = {
+            { mesh.rest, 0, VK_WHOLE_SIZE },
+            { mesh.positions, 0, VK_WHOLE_SIZE },
+            { mesh.attributes, 0, VK_WHOLE_SIZE },
+            { m_boneBuf, 0, VK_WHOLE_SIZE }
+        };
+        VkWriteDescriptorSet writes[4] = {};
+        for (uint32_t binding = 0; binding < 4; ++binding) {
+            writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[binding].dstSet = m_descSets[i];
+            writes[binding].dstBinding = binding;
+            writes[binding].descriptorCount = 1;
+            writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[binding].pBufferInfo = &bufferInfos[binding];
+        }
+        vk->df->vkUpdateDescriptorSets(vk->dev, 4, writes, 0, nullptr);
+    }
+
+    return true;
+}
+
+void MeshDeformer::destroy()
+{
+    if (!m_vk)
+        return;
+
+    if (m_boneBuf) {
+        m_vk->df->vkUnmapMemory(m_vk->dev, m_boneBufMem);
+        m_vk->destroyBuffer(m_boneBuf, m_boneBufMem);
+        m_boneBuf = VK_NULL_HANDLE;
+        m_boneBufMem = VK_NULL_HANDLE;
+        m_bones = nullptr;
+    }
+
+    m_vk->df->vkDestroyDescriptorPool(m_vk->dev, m_descPool, nullptr);
+    m_descPool = VK_NULL_HANDLE;
+    m_descSets.clear();
+    m_vk->df->vkDestroyPipeline(m_vk->dev, m_pipeline, nullptr);
+    m_pipeline = VK_NULL_HANDLE;
+    m_vk->df->vkDestroyPipelineLayout(m_vk->dev, m_pipelineLayout, nullptr);
+    m_pipelineLayout = VK_NULL_HANDLE;
+    m_vk->df->vkDestroyDescriptorSetLayout(m_vk->dev, m_setLayout, nullptr);
+    m_setLayout = VK_NULL_HANDLE;
+    m_meshes.clear();
+    m_vk = nullptr;
+}
+
+void MeshDeformer::record(VkCommandBuffer cb, int frameSlot, float time, int meshCount)
+{
+    meshCount = qMin(meshCount, m_meshes.count());
+    if (meshCount <= 0)
+        return;
+
+    m_vk->df->vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    for (int i = 0; i < meshCount; ++i) {
+        const Mesh &mesh(m_meshes[i]);
+
+        // Each bone rotates about its joint at the bottom of its segment,
+        // carrying along the bones above. Bone 0 is the root and stays put.
+        const quint32 firstBone = quint32((frameSlot * m_meshes.count() + i) * BONES_PER_MESH);
+        float *bones = m_bones + firstBone * 16;
+        const float segment = (mesh.maxY - mesh.minY) / (BONES_PER_MESH - 1);
+        QMatrix4x4 m;
+        for (int bone = 0; bone < BONES_PER_MESH; ++bone) {
+            if (bone > 0) {
+                // out of phase per mesh and per joint, for something that looks less mechanical
+                const float angle = BEND_ANGLE * qSin(BEND_SPEED * time + 0.37f * i + 0.8f * bone);
+                const float jointY = mesh.minY + (bone - 0.5f) * segment;
+                m.translate(0.0f, jointY, 0.0f);
+                m.rotate(angle, 0.0f, 0.0f, 1.0f);
+                m.translate(0.0f, -jointY, 0.0f);
+            }
+            memcpy(bones + bone * 16, m.constData(), 16 * sizeof(float));
+        }
+
+        m_vk->df->vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descSets[i], 0, nullptr);
+        const DeformPushConstants pc = { quint32(mesh.vertexCount), firstBone };
+        m_vk->df->vkCmdPushConstants(cb, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pc), &pc);
+        m_vk->df->vkCmdDispatch(cb, uint32_t(mesh.vertexCount + 63) / 64, 1, 1);
+    }
+}
@@ -0,0 +1,110 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef MESH_DEFORMER_H
+#define MESH_DEFORMER_H
+
+#include "vulkan_device.h"
+#include "scene.h"
+#include <QByteArray>
+#include <QVector>
+
+// GPU skinning (deform.comp) of the meshes animated every frame. Each mesh
+// gets a chain of BONES_PER_MESH bones along its Y axis, bending back and
+// forth about Z, with every vertex weighted between the two bones nearest to
+// its rest height. The bone matrices are calculated on the CPU into a host
+// visible buffer with a range per frame slot. The rest pose is read from a
+// buffer of its own, the results overwrite the mesh's positions (the BLAS
+// input) and the normals in its attributes.
+//
+// Recording the dispatches is all this does; the barriers before and after,
+// and what to do with the BLASes, is up to the caller.
+
+class MeshDeformer
+{
+public:
+    static const int BONES_PER_MESH = 4;
+
+    struct Mesh {
+        VkBuffer rest; // restVertices()
+        VkBuffer positions; // float xyz
+        VkBuffer attributes; // normal xyz, uv
+        int vertexCount;
+        float minY; // the rest pose's extent the bones span
+        float maxY;
+    };
+
+    // the rest pose in the layout deform.comp wants, and its extent in Y
+    static QByteArray restVertices(const SceneMesh &mesh, float *minY, float *maxY);
+
+    bool create(const VulkanDevice *vk, const QByteArray &spirv, const QVector<Mesh> &meshes, int framesInFlight);
+    void destroy();
+    bool isValid() const { return m_pipeline != VK_NULL_HANDLE; }
+
+    int meshCount() const { return m_meshes.count(); }
+
+    // Poses the first meshCount meshes for time (in seconds) and records
+    // their dispatches.
+    void record(VkCommandBuffer cb, int frameSlot, float time, int meshCount);
+
+private:
+    const VulkanDevice *m_vk = nullptr;
+    QVector<Mesh> m_meshes;
+    VkDescriptorSetLayout m_setLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool m_descPool = VK_NULL_HANDLE;
+    QVector<VkDescriptorSet> m_descSets; // one per mesh
+    VkBuffer m_boneBuf = VK_NULL_HANDLE;
+    VkDeviceMemory m_boneBufMem = VK_NULL_HANDLE;
+    float *m_bones = nullptr; // mapped
+};
+
+#endif
@@ -0,0 +1,157 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "opacity_classifier.h"
+#include <QtMath>
+#include <QPointF>
+
+OpacityClassifier::OpacityClassifier(const QImage &texture, float uvScale, float alphaCutoff)
+    : m_uvScale(uvScale)
+{
+    const QImage image = texture.convertToFormat(QImage::Format_RGBA8888);
+    m_width = image.width();
+    m_height = image.height();
+    m_passes.resize(m_width * m_height);
+    // the same comparison the any-hit shader makes on the normalized value
+    const int cutoff = qCeil(alphaCutoff * 255.0f);
+    int passing = 0;
+    for (int y = 0; y < m_height; ++y) {
+        const uchar *line = image.constScanLine(y);
+        for (int x = 0; x < m_width; ++x) {
+            const bool pass = line[x * 4 + 3] >= cutoff;
+            m_passes[y * m_width + x] = pass;
+            passing += pass;
+        }
+    }
+    m_whole = passing == m_passes.count() ? Opaque : (passing ? Mixed : Transparent);
+}
+
+bool OpacityClassifier::passes(int x, int y) const
+{
+    x %= m_width;
+    y %= m_height;
+    if (x < 0)
+        x += m_width;
+    if (y < 0)
+        y += m_height;
+    return m_passes[y * m_width + x];
+}
+
+// squared distance of p from the triangle abc, 0 inside
+static float distanceSquared(const QPointF &p, const QPointF tri[3])
+{
+    const QPointF &a(tri[0]);
+    const QPointF &b(tri[1]);
+    const QPointF &c(tri[2]);
+    const qreal area = (b.x() - a.x()) * (c.y() - a.y()) - (b.y() - a.y()) * (c.x() - a.x());
+    const qreal w0 = (b.x() - p.x()) * (c.y() - p.y()) - (b.y() - p.y()) * (c.x() - p.x());
+    const qreal w1 = (c.x() - p.x()) * (a.y() - p.y()) - (c.y() - p.y()) * (a.x() - p.x());
+    const qreal w2 = (a.x() - p.x()) * (b.y() - p.y()) - (a.y() - p.y()) * (b.x() - p.x());
+    // either winding
+    if (area != 0 && ((w0 >= 0 && w1 >= 0 && w2 >= 0) || (w0 <= 0 && w1 <= 0 && w2 <= 0)))
+        return 0.0f;
+
+    qreal d = qInf();
+    for (int i = 0; i < 3; ++i) {
+        const QPointF &e0(tri[i]);
+        const QPointF &e1(tri[(i + 1) % 3]);
+        const QPointF e = e1 - e0;
+        const qreal len2 = QPointF::dotProduct(e, e);
+        const qreal t = len2 > 0 ? qBound(0.0, QPointF::dotProduct(p - e0, e) / len2, 1.0) : 0.0;
+        const QPointF q = e0 + t * e - p;
+        d = qMin(d, QPointF::dotProduct(q, q));
+    }
+    return float(d);
+}
+
+OpacityClassifier::Coverage OpacityClassifier::classify(const SceneMesh &mesh, int triangle) const
+{
+    if (m_whole != Mixed)
+        return m_whole;
+
+    // the corners in texel space, texel centers are at integer + 0.5
+    QPointF tri[3];
+    qreal minX = qInf(), minY = qInf(), maxX = -qInf(), maxY = -qInf();
+    for (int i = 0; i < 3; ++i) {
+        const float *v = mesh.vertices.constData() + mesh.indices[triangle * 3 + i] * SceneMesh::FLOATS_PER_VERTEX;
+        tri[i] = QPointF(v[6] * m_uvScale * m_width, v[7] * m_uvScale * m_height);
+        minX = qMin(minX, tri[i].x());
+        minY = qMin(minY, tri[i].y());
+        maxX = qMax(maxX, tri[i].x());
+        maxY = qMax(maxY, tri[i].y());
+    }
+
+    // Bilinear filtering blends the texels whose centers are less than a
+    // texel away on both axes, a distance of at most sqrt(2).
+    static const float REACH = 1.5f;
+    const int x0 = qFloor(minX - REACH);
+    const int y0 = qFloor(minY - REACH);
+    const int x1 = qCeil(maxX + REACH);
+    const int y1 = qCeil(maxY + REACH);
+    // not worth walking more texels than the texture has, mixed is always safe
+    if (qint64(x1 - x0) * (y1 - y0) >= qint64(m_width) * m_height)
+        return Mixed;
+
+    int passing = 0;
+    int failing = 0;
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            if (distanceSquared(QPointF(x + 0.5, y + 0.5), tri) > REACH * REACH)
+                continue;
+            if (passes(x, y))
+                ++passing;
+            else
+                ++failing;
+            if (passing && failing)
+                return Mixed;
+        }
+    }
+    return failing ? Transparent : Opaque;
+}
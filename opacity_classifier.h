@@ -0,0 +1,92 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef OPACITY_CLASSIFIER_H
+#define OPACITY_CLASSIFIER_H
+
+#include "scene.h"
+
+// Classifies triangles by the alpha test result over their footprint in a
+// texture. A triangle passing the test everywhere can go into opaque
+// geometry, one failing it everywhere can be dropped; only the rest need
+// the any-hit shader. The footprint is widened by the bilinear filter's
+// reach and wraps around like the material sampler does, so the
+// classification is conservative: a mixed triangle may well turn out to be
+// fully opaque, never the other way around.
+
+class OpacityClassifier
+{
+public:
+    enum Coverage : quint8 {
+        Opaque,
+        Transparent,
+        Mixed
+    };
+
+    // texture as in SceneMaterial: sampled at uv * uvScale, level 0 only,
+    // alpha below alphaCutoff is discarded
+    OpacityClassifier(const QImage &texture, float uvScale, float alphaCutoff);
+
+    Coverage classify(const SceneMesh &mesh, int triangle) const;
+
+    // the coverage of a triangle shared by two materials
+    static Coverage combine(Coverage a, Coverage b) { return a == b ? a : Mixed; }
+
+private:
+    bool passes(int x, int y) const;
+
+    int m_width;
+    int m_height;
+    float m_uvScale;
+    QVector<quint8> m_passes; // per texel, 1 where alpha >= the cutoff
+    Coverage m_whole; // of the entire texture, for footprints covering all of it
+};
+
+#endif
@@ -0,0 +1,28 @@
+// The payload of the rays, shared by raygen.rgen, closesthit.rchit,
+// closesthit_sphere.rchit and miss.rmiss. All but the sphere hit shader are
+// compiled a second time with INLINE_SHADING defined, in which case the hit
+// shader only reports what was hit and the raygen shader fetches the surface
+// attributes. The lighting is always done in the raygen shader. Shadow and
+// AO rays normally use the occlusion ray type with its own payload instead
+// (see miss_occlusion.rmiss).
+
+const vec3 MISS_COLOR = vec3(0.0, 0.0, 0.2);
+
+#ifdef INLINE_SHADING
+struct RayPayload
+{
+    uint instance; // gl_InstanceCustomIndexNV
+    uint lod;
+    uint primitive;
+    float hitT; // negative for a miss
+    vec2 baryCoord;
+    mat3 worldToObject;
+};
+#else
+struct RayPayload
+{
+    vec3 albedo;
+    float hitT; // negative for a miss
+    vec3 normal;
+};
+#endif
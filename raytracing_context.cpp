@@ -0,0 +1,86 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "raytracing_context.h"
+#include "raytracing_window.h"
+
+void RaytracingContext::addWindow(RaytracingWindow *window)
+{
+    m_windows.append(window);
+    m_memoryUsage.append(MemoryUsage());
+    window->setContext(this);
+}
+
+void RaytracingContext::reportMemoryUsage(const RaytracingWindow *window, quint64 sharedBytes, quint64 perWindowBytes)
+{
+    const int idx = m_windows.indexOf(const_cast<RaytracingWindow *>(window));
+    if (idx < 0)
+        return;
+
+    m_memoryUsage[idx].reported = true;
+    m_memoryUsage[idx].sharedBytes = sharedBytes;
+    m_memoryUsage[idx].perWindowBytes = perWindowBytes;
+
+    quint64 shared = 0;
+    quint64 perWindow = 0;
+    for (const MemoryUsage &usage : m_memoryUsage) {
+        if (!usage.reported)
+            return;
+        shared += usage.sharedBytes;
+        perWindow += usage.perWindowBytes;
+    }
+
+    // without sharing every window would have its own copy of everything
+    const quint64 total = shared + perWindow;
+    const quint64 unshared = shared * quint64(m_windows.count()) + perWindow;
+    qDebug("%d windows on one device and scene: shared %llu bytes, per window %llu bytes (all windows), "
+           "total %llu bytes; with a device and scene per window it would be %llu bytes (%.2fx)",
+           m_windows.count(), shared, perWindow, total, unshared, double(unshared) / qMax<quint64>(1, total));
+}
@@ -0,0 +1,95 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef RAYTRACING_CONTEXT_H
+#define RAYTRACING_CONTEXT_H
+
+#include <QVector>
+
+class RaytracingWindow;
+
+// Lets multiple RaytracingWindows show the same scene. The first window added
+// is the owner: it creates the device, the scene, the acceleration
+// structures, the ray tracing pipeline and the shader binding table, and
+// records all uploads and builds in its frames. The others are views that
+// import the owner's VkDevice into their own QRhi and have nothing but their
+// swapchain, output texture, uniform buffer and descriptor sets, the latter
+// referencing the owner's resources. Everything is submitted to the same
+// queue, so submission order plus a barrier at the start of each view's trace
+// is enough to see the results of the owner's builds.
+//
+// The windows are not owned by the context. Add all of them before any gets
+// shown, and destroy the owner last.
+
+class RaytracingContext
+{
+public:
+    void addWindow(RaytracingWindow *window);
+
+    RaytracingWindow *owner() const { return m_windows.isEmpty() ? nullptr : m_windows.first(); }
+    int windowCount() const { return m_windows.count(); }
+
+    // Called by each window once its resources are created. sharedBytes is
+    // what a window would need on its own device without sharing (only
+    // reported by the owner), perWindowBytes is what every window needs
+    // regardless. Logs a summary when all windows have reported.
+    void reportMemoryUsage(const RaytracingWindow *window, quint64 sharedBytes, quint64 perWindowBytes);
+
+private:
+    struct MemoryUsage {
+        bool reported = false;
+        quint64 sharedBytes = 0;
+        quint64 perWindowBytes = 0;
+    };
+    QVector<RaytracingWindow *> m_windows;
+    QVector<MemoryUsage> m_memoryUsage;
+};
+
+#endif
@@ -1,14 +1,64 @@
 TEMPLATE = app
 
-QT += gui-private
+QT += gui-private core-private network
 
 SOURCES = \
     main.cpp \
     window.cpp \
-    raytracing_window.cpp
+    raytracing_window.cpp \
+    shader_binding_table.cpp \
+    vulkan_device.cpp \
+    staging_ring.cpp \
+    device_buffer.cpp \
+    gpu_timer.cpp \
+    blas_builder.cpp \
+    scene.cpp \
+    async_compute_queue.cpp \
+    vertex_quantization.cpp \
+    instance_packer.cpp \
+    cpu_profiler.cpp \
+    raytracing_context.cpp \
+    denoiser.cpp \
+    gbuffer_pass.cpp \
+    blas_residency.cpp \
+    software_tracer.cpp \
+    tile_farm.cpp \
+    frame_capture.cpp \
+    frame_graph.cpp \
+    opacity_classifier.cpp \
+    mesh_deformer.cpp \
+    geometry_registry.cpp \
+    memory_tracker.cpp \
+    startup_timeline.cpp \
+    benchmark_runner.cpp
 
 HEADERS = \
     window.h \
-    raytracing_window.h
+    raytracing_window.h \
+    shader_binding_table.h \
+    vulkan_device.h \
+    staging_ring.h \
+    device_buffer.h \
+    gpu_timer.h \
+    blas_builder.h \
+    scene.h \
+    async_compute_queue.h \
+    vertex_quantization.h \
+    instance_packer.h \
+    cpu_profiler.h \
+    raytracing_context.h \
+    denoiser.h \
+    gbuffer_pass.h \
+    blas_residency.h \
+    software_tracer.h \
+    tile_farm.h \
+    frame_capture.h \
+    frame_graph.h \
+    opacity_classifier.h \
+    mesh_deformer.h \
+    geometry_registry.h \
+    memory_tracker.h \
+    startup_timeline.h \
+    benchmark_runner.h
 
 RESOURCES = raytracing_nvx.qrc
@@ -56,6 +56,8 @@
 #include "raytracing_window.h"
 #include <QVulkanFunctions>
 #include <QFile>
+#include <QThread>
+#include <QtMath>
 #include <QtGui/private/qshader_p.h>
 
 QShader getShader(const QString &name)
@@ -85,12 +87,6 @@ QByteArray getSpirv(const QString &name)
 // winding order being determined in Y down object space against our Y up
 // front=CCW data... or whatever)
 
-static float vertexData[] = {
-     0.0f,   1.0f,  0.0f,
-    -1.0f,  -1.0f,  0.0f,
-     1.0f,  -1.0f,  0.0f
-};
-
 static float quadVertexAndCoordData[] = {
   -1.0f,   1.0f,   0.0f, 0.0f,
   -1.0f,  -1.0f,   0.0f, 1.0f,
@@ -102,32 +98,173 @@ static float quadVertexAndCoordData[] = {
 
 RaytracingWindow::~RaytracingWindow()
 {
+    // startup may still be running when closing right away
+    m_startupPool.waitForDone();
+
+    // with the peaks of the whole run
+    if (!isView() && !m_options.memoryReportFile.isEmpty())
+        writeMemoryReport();
+
     const QRhiVulkanNativeHandles *h = static_cast<const QRhiVulkanNativeHandles *>(m_rhi->nativeHandles());
     QVulkanDeviceFunctions *df = vulkanInstance()->deviceFunctions(h->dev);
 
     df->vkDestroyDescriptorPool(h->dev, m_rayDescPool, nullptr);
+    m_vk.destroyBuffer(m_anyHitCounterBuf, m_anyHitCounterBufMem);
     df->vkDestroyDescriptorSetLayout(h->dev, m_rayDescSetLayout, nullptr);
     df->vkDestroyPipelineLayout(h->dev, m_rayPipelineLayout, nullptr);
     df->vkDestroyPipeline(h->dev, m_rayPipeline, nullptr);
 
-    destroyAccelerationStructure(h->dev, m_blas, nullptr);
-    df->vkFreeMemory(h->dev, m_blasMem, nullptr);
+    m_asyncQueue.destroy();
+    releaseAccelerationStructureSet(&m_asyncBuild);
+    for (AccelerationStructureSet &set : m_retiredAccelSets)
+        releaseAccelerationStructureSet(&set);
+    m_asyncBlasBuilder.destroy();
+
+    for (RayMesh &mesh : m_meshes) {
+        destroyAccelerationStructure(h->dev, mesh.blas, nullptr);
+        m_vk.freeMemory(mesh.blasMem);
+    }
+    destroyAccelerationStructure(h->dev, m_placeholderBlas, nullptr);
+    m_vk.freeMemory(m_placeholderBlasMem);
+    m_vk.destroyBuffer(m_placeholderVertexBuf, m_placeholderVertexBufMem);
     destroyAccelerationStructure(h->dev, m_tlas, nullptr);
-    df->vkFreeMemory(h->dev, m_tlasMem, nullptr);
+    m_vk.freeMemory(m_tlasMem);
 
 #if 0
     df->vkFreeMemory(h->dev, m_geometryTransformBufMem, nullptr);
     df->vkDestroyBuffer(h->dev, m_geometryTransformBuf, nullptr);
 #endif
-    df->vkFreeMemory(h->dev, m_scratchBufMem, nullptr);
+    m_vk.freeMemory(m_scratchBufMem);
     df->vkDestroyBuffer(h->dev, m_scratchBuf, nullptr);
-    df->vkFreeMemory(h->dev, m_instanceBufMem, nullptr);
-    df->vkDestroyBuffer(h->dev, m_instanceBuf, nullptr);
-    df->vkFreeMemory(h->dev, m_sbtBufMem, nullptr);
-    df->vkDestroyBuffer(h->dev, m_sbtBuf, nullptr);
+    m_blasBuilder.destroy();
+    m_instanceBuf.destroy();
+    m_sbtBuf.destroy();
+    m_staging.destroy();
+    const bool capturing = m_capture.isValid();
+    m_capture.destroy(); // waits for the frames being written
+    if (capturing && !m_captureReported)
+        reportCapture();
+    m_gpuTimer.destroy();
 
     for (VkImageView v : m_imageViews)
         df->vkDestroyImageView(h->dev, v, nullptr);
+    for (VkImageView v : m_materialTextureViews)
+        df->vkDestroyImageView(h->dev, v, nullptr);
+    df->vkDestroySampler(h->dev, m_materialSampler, nullptr);
+
+    m_vk.destroyImage(m_viewImage, m_viewImageMem, m_viewImageView);
+    m_denoiser.destroy();
+    m_benchmarkDenoiser.destroy();
+    m_gbuffer.destroy();
+    m_deformer.destroy();
+    m_vk.destroyImage(m_denoiseBenchmarkImage, m_denoiseBenchmarkImageMem, m_denoiseBenchmarkImageView);
+    for (const RetiredImage &retired : m_retiredViewImages)
+        m_vk.destroyImage(retired.image, retired.mem, retired.view);
+}
+
+// Creates the acceleration structure and binds dedicated memory to it.
+// Returns the size of that memory. scratchMemReq covers updates as well when
+// the flags allow those.
+VkDeviceSize RaytracingWindow::allocateAccelerationStructure(const VkAccelerationStructureInfoNV &info,
+                                                             VkAccelerationStructureNV *as,
+                                                             VkDeviceMemory *mem,
+                                                             uint64_t *handle,
+                                                             VkMemoryRequirements *scratchMemReq)
+{
+    VkAccelerationStructureCreateInfoNV accelCreateInfo = {};
+    accelCreateInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_NV;
+    accelCreateInfo.info = info;
+    VkResult err = createAccelerationStructure(m_vk.dev, &accelCreateInfo, nullptr, as);
+    if (err != VK_SUCCESS)
+        qFatal("Failed to create acceleration structure: %d", err);
+
+    VkAccelerationStructureMemoryRequirementsInfoNV memReqInfo = {};
+    memReqInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_INFO_NV;
+    memReqInfo.type = VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_OBJECT_NV;
+    memReqInfo.accelerationStructure = *as;
+    VkMemoryRequirements2 memReq = {};
+    memReq.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    getAccelerationStructureMemoryRequirements(m_vk.dev, &memReqInfo, &memReq);
+
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memReq.memoryRequirements.size;
+    allocInfo.memoryTypeIndex = m_vk.findMemTypeIndex(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memReq.memoryRequirements);
+    err = m_vk.allocateMemory(allocInfo, MemoryTracker::AccelerationStructures, mem);
+    if (err != VK_SUCCESS)
+        qFatal("Failed to allocate memory for acceleration structure: %d", err);
+
+    VkBindAccelerationStructureMemoryInfoNV accelMemInfo = {};
+    accelMemInfo.sType = VK_STRUCTURE_TYPE_BIND_ACCELERATION_STRUCTURE_MEMORY_INFO_NV;
+    accelMemInfo.accelerationStructure = *as;
+    accelMemInfo.memory = *mem;
+    bindAccelerationStructureMemory(m_vk.dev, 1, &accelMemInfo);
+
+    getAccelerationStructureHandle(m_vk.dev, *as, sizeof(uint64_t), handle);
+
+    if (scratchMemReq) {
+        memReqInfo.type = VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_BUILD_SCRATCH_NV;
+        getAccelerationStructureMemoryRequirements(m_vk.dev, &memReqInfo, &memReq);
+        *scratchMemReq = memReq.memoryRequirements;
+        if (info.flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_NV) {
+            memReqInfo.type = VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_UPDATE_SCRATCH_NV;
+            getAccelerationStructureMemoryRequirements(m_vk.dev, &memReqInfo, &memReq);
+            scratchMemReq->size = qMax(scratchMemReq->size, memReq.memoryRequirements.size);
+            scratchMemReq->alignment = qMax(scratchMemReq->alignment, memReq.memoryRequirements.alignment);
+            scratchMemReq->memoryTypeBits &= memReq.memoryRequirements.memoryTypeBits;
+        }
+    }
+
+    return allocInfo.allocationSize;
+}
+
+// The memory allocateAccelerationStructure() would need, without keeping
+// anything allocated. The acceleration structure object is only created to
+// be able to query its requirements.
+VkDeviceSize RaytracingWindow::accelerationStructureSize(const VkAccelerationStructureInfoNV &info,
+                                                         VkMemoryRequirements *scratchMemReq)
+{
+    VkAccelerationStructureCreateInfoNV accelCreateInfo = {};
+    accelCreateInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_NV;
+    accelCreateInfo.info = info;
+    VkAccelerationStructureNV as;
+    VkResult err = createAccelerationStructure(m_vk.dev, &accelCreateInfo, nullptr, &as);
+    if (err != VK_SUCCESS)
+        qFatal("Failed to create acceleration structure: %d", err);
+
+    VkAccelerationStructureMemoryRequirementsInfoNV memReqInfo = {};
+    memReqInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_INFO_NV;
+    memReqInfo.type = VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_OBJECT_NV;
+    memReqInfo.accelerationStructure = as;
+    VkMemoryRequirements2 memReq = {};
+    memReq.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    getAccelerationStructureMemoryRequirements(m_vk.dev, &memReqInfo, &memReq);
+    const VkDeviceSize size = memReq.memoryRequirements.size;
+
+    memReqInfo.type = VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_BUILD_SCRATCH_NV;
+    getAccelerationStructureMemoryRequirements(m_vk.dev, &memReqInfo, &memReq);
+    *scratchMemReq = memReq.memoryRequirements;
+
+    destroyAccelerationStructure(m_vk.dev, as, nullptr);
+    return size;
+}
+
+// The vertex formats VK_NV_ray_tracing accepts for triangle geometry. There
+// is no per-device query for this (unlike with the KHR extension), but keep
+// the check in one place for when there is.
+static bool blasSupportsVertexFormat(VkFormat format)
+{
+    switch (format) {
+    case VK_FORMAT_R32G32B32_SFLOAT:
+    case VK_FORMAT_R32G32_SFLOAT:
+    case VK_FORMAT_R16G16B16_SFLOAT:
+    case VK_FORMAT_R16G16_SFLOAT:
+    case VK_FORMAT_R16G16_SNORM:
+    case VK_FORMAT_R16G16B16_SNORM:
+        return true;
+    default:
+        return false;
+    }
 }
 
 struct GeometryInstance // as per spec
@@ -140,14 +277,224 @@ struct GeometryInstance // as per spec
     uint64_t accelerationStructureHandle;
 };
 
+// Y up -> Y down flip as explained above
+static QMatrix4x4 toInstanceTransform(const QMatrix4x4 &m)
+{
+    QMatrix4x4 flipped;
+    flipped.scale(1.0f, -1.0f, 1.0f);
+    return flipped * m;
+}
+
+// Points each instance to the BLAS of its mesh at the currently selected
+// level of detail, blasHandles is indexed by mesh.
+void RaytracingWindow::setInstanceBlasHandles(const QVector<uint64_t> &blasHandles)
+{
+    for (int i = 0; i < m_scene.instances.count(); ++i)
+        m_instanceTransforms.setBlasHandle(i, blasHandles[m_scene.instances[i].mesh + m_instanceLods[i]]);
+}
+
+// Picks the level of detail for each instance based on its projected size:
+// the coarsest level that still has a triangle per PIXELS_PER_TRIANGLE
+// covered pixels. Only the GeometryInstance entries of the instances that
+// switch levels get rewritten, and of those only the hit group offset (which
+// selects the hit record of the level) and the BLAS handle. Returns true if
+// any instance switched.
+bool RaytracingWindow::selectLods(const QSize &outputSizeInPixels)
+{
+    static const float PIXELS_PER_TRIANGLE = 8.0f;
+    const QVector3D eye = m_rayViewInverse.map(QVector3D(0, 0, 0));
+    // projected size of 1 unit at distance 1
+    const float pixelsPerUnit = m_rayProj(1, 1) * 0.5f * outputSizeInPixels.height();
+
+    bool changed = false;
+    qint64 triangles = 0;
+    for (int i = 0; i < m_scene.instances.count(); ++i) {
+        const int mesh = m_scene.instances[i].mesh;
+        const QVector4D &bounds(m_instanceBounds[i]);
+        int lod = 0;
+        const float distance = (bounds.toVector3D() - eye).length();
+        if (m_lodEnabled && distance > bounds.w()) {
+            const float projectedRadius = bounds.w() * pixelsPerUnit / distance;
+            const float wantedTriangles = float(M_PI) * projectedRadius * projectedRadius / PIXELS_PER_TRIANGLE;
+            for (lod = m_scene.lodCount - 1; lod > 0; --lod) {
+                if (m_scene.meshes[mesh + lod].triangleCount() >= wantedTriangles)
+                    break;
+            }
+        }
+        triangles += m_scene.meshes[mesh + lod].triangleCount();
+        if (lod == m_instanceLods[i])
+            continue;
+
+        changed = true;
+        m_instanceLods[i] = quint8(lod);
+        m_instanceTransforms.setHitGroupOffset(i, uint32_t(lod));
+        // with a BLAS budget the level may not be resident, updateResidency() sets the handle
+        if (!m_residency.isEnabled())
+            m_instanceTransforms.setBlasHandle(i, m_meshes[size_t(mesh + lod)].blasHandle);
+        // animated instances get packed completely every frame anyway
+        if (!m_options.animateInstances) {
+            const VkDeviceSize offset = VkDeviceSize(i) * sizeof(GeometryInstance);
+            m_instanceBuf.update(offset + offsetof(GeometryInstance, accelerationStructureHandle) - sizeof(quint32),
+                                 m_instanceTransforms.hitGroupOffsetAndFlags() + i, sizeof(quint32));
+            m_instanceBuf.update(offset + offsetof(GeometryInstance, accelerationStructureHandle),
+                                 m_instanceTransforms.blasHandles() + i, sizeof(quint64));
+        }
+    }
+
+    m_lodTrianglesReferenced = triangles;
+    return changed;
+}
+
+// Writes the contents of the instance buffer (GeometryInstance records,
+// referencing the BLAS of each mesh via blasHandles) to dst.
+void RaytracingWindow::packGeometryInstances(const QVector<uint64_t> &blasHandles, void *dst)
+{
+    Q_ASSERT(sizeof(GeometryInstance) == InstancePacker::INSTANCE_SIZE);
+    setInstanceBlasHandles(blasHandles);
+    m_instancePacker.pack(m_instanceTransforms, dst);
+}
+
+// Bobs the instances up and down, relative to their size. This is what
+// makes repacking the instances and rebuilding the TLAS necessary in every frame.
+void RaytracingWindow::animateInstances()
+{
+    const float t = m_animationTimer.elapsed() / 1000.0f;
+    float *translateY = m_instanceTransforms.components(7); // row 1, column 3
+    const float *scaleY = m_instanceTransforms.components(5);
+    const float *restY = m_instanceRestY.constData();
+    for (int i = 0; i < m_instanceTransforms.count(); ++i)
+        translateY[i] = restY[i] + 0.25f * qAbs(scaleY[i]) * qSin(2.0f * t + 0.37f * i);
+}
+
+// Packs all instances with and without AVX2, on one and on all threads, into
+// mapped host visible memory (like the staging ring or a host visible
+// instance buffer), then reports the throughput and checks the results
+// against the scalar version.
+void RaytracingWindow::runPackingBenchmark()
+{
+    static const int ITERATIONS = 20;
+    const int count = m_instanceTransforms.count();
+    const VkDeviceSize size = VkDeviceSize(count) * InstancePacker::INSTANCE_SIZE;
+
+    VkBuffer buf;
+    VkDeviceMemory mem;
+    VkResult err = m_vk.createBuffer(size, VK_BUFFER_USAGE_RAY_TRACING_BIT_NV,
+                                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                     &buf, &mem, MemoryTracker::Instances);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to create buffer for the packing benchmark: %d", err);
+        return;
+    }
+    quint8 *p = nullptr;
+    err = m_vk.df->vkMapMemory(m_vk.dev, mem, 0, size, 0, reinterpret_cast<void **>(&p));
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to map buffer for the packing benchmark: %d", err);
+        m_vk.destroyBuffer(buf, mem);
+        return;
+    }
+
+    QByteArray reference(int(size), Qt::Uninitialized);
+    InstancePacker::packRange(m_instanceTransforms, 0, count, reinterpret_cast<quint8 *>(reference.data()), false);
+
+    const int threadCounts[] = { 1, qMax(1, QThread::idealThreadCount()) };
+    InstancePacker packer;
+    for (bool simd : { false, true }) {
+        if (simd && !InstancePacker::hasAvx2()) {
+            qDebug("instance packing: no AVX2, skipping the SIMD variants");
+            continue;
+        }
+        for (int threadCount : threadCounts) {
+            packer.setThreadCount(threadCount);
+            packer.setSimdEnabled(simd);
+            packer.pack(m_instanceTransforms, p);
+            QElapsedTimer timer;
+            timer.start();
+            for (int i = 0; i < ITERATIONS; ++i)
+                packer.pack(m_instanceTransforms, p);
+            const double ms = timer.nsecsElapsed() / 1000000.0 / ITERATIONS;
+            qDebug("instance packing [%s, %d thread(s)]: %d instances in %.3f ms, %.0f instances/ms%s",
+                   simd ? "avx2" : "scalar", threadCount, count, ms, count / qMax(ms, 0.001),
+                   memcmp(p, reference.constData(), size_t(size)) ? ", MISMATCH" : "");
+        }
+    }
+
+    m_vk.df->vkUnmapMemory(m_vk.dev, mem);
+    m_vk.destroyBuffer(buf, mem);
+}
+
+static quint64 perWindowMemoryBytes(const QRhiTexture *tex, const QRhiBuffer *ubuf, int framesInFlight)
+{
+    // the output image and the Dynamic uniform buffer (one per frame in flight)
+    return quint64(tex->pixelSize().width()) * quint64(tex->pixelSize().height()) * 4
+            + quint64(framesInFlight) * quint64(ubuf->size());
+}
+
+Scene RaytracingOptions::createScene(GeometryRegistry *registry) const
+{
+    Scene scene;
+    if (sphereCount > 0) {
+        scene = Scene::createSphereCloud(sphereCount);
+        if (benchmarkSpheres) {
+            // both the procedural and the triangulated spheres go into the
+            // TLAS, with the instances of the one not being measured masked out
+            scene.triangulateSpheres(true);
+        } else if (triangulatedSpheres) {
+            scene.triangulateSpheres(false);
+        }
+    } else {
+        scene = meshCount > 0 ? Scene::createMeshGrid(meshCount) : Scene::createTriangle();
+    }
+    if (duplicateMeshes > 1)
+        scene.duplicateMeshes(duplicateMeshes);
+    if (instanceCount > 0)
+        scene.replicateInstances(instanceCount);
+    if (materialCount > 0)
+        scene.createMaterials(materialCount);
+    // identical meshes get one set of buffers and one BLAS; the generated
+    // meshes are all distinct, only the copies can be shared
+    if (duplicateMeshes > 1) {
+        GeometryRegistry localRegistry;
+        scene.deduplicateMeshes(registry ? registry : &localRegistry);
+    }
+    if (lodCount > 1)
+        scene.createLods(lodCount);
+    if (alphaTest) {
+        scene.cutOutMaterials(0.5f);
+        scene.classifyOpacity(benchmarkAlpha);
+    }
+    return scene;
+}
+
 void RaytracingWindow::customInit()
 {
-    Q_ASSERT(m_rhi->resourceLimit(QRhi::FramesInFlight) == 2); // not prepared to handle other values
+    m_framesInFlight = m_rhi->resourceLimit(QRhi::FramesInFlight);
+    const qint64 beginNs = m_startupTimeline.now();
 
     const QRhiVulkanNativeHandles *h = static_cast<const QRhiVulkanNativeHandles *>(m_rhi->nativeHandles());
     QVulkanInstance *inst = vulkanInstance();
     QVulkanFunctions *f = inst->functions();
-    QVulkanDeviceFunctions *df = inst->deviceFunctions(h->dev);
+
+    m_vk.create(inst, h->physDev, h->dev);
+    if (isView()) {
+        m_vk.memoryTracker = &m_context->owner()->m_memoryTracker;
+    } else {
+        m_memoryTracker.create(m_vk.memProps);
+        m_vk.memoryTracker = &m_memoryTracker;
+    }
+    if (m_hasMemoryBudget) {
+        getPhysicalDeviceMemoryProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(
+                    inst->getInstanceProcAddr("vkGetPhysicalDeviceMemoryProperties2KHR"));
+    }
+    m_frameGraph.create(&m_vk);
+    m_frameGraph.setBatching(!m_options.unbatchedBarriers);
+
+    if (!m_options.captureDirectory.isEmpty()) {
+        // the tiles never go through traceScene(), which records the copies
+        if (m_options.tileWorkerCount || m_options.benchmarkTileWorkers)
+            qWarning("Frame capture is not supported with tile workers");
+        else if (m_capture.create(&m_vk, m_options.captureDirectory, m_framesInFlight, m_options.captureFrameCount))
+            qDebug("capturing frames to %s", qPrintable(m_options.captureDirectory));
+    }
 
     PFN_vkGetPhysicalDeviceProperties2 getPhysicalDeviceProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2>(
                 inst->getInstanceProcAddr("vkGetPhysicalDeviceProperties2"));
@@ -227,31 +574,358 @@ void RaytracingWindow::customInit()
 
     // Now onto the raytracing resources
 
-    // Say no to boilerplate; will use QRhi and dig out the VkBuffers afterwards (same goes for the image)
-    m_vbuf.reset(m_rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::VertexBuffer, sizeof(vertexData)));
-    m_vbuf->create();
+    // the hit shader reads geometry and materials via descriptor arrays
+    if (!m_hasDescriptorIndexing)
+        qFatal("Bindless geometry and material access needs VK_EXT_descriptor_indexing");
+
+    // the guide image is always needed, the filter only with --denoise
+    const QByteArray denoiseSpirv = m_options.denoiseIterations > 0 ? getSpirv(QLatin1String(":/denoise.spv")) : QByteArray();
+    if ((m_options.denoiseIterations > 0 && denoiseSpirv.isEmpty()) || !m_denoiser.create(&m_vk, denoiseSpirv, m_framesInFlight))
+        qFatal("Failed to create denoiser");
+    m_denoiser.setIterationCount(m_options.denoiseIterations);
+    if (m_options.hasProceduralGeometry() && (m_options.inlineShading || m_options.benchmarkInlineShading)) {
+        // the raygen shader only knows how to fetch triangle attributes
+        qWarning("Procedural spheres: shading in the closest hit shader");
+        m_options.inlineShading = m_options.benchmarkInlineShading = false;
+    }
+    m_inlineShading = m_options.inlineShading;
+    if (m_inlineShading)
+        qDebug("shading in the raygen shader");
+    if (m_denoiser.isEnabled())
+        qDebug("denoising with %d iteration(s), %d sample(s) per pixel", m_denoiser.iterationCount(), qMax(1, m_options.samplesPerPixel));
+
+    // the rest waits for the owner, see pollStartup()
+    if (isView()) {
+        m_startupTimeline.record("ray tracing setup", beginNs, m_startupTimeline.now());
+        return;
+    }
+
+    if (isShared()) {
+        // The views use the instance buffer and the shader binding table with
+        // their own frame slots, so there must not be a copy per frame slot.
+        // They also keep tracing against the TLAS between the owner's
+        // frames, so the acceleration structures must not get swapped out
+        // and released based on the owner's frames only.
+        if (m_options.bufferPlacement == RaytracingOptions::HostVisiblePlacement || m_options.benchmarkPlacement)
+            qWarning("Multiple windows: instance and shader binding table buffers are always device local");
+        m_options.bufferPlacement = RaytracingOptions::DeviceLocalPlacement;
+        m_options.benchmarkPlacement = false;
+        if (m_options.asyncBuilds)
+            qWarning("Multiple windows: acceleration structures are built in the frame command buffer only");
+        m_options.asyncBuilds = false;
+    }
 
-    VkBuffer vbuf = *reinterpret_cast<const VkBuffer *>(m_vbuf->nativeBuffer().objects[0]);
+    m_viewCount = qBound(1, m_options.multiViewCount, int(MAX_VIEWS));
+    if (m_viewCount > 1)
+        qDebug("tracing %d views per frame into a layered image", m_viewCount);
 
-    m_ubuf.reset(m_rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, 64 * 2));
-    m_ubuf->create();
+    const bool rasterize = m_options.hybrid || m_options.benchmarkHybrid;
+    if (rasterize && m_viewCount > 1) {
+        qWarning("Hybrid rendering is not supported with multiple views, tracing primary rays");
+        m_options.hybrid = m_options.benchmarkHybrid = false;
+    }
+    if (rasterize && m_options.hasProceduralGeometry()) {
+        qWarning("Hybrid rendering is not supported with procedural spheres, tracing primary rays");
+        m_options.hybrid = m_options.benchmarkHybrid = false;
+    }
+    m_hybrid = m_options.hybrid;
+    if (m_hybrid)
+        qDebug("hybrid: rasterized primary visibility, traced secondary rays");
+
+    // Evicted BLASes are released based on this window's frames, visibility
+    // is that of a single camera, and the async and the sphere benchmark
+    // builds replace all BLASes at once.
+    if (m_options.blasBudget && (isShared() || m_viewCount > 1 || m_options.asyncBuilds || m_options.benchmarkSpheres
+                                 || m_options.benchmarkAlpha || m_options.deform || m_options.benchmarkDedup))
+    {
+        qWarning("BLAS budget is not supported with multiple windows or views, async builds, deformed meshes "
+                 "and the sphere, alpha test and geometry sharing benchmarks, keeping all BLASes resident");
+        m_options.blasBudget = 0;
+    }
 
-    // but sadly, no help from QRhi from this point on. so much for no boilerplate..
+    if ((m_options.tileWorkerCount || m_options.benchmarkTileWorkers) && (isShared() || m_viewCount > 1)) {
+        qWarning("Tile workers are not supported with multiple windows or views, tracing on the GPU");
+        m_options.tileWorkerCount = m_options.benchmarkTileWorkers = 0;
+    }
+
+    if (m_options.sphereCount > 0) {
+        if (m_options.benchmarkSpheres) {
+            if (m_options.asyncBuilds)
+                qWarning("Sphere benchmark: acceleration structures are built in the frame command buffer only");
+            m_options.asyncBuilds = false;
+        }
+        qDebug("%d spheres, %s", m_options.sphereCount,
+               m_options.benchmarkSpheres ? "procedural and triangulated"
+                                          : (m_options.triangulatedSpheres ? "triangulated" : "procedural"));
+        if (m_options.lodCount > 1) {
+            qWarning("Levels of detail are not supported with spheres");
+            m_options.lodCount = 1;
+            m_options.benchmarkLod = false;
+        }
+    }
+    if (m_options.alphaTest) {
+        if (m_options.benchmarkAlpha) {
+            if (m_options.lodCount > 1) {
+                qWarning("Levels of detail are not supported with the alpha test benchmark");
+                m_options.lodCount = 1;
+                m_options.benchmarkLod = false;
+            }
+        }
+        if (m_options.hybrid || m_options.benchmarkHybrid)
+            qWarning("Hybrid: the rasterized primary visibility is not alpha tested");
+    }
+    if (m_options.deform) {
+        // the tile workers trace the rest pose, the async builds would
+        // replace the BLASes being refit with ones built from it
+        if (m_options.sphereCount > 0 || m_options.tileWorkerCount || m_options.benchmarkTileWorkers) {
+            qWarning("Deformed meshes are not supported with spheres and tile workers");
+            m_options.deform = m_options.benchmarkDeform = false;
+        } else if (m_options.asyncBuilds) {
+            qWarning("Deformed meshes: acceleration structures are built in the frame command buffer only");
+            m_options.asyncBuilds = false;
+        }
+    }
+    if (m_options.benchmarkDedup) {
+        // the builds of the benchmark would compete with the deformed
+        // meshes' refits and the async rebuilds
+        if (m_options.deform) {
+            qWarning("Geometry sharing benchmark is not supported with deformed meshes");
+            m_options.benchmarkDedup = false;
+        } else {
+            if (m_options.asyncBuilds)
+                qWarning("Geometry sharing benchmark: acceleration structures are built in the frame command buffer only");
+            m_options.asyncBuilds = false;
+        }
+    }
+    m_positionFormat = m_options.positionFormat;
+    if (m_positionFormat == RaytracingOptions::Snorm16Positions && !blasSupportsVertexFormat(VK_FORMAT_R16G16B16_SNORM)) {
+        qWarning("SNORM16 positions cannot be used as BLAS input, decoding them on upload");
+        m_positionFormat = RaytracingOptions::Snorm16DecodedPositions;
+    }
+    if (m_positionFormat == RaytracingOptions::Snorm16Positions && (m_options.hybrid || m_options.benchmarkHybrid)) {
+        // QRhi has no SNORM16 vertex format; the decoded values are the
+        // same as what the BLAS gets, so raster and rays see the same geometry
+        qDebug("Rasterizing: decoding SNORM16 positions on upload");
+        m_positionFormat = RaytracingOptions::Snorm16DecodedPositions;
+    }
+    if (m_positionFormat != RaytracingOptions::FloatPositions && m_options.deform) {
+        qDebug("Deformed meshes: the skinning writes float positions");
+        m_positionFormat = RaytracingOptions::FloatPositions;
+    }
 
-    VkPhysicalDeviceMemoryProperties memProps;
-    f->vkGetPhysicalDeviceMemoryProperties(h->physDev, &memProps);
+    m_startupTimeline.record("ray tracing setup", beginNs, m_startupTimeline.now());
+    startBackgroundInit();
+}
 
-    const VkDescriptorPoolSize descPoolSizes[] = {
-        { VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_NV, 2 },
-        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2 },
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 }
-    };
-    VkDescriptorPoolCreateInfo descPoolInfo = {};
-    descPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    descPoolInfo.maxSets = 2;
-    descPoolInfo.poolSizeCount = sizeof(descPoolSizes) / sizeof(descPoolSizes[0]);
-    descPoolInfo.pPoolSizes = descPoolSizes;
-    df->vkCreateDescriptorPool(h->dev, &descPoolInfo, nullptr, &m_rayDescPool);
+// Runs the slow parts of the initialization on worker threads: the scene
+// creation and the preparation of its geometry on one, and once the scene
+// is there (the layouts depend on its mesh and texture counts), the ray
+// tracing pipeline with its shader modules on another. Everything touching
+// QRhi, which is not thread safe, is left to finishInit().
+void RaytracingWindow::startBackgroundInit()
+{
+    m_startupPool.start([this] {
+        {
+            StartupTimeline::Scope scope(&m_startupTimeline, "scene creation");
+            m_scene = m_options.createScene(&m_geometryRegistry);
+        }
+        m_startupPool.start([this] {
+            StartupTimeline::Scope scope(&m_startupTimeline, "ray tracing pipeline");
+            createRayPipelineLayout();
+            createRayPipeline();
+            m_pipelineCreated.store(true, std::memory_order_release);
+        });
+        {
+            StartupTimeline::Scope scope(&m_startupTimeline, "geometry preparation");
+            prepareGeometry();
+        }
+        m_geometryPrepared.store(true, std::memory_order_release);
+    });
+}
+
+// Called every frame until ray tracing is ready. For the owner, that is when
+// the workers are done and finishInit() has created the rest, for a view
+// when the owner is ready.
+bool RaytracingWindow::pollStartup()
+{
+    if (isView()) {
+        if (!m_context->owner()->m_rayTracingReady)
+            return false;
+        StartupTimeline::Scope scope(&m_startupTimeline, "view setup");
+        initView();
+    } else {
+        if (!m_geometryPrepared.load(std::memory_order_acquire) || !m_pipelineCreated.load(std::memory_order_acquire))
+            return false;
+        StartupTimeline::Scope scope(&m_startupTimeline, "buffers, acceleration structures, SBT");
+        finishInit();
+    }
+
+    m_rayTracingReady = true;
+    m_startupTimeline.finish("ray tracing on");
+    // the placeholder frames did not upload them
+    m_matricesChanged = true;
+    return true;
+}
+
+// The CPU side of the meshes and the instances, on a worker thread during
+// startup: the BLAS input (the positions, possibly quantized, or the
+// spheres' AABBs), the attributes the hit shaders read, the rest pose of the
+// deformed meshes and the instance transforms. finishInit() creates the
+// buffers from these.
+void RaytracingWindow::prepareGeometry()
+{
+    m_meshes.resize(size_t(m_scene.meshes.count()));
+    for (int i = 0; i < m_scene.meshes.count(); ++i) {
+        const SceneMesh &sceneMesh(m_scene.meshes[i]);
+        RayMesh &mesh(m_meshes[size_t(i)]);
+        const int vertexCount = sceneMesh.vertexCount();
+        const float *v = sceneMesh.vertices.constData();
+
+        if (sceneMesh.isProcedural()) {
+            // The AABBs are the BLAS input, the spheres are read by the
+            // intersection and closest hit shaders. There are no indices.
+            QVector<float> aabbs;
+            aabbs.reserve(sceneMesh.sphereCount() * 6);
+            for (int j = 0; j < sceneMesh.sphereCount(); ++j) {
+                const float *s = sceneMesh.spheres.constData() + j * SceneMesh::FLOATS_PER_SPHERE;
+                aabbs.append({ s[0] - s[3], s[1] - s[3], s[2] - s[3], s[0] + s[3], s[1] + s[3], s[2] + s[3] });
+            }
+            mesh.positionData = QByteArray(reinterpret_cast<const char *>(aabbs.constData()), aabbs.count() * int(sizeof(float)));
+            mesh.positionStride = 6 * sizeof(float);
+            mesh.attributeData = QByteArray(reinterpret_cast<const char *>(sceneMesh.spheres.constData()),
+                                            sceneMesh.spheres.count() * int(sizeof(float)));
+            continue;
+        }
+
+        QVector3D normalScale(1.0f, 1.0f, 1.0f);
+        if (m_positionFormat == RaytracingOptions::FloatPositions) {
+            QVector<float> positions;
+            positions.reserve(vertexCount * 3);
+            for (int j = 0; j < vertexCount; ++j)
+                positions.append({ v[j * SceneMesh::FLOATS_PER_VERTEX], v[j * SceneMesh::FLOATS_PER_VERTEX + 1], v[j * SceneMesh::FLOATS_PER_VERTEX + 2] });
+            mesh.positionData = QByteArray(reinterpret_cast<const char *>(positions.constData()), positions.count() * int(sizeof(float)));
+        } else {
+            const QuantizedPositions quantized = QuantizedPositions::fromMesh(sceneMesh);
+            mesh.positionTransform = quantized.dequantizeTransform();
+            normalScale = quantized.scale;
+            QuantizationError &quantizationError(m_geometryStats.quantizationError);
+            if (quantizationError.rayCount < 65536)
+                quantizationError.accumulate(QuantizationError::measure(sceneMesh, quantized, 256));
+            if (m_positionFormat == RaytracingOptions::Snorm16Positions) {
+                mesh.positionData = QByteArray(reinterpret_cast<const char *>(quantized.data.constData()),
+                                               quantized.data.count() * int(sizeof(qint16)));
+                mesh.positionFormat = VK_FORMAT_R16G16B16_SNORM;
+                mesh.positionStride = QuantizedPositions::BYTES_PER_VERTEX;
+            } else {
+                const QVector<float> positions = quantized.decode();
+                mesh.positionData = QByteArray(reinterpret_cast<const char *>(positions.constData()), positions.count() * int(sizeof(float)));
+            }
+        }
+        m_geometryStats.positionBytes += VkDeviceSize(mesh.positionData.size());
+        m_geometryStats.floatPositionBytes += VkDeviceSize(vertexCount) * 3 * sizeof(float);
+
+        // The normals are transformed into the (possibly quantized) object
+        // space, the hit shader takes them to world space with the inverse
+        // transpose of the instance transform.
+        QVector<float> attributes;
+        attributes.reserve(vertexCount * 5);
+        for (int j = 0; j < vertexCount; ++j) {
+            const float *vertex = v + j * SceneMesh::FLOATS_PER_VERTEX;
+            const QVector3D n = (QVector3D(vertex[3], vertex[4], vertex[5]) * normalScale).normalized();
+            attributes.append({ n.x(), n.y(), n.z(), vertex[6], vertex[7] });
+        }
+        mesh.attributeData = QByteArray(reinterpret_cast<const char *>(attributes.constData()), attributes.count() * int(sizeof(float)));
+
+        // deformed meshes have their positions and normals overwritten by
+        // MeshDeformer every frame, from this rest pose
+        if (m_options.deform) {
+            float minY, maxY;
+            mesh.restData = MeshDeformer::restVertices(sceneMesh, &minY, &maxY);
+            m_deformedMeshes.append(i);
+            m_deformedMeshInput.append({ VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE, vertexCount, minY, maxY });
+        }
+
+        // The alpha tested triangles follow the opaque ones, but a geometry's
+        // gl_PrimitiveID starts from 0, and the shaders use it to index ibuf.
+        // So their geometry gets indices of its own, starting with a
+        // degenerate (never hit) triangle in place of each opaque one.
+        const int opaqueTriangles = sceneMesh.opaqueTriangleCount;
+        if (opaqueTriangles > 0 && opaqueTriangles < sceneMesh.triangleCount()) {
+            mesh.alphaIndexData = sceneMesh.indices;
+            for (int j = 0; j < opaqueTriangles * 3; ++j)
+                mesh.alphaIndexData[j] = sceneMesh.indices[0];
+        }
+    }
+
+    // The instances in the form the packing into the instance buffer wants.
+    // All of them use the same hit record; what differs per instance is
+    // looked up via gl_InstanceCustomIndexNV.
+    // The hit group offset is the level of detail, each level has its own
+    // hit record (see updateShaderBindingTable()).
+    m_instanceTransforms.resize(m_scene.instances.count());
+    m_instanceRestY.resize(m_scene.instances.count());
+    m_instanceLods.fill(0, m_scene.instances.count());
+    m_instanceBounds.resize(m_scene.instances.count());
+    QVector<QVector4D> meshBounds(m_scene.meshes.count());
+    for (int i = 0; i < m_scene.meshes.count(); i += m_scene.lodCount) {
+        QVector3D center;
+        float radius;
+        m_scene.meshes[i].boundingSphere(&center, &radius);
+        meshBounds[i] = QVector4D(center, radius);
+    }
+    for (int i = 0; i < m_scene.instances.count(); ++i) {
+        const SceneInstance &sceneInstance(m_scene.instances[i]);
+        const QMatrix4x4 transform = toInstanceTransform(sceneInstance.transform);
+        const QVector4D &bounds(meshBounds[sceneInstance.mesh]);
+        float scale = 0.0f;
+        for (int col = 0; col < 3; ++col)
+            scale = qMax(scale, QVector3D(transform(0, col), transform(1, col), transform(2, col)).length());
+        m_instanceBounds[i] = QVector4D(transform.map(bounds.toVector3D()), bounds.w() * scale);
+        m_instanceTransforms.setTransform(i, transform * m_meshes[size_t(sceneInstance.mesh)].positionTransform);
+        //m_instanceTransforms.setInstance(i, uint32_t(i), 0xFF, 0, VK_GEOMETRY_INSTANCE_TRIANGLE_CULL_DISABLE_BIT_NV);
+        //m_instanceTransforms.setInstance(i, uint32_t(i), 0xFF, 0, VK_GEOMETRY_INSTANCE_TRIANGLE_FRONT_COUNTERCLOCKWISE_BIT_NV);
+        // spheres have their own hit record, see updateShaderBindingTable(); in
+        // the sphere benchmark the triangulated ones start out masked out, in
+        // the alpha test benchmark the unclassified meshes
+        const SceneMesh &sceneMesh(m_scene.meshes[sceneInstance.mesh]);
+        const bool procedural = sceneMesh.isProcedural();
+        quint32 mask = m_options.benchmarkSpheres && !procedural ? 0 : 0xFF;
+        if (sceneMesh.isAlphaTested() && !sceneMesh.classified)
+            mask = 0;
+        // with a BLAS budget nothing is resident until the first updateResidency()
+        if (m_options.blasBudget)
+            mask = 0;
+        m_instanceTransforms.setInstance(i, uint32_t(i), mask, procedural ? sphereHitRecord() : 0, 0);
+        m_instanceRestY[i] = m_instanceTransforms.components(7)[i];
+    }
+}
+
+// The descriptor set layout and the pipeline layout of the ray tracing
+// pipeline, on a worker thread during startup.
+void RaytracingWindow::createRayPipelineLayout()
+{
+    // but sadly, no help from QRhi from this point on. so much for no boilerplate..
+
+    // One descriptor set for all the meshes and materials: the vertex and
+    // index buffers and the textures are arrays, indexed in the closest hit
+    // shader, so there is never any rebinding per mesh or material.
+    const uint32_t meshCount = uint32_t(m_scene.meshes.count());
+    const uint32_t textureCount = uint32_t(m_scene.textures.count());
+    const uint32_t storageBufferCount = 3 + 2 * meshCount; // the last is the any-hit counter
+    const VkPhysicalDeviceLimits &limits(m_vk.props.limits);
+    if (storageBufferCount > limits.maxPerStageDescriptorStorageBuffers
+            || storageBufferCount > limits.maxDescriptorSetStorageBuffers)
+    {
+        qFatal("%u meshes need %u storage buffer descriptors, the limit is %u",
+               meshCount, storageBufferCount,
+               qMin(limits.maxPerStageDescriptorStorageBuffers, limits.maxDescriptorSetStorageBuffers));
+    }
+    if (textureCount > limits.maxPerStageDescriptorSampledImages
+            || textureCount > limits.maxDescriptorSetSampledImages)
+    {
+        qFatal("%u material textures exceed the sampled image descriptor limit of %u",
+               textureCount, qMin(limits.maxPerStageDescriptorSampledImages, limits.maxDescriptorSetSampledImages));
+    }
 
     VkDescriptorSetLayoutBinding accelerationStructureLayoutBinding = {};
     accelerationStructureLayoutBinding.binding = 0;
@@ -271,117 +945,249 @@ void RaytracingWindow::customInit()
     uniformBufferBinding.descriptorCount = 1;
     uniformBufferBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV;
 
+    VkDescriptorSetLayoutBinding instanceDataBinding = {};
+    instanceDataBinding.binding = 3;
+    instanceDataBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    instanceDataBinding.descriptorCount = 1;
+    // the raygen shader needs them too when shading there (--inline-shading),
+    // the intersection shader reads the spheres, the any-hit shader the UVs
+    instanceDataBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV | VK_SHADER_STAGE_RAYGEN_BIT_NV
+            | VK_SHADER_STAGE_INTERSECTION_BIT_NV | VK_SHADER_STAGE_ANY_HIT_BIT_NV;
+
+    VkDescriptorSetLayoutBinding materialBinding = instanceDataBinding;
+    materialBinding.binding = 4;
+
+    VkDescriptorSetLayoutBinding vertexBuffersBinding = instanceDataBinding;
+    vertexBuffersBinding.binding = 5;
+    vertexBuffersBinding.descriptorCount = meshCount;
+
+    VkDescriptorSetLayoutBinding indexBuffersBinding = vertexBuffersBinding;
+    indexBuffersBinding.binding = 6;
+
+    VkDescriptorSetLayoutBinding texturesBinding = {};
+    texturesBinding.binding = 7;
+    texturesBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    texturesBinding.descriptorCount = textureCount;
+    texturesBinding.stageFlags = instanceDataBinding.stageFlags;
+
+    VkDescriptorSetLayoutBinding guideImageLayoutBinding = resultImageLayoutBinding;
+    guideImageLayoutBinding.binding = 8;
+
+    VkDescriptorSetLayoutBinding gbufferAlbedoLayoutBinding = resultImageLayoutBinding;
+    gbufferAlbedoLayoutBinding.binding = 9;
+
+    VkDescriptorSetLayoutBinding gbufferNormalDistanceLayoutBinding = resultImageLayoutBinding;
+    gbufferNormalDistanceLayoutBinding.binding = 10;
+
+    VkDescriptorSetLayoutBinding anyHitCounterBinding = {};
+    anyHitCounterBinding.binding = 11;
+    anyHitCounterBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    anyHitCounterBinding.descriptorCount = 1;
+    anyHitCounterBinding.stageFlags = VK_SHADER_STAGE_ANY_HIT_BIT_NV;
+
     const VkDescriptorSetLayoutBinding bindings[] = {
         accelerationStructureLayoutBinding,
         resultImageLayoutBinding,
-        uniformBufferBinding
+        uniformBufferBinding,
+        instanceDataBinding,
+        materialBinding,
+        vertexBuffersBinding,
+        indexBuffersBinding,
+        texturesBinding,
+        guideImageLayoutBinding,
+        gbufferAlbedoLayoutBinding,
+        gbufferNormalDistanceLayoutBinding,
+        anyHitCounterBinding
     };
 
     VkDescriptorSetLayoutCreateInfo layoutInfo = {};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     layoutInfo.bindingCount = static_cast<uint32_t>(sizeof(bindings) / sizeof(bindings[0]));
     layoutInfo.pBindings = bindings;
-    df->vkCreateDescriptorSetLayout(h->dev, &layoutInfo, nullptr, &m_rayDescSetLayout);
+    m_vk.df->vkCreateDescriptorSetLayout(m_vk.dev, &layoutInfo, nullptr, &m_rayDescSetLayout);
 
     VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
     pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutCreateInfo.setLayoutCount = 1;
     pipelineLayoutCreateInfo.pSetLayouts = &m_rayDescSetLayout;
-    df->vkCreatePipelineLayout(h->dev, &pipelineLayoutCreateInfo, nullptr, &m_rayPipelineLayout);
-
-    VkShaderModule shaderModules[3];
-    QByteArray spirv = getSpirv(QLatin1String(":/raygen.spv"));
-    VkShaderModuleCreateInfo shaderInfo = {};
-    shaderInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    shaderInfo.codeSize = size_t(spirv.size());
-    shaderInfo.pCode = reinterpret_cast<const quint32 *>(spirv.constData());
-    df->vkCreateShaderModule(h->dev, &shaderInfo, nullptr, &shaderModules[0]);
-    spirv = getSpirv(QLatin1String(":/miss.spv"));
-    shaderInfo.codeSize = size_t(spirv.size());
-    shaderInfo.pCode = reinterpret_cast<const quint32 *>(spirv.constData());
-    df->vkCreateShaderModule(h->dev, &shaderInfo, nullptr, &shaderModules[1]);
-    spirv = getSpirv(QLatin1String(":/closesthit.spv"));
-    shaderInfo.codeSize = size_t(spirv.size());
-    shaderInfo.pCode = reinterpret_cast<const quint32 *>(spirv.constData());
-    df->vkCreateShaderModule(h->dev, &shaderInfo, nullptr, &shaderModules[2]);
-
-    VkPipelineShaderStageCreateInfo shaderStages[3] = {};
-    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderStages[0].stage = VK_SHADER_STAGE_RAYGEN_BIT_NV;
-    shaderStages[0].module = shaderModules[0];
-    shaderStages[0].pName = "main";
-    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderStages[1].stage = VK_SHADER_STAGE_MISS_BIT_NV;
-    shaderStages[1].module = shaderModules[1];
-    shaderStages[1].pName = "main";
-    shaderStages[2].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderStages[2].stage = VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV;
-    shaderStages[2].module = shaderModules[2];
-    shaderStages[2].pName = "main";
-
-    VkRayTracingShaderGroupCreateInfoNV shaderGroupInfo[3] = {};
-    for (int i = 0; i < 3; ++i) {
-        shaderGroupInfo[i].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_NV;
-        shaderGroupInfo[i].generalShader = VK_SHADER_UNUSED_NV;
-        shaderGroupInfo[i].closestHitShader = VK_SHADER_UNUSED_NV;
-        shaderGroupInfo[i].anyHitShader = VK_SHADER_UNUSED_NV;
-        shaderGroupInfo[i].intersectionShader = VK_SHADER_UNUSED_NV;
-    }
-    shaderGroupInfo[0].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_NV;
-    shaderGroupInfo[0].generalShader = 0; // raygen
-    shaderGroupInfo[1].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_NV;
-    shaderGroupInfo[1].generalShader = 1; // miss
-    shaderGroupInfo[2].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_NV;
-    shaderGroupInfo[2].closestHitShader = 2; // closesthit
+    // see PushConstants in raygen.rgen, the any-hit shader checks the flags
+    const VkPushConstantRange pushConstantRange = { VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_ANY_HIT_BIT_NV,
+                                                    0, 4 * sizeof(quint32) };
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+    m_vk.df->vkCreatePipelineLayout(m_vk.dev, &pipelineLayoutCreateInfo, nullptr, &m_rayPipelineLayout);
+}
 
-    VkRayTracingPipelineCreateInfoNV rayPipelineInfo = {};
-    rayPipelineInfo.sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_NV;
-    rayPipelineInfo.stageCount = 3;
-    rayPipelineInfo.pStages = shaderStages;
-    rayPipelineInfo.groupCount = 3;
-    rayPipelineInfo.pGroups = shaderGroupInfo;
-    rayPipelineInfo.maxRecursionDepth = 1;
-    rayPipelineInfo.layout = m_rayPipelineLayout;
-    VkResult err = createRayTracingPipelines(h->dev, VK_NULL_HANDLE, 1, &rayPipelineInfo, nullptr, &m_rayPipeline);
-    if (err != VK_SUCCESS)
-        qFatal("Failed to create raytracing pipeline: %d", err);
+// What is left of the initialization once the workers are done, on the GUI
+// thread, in the first frame that can trace: the buffers and textures
+// (QRhi's), the acceleration structures, the shader binding table and the
+// descriptor sets.
+void RaytracingWindow::finishInit()
+{
+    const QRhiVulkanNativeHandles *h = static_cast<const QRhiVulkanNativeHandles *>(m_rhi->nativeHandles());
+    QVulkanDeviceFunctions *df = vulkanInstance()->deviceFunctions(h->dev);
+
+    if (m_geometryRegistry.geometryCount()) {
+        const GeometryRegistry::Statistics &stats(m_geometryRegistry.lastStatistics());
+        int shared = 0;
+        for (int i = 0; i < m_geometryRegistry.geometryCount(); ++i) {
+            if (m_geometryRegistry.refCount(i) > 1)
+                ++shared;
+        }
+        qDebug("geometry registry: %d meshes loaded, %d distinct, %d of them loaded more than once; "
+               "hashed %.1f MB in %.3f ms on %d thread(s)",
+               stats.meshCount, m_geometryRegistry.geometryCount(), shared,
+               stats.hashedBytes / (1024.0 * 1024.0), stats.hashNs / 1000000.0, stats.threadCount);
+    }
+    if (m_options.alphaTest) {
+        const Scene::OpacityStatistics &stats(m_scene.opacityStatistics);
+        qDebug("alpha test: %lld opaque, %lld mixed (running the any-hit shader), %lld transparent (dropped) "
+               "triangles, classified in %.3f ms",
+               stats.opaqueTriangles, stats.mixedTriangles, stats.transparentTriangles, stats.classifyNs / 1000000.0);
+    }
+    if (m_scene.lodCount > 1) {
+        QByteArray levels;
+        for (int lod = 0; lod < m_scene.lodCount; ++lod) {
+            qint64 triangles = 0;
+            for (int i = lod; i < m_scene.meshes.count(); i += m_scene.lodCount)
+                triangles += m_scene.meshes[i].triangleCount();
+            levels += QByteArray(lod ? ", " : "") + QByteArray::number(triangles);
+        }
+        qDebug("levels of detail: %d, triangles per level (all meshes): %s", m_scene.lodCount, levels.constData());
+        m_tlasFlags = VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_NV;
+        // the benchmark starts without, see addLodBenchmark()
+        m_lodEnabled = !m_options.benchmarkLod;
+    }
+    if (uint64_t(m_scene.instances.count()) > m_raytracingProps.maxInstanceCount)
+        qFatal("%d instances exceed maxInstanceCount", m_scene.instances.count());
+
+    // Say no to boilerplate; will use QRhi and dig out the VkBuffers afterwards (same goes for the image).
+    // The positions are only used as BLAS input. The rest of the vertex
+    // attributes and the indices are read by the closest hit shader, hence
+    // the storage buffer usage.
+    for (int i = 0; i < m_scene.meshes.count(); ++i) {
+        const SceneMesh &sceneMesh(m_scene.meshes[i]);
+        RayMesh &mesh(m_meshes[size_t(i)]);
+
+        if (sceneMesh.isProcedural()) {
+            mesh.vbuf.reset(m_rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::VertexBuffer, mesh.positionData.size()));
+            mesh.vbuf->create();
+            mesh.attrBuf.reset(m_rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::StorageBuffer, mesh.attributeData.size()));
+            mesh.attrBuf->create();
+            continue;
+        }
+
+        // deformed meshes have their positions and normals overwritten by
+        // MeshDeformer every frame, from the rest pose in restBuf
+        QRhiBuffer::UsageFlags positionUsage = QRhiBuffer::VertexBuffer;
+        if (!mesh.restData.isEmpty()) {
+            positionUsage |= QRhiBuffer::StorageBuffer;
+            mesh.restBuf.reset(m_rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::StorageBuffer, mesh.restData.size()));
+            mesh.restBuf->create();
+        }
+        mesh.vbuf.reset(m_rhi->newBuffer(QRhiBuffer::Immutable, positionUsage, mesh.positionData.size()));
+        mesh.vbuf->create();
+        mesh.attrBuf.reset(m_rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::VertexBuffer | QRhiBuffer::StorageBuffer,
+                                            mesh.attributeData.size()));
+        mesh.attrBuf->create();
+        mesh.ibuf.reset(m_rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::IndexBuffer | QRhiBuffer::StorageBuffer,
+                                         sceneMesh.indices.count() * sizeof(quint32)));
+        mesh.ibuf->create();
+        if (!mesh.alphaIndexData.isEmpty()) {
+            mesh.alphaIbuf.reset(m_rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::IndexBuffer,
+                                                  mesh.alphaIndexData.count() * sizeof(quint32)));
+            mesh.alphaIbuf->create();
+        }
+    }
 
-    for (int i = 0; i < 3; ++i)
-        df->vkDestroyShaderModule(h->dev, shaderModules[i], nullptr);
+    static const char *positionFormatNames[] = { "float", "snorm16", "snorm16 decoded to float" };
+    qDebug("vertex positions: %llu bytes as %s, %llu bytes as float, saved %llu bytes (%.1f%%)",
+           m_geometryStats.positionBytes, positionFormatNames[m_positionFormat], m_geometryStats.floatPositionBytes,
+           m_geometryStats.floatPositionBytes - m_geometryStats.positionBytes,
+           100.0 * (m_geometryStats.floatPositionBytes - m_geometryStats.positionBytes)
+           / qMax<VkDeviceSize>(1, m_geometryStats.floatPositionBytes));
+    const QuantizationError &quantizationError(m_geometryStats.quantizationError);
+    if (quantizationError.rayCount) {
+        qDebug("quantization error vs. float positions over %d rays: position error max %g (object space), "
+               "hit distance error max %g avg %g (relative to mesh size), %d hit/miss mismatches",
+               quantizationError.rayCount, double(quantizationError.maxPositionError),
+               double(quantizationError.maxHitDistanceError), quantizationError.avgHitDistanceError,
+               quantizationError.hitMismatches);
+    }
+
+    qDebug("instance packing: %d thread(s), %s", m_instancePacker.threadCount(),
+           m_instancePacker.isSimdEnabled() ? "avx2" : "scalar");
+    if (m_options.benchmarkPacking)
+        runPackingBenchmark();
+    if (m_options.animateInstances)
+        m_animationTimer.start();
+
+    // per instance mesh and material indices, looked up via gl_InstanceCustomIndexNV
+    m_instanceDataBuf.reset(m_rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::StorageBuffer,
+                                             m_scene.instances.count() * 2 * sizeof(quint32)));
+    m_instanceDataBuf->create();
+    m_materialBuf.reset(m_rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::StorageBuffer,
+                                         m_scene.materials.count() * sizeof(SceneMaterial)));
+    m_materialBuf->create();
+
+    m_materialTextures.resize(size_t(m_scene.textures.count()));
+    m_materialTextureStates.resize(m_scene.textures.count());
+    for (int i = 0; i < m_scene.textures.count(); ++i) {
+        std::unique_ptr<QRhiTexture> &t(m_materialTextures[size_t(i)]);
+        t.reset(m_rhi->newTexture(QRhiTexture::RGBA8, m_scene.textures[i].size()));
+        t->create();
+        VkImageViewCreateInfo viewInfo = {};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = VkImage(t->nativeTexture().object);
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+        viewInfo.components.r = VK_COMPONENT_SWIZZLE_R;
+        viewInfo.components.g = VK_COMPONENT_SWIZZLE_G;
+        viewInfo.components.b = VK_COMPONENT_SWIZZLE_B;
+        viewInfo.components.a = VK_COMPONENT_SWIZZLE_A;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.layerCount = 1;
+        VkImageView v;
+        df->vkCreateImageView(h->dev, &viewInfo, nullptr, &v);
+        m_materialTextureViews.append(v);
+    }
 
-    // common stuff for buffers
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.maxLod = 0.25f;
+    df->vkCreateSampler(h->dev, &samplerInfo, nullptr, &m_materialSampler);
+
+    m_ubuf.reset(m_rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, MAX_VIEWS * 64 * 2));
+    m_ubuf->create();
+
+    VkResult err;
+
+#if 0
+    // geometry transform buffer
     VkBufferCreateInfo bufInfo = {};
     bufInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufInfo.usage = VK_BUFFER_USAGE_RAY_TRACING_BIT_NV;
     VkMemoryRequirements bufMemReq;
     VkMemoryAllocateInfo bufMemAllocInfo = {};
     bufMemAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    quint8 *p;
-    auto findMemTypeIndex = [&memProps](uint32_t wantedBits, const VkMemoryRequirements &memReqs) {
-        uint32_t memTypeIndex = 0;
-        for (uint32_t i = 0; i < memProps.memoryTypeCount; ++i) {
-            if (memReqs.memoryTypeBits & (1 << i)) {
-                if ((memProps.memoryTypes[i].propertyFlags & wantedBits) == wantedBits) {
-                    memTypeIndex = i;
-                    break;
-                }
-            }
-        }
-        return memTypeIndex;
-    };
-
-#if 0
-    // geometry transform buffer
     bufInfo.size = 12 * sizeof(float);
     df->vkCreateBuffer(h->dev, &bufInfo, nullptr, &m_geometryTransformBuf);
     df->vkGetBufferMemoryRequirements(h->dev, m_geometryTransformBuf, &bufMemReq);
     bufMemAllocInfo.allocationSize = bufMemReq.size;
-    bufMemAllocInfo.memoryTypeIndex = findMemTypeIndex(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, bufMemReq);
+    bufMemAllocInfo.memoryTypeIndex = m_vk.findMemTypeIndex(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, bufMemReq);
     err = df->vkAllocateMemory(h->dev, &bufMemAllocInfo, nullptr, &m_geometryTransformBufMem);
     if (err != VK_SUCCESS)
         qFatal("Failed to allocate geometry transform buffer memory: %d", err);
     df->vkBindBufferMemory(h->dev, m_geometryTransformBuf, m_geometryTransformBufMem, 0);
 
+    quint8 *p;
     static const float flip4x3RowMajor[12] = {
         1.0f, 0.0f, 0.0f, 0.0f,
         0.0f, -1.0f, 0.0f, 0.0f,
@@ -392,238 +1198,494 @@ void RaytracingWindow::customInit()
     df->vkUnmapMemory(h->dev, m_geometryTransformBufMem);
 #endif
 
-    // the geometry
-    m_geometry = {};
-    m_geometry.sType = VK_STRUCTURE_TYPE_GEOMETRY_NV;
-    m_geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_NV;
-    m_geometry.geometry.triangles.sType = VK_STRUCTURE_TYPE_GEOMETRY_TRIANGLES_NV;
-    m_geometry.geometry.triangles.vertexData = vbuf;
-    m_geometry.geometry.triangles.vertexOffset = 0;
-    m_geometry.geometry.triangles.vertexCount = 3;
-    m_geometry.geometry.triangles.vertexStride = 3 * sizeof(float);
-    m_geometry.geometry.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
-    m_geometry.geometry.triangles.indexType = VK_INDEX_TYPE_NONE_NV;
+    // With a compute queue the first build is a quick one, recorded in the
+    // frame command buffer to get something on screen right away, followed by
+    // a build preferring fast tracing in the background, swapped in once done.
+    if (m_options.asyncBuilds) {
+        if (m_computeQueue && m_asyncQueue.create(&m_vk, m_computeQueue, m_computeQueueFamilyIdx))
+            qDebug("acceleration structures get rebuilt on a separate compute queue");
+        else
+            qWarning("No compute queue, acceleration structures are built in the frame command buffer only");
+    }
+    const VkBuildAccelerationStructureFlagsNV blasFlags = m_asyncQueue.isValid()
+            ? VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_NV : 0;
+
+    // the geometries and the bottom level acceleration structures, one per mesh
+    VkDeviceSize blasMemSize = 0;
+    VkDeviceSize blasScratchSize = 0;
+    VkDeviceSize blasScratchAlignment = 1;
+    QVector<VkDeviceSize> blasSizes;
+    for (int i = 0; i < m_scene.meshes.count(); ++i) {
+        const SceneMesh &sceneMesh(m_scene.meshes[i]);
+        RayMesh &mesh(m_meshes[size_t(i)]);
+
+        VkGeometryNV geometry = {};
+        geometry.sType = VK_STRUCTURE_TYPE_GEOMETRY_NV;
+        geometry.geometry.triangles.sType = VK_STRUCTURE_TYPE_GEOMETRY_TRIANGLES_NV;
+        geometry.geometry.aabbs.sType = VK_STRUCTURE_TYPE_GEOMETRY_AABB_NV;
+        geometry.flags = VK_GEOMETRY_OPAQUE_BIT_NV;
+        mesh.geometryCount = 0;
+        if (sceneMesh.isProcedural()) {
+            geometry.geometryType = VK_GEOMETRY_TYPE_AABBS_NV;
+            geometry.geometry.aabbs.aabbData = *reinterpret_cast<const VkBuffer *>(mesh.vbuf->nativeBuffer().objects[0]);
+            geometry.geometry.aabbs.numAABBs = uint32_t(sceneMesh.sphereCount());
+            geometry.geometry.aabbs.stride = uint32_t(mesh.positionStride);
+            geometry.geometry.aabbs.offset = 0;
+            mesh.geometries[mesh.geometryCount++] = geometry;
+        } else {
+            geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_NV;
+            geometry.geometry.triangles.vertexData = *reinterpret_cast<const VkBuffer *>(mesh.vbuf->nativeBuffer().objects[0]);
+            geometry.geometry.triangles.vertexOffset = 0;
+            geometry.geometry.triangles.vertexCount = uint32_t(sceneMesh.vertexCount());
+            geometry.geometry.triangles.vertexStride = mesh.positionStride;
+            geometry.geometry.triangles.vertexFormat = mesh.positionFormat;
+            geometry.geometry.triangles.indexData = *reinterpret_cast<const VkBuffer *>(mesh.ibuf->nativeBuffer().objects[0]);
+            geometry.geometry.triangles.indexType = VK_INDEX_TYPE_UINT32;
 #if 0
-    m_geometry.geometry.triangles.transformData = m_geometryTransformBuf;
+            geometry.geometry.triangles.transformData = m_geometryTransformBuf;
 #endif
-    m_geometry.geometry.aabbs.sType = VK_STRUCTURE_TYPE_GEOMETRY_AABB_NV;
-    m_geometry.flags = VK_GEOMETRY_OPAQUE_BIT_NV;
+            // the opaque triangles come first, see Scene::classifyOpacity()
+            const int opaqueTriangles = sceneMesh.isAlphaTested() ? sceneMesh.opaqueTriangleCount : sceneMesh.triangleCount();
+            if (opaqueTriangles > 0) {
+                geometry.geometry.triangles.indexCount = uint32_t(opaqueTriangles * 3);
+                mesh.geometries[mesh.geometryCount++] = geometry;
+            }
+            if (opaqueTriangles < sceneMesh.triangleCount()) {
+                geometry.flags = 0;
+                if (mesh.alphaIbuf)
+                    geometry.geometry.triangles.indexData = *reinterpret_cast<const VkBuffer *>(mesh.alphaIbuf->nativeBuffer().objects[0]);
+                geometry.geometry.triangles.indexCount = uint32_t(sceneMesh.indices.count());
+                mesh.geometries[mesh.geometryCount++] = geometry;
+            }
+        }
+
+        VkAccelerationStructureInfoNV accelInfo = {};
+        accelInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
+        accelInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_NV;
+        accelInfo.flags = blasFlags;
+        accelInfo.instanceCount = 0;
+        accelInfo.geometryCount = mesh.geometryCount;
+        accelInfo.pGeometries = mesh.geometries;
+        if (m_options.deform && !sceneMesh.isProcedural()) {
+            // refit every frame, rebuilt only every rebuildInterval frames
+            accelInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_NV
+                    | VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_NV;
+        }
+        mesh.buildFlags = accelInfo.flags;
+
+        VkMemoryRequirements scratchMemReq;
+        VkDeviceSize blasSize;
+        if (m_options.blasBudget) {
+            // allocated when the mesh becomes visible, see updateResidency()
+            blasSize = accelerationStructureSize(accelInfo, &scratchMemReq);
+        } else {
+            blasSize = allocateAccelerationStructure(accelInfo, &mesh.blas, &mesh.blasMem, &mesh.blasHandle, &scratchMemReq);
+        }
+        blasSizes.append(blasSize);
+        if (m_options.benchmarkAlpha && sceneMesh.isAlphaTested()) {
+            AlphaBenchmarkResult &result(m_alphaBenchmark[sceneMesh.classified ? 1 : 0]);
+            result.blasBytes += blasSize;
+            result.nonOpaqueTriangles += sceneMesh.triangleCount() - sceneMesh.opaqueTriangleCount;
+        }
+        blasMemSize += blasSize;
+        mesh.scratchSize = scratchMemReq.size;
+        if (m_options.benchmarkSpheres) {
+            SphereBenchmarkResult &result(m_sphereBenchmark[sceneMesh.isProcedural() ? 0 : 1]);
+            result.inputBytes = quint64(mesh.vbuf->size() + mesh.attrBuf->size() + (mesh.ibuf ? mesh.ibuf->size() : 0));
+            result.blasBytes = blasSize;
+            result.triangleCount = sceneMesh.triangleCount();
+        }
+        blasScratchSize += scratchMemReq.size;
+        blasScratchAlignment = qMax(blasScratchAlignment, scratchMemReq.alignment);
+        if (sceneMesh.duplicates) {
+            const quint64 bufferBytes = quint64(mesh.vbuf->size() + mesh.attrBuf->size())
+                    + (mesh.ibuf ? quint64(mesh.ibuf->size()) : 0)
+                    + (mesh.alphaIbuf ? quint64(mesh.alphaIbuf->size()) : 0)
+                    + (mesh.restBuf ? quint64(mesh.restBuf->size()) : 0);
+            m_sharedBufferBytesSaved += quint64(sceneMesh.duplicates) * bufferBytes;
+            m_sharedBlasBytesSaved += quint64(sceneMesh.duplicates) * blasSize;
+        }
+    }
+    qDebug("blas memory needed: %llu (%d meshes)", blasMemSize, int(m_meshes.size()));
+    if (m_sharedBufferBytesSaved) {
+        qDebug("shared geometry: saved %llu bytes of vertex and index buffers and %llu bytes of BLAS memory",
+               m_sharedBufferBytesSaved, m_sharedBlasBytesSaved);
+    }
+    qDebug("blas scratch buffer size: %llu (total for all meshes)", blasScratchSize);
+    if (m_options.blasBudget) {
+        m_residency.create(blasSizes, m_options.blasBudget);
+        VkMemoryRequirements scratchMemReq;
+        createPlaceholderBlas(&scratchMemReq);
+        blasScratchAlignment = qMax(blasScratchAlignment, scratchMemReq.alignment);
+        qDebug("blas budget: %llu bytes%s", m_options.blasBudget,
+               getPhysicalDeviceMemoryProperties2 ? ", or less when VK_EXT_memory_budget says so" : "");
+    }
+
+    m_blasBuilder.create(&m_vk, cmdBuildAccelerationStructure, m_options.scratchBudget, blasScratchAlignment);
+
+    if (m_asyncQueue.isValid())
+        m_asyncBlasBuilder.create(&m_vk, cmdBuildAccelerationStructure, m_options.scratchBudget, blasScratchAlignment);
+
+    if (!m_deformedMeshInput.isEmpty()) {
+        QVector<MeshDeformer::Mesh> deformedMeshes;
+        deformedMeshes.swap(m_deformedMeshInput);
+        qint64 vertexCount = 0;
+        for (int i = 0; i < deformedMeshes.count(); ++i) {
+            const RayMesh &mesh(m_meshes[size_t(m_deformedMeshes[i])]);
+            deformedMeshes[i].rest = *reinterpret_cast<const VkBuffer *>(mesh.restBuf->nativeBuffer().objects[0]);
+            deformedMeshes[i].positions = *reinterpret_cast<const VkBuffer *>(mesh.vbuf->nativeBuffer().objects[0]);
+            deformedMeshes[i].attributes = *reinterpret_cast<const VkBuffer *>(mesh.attrBuf->nativeBuffer().objects[0]);
+            vertexCount += deformedMeshes[i].vertexCount;
+        }
+        if (!m_deformer.create(&m_vk, getSpirv(QLatin1String(":/deform.spv")), deformedMeshes, m_framesInFlight))
+            qFatal("Failed to create mesh deformer");
+        m_deformedMeshCount = deformedMeshes.count();
+        m_deformTimer.start();
+        // the instances stay the same, so the TLAS can be refit too
+        m_tlasFlags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_NV;
+        if (m_options.rebuildInterval > 0) {
+            qDebug("deforming %d meshes (%lld vertices) on the GPU, BLASes refit every frame, rebuilt every %d frames",
+                   m_deformedMeshCount, vertexCount, m_options.rebuildInterval);
+        } else {
+            qDebug("deforming %d meshes (%lld vertices) on the GPU, BLASes refit every frame, never rebuilt",
+                   m_deformedMeshCount, vertexCount);
+        }
+    }
 
-    // bottom level acceleration structure
+    // top level acceleration structure
     VkAccelerationStructureInfoNV accelInfo = {};
     accelInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
-    accelInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_NV;
-    accelInfo.instanceCount = 0;
-    accelInfo.geometryCount = 1;
-    accelInfo.pGeometries = &m_geometry;
+    accelInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_NV;
+    accelInfo.flags = m_tlasFlags;
+    accelInfo.instanceCount = uint32_t(m_scene.instances.count());
+    accelInfo.geometryCount = 0;
 
-    VkAccelerationStructureCreateInfoNV accelCreateInfo = {};
-    accelCreateInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_NV;
-    accelCreateInfo.info = accelInfo;
-    err = createAccelerationStructure(h->dev, &accelCreateInfo, nullptr, &m_blas);
+    VkMemoryRequirements scratchMemReq;
+    const VkDeviceSize tlasMemSize = allocateAccelerationStructure(accelInfo, &m_tlas, &m_tlasMem, &m_tlasHandle, &scratchMemReq);
+    qDebug("tlas memory needed: %llu", tlasMemSize);
+
+    // scratch buffer for building the TLAS, the BLAS builds have their own
+    qDebug("tlas scratch buffer size: %llu", scratchMemReq.size);
+    err = m_vk.createBuffer(scratchMemReq.size, VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                            &m_scratchBuf, &m_scratchBufMem, MemoryTracker::Scratch);
     if (err != VK_SUCCESS)
-        qFatal("Failed to create bottom level acceleration structure: %d", err);
+        qFatal("Failed to create scratch buffer: %d", err);
+
+    // instance buffer
+    QVector<uint64_t> blasHandles;
+    for (const RayMesh &mesh : m_meshes)
+        blasHandles.append(mesh.blas ? mesh.blasHandle : m_placeholderBlasHandle);
+    QByteArray instances(m_scene.instances.count() * int(sizeof(GeometryInstance)), Qt::Uninitialized);
+    packGeometryInstances(blasHandles, instances.data());
+
+    // The instance buffer and the shader binding table are read by the GPU on
+    // every TLAS build and every trace, so these live in device local memory,
+    // updated via a staging ring, unless this is an UMA device (or told otherwise).
+    switch (m_options.bufferPlacement) {
+    case RaytracingOptions::HostVisiblePlacement:
+        m_rayBufferPlacement = DeviceBuffer::HostVisible;
+        break;
+    case RaytracingOptions::DeviceLocalPlacement:
+        m_rayBufferPlacement = DeviceBuffer::DeviceLocal;
+        break;
+    default:
+        m_rayBufferPlacement = m_vk.isUma() ? DeviceBuffer::HostVisible : DeviceBuffer::DeviceLocal;
+        break;
+    }
+    qDebug("instance and shader binding table buffers are %s",
+           m_rayBufferPlacement == DeviceBuffer::HostVisible ? "host visible" : "device local");
 
-    VkAccelerationStructureMemoryRequirementsInfoNV memReqInfo = {};
-    memReqInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_INFO_NV;
-    memReqInfo.type = VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_OBJECT_NV;
-    memReqInfo.accelerationStructure = m_blas;
-    VkMemoryRequirements2 memReq = {};
-    getAccelerationStructureMemoryRequirements(h->dev, &memReqInfo, &memReq);
-    qDebug("blas memory needed: %llu", memReq.memoryRequirements.size);
+    if (!m_staging.create(&m_vk, m_framesInFlight, 64 * 1024))
+        qFatal("Failed to create staging ring");
 
-    VkMemoryAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memReq.memoryRequirements.size;
-    allocInfo.memoryTypeIndex = findMemTypeIndex(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memReq.memoryRequirements);
-    err = df->vkAllocateMemory(h->dev, &allocInfo, nullptr, &m_blasMem);
-    if (err != VK_SUCCESS)
-        qFatal("Failed to allocate memory for bottom level acceleration structure: %d", err);
+    const VkDeviceSize instanceBufSize = VkDeviceSize(instances.size());
+    if (!m_instanceBuf.create(&m_vk, m_rayBufferPlacement, instanceBufSize, VK_BUFFER_USAGE_RAY_TRACING_BIT_NV,
+                              m_framesInFlight, sizeof(GeometryInstance), MemoryTracker::Instances))
+    {
+        qFatal("Failed to create instance buffer");
+    }
+    m_instanceBuf.update(0, instances.constData(), instanceBufSize);
 
-    VkBindAccelerationStructureMemoryInfoNV accelMemInfo = {};
-    accelMemInfo.sType = VK_STRUCTURE_TYPE_BIND_ACCELERATION_STRUCTURE_MEMORY_INFO_NV;
-    accelMemInfo.accelerationStructure = m_blas;
-    accelMemInfo.memory = m_blasMem;
-    bindAccelerationStructureMemory(h->dev, 1, &accelMemInfo);
+    // the shader binding table gets (re)built whenever the pipeline changes
+    m_sbt.setDeviceLimits(m_raytracingProps.shaderGroupHandleSize,
+                          m_raytracingProps.shaderGroupBaseAlignment,
+                          m_raytracingProps.maxShaderGroupStride);
+    updateShaderBindingTable();
 
-    getAccelerationStructureHandle(h->dev, m_blas, sizeof(uint64_t), &m_blasHandle);
+    createDescriptorSets(this);
 
-    // top level acceleration structure
-    accelInfo = {};
-    accelInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
-    accelInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_NV;
-    accelInfo.instanceCount = 1;
-    accelInfo.geometryCount = 0;
+    if (!m_gpuTimer.create(&m_vk, m_framesInFlight))
+        qFatal("Failed to create GPU timer");
 
-    accelCreateInfo = {};
-    accelCreateInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_NV;
-    accelCreateInfo.info = accelInfo;
-    err = createAccelerationStructure(h->dev, &accelCreateInfo, nullptr, &m_tlas);
-    if (err != VK_SUCCESS)
-        qFatal("Failed to create top level acceleration structure: %d", err);
+    if (m_options.benchmarkPlacement)
+        setRayBufferPlacement(DeviceBuffer::HostVisible);
 
-    memReqInfo.type = VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_OBJECT_NV;
-    memReqInfo.accelerationStructure = m_tlas;
-    getAccelerationStructureMemoryRequirements(h->dev, &memReqInfo, &memReq);
-    qDebug("tlas memory needed: %llu", memReq.memoryRequirements.size);
+    m_needsRayBuild = true;
 
-    allocInfo.allocationSize = memReq.memoryRequirements.size;
-    allocInfo.memoryTypeIndex = findMemTypeIndex(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memReq.memoryRequirements);
-    err = df->vkAllocateMemory(h->dev, &allocInfo, nullptr, &m_tlasMem);
-    if (err != VK_SUCCESS)
-        qFatal("Failed to allocate memory for top level acceleration structure: %d", err);
+    // The GPU resources are still all there, just unused, to keep the
+    // distributed mode out of the way of everything else.
+    if (m_options.benchmarkTileWorkers) {
+        m_tileBenchmarkWorkers = 1;
+        m_tileBenchmarkMs.fill(0, m_options.benchmarkTileWorkers);
+        m_tileBenchmarkStolen.fill(0, m_options.benchmarkTileWorkers);
+    }
+    const int tileWorkerCount = m_tileBenchmarkWorkers ? m_tileBenchmarkWorkers : m_options.tileWorkerCount;
+    if (tileWorkerCount) {
+        m_tileFarm.reset(new TileCoordinator);
+        if (m_tileFarm->start(tileWorkerCount, m_options.arguments)) {
+            qDebug("tracing on the CPU in %d worker process(es), %dx%d tiles", tileWorkerCount,
+                   TileCoordinator::TILE_SIZE, TileCoordinator::TILE_SIZE);
+        } else {
+            m_tileFarm.reset();
+            m_tileBenchmarkWorkers = 0;
+        }
+    }
 
-    accelMemInfo.accelerationStructure = m_tlas;
-    accelMemInfo.memory = m_tlasMem;
-    bindAccelerationStructureMemory(h->dev, 1, &accelMemInfo);
+    if (m_options.benchmarkDenoise) {
+        // the filter does the same amount of work regardless of the contents,
+        // so it just runs on an image of the largest size nothing writes to
+        if (!m_benchmarkDenoiser.create(&m_vk, getSpirv(QLatin1String(":/denoise.spv")), m_framesInFlight) || !m_benchmarkDenoiser.isValid())
+            qFatal("Failed to create denoiser");
+        m_benchmarkDenoiser.setIterationCount(m_denoiser.isEnabled() ? m_denoiser.iterationCount() : 4);
+        VkResult err = m_vk.createImage(3840, 2160, 1, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_STORAGE_BIT,
+                                        &m_denoiseBenchmarkImage, &m_denoiseBenchmarkImageMem, &m_denoiseBenchmarkImageView);
+        if (err != VK_SUCCESS)
+            qFatal("Failed to create denoiser benchmark image: %d", err);
+        m_denoiseBenchmarkImageState.image = m_denoiseBenchmarkImage;
+    }
 
-    getAccelerationStructureHandle(h->dev, m_tlas, sizeof(uint64_t), &m_tlasHandle);
+    // the pipeline only when rasterizing, the hybrid raygen shader needs the images regardless
+    const bool rasterizes = m_options.hybrid || m_options.benchmarkHybrid;
+    m_gbuffer.create(m_rhi.get(), &m_vk, m_framesInFlight,
+                     getShader(QLatin1String(":/gbuffer.vert.qsb")), getShader(QLatin1String(":/gbuffer.frag.qsb")),
+                     rasterizes ? m_scene.instances.count() : 0, m_materialTextures,
+                     m_meshes.empty() ? 0 : m_meshes[0].positionStride);
+
+    if (m_context) {
+        // the BLAS scratch buffer is allocated on demand, up to the budget
+        quint64 sharedBytes = blasMemSize + tlasMemSize + scratchMemReq.size + qMin(m_options.scratchBudget, blasScratchSize);
+        for (const RayMesh &mesh : m_meshes)
+            sharedBytes += quint64(mesh.vbuf->size() + mesh.attrBuf->size() + (mesh.ibuf ? mesh.ibuf->size() : 0)
+                                   + (mesh.restBuf ? mesh.restBuf->size() : 0));
+        for (const std::unique_ptr<QRhiTexture> &t : m_materialTextures)
+            sharedBytes += quint64(t->pixelSize().width()) * quint64(t->pixelSize().height()) * 4;
+        sharedBytes += quint64(m_instanceDataBuf->size() + m_materialBuf->size());
+        const quint64 rayBufferCopies = m_rayBufferPlacement == DeviceBuffer::HostVisible ? quint64(m_framesInFlight) : 1;
+        sharedBytes += rayBufferCopies * (m_instanceBuf.size() + m_sbtBuf.size()) + quint64(m_framesInFlight) * m_staging.sizePerFrame();
+        m_context->reportMemoryUsage(this, sharedBytes, perWindowMemoryBytes(m_tex.get(), m_ubuf.get(), m_framesInFlight));
+    }
 
-    // scratch buffer for vkCmdBuildAccelerationStructureNV
-    VkDeviceSize scratchSize = 0;
-    memReqInfo.type = VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_BUILD_SCRATCH_NV;
-    memReqInfo.accelerationStructure = m_blas;
-    getAccelerationStructureMemoryRequirements(h->dev, &memReqInfo, &memReq);
-    qDebug("blas scratch buffer size: %llu", memReq.memoryRequirements.size);
-    scratchSize = memReq.memoryRequirements.size;
-    memReqInfo.accelerationStructure = m_tlas;
-    getAccelerationStructureMemoryRequirements(h->dev, &memReqInfo, &memReq);
-    qDebug("tlas scratch buffer size: %llu", memReq.memoryRequirements.size);
-    scratchSize = qMax(scratchSize, memReq.memoryRequirements.size);
-
-    bufInfo.size = scratchSize;
-    df->vkCreateBuffer(h->dev, &bufInfo, nullptr, &m_scratchBuf);
-    df->vkGetBufferMemoryRequirements(h->dev, m_scratchBuf, &bufMemReq);
-    bufMemAllocInfo.allocationSize = bufMemReq.size;
-    bufMemAllocInfo.memoryTypeIndex = findMemTypeIndex(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, bufMemReq);
-    err = df->vkAllocateMemory(h->dev, &bufMemAllocInfo, nullptr, &m_scratchBufMem);
-    if (err != VK_SUCCESS)
-        qFatal("Failed to allocate scratch buffer memory: %d", err);
-    df->vkBindBufferMemory(h->dev, m_scratchBuf, m_scratchBufMem, 0);
+    reportRhiMemory();
+    updateMemoryBudget();
+    m_memoryTracker.log();
+    if (!m_options.memoryReportFile.isEmpty()) {
+        qDebug("writing memory reports to %s every %d frames",
+               qPrintable(m_options.memoryReportFile), m_options.memoryReportInterval);
+        writeMemoryReport();
+    }
 
-    static const float modelMatrix4x3RowMajor[12] = {
-        1.0f, 0.0f, 0.0f, 0.0f,
-        0.0f, -1.0f, 0.0f, 0.0f,
-        0.0f, 0.0f, 1.0f, 0.0f
-    };
+    addBenchmarks();
+}
 
-    // instance buffer (the TLAS has only 1 instance in this example)
-    Q_ASSERT(sizeof(GeometryInstance) == 64);
-    GeometryInstance instance = {};
-    memcpy(instance.transform, modelMatrix4x3RowMajor, 12 * sizeof(float));
-    instance.mask = 0xFF;
-    //instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_CULL_DISABLE_BIT_NV;
-    //instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FRONT_COUNTERCLOCKWISE_BIT_NV;
-    instance.accelerationStructureHandle = m_blasHandle;
+// A window sharing the owner's scene only needs a uniform buffer with its own
+// camera, and descriptor sets referencing that and its own output image next
+// to the owner's resources.
+void RaytracingWindow::initView()
+{
+    const RaytracingWindow *owner = m_context->owner();
+    qDebug("window %p shares the device and scene of %p", static_cast<void *>(this), static_cast<const void *>(owner));
 
-    bufInfo.size = sizeof(GeometryInstance);
-    df->vkCreateBuffer(h->dev, &bufInfo, nullptr, &m_instanceBuf);
-    df->vkGetBufferMemoryRequirements(h->dev, m_instanceBuf, &bufMemReq);
-    bufMemAllocInfo.allocationSize = bufMemReq.size;
-    bufMemAllocInfo.memoryTypeIndex = findMemTypeIndex(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, bufMemReq);
-    err = df->vkAllocateMemory(h->dev, &bufMemAllocInfo, nullptr, &m_instanceBufMem);
-    if (err != VK_SUCCESS)
-        qFatal("Failed to allocate instance buffer memory: %d", err);
-    df->vkBindBufferMemory(h->dev, m_instanceBuf, m_instanceBufMem, 0);
+    m_ubuf.reset(m_rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, MAX_VIEWS * 64 * 2));
+    m_ubuf->create();
 
-    df->vkMapMemory(h->dev, m_instanceBufMem, 0, sizeof(GeometryInstance), 0, reinterpret_cast<void **>(&p));
-    memcpy(p, &instance, sizeof(GeometryInstance));
-    df->vkUnmapMemory(h->dev, m_instanceBufMem);
+    createDescriptorSets(owner);
 
-    // buffer for shader binding table
-    const uint32_t sghSize = m_raytracingProps.shaderGroupHandleSize;
-    const uint32_t sbtSize = sghSize * 3;
-    bufInfo.size = sbtSize;
-    df->vkCreateBuffer(h->dev, &bufInfo, nullptr, &m_sbtBuf);
-    df->vkGetBufferMemoryRequirements(h->dev, m_sbtBuf, &bufMemReq);
-    bufMemAllocInfo.allocationSize = bufMemReq.size;
-    bufMemAllocInfo.memoryTypeIndex = findMemTypeIndex(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, bufMemReq);
-    err = df->vkAllocateMemory(h->dev, &bufMemAllocInfo, nullptr, &m_sbtBufMem);
-    if (err != VK_SUCCESS)
-        qFatal("Failed to allocate shader binding table buffer memory: %d", err);
-    df->vkBindBufferMemory(h->dev, m_sbtBuf, m_sbtBufMem, 0);
+    m_gbuffer.create(m_rhi.get(), &m_vk, m_framesInFlight, QShader(), QShader(), 0, m_materialTextures, 0);
 
-    QVector<quint8> shaderHandles;
-    shaderHandles.resize(sbtSize);
-    getRayTracingShaderGroupHandles(h->dev, m_rayPipeline, 0, 3, sbtSize, shaderHandles.data());
+    if (!m_gpuTimer.create(&m_vk, m_framesInFlight))
+        qFatal("Failed to create GPU timer");
 
-    df->vkMapMemory(h->dev, m_sbtBufMem, 0, sbtSize, 0, reinterpret_cast<void **>(&p));
-    memcpy(p, shaderHandles.constData(), sbtSize);
-    df->vkUnmapMemory(h->dev, m_sbtBufMem);
+    m_context->reportMemoryUsage(this, 0, perWindowMemoryBytes(m_tex.get(), m_ubuf.get(), m_framesInFlight));
+    reportRhiMemory();
+}
 
-    // descriptor sets (have to deal with double buffering)
+// Creates the descriptor pool and a descriptor set per frame in flight,
+// using the set layout and the bindless geometry and material resources of
+// resources, which is either this window or the owner of the shared scene.
+void RaytracingWindow::createDescriptorSets(const RaytracingWindow *resources)
+{
+    const QRhiVulkanNativeHandles *h = static_cast<const QRhiVulkanNativeHandles *>(m_rhi->nativeHandles());
+    QVulkanDeviceFunctions *df = vulkanInstance()->deviceFunctions(h->dev);
+
+    const uint32_t meshCount = uint32_t(resources->m_meshes.size());
+    const uint32_t textureCount = uint32_t(resources->m_materialTextures.size());
+    const uint32_t storageBufferCount = 3 + 2 * meshCount; // the last is the any-hit counter
+
+    const uint32_t setCount = uint32_t(m_framesInFlight);
+    const VkDescriptorPoolSize descPoolSizes[] = {
+        { VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_NV, setCount },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, setCount * 4 },
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, setCount },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, setCount * storageBufferCount },
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setCount * textureCount }
+    };
+    VkDescriptorPoolCreateInfo descPoolInfo = {};
+    descPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descPoolInfo.maxSets = setCount;
+    descPoolInfo.poolSizeCount = sizeof(descPoolSizes) / sizeof(descPoolSizes[0]);
+    descPoolInfo.pPoolSizes = descPoolSizes;
+    df->vkCreateDescriptorPool(h->dev, &descPoolInfo, nullptr, &m_rayDescPool);
+
+    // a set per frame slot, to deal with the frames in flight
     VkDescriptorSetAllocateInfo descSetAllocInfo = {};
     descSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     descSetAllocInfo.descriptorPool = m_rayDescPool;
-    descSetAllocInfo.descriptorSetCount = 2;
-    VkDescriptorSetLayout descSetLayouts[2] = { m_rayDescSetLayout, m_rayDescSetLayout };
-    descSetAllocInfo.pSetLayouts = descSetLayouts;
-    df->vkAllocateDescriptorSets(h->dev, &descSetAllocInfo, m_rayDescSet);
+    descSetAllocInfo.descriptorSetCount = setCount;
+    const QVector<VkDescriptorSetLayout> descSetLayouts(m_framesInFlight, resources->m_rayDescSetLayout);
+    descSetAllocInfo.pSetLayouts = descSetLayouts.constData();
+    m_rayDescSet.resize(m_framesInFlight);
+    df->vkAllocateDescriptorSets(h->dev, &descSetAllocInfo, m_rayDescSet.data());
+
+    // an any-hit counter per set, so per frame slot
+    m_anyHitCounterStride = qMax<VkDeviceSize>(sizeof(quint32), m_vk.props.limits.minStorageBufferOffsetAlignment);
+    VkResult err = m_vk.createBuffer(setCount * m_anyHitCounterStride, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                     &m_anyHitCounterBuf, &m_anyHitCounterBufMem);
+    if (err != VK_SUCCESS)
+        qFatal("Failed to create any-hit counter buffer: %d", err);
+    void *p;
+    df->vkMapMemory(h->dev, m_anyHitCounterBufMem, 0, VK_WHOLE_SIZE, 0, &p);
+    m_anyHitCounters = static_cast<quint32 *>(p);
+    memset(p, 0, size_t(setCount * m_anyHitCounterStride));
+    m_anyHitsCounted.fill(false, m_framesInFlight);
+
+    // the bindless part never changes, write it once into each set
+    {
+        QElapsedTimer descTimer;
+        descTimer.start();
+        QVector<VkDescriptorBufferInfo> bufferInfos;
+        bufferInfos.reserve(int(storageBufferCount));
+        bufferInfos.append({ *reinterpret_cast<const VkBuffer *>(resources->m_instanceDataBuf->nativeBuffer().objects[0]), 0, VK_WHOLE_SIZE });
+        bufferInfos.append({ *reinterpret_cast<const VkBuffer *>(resources->m_materialBuf->nativeBuffer().objects[0]), 0, VK_WHOLE_SIZE });
+        for (const RayMesh &mesh : resources->m_meshes)
+            bufferInfos.append({ *reinterpret_cast<const VkBuffer *>(mesh.attrBuf->nativeBuffer().objects[0]), 0, VK_WHOLE_SIZE });
+        // procedural meshes have no indices, but the descriptor must be valid
+        for (const RayMesh &mesh : resources->m_meshes) {
+            const QRhiBuffer *ibuf = mesh.ibuf ? mesh.ibuf.get() : mesh.attrBuf.get();
+            bufferInfos.append({ *reinterpret_cast<const VkBuffer *>(ibuf->nativeBuffer().objects[0]), 0, VK_WHOLE_SIZE });
+        }
+        QVector<VkDescriptorBufferInfo> anyHitCounterInfos;
+        for (int slot = 0; slot < m_framesInFlight; ++slot)
+            anyHitCounterInfos.append({ m_anyHitCounterBuf, VkDeviceSize(slot) * m_anyHitCounterStride, sizeof(quint32) });
+        QVector<VkDescriptorImageInfo> imageInfos;
+        for (VkImageView v : resources->m_materialTextureViews)
+            imageInfos.append({ resources->m_materialSampler, v, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL });
+
+        QVarLengthArray<VkWriteDescriptorSet, 18> writeDescSets;
+        for (int slot = 0; slot < m_framesInFlight; ++slot) {
+            VkWriteDescriptorSet w = {};
+            w.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            w.dstSet = m_rayDescSet[slot];
+            w.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            w.dstBinding = 3;
+            w.descriptorCount = 1;
+            w.pBufferInfo = &bufferInfos[0];
+            writeDescSets.append(w);
+            w.dstBinding = 4;
+            w.pBufferInfo = &bufferInfos[1];
+            writeDescSets.append(w);
+            w.dstBinding = 5;
+            w.descriptorCount = meshCount;
+            w.pBufferInfo = &bufferInfos[2];
+            writeDescSets.append(w);
+            w.dstBinding = 6;
+            w.pBufferInfo = &bufferInfos[2 + int(meshCount)];
+            writeDescSets.append(w);
+            w.dstBinding = 11;
+            w.descriptorCount = 1;
+            w.pBufferInfo = anyHitCounterInfos.constData() + slot;
+            writeDescSets.append(w);
+            w.dstBinding = 7;
+            w.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            w.descriptorCount = textureCount;
+            w.pBufferInfo = nullptr;
+            w.pImageInfo = imageInfos.constData();
+            writeDescSets.append(w);
+        }
+        df->vkUpdateDescriptorSets(h->dev, uint32_t(writeDescSets.count()), writeDescSets.constData(), 0, nullptr);
+        m_bindlessWriteTimeUs = descTimer.nsecsElapsed() / 1000;
+        qDebug("bindless descriptors: %u storage buffers, %u textures per set, written in %lld us",
+               storageBufferCount, textureCount, m_bindlessWriteTimeUs);
+    }
+}
 
-    m_needsRayBuild = true;
+// The size of one layer when tracing multiple views: the layers are shown as
+// a grid of tiles filling the window. Cubemap faces are square.
+QSize RaytracingWindow::multiViewSize(const QSize &outputSizeInPixels) const
+{
+    const int columns = qCeil(qSqrt(qreal(m_viewCount)));
+    const int rows = (m_viewCount + columns - 1) / columns;
+    QSize size(qMax(1, outputSizeInPixels.width() / columns), qMax(1, outputSizeInPixels.height() / rows));
+    if (m_viewCount == 6)
+        size = QSize(qMin(size.width(), size.height()), qMin(size.width(), size.height()));
+    return size;
 }
 
-void RaytracingWindow::customRender()
+// Writes the CameraView array of raygen.rgen. Six views are the faces of a
+// cubemap around the camera position, two are a stereo pair, any other number
+// is that many cameras spread around the scene.
+void RaytracingWindow::updateViewMatrices(QRhiResourceUpdateBatch *u, const QSize &outputSizeInPixels)
 {
-    QRhiResourceUpdateBatch *u = m_rhi->nextResourceUpdateBatch();
-    if (!m_vbufReady) {
-        m_vbufReady = true;
-        u->uploadStaticBuffer(m_quadVbuf.get(), quadVertexAndCoordData);
-        u->uploadStaticBuffer(m_vbuf.get(), vertexData);
-    }
-    if (m_matricesChanged) {
+    if (m_viewCount == 1) {
         u->updateDynamicBuffer(m_ubuf.get(), 0, 64, m_rayViewInverse.constData());
         u->updateDynamicBuffer(m_ubuf.get(), 64, 64, m_rayProjInverse.constData());
+        return;
     }
 
-    QRhiCommandBuffer *cb = m_sc->currentFrameCommandBuffer();
-    cb->resourceUpdate(u);
-    u = nullptr;
-
-    const QSize outputSizeInPixels = m_sc->currentPixelSize();
-    if (m_tex->pixelSize() != outputSizeInPixels) {
-        m_tex->setPixelSize(outputSizeInPixels);
-        m_tex->create();
+    // same as in Window::resizeSwapChain()
+    static const QMatrix4x4 depthCorrection(1.0f, 0.0f, 0.0f, 0.0f,
+                                            0.0f, 1.0f, 0.0f, 0.0f,
+                                            0.0f, 0.0f, 0.5f, 0.5f,
+                                            0.0f, 0.0f, 0.0f, 1.0f);
+    static const QVector3D cubeFaceDirections[6] = {
+        { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }
+    };
+    static const QVector3D cubeFaceUp[6] = {
+        { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 }
+    };
+    static const float STEREO_EYE_SEPARATION = 0.065f;
+
+    const QSize viewSize = multiViewSize(outputSizeInPixels);
+    const QVector3D eye = m_rayViewInverse.map(QVector3D(0, 0, 0));
+    for (int view = 0; view < m_viewCount; ++view) {
+        QMatrix4x4 viewMatrix;
+        QMatrix4x4 projMatrix = depthCorrection;
+        if (m_viewCount == 6) {
+            viewMatrix.lookAt(eye, eye + cubeFaceDirections[view], cubeFaceUp[view]);
+            projMatrix.perspective(90.0f, 1.0f, 0.01f, 1000.0f);
+        } else {
+            if (m_viewCount == 2)
+                viewMatrix.translate((view ? -0.5f : 0.5f) * STEREO_EYE_SEPARATION, 0, 0);
+            viewMatrix *= m_rayView;
+            if (m_viewCount > 2)
+                viewMatrix.rotate(360.0f * view / m_viewCount, 0, 1, 0);
+            projMatrix.perspective(45.0f, viewSize.width() / float(viewSize.height()), 0.01f, 1000.0f);
+        }
+        const int offset = view * 64 * 2;
+        u->updateDynamicBuffer(m_ubuf.get(), offset, 64, viewMatrix.inverted().constData());
+        u->updateDynamicBuffer(m_ubuf.get(), offset + 64, 64, projMatrix.inverted().constData());
     }
+}
 
+// Records the trace into m_tex, using the pipeline, shader binding table and
+// TLAS of resources (this window or the owner of the shared scene), followed
+// by the render pass drawing m_tex.
+void RaytracingWindow::traceScene(QRhiCommandBuffer *cb, const RaytracingWindow *resources)
+{
     const QRhiVulkanNativeHandles *h = static_cast<const QRhiVulkanNativeHandles *>(m_rhi->nativeHandles());
     QVulkanDeviceFunctions *df = vulkanInstance()->deviceFunctions(h->dev);
 
-    if (m_needsRayBuild) {
-        m_needsRayBuild = false;
-
-        cb->beginExternal();
-        VkCommandBuffer commandBuffer = static_cast<const QRhiVulkanCommandBufferNativeHandles *>(cb->nativeHandles())->commandBuffer;
-
-        // build bottom level acceleration structure
-        VkAccelerationStructureInfoNV buildInfo = {};
-        buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
-        buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_NV;
-        buildInfo.geometryCount = 1;
-        buildInfo.pGeometries = &m_geometry;
-        cmdBuildAccelerationStructure(commandBuffer, &buildInfo, VK_NULL_HANDLE, 0, VK_FALSE, m_blas, VK_NULL_HANDLE, m_scratchBuf, 0);
-
-        // because scratch is reused
-        VkMemoryBarrier memoryBarrier = {};
-        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
-        const VkAccessFlags accelAccess = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV;
-        memoryBarrier.srcAccessMask = accelAccess;
-        memoryBarrier.dstAccessMask = accelAccess;
-        df->vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV,
-                                 0, 1, &memoryBarrier, 0, 0, 0, 0);
-
-        // build top level acceleration structure
-        buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_NV;
-        buildInfo.instanceCount = 1;
-        buildInfo.geometryCount = 0;
-        buildInfo.pGeometries = nullptr;
-        cmdBuildAccelerationStructure(commandBuffer, &buildInfo, m_instanceBuf, 0, VK_FALSE, m_tlas, VK_NULL_HANDLE, m_scratchBuf, 0);
-
-        df->vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV,
-                                 0, 1, &memoryBarrier, 0, 0, 0, 0);
-
-        cb->endExternal();
-    }
+    const int currentFrameSlot = m_rhi->currentFrameSlot();
 
     VkImage image = VkImage(m_tex->nativeTexture().object);
     if (image != m_lastImage) {
@@ -631,7 +1693,7 @@ void RaytracingWindow::customRender()
         VkImageViewCreateInfo viewInfo = {};
         viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
         viewInfo.image = image;
-        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY; // raygen.rgen writes to an image2DArray
         viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
         viewInfo.components.r = VK_COMPONENT_SWIZZLE_R;
         viewInfo.components.g = VK_COMPONENT_SWIZZLE_G;
@@ -644,28 +1706,55 @@ void RaytracingWindow::customRender()
         viewInfo.subresourceRange.layerCount = 1;
         VkImageView v;
         df->vkCreateImageView(h->dev, &viewInfo, nullptr, &v);
-        if (!m_imageViews.isEmpty()) {
-            // assumes FramesInFlight is 2
-            for (int i = 0; i < m_imageViews.count() - 1; ++i)
+        // the views of the frames still in flight stay alive
+        const int releaseCount = m_imageViews.count() - (m_framesInFlight - 1);
+        if (releaseCount > 0) {
+            for (int i = 0; i < releaseCount; ++i)
                 df->vkDestroyImageView(h->dev, m_imageViews[i], nullptr);
-            m_imageViews.remove(0, m_imageViews.count() - 1);
+            m_imageViews.remove(0, releaseCount);
         }
         m_imageViews.append(v);
     }
     VkImageView imageView = m_imageViews.last();
 
-    const int currentFrameSlot = m_rhi->currentFrameSlot();
+    if (m_viewCount > 1) {
+        for (int i = m_retiredViewImages.count() - 1; i >= 0; --i) {
+            RetiredImage &retired(m_retiredViewImages[i]);
+            if (--retired.framesUntilRelease == 0) {
+                m_vk.destroyImage(retired.image, retired.mem, retired.view);
+                m_retiredViewImages.remove(i);
+            }
+        }
+        const QSize viewImageSize = multiViewSize(m_tex->pixelSize());
+        if (viewImageSize != m_viewImageSize) {
+            if (m_viewImage)
+                m_retiredViewImages.append({ m_viewImage, m_viewImageMem, m_viewImageView, m_framesInFlight });
+            m_viewImageSize = viewImageSize;
+            VkResult err = m_vk.createImage(uint32_t(viewImageSize.width()), uint32_t(viewImageSize.height()), uint32_t(m_viewCount),
+                                            VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                                            &m_viewImage, &m_viewImageMem, &m_viewImageView);
+            if (err != VK_SUCCESS)
+                qFatal("Failed to create layered output image: %d", err);
+            m_viewImageState = FrameGraph::Resource();
+            m_viewImageState.image = m_viewImage;
+        }
+        imageView = m_viewImageView;
+    }
+
+    const QSize launchSize = m_viewCount > 1 ? m_viewImageSize : m_tex->pixelSize();
+    m_denoiser.prepare(launchSize, m_viewCount);
+    m_gbuffer.prepare(m_hybrid ? launchSize : m_gbuffer.size());
 
     // Dynamic QRhiBuffers are backed by multiple native buffers, pick the current one
     VkBuffer ubuf = *reinterpret_cast<const VkBuffer *>(m_ubuf->nativeBuffer().objects[currentFrameSlot]);
 
     {
-        VkWriteDescriptorSet writeDescSet[3] = {};
+        VkWriteDescriptorSet writeDescSet[6] = {};
 
         VkWriteDescriptorSetAccelerationStructureNV accelWriteDescSet = {};
         accelWriteDescSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_NV;
         accelWriteDescSet.accelerationStructureCount = 1;
-        accelWriteDescSet.pAccelerationStructures = &m_tlas;
+        accelWriteDescSet.pAccelerationStructures = &resources->m_tlas;
         writeDescSet[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         writeDescSet[0].pNext = &accelWriteDescSet;
         writeDescSet[0].dstSet = m_rayDescSet[currentFrameSlot];
@@ -674,7 +1763,7 @@ void RaytracingWindow::customRender()
         writeDescSet[0].descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_NV;
 
         VkDescriptorImageInfo descImageInfo = {};
-        descImageInfo.imageView = imageView;
+        descImageInfo.imageView = m_denoiser.traceTarget(imageView);
         descImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
         writeDescSet[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -695,64 +1784,192 @@ void RaytracingWindow::customRender()
         writeDescSet[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
         writeDescSet[2].pBufferInfo = &descBufferInfo;
 
-        df->vkUpdateDescriptorSets(h->dev, 3, writeDescSet, 0, nullptr);
+        VkDescriptorImageInfo guideImageInfo = {};
+        guideImageInfo.imageView = m_denoiser.guideView();
+        guideImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        writeDescSet[3] = writeDescSet[1];
+        writeDescSet[3].dstBinding = 8;
+        writeDescSet[3].pImageInfo = &guideImageInfo;
+
+        VkDescriptorImageInfo gbufferImageInfo[2] = {};
+        gbufferImageInfo[0].imageView = m_gbuffer.albedoView();
+        gbufferImageInfo[0].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        gbufferImageInfo[1].imageView = m_gbuffer.normalDistanceView();
+        gbufferImageInfo[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        for (int i = 0; i < 2; ++i) {
+            writeDescSet[4 + i] = writeDescSet[1];
+            writeDescSet[4 + i].dstBinding = uint32_t(9 + i);
+            writeDescSet[4 + i].pImageInfo = &gbufferImageInfo[i];
+        }
+
+        df->vkUpdateDescriptorSets(h->dev, 6, writeDescSet, 0, nullptr);
     }
 
+    if (m_hybrid)
+        rasterizeGBuffer(cb);
+
     {
         // Raytracing pass: writes to m_tex
+        CpuProfiler::Scope scope(&m_cpuProfiler, "external: trace");
         cb->beginExternal();
         VkCommandBuffer commandBuffer = static_cast<const QRhiVulkanCommandBufferNativeHandles *>(cb->nativeHandles())->commandBuffer;
 
-        VkImageMemoryBarrier imageBarrier = {};
-        imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        imageBarrier.subresourceRange.baseMipLevel = 0;
-        imageBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
-        imageBarrier.subresourceRange.baseArrayLayer = 0;
-        imageBarrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
-        imageBarrier.image = image;
-
-        imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
-        imageBarrier.srcAccessMask = 0;
-        imageBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-        df->vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-                                 0, nullptr, 0, nullptr, 1, &imageBarrier);
-
-        df->vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_rayPipeline);
-        df->vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_rayPipelineLayout, 0, 1, &m_rayDescSet[currentFrameSlot], 0, nullptr);
-
-        const uint32_t sghSize = m_raytracingProps.shaderGroupHandleSize;
-        VkDeviceSize bindingOffsetRayGenShader = 0;
-        VkDeviceSize bindingOffsetMissShader = sghSize;
-        VkDeviceSize bindingOffsetHitShader = 2 * sghSize;
-
-        cmdTraceRays(commandBuffer,
-                     m_sbtBuf, bindingOffsetRayGenShader,
-                     m_sbtBuf, bindingOffsetMissShader, sghSize,
-                     m_sbtBuf, bindingOffsetHitShader, sghSize,
-                     VK_NULL_HANDLE, 0, 0,
-                     m_tex->pixelSize().width(), m_tex->pixelSize().height(), 1);
-
-        imageBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
-        imageBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-        imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        df->vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-                                 0, nullptr, 0, nullptr, 1, &imageBarrier);
+        if (resources != this) {
+            // The owner's builds and uploads were submitted earlier to the
+            // same queue, make their results visible to the trace.
+            m_gpuTimer.beginFrame(commandBuffer, currentFrameSlot);
+            m_frameGraph.externalAccess(&m_tlasState,
+                                        VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                        VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV | VK_ACCESS_TRANSFER_WRITE_BIT);
+            m_frameGraph.access(&m_tlasState, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV,
+                                VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV | VK_ACCESS_SHADER_READ_BIT);
+        } else {
+            const VkPipelineStageFlags stage = VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV;
+            m_frameGraph.access(&m_tlasState, stage, VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV);
+            m_frameGraph.access(&m_blasState, stage, VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV);
+            m_frameGraph.access(&m_geometryState, stage, VK_ACCESS_SHADER_READ_BIT);
+        }
+
+        // the previous frame's composition was the last to use m_tex
+        m_frameGraph.importTexture(&m_outputState, m_tex.get(),
+                                   VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        // with multiple views the trace goes to the layered image instead
+        FrameGraph::Resource *traceOutput = m_viewCount > 1 ? &m_viewImageState : &m_outputState;
+        m_denoiser.declareTrace(&m_frameGraph, traceOutput);
+        m_gbuffer.declareTrace(&m_frameGraph);
+
+        // The previous frame in this slot has completed, collect its any-hit
+        // count. Resetting it needs no barrier, the submission makes host
+        // writes visible.
+        quint32 &anyHitCounter(m_anyHitCounters[currentFrameSlot * m_anyHitCounterStride / sizeof(quint32)]);
+        if (m_anyHitsCounted[currentFrameSlot]) {
+            m_anyHitInvocations += anyHitCounter;
+            ++m_anyHitFrames;
+        }
+        anyHitCounter = 0;
+        m_anyHitsCounted[currentFrameSlot] = m_countAnyHits;
+        if (m_countAnyHits) {
+            m_frameGraph.access(&m_anyHitCounterState, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV,
+                                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+        }
+        m_frameGraph.flush(commandBuffer);
+
+        df->vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, resources->m_rayPipeline);
+        df->vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, resources->m_rayPipelineLayout,
+                                    0, 1, &m_rayDescSet[currentFrameSlot], 0, nullptr);
+
+        // the views' frame slots have nothing to do with the owner's, but
+        // in that case the buffer is device local, so there is only one
+        const VkBuffer sbtBuf = resources->m_sbtBuf.buffer(currentFrameSlot);
+        const ShaderBindingTable &sbt(resources->m_sbt);
+        // see updateShaderBindingTable()
+        const SbtVariant &variant(resources->m_sbtVariants[m_inlineShading ? 1 : 0]);
+        const int rayGenRecord = m_hybrid ? resources->m_hybridRayGenRecord : variant.rayGen;
+        const bool hasCallables = sbt.recordCount(ShaderBindingTable::Callable) > 0;
+        // All views in one launch, with the depth selecting the view, or
+        // (for comparison) one launch per view.
+        const int launchCount = m_multiViewSeparateLaunches ? m_viewCount : 1;
+        const int launchDepth = m_multiViewSeparateLaunches ? 1 : m_viewCount;
+        ++m_frameIndex;
+        // the flags in raygen.rgen
+        quint32 rayGenFlags = m_denoiser.isEnabled() ? 0x01 : 0;
+        if (m_options.secondaryRays)
+            rayGenFlags |= 0x02 | 0x04; // shadows, ambient occlusion
+        if (m_closestHitOcclusion)
+            rayGenFlags |= 0x08;
+        if (m_countAnyHits)
+            rayGenFlags |= 0x10; // for anyhit.rahit
+        m_gpuTimer.begin(commandBuffer, "trace");
+        for (int launch = 0; launch < launchCount; ++launch) {
+            // laid out as PushConstants in raygen.rgen
+            const quint32 pushConstants[4] = {
+                quint32(launch),
+                quint32(m_options.samplesPerPixel),
+                m_frameIndex,
+                rayGenFlags
+            };
+            df->vkCmdPushConstants(commandBuffer, resources->m_rayPipelineLayout,
+                                   VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_ANY_HIT_BIT_NV,
+                                   0, sizeof(pushConstants), pushConstants);
+            cmdTraceRays(commandBuffer,
+                         sbtBuf, sbt.offset(ShaderBindingTable::RayGen, rayGenRecord),
+                         sbtBuf, sbt.offset(ShaderBindingTable::Miss, variant.miss), sbt.stride(ShaderBindingTable::Miss),
+                         sbtBuf, sbt.offset(ShaderBindingTable::Hit, variant.hit), sbt.stride(ShaderBindingTable::Hit),
+                         hasCallables ? sbtBuf : VK_NULL_HANDLE,
+                         sbt.offset(ShaderBindingTable::Callable), sbt.stride(ShaderBindingTable::Callable),
+                         uint32_t(launchSize.width()), uint32_t(launchSize.height()), uint32_t(launchDepth));
+        }
+        m_gpuTimer.end(commandBuffer, "trace");
+        // read by the next frame in this slot
+        if (m_countAnyHits)
+            m_frameGraph.access(&m_anyHitCounterState, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+
+        if (m_denoiser.isEnabled()) {
+            m_gpuTimer.begin(commandBuffer, "denoise");
+            m_denoiser.record(commandBuffer, &m_frameGraph, currentFrameSlot, imageView, traceOutput);
+            m_gpuTimer.end(commandBuffer, "denoise");
+        }
+        if (!m_denoiseBenchmarkSize.isEmpty())
+            recordDenoiseBenchmark(commandBuffer, currentFrameSlot);
+
+        if (m_viewCount > 1) {
+            // copy the layers into m_tex, laid out as a grid
+            m_frameGraph.access(&m_viewImageState, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+            m_frameGraph.access(&m_outputState, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+            m_frameGraph.flush(commandBuffer);
+
+            const VkClearColorValue clearColor = { { 1.0f, 1.0f, 1.0f, 1.0f } };
+            const VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+            df->vkCmdClearColorImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearColor, 1, &range);
+            m_frameGraph.access(&m_outputState, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+            m_frameGraph.flush(commandBuffer);
+
+            const int columns = qCeil(qSqrt(qreal(m_viewCount)));
+            QVarLengthArray<VkImageCopy, MAX_VIEWS> copies;
+            for (int view = 0; view < m_viewCount; ++view) {
+                VkImageCopy copy = {};
+                copy.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, uint32_t(view), 1 };
+                copy.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+                copy.dstOffset = { (view % columns) * m_viewImageSize.width(), (view / columns) * m_viewImageSize.height(), 0 };
+                copy.extent = { uint32_t(m_viewImageSize.width()), uint32_t(m_viewImageSize.height()), 1 };
+                copies.append(copy);
+            }
+            df->vkCmdCopyImage(commandBuffer, m_viewImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                               image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, uint32_t(copies.count()), copies.constData());
+        }
+
+        if (m_capture.isValid() && m_capture.wantsFrame()) {
+            m_gpuTimer.begin(commandBuffer, "capture copy");
+            m_capture.record(commandBuffer, &m_frameGraph, &m_outputState, m_tex->pixelSize());
+            m_gpuTimer.end(commandBuffer, "capture copy");
+        }
+
+        // Hand the images back to QRhi: m_tex to the composition below, the
+        // G-buffer to the next frame's rasterization. The graph reports the
+        // layouts to the QRhi backend (setNativeLayout), without that QRhi
+        // would record incorrect transitions from whatever it last knew of.
+        m_frameGraph.access(&m_outputState, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        m_gbuffer.declareRasterization(&m_frameGraph);
+        m_frameGraph.flush(commandBuffer);
+        m_frameGraph.endFrame();
 
         cb->endExternal();
     }
 
-    // Communicate to the QRhi backend that the image backing m_tex is in this
-    // layout. Without this we would get at least one incorrect layout
-    // transition because m_tex is probably PREINITIALIZED initially, and
-    // nothing QRhi recorded on the command buffer changed that so far. But
-    // what we recorded above does just that.
-    m_tex->setNativeLayout(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    drawTexturedQuad(cb);
+}
 
-    // Render pass: draw a quad textured with m_tex
-    cb->beginPass(m_sc->currentFrameRenderTarget(), Qt::white, { 1.0f, 0 });
+// Render pass: draw a quad textured with m_tex
+void RaytracingWindow::drawTexturedQuad(QRhiCommandBuffer *cb, QRhiResourceUpdateBatch *u)
+{
+    const QSize outputSizeInPixels = m_sc->currentPixelSize();
+    cb->beginPass(m_sc->currentFrameRenderTarget(), Qt::white, { 1.0f, 0 }, u);
     cb->setGraphicsPipeline(m_quadPs.get());
     cb->setShaderResources();
     cb->setViewport({ 0, 0, float(outputSizeInPixels.width()), float(outputSizeInPixels.height()) });
@@ -761,3 +1978,1648 @@ void RaytracingWindow::customRender()
     cb->draw(6);
     cb->endPass();
 }
+
+// Laid out as GBufferPass::Instance: the same transforms as in the TLAS, and
+// the inverse transpose for the normals like the hit shader does with
+// gl_WorldToObjectNV.
+QVector<GBufferPass::Instance> RaytracingWindow::gbufferInstances() const
+{
+    QVector<GBufferPass::Instance> instances(m_scene.instances.count());
+    for (int i = 0; i < instances.count(); ++i) {
+        GBufferPass::Instance &instance(instances[i]);
+        float rows[16] = {};
+        for (int c = 0; c < InstanceTransforms::COMPONENTS; ++c)
+            rows[c] = m_instanceTransforms.components(c)[i];
+        rows[15] = 1.0f;
+        const QMatrix4x4 world(rows);
+        memcpy(instance.world, world.constData(), sizeof(instance.world));
+        const QMatrix3x3 normalMatrix = world.normalMatrix();
+        memset(instance.normalMatrix, 0, sizeof(instance.normalMatrix));
+        for (int col = 0; col < 3; ++col) {
+            for (int row = 0; row < 3; ++row)
+                instance.normalMatrix[col * 4 + row] = normalMatrix(row, col);
+        }
+        const SceneMaterial &material(m_scene.materials[m_scene.instances[i].material]);
+        memcpy(instance.baseColor, material.baseColor, sizeof(instance.baseColor));
+        instance.uvScale[0] = material.uvScale;
+        instance.uvScale[1] = instance.uvScale[2] = instance.uvScale[3] = 0.0f;
+    }
+    return instances;
+}
+
+// Rasterizes the primary visibility for the hybrid mode, with each instance
+// at its currently selected level of detail, like in the TLAS.
+void RaytracingWindow::rasterizeGBuffer(QRhiCommandBuffer *cb)
+{
+    CpuProfiler::Scope scope(&m_cpuProfiler, "gbuffer");
+
+    QRhiResourceUpdateBatch *u = m_rhi->nextResourceUpdateBatch();
+    m_gbuffer.updateCamera(u, m_rayProj * m_rayView, m_rayViewInverse.map(QVector3D(0, 0, 0)));
+    if (!m_gbufferInstancesUploaded || m_options.animateInstances) {
+        m_gbuffer.updateInstances(u, gbufferInstances());
+        m_gbufferInstancesUploaded = true;
+    }
+
+    m_gbufferDraws.resize(m_scene.instances.count());
+    for (int i = 0; i < m_scene.instances.count(); ++i) {
+        const SceneInstance &instance(m_scene.instances[i]);
+        const int mesh = instance.mesh + m_instanceLods[i];
+        const RayMesh &rayMesh(m_meshes[size_t(mesh)]);
+        m_gbufferDraws[i] = { rayMesh.vbuf.get(), rayMesh.attrBuf.get(), rayMesh.ibuf.get(),
+                              quint32(m_scene.meshes[mesh].indices.count()),
+                              int(m_scene.materials[instance.material].texture) };
+    }
+
+    cb->beginExternal();
+    m_gpuTimer.begin(static_cast<const QRhiVulkanCommandBufferNativeHandles *>(cb->nativeHandles())->commandBuffer, "gbuffer");
+    cb->endExternal();
+
+    m_gbuffer.record(cb, m_gbufferDraws, u);
+
+    cb->beginExternal();
+    m_gpuTimer.end(static_cast<const QRhiVulkanCommandBufferNativeHandles *>(cb->nativeHandles())->commandBuffer, "gbuffer");
+    cb->endExternal();
+}
+
+void RaytracingWindow::uploadScene(QRhiResourceUpdateBatch *u)
+{
+    for (int i = 0; i < m_scene.meshes.count(); ++i) {
+        const SceneMesh &sceneMesh(m_scene.meshes[i]);
+        RayMesh &mesh(m_meshes[size_t(i)]);
+        u->uploadStaticBuffer(mesh.vbuf.get(), mesh.positionData.constData());
+        u->uploadStaticBuffer(mesh.attrBuf.get(), mesh.attributeData.constData());
+        if (mesh.ibuf)
+            u->uploadStaticBuffer(mesh.ibuf.get(), sceneMesh.indices.constData());
+        if (mesh.alphaIbuf)
+            u->uploadStaticBuffer(mesh.alphaIbuf.get(), mesh.alphaIndexData.constData());
+        if (mesh.restBuf)
+            u->uploadStaticBuffer(mesh.restBuf.get(), mesh.restData.constData());
+        // the batch has its own copy
+        mesh.positionData.clear();
+        mesh.attributeData.clear();
+        mesh.alphaIndexData.clear();
+        mesh.restData.clear();
+    }
+    QVector<quint32> instanceData; // laid out as InstanceData in shading.glsl
+    for (const SceneInstance &instance : m_scene.instances)
+        instanceData.append({ quint32(instance.mesh), quint32(instance.material) });
+    u->uploadStaticBuffer(m_instanceDataBuf.get(), instanceData.constData());
+    u->uploadStaticBuffer(m_materialBuf.get(), m_scene.materials.constData());
+    for (int i = 0; i < m_scene.textures.count(); ++i)
+        u->uploadTexture(m_materialTextures[size_t(i)].get(), m_scene.textures[i]);
+}
+
+void RaytracingWindow::releaseAccelerationStructureSet(AccelerationStructureSet *set)
+{
+    for (const AccelerationStructureSet::Blas &blas : set->blas) {
+        destroyAccelerationStructure(m_vk.dev, blas.as, nullptr);
+        m_vk.freeMemory(blas.mem);
+    }
+    destroyAccelerationStructure(m_vk.dev, set->tlas, nullptr);
+    m_vk.freeMemory(set->tlasMem);
+    m_vk.destroyBuffer(set->instanceBuf, set->instanceBufMem);
+    m_vk.destroyBuffer(set->scratchBuf, set->scratchBufMem);
+    *set = AccelerationStructureSet();
+}
+
+// Called every frame, the retired sets are either swapped out by an async
+// build or hold the BLASes evicted by updateResidency().
+void RaytracingWindow::releaseRetiredAccelerationStructures()
+{
+    for (int i = m_retiredAccelSets.count() - 1; i >= 0; --i) {
+        if (--m_retiredAccelSets[i].framesUntilRelease <= 0) {
+            releaseAccelerationStructureSet(&m_retiredAccelSets[i]);
+            m_retiredAccelSets.removeAt(i);
+        }
+    }
+}
+
+// What instances of meshes without a BLAS point to. Masked out, so never
+// hit, but the TLAS build still wants a valid handle. The triangle is
+// inactive (NaN x), so this costs next to nothing to build and to keep.
+void RaytracingWindow::createPlaceholderBlas(VkMemoryRequirements *scratchMemReq)
+{
+    const float vertices[9] = { qQNaN(), 0, 0, qQNaN(), 0, 0, qQNaN(), 0, 0 };
+    VkResult err = m_vk.createBuffer(sizeof(vertices), VK_BUFFER_USAGE_RAY_TRACING_BIT_NV,
+                                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                     &m_placeholderVertexBuf, &m_placeholderVertexBufMem);
+    if (err != VK_SUCCESS)
+        qFatal("Failed to create placeholder vertex buffer: %d", err);
+    void *p;
+    m_vk.df->vkMapMemory(m_vk.dev, m_placeholderVertexBufMem, 0, sizeof(vertices), 0, &p);
+    memcpy(p, vertices, sizeof(vertices));
+    m_vk.df->vkUnmapMemory(m_vk.dev, m_placeholderVertexBufMem);
+
+    m_placeholderGeometry = {};
+    m_placeholderGeometry.sType = VK_STRUCTURE_TYPE_GEOMETRY_NV;
+    m_placeholderGeometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_NV;
+    m_placeholderGeometry.geometry.triangles.sType = VK_STRUCTURE_TYPE_GEOMETRY_TRIANGLES_NV;
+    m_placeholderGeometry.geometry.triangles.vertexData = m_placeholderVertexBuf;
+    m_placeholderGeometry.geometry.triangles.vertexCount = 3;
+    m_placeholderGeometry.geometry.triangles.vertexStride = 3 * sizeof(float);
+    m_placeholderGeometry.geometry.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
+    m_placeholderGeometry.geometry.triangles.indexType = VK_INDEX_TYPE_NONE_NV;
+    m_placeholderGeometry.geometry.aabbs.sType = VK_STRUCTURE_TYPE_GEOMETRY_AABB_NV;
+    m_placeholderGeometry.flags = VK_GEOMETRY_OPAQUE_BIT_NV;
+
+    VkAccelerationStructureInfoNV accelInfo = {};
+    accelInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
+    accelInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_NV;
+    accelInfo.geometryCount = 1;
+    accelInfo.pGeometries = &m_placeholderGeometry;
+    allocateAccelerationStructure(accelInfo, &m_placeholderBlas, &m_placeholderBlasMem, &m_placeholderBlasHandle, scratchMemReq);
+    m_placeholderScratchSize = scratchMemReq->size;
+}
+
+// What VK_EXT_memory_budget says can still be allocated from the largest
+// device local heap. Returns false when the extension is not there.
+bool RaytracingWindow::availableDeviceMemory(VkDeviceSize *available) const
+{
+    if (!getPhysicalDeviceMemoryProperties2)
+        return false;
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProps = {};
+    budgetProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 memProps = {};
+    memProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    memProps.pNext = &budgetProps;
+    getPhysicalDeviceMemoryProperties2(m_vk.physDev, &memProps);
+
+    const VkPhysicalDeviceMemoryProperties &props(memProps.memoryProperties);
+    int heap = -1;
+    for (uint32_t i = 0; i < props.memoryHeapCount; ++i) {
+        if ((props.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+                && (heap < 0 || props.memoryHeaps[i].size > props.memoryHeaps[heap].size))
+        {
+            heap = int(i);
+        }
+    }
+    if (heap < 0)
+        return false;
+
+    *available = budgetProps.heapUsage[heap] < budgetProps.heapBudget[heap]
+            ? budgetProps.heapBudget[heap] - budgetProps.heapUsage[heap] : 0;
+    return true;
+}
+
+// Passes VK_EXT_memory_budget's view of the heaps to the memory tracker.
+void RaytracingWindow::updateMemoryBudget()
+{
+    if (!getPhysicalDeviceMemoryProperties2)
+        return;
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProps = {};
+    budgetProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 memProps = {};
+    memProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    memProps.pNext = &budgetProps;
+    getPhysicalDeviceMemoryProperties2(m_vk.physDev, &memProps);
+    m_vk.memoryTracker->setBudget(budgetProps.heapBudget, budgetProps.heapUsage);
+}
+
+static quint64 rhiTextureBytes(const QRhiTexture *tex)
+{
+    // all RGBA8 here, apart from the G-buffer's, see GBufferPass::textureBytes()
+    return tex ? quint64(tex->pixelSize().width()) * quint64(tex->pixelSize().height()) * 4 : 0;
+}
+
+// QRhi allocates its buffers and textures itself, so these are reported to
+// the memory tracker as totals per window: textures, Immutable and Static
+// buffers in device local memory, Dynamic buffers in host visible memory
+// with a copy per frame in flight.
+void RaytracingWindow::reportRhiMemory()
+{
+    MemoryTracker *tracker = m_vk.memoryTracker;
+    const int deviceLocalHeap = tracker->heapOf(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    const int hostVisibleHeap = tracker->heapOf(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    // the same heap on UMA devices
+    quint64 bufferBytes[VK_MAX_MEMORY_HEAPS] = {};
+    quint64 textureBytes[VK_MAX_MEMORY_HEAPS] = {};
+
+    auto addBuffer = [&](const QRhiBuffer *buf) {
+        if (!buf)
+            return;
+        if (buf->type() == QRhiBuffer::Dynamic) {
+            if (hostVisibleHeap >= 0)
+                bufferBytes[hostVisibleHeap] += 2 * quint64(buf->size());
+        } else if (deviceLocalHeap >= 0) {
+            bufferBytes[deviceLocalHeap] += quint64(buf->size());
+        }
+    };
+    addBuffer(m_quadVbuf.get());
+    addBuffer(m_ubuf.get());
+    addBuffer(m_instanceDataBuf.get());
+    addBuffer(m_materialBuf.get());
+    for (const RayMesh &mesh : m_meshes) {
+        addBuffer(mesh.vbuf.get());
+        addBuffer(mesh.attrBuf.get());
+        addBuffer(mesh.ibuf.get());
+        addBuffer(mesh.alphaIbuf.get());
+        addBuffer(mesh.restBuf.get());
+    }
+    if (deviceLocalHeap >= 0) {
+        bufferBytes[deviceLocalHeap] += m_gbuffer.bufferBytes();
+        textureBytes[deviceLocalHeap] += rhiTextureBytes(m_tex.get()) + m_gbuffer.textureBytes();
+        for (const std::unique_ptr<QRhiTexture> &t : m_materialTextures)
+            textureBytes[deviceLocalHeap] += rhiTextureBytes(t.get());
+    }
+
+    for (int i = 0; i < tracker->heapCount(); ++i) {
+        tracker->setExternalBytes(this, MemoryTracker::RhiBuffers, i, bufferBytes[i]);
+        tracker->setExternalBytes(this, MemoryTracker::RhiTextures, i, textureBytes[i]);
+    }
+}
+
+void RaytracingWindow::writeMemoryReport()
+{
+    updateMemoryBudget();
+    m_memoryTracker.writeJson(m_options.memoryReportFile);
+}
+
+// Decides which meshes have a BLAS in this frame: those of the instances
+// intersecting the view frustum, at their current level of detail, as far as
+// the budget allows. The BLASes of the meshes to stream in are created here
+// and built in customRender(), the evicted ones are retired like a swapped
+// out AccelerationStructureSet since the previous frame may still trace
+// against them. Instances of meshes without a BLAS get masked out and
+// pointed to the placeholder.
+void RaytracingWindow::updateResidency()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // leave some room for everything else, the budget is only refreshed
+    // by the driver every now and then
+    VkDeviceSize budget = m_options.blasBudget;
+    VkDeviceSize available;
+    if (availableDeviceMemory(&available))
+        budget = qMin(budget, m_residency.usedBytes() + available / 10 * 9);
+    m_residency.setBudget(budget);
+
+    // side and near planes, normalized, pointing inwards
+    const QMatrix4x4 viewProj = m_rayProj * m_rayView;
+    QVector4D planes[5] = {
+        viewProj.row(3) + viewProj.row(0),
+        viewProj.row(3) - viewProj.row(0),
+        viewProj.row(3) + viewProj.row(1),
+        viewProj.row(3) - viewProj.row(1),
+        viewProj.row(2)
+    };
+    for (QVector4D &plane : planes)
+        plane /= plane.toVector3D().length();
+
+    m_visibleMeshes.clear();
+    for (int i = 0; i < m_scene.instances.count(); ++i) {
+        const QVector4D &bounds(m_instanceBounds[i]);
+        bool visible = true;
+        for (const QVector4D &plane : planes) {
+            if (QVector3D::dotProduct(plane.toVector3D(), bounds.toVector3D()) + plane.w() < -bounds.w()) {
+                visible = false;
+                break;
+            }
+        }
+        if (visible)
+            m_visibleMeshes.append(m_scene.instances[i].mesh + m_instanceLods[i]);
+    }
+
+    QVector<int> evicted;
+    m_streamIn.clear();
+    m_residency.update(m_visibleMeshes, &m_streamIn, &evicted);
+
+    if (!evicted.isEmpty()) {
+        AccelerationStructureSet retired;
+        for (int i : evicted) {
+            RayMesh &mesh(m_meshes[size_t(i)]);
+            retired.blas.append({ mesh.blas, mesh.blasMem, mesh.blasHandle, mesh.scratchSize });
+            mesh.blas = VK_NULL_HANDLE;
+            mesh.blasMem = VK_NULL_HANDLE;
+            mesh.blasHandle = 0;
+        }
+        retired.framesUntilRelease = m_framesInFlight;
+        m_retiredAccelSets.append(retired);
+    }
+
+    for (int i : m_streamIn) {
+        RayMesh &mesh(m_meshes[size_t(i)]);
+        VkAccelerationStructureInfoNV accelInfo = {};
+        accelInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
+        accelInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_NV;
+        accelInfo.flags = mesh.buildFlags;
+        accelInfo.geometryCount = mesh.geometryCount;
+        accelInfo.pGeometries = mesh.geometries;
+        allocateAccelerationStructure(accelInfo, &mesh.blas, &mesh.blasMem, &mesh.blasHandle, nullptr);
+    }
+
+    // only the mask and the BLAS handle of the instances that changed get rewritten
+    bool changed = false;
+    for (int i = 0; i < m_scene.instances.count(); ++i) {
+        const RayMesh &mesh(m_meshes[size_t(m_scene.instances[i].mesh + m_instanceLods[i])]);
+        const quint64 blasHandle = mesh.blas ? mesh.blasHandle : m_placeholderBlasHandle;
+        const quint32 mask = mesh.blas ? 0xFF : 0;
+        if (m_instanceTransforms.blasHandles()[i] == blasHandle && (m_instanceTransforms.customIndexAndMask()[i] >> 24) == mask)
+            continue;
+
+        changed = true;
+        m_instanceTransforms.setBlasHandle(i, blasHandle);
+        m_instanceTransforms.setMask(i, mask);
+        // animated instances get packed completely every frame anyway
+        if (!m_options.animateInstances) {
+            const VkDeviceSize offset = VkDeviceSize(i) * sizeof(GeometryInstance);
+            m_instanceBuf.update(offset + offsetof(GeometryInstance, accelerationStructureHandle) - 2 * sizeof(quint32),
+                                 m_instanceTransforms.customIndexAndMask() + i, sizeof(quint32));
+            m_instanceBuf.update(offset + offsetof(GeometryInstance, accelerationStructureHandle),
+                                 m_instanceTransforms.blasHandles() + i, sizeof(quint64));
+        }
+    }
+    if (changed) {
+        m_needsTlasBuild = true;
+        m_tlasRefitAllowed = false;
+    }
+
+    m_residencyCpuTimeNs += timer.nsecsElapsed();
+    if (++m_residencyFrame % 300 == 0)
+        reportResidency();
+}
+
+void RaytracingWindow::reportResidency()
+{
+    const BlasResidency::Statistics &stats(m_residency.statistics());
+    const double mb = 1024.0 * 1024.0;
+    qDebug("blas residency: %d of %d meshes resident, %.1f of %.1f MB, hit rate %.1f%%, "
+           "%d streamed in, %d evicted, %d deferred over the last 300 frames",
+           m_residency.residentCount(), m_residency.meshCount(),
+           m_residency.usedBytes() / mb, m_residency.budget() / mb,
+           stats.lookups ? 100.0 * stats.hits / stats.lookups : 100.0,
+           stats.streamedIn, stats.evictions, stats.deferred);
+    qDebug("blas residency stalls: %.3f ms/frame on the CPU, %.3f ms per stream-in on the GPU (%d so far)",
+           m_residencyCpuTimeNs / 300 / 1000000.0,
+           m_gpuTimer.averageMs("blas stream-in"), m_gpuTimer.sampleCount("blas stream-in"));
+    m_residency.resetStatistics();
+    m_residencyCpuTimeNs = 0;
+}
+
+// Only what goes through m_frameGraph: the barriers within passes (BlasBuilder
+// waves, denoiser iterations) and those of DeviceBuffer's uploads are not
+// counted. Run with --unbatched-barriers to compare with one barrier per
+// dependency.
+void RaytracingWindow::reportBarriers()
+{
+    const FrameGraph::Statistics &stats(m_frameGraph.statistics());
+    const double frames = stats.frames;
+    qDebug("barriers (%s): %.1f dependencies/frame, %.1f vkCmdPipelineBarrier calls/frame "
+           "with %.1f image and %.1f memory barriers, over %d frames",
+           m_options.unbatchedBarriers ? "unbatched" : "batched",
+           stats.dependencies / frames, stats.barrierCalls / frames,
+           stats.imageBarriers / frames, stats.memoryBarriers / frames, stats.frames);
+    m_frameGraph.resetStatistics();
+}
+
+// Totals since the start of the capture. Frames are only dropped when all the
+// readback buffers are either in flight or waiting for the encoder.
+void RaytracingWindow::reportCapture()
+{
+    const FrameCapture::Statistics stats = m_capture.statistics();
+    const int frames = m_capture.frameNumber();
+    qDebug("capture: %d frames, %d written, %d dropped, %d failed", frames, stats.written, stats.dropped, stats.failed);
+    qDebug("capture overhead: %.3f ms/frame on the render thread, %.3f ms/frame copying on the GPU, "
+           "%.2f ms/frame encoding on the worker thread",
+           frames ? stats.renderThreadNs / frames / 1000000.0 : 0.0,
+           m_gpuTimer.averageMs("capture copy"),
+           stats.written ? stats.encodeNs / stats.written / 1000000.0 : 0.0);
+}
+
+// Called every frame when there is a compute queue. Never blocks: the
+// timeline semaphore value of the background build is only polled.
+void RaytracingWindow::stepAsyncBuild()
+{
+    if (m_asyncBuild.timelineValue) {
+        if (m_asyncQueue.isComplete(m_asyncBuild.timelineValue))
+            finishAsyncBuild();
+    } else if (m_asyncBuildDelay > 0 && --m_asyncBuildDelay == 0) {
+        startAsyncBuild();
+    }
+}
+
+// Builds a new set of BLASes and a TLAS on the compute queue. The current
+// ones stay untouched and keep being used for rendering in the meantime.
+void RaytracingWindow::startAsyncBuild()
+{
+    AccelerationStructureSet &set(m_asyncBuild);
+    const VkBuildAccelerationStructureFlagsNV blasFlags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_NV;
+
+    set.blas.resize(int(m_meshes.size()));
+    QVector<uint64_t> blasHandles(set.blas.count());
+    for (int i = 0; i < set.blas.count(); ++i) {
+        const RayMesh &mesh(m_meshes[size_t(i)]);
+        AccelerationStructureSet::Blas &blas(set.blas[i]);
+        VkAccelerationStructureInfoNV accelInfo = {};
+        accelInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
+        accelInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_NV;
+        accelInfo.flags = blasFlags;
+        accelInfo.geometryCount = mesh.geometryCount;
+        accelInfo.pGeometries = mesh.geometries;
+        VkMemoryRequirements scratchMemReq;
+        allocateAccelerationStructure(accelInfo, &blas.as, &blas.mem, &blas.handle, &scratchMemReq);
+        blas.scratchSize = scratchMemReq.size;
+        blasHandles[i] = blas.handle;
+        m_asyncBlasBuilder.addBuild({ blas.as, mesh.geometries, mesh.geometryCount, blasFlags, blas.scratchSize });
+    }
+
+    VkAccelerationStructureInfoNV tlasInfo = {};
+    tlasInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
+    tlasInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_NV;
+    tlasInfo.flags = m_tlasFlags;
+    tlasInfo.instanceCount = uint32_t(m_scene.instances.count());
+    VkMemoryRequirements scratchMemReq;
+    allocateAccelerationStructure(tlasInfo, &set.tlas, &set.tlasMem, &set.tlasHandle, &scratchMemReq);
+    VkResult err = m_vk.createBuffer(scratchMemReq.size, VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                     &set.scratchBuf, &set.scratchBufMem, MemoryTracker::Scratch);
+    if (err != VK_SUCCESS)
+        qFatal("Failed to create scratch buffer: %d", err);
+
+    // written once and read once by the build, so no staging here
+    const VkDeviceSize instanceBufSize = VkDeviceSize(m_scene.instances.count()) * sizeof(GeometryInstance);
+    err = m_vk.createBuffer(instanceBufSize, VK_BUFFER_USAGE_RAY_TRACING_BIT_NV,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                            &set.instanceBuf, &set.instanceBufMem, MemoryTracker::Instances);
+    if (err != VK_SUCCESS)
+        qFatal("Failed to create instance buffer: %d", err);
+    void *p = nullptr;
+    m_vk.df->vkMapMemory(m_vk.dev, set.instanceBufMem, 0, instanceBufSize, 0, &p);
+    packGeometryInstances(blasHandles, p);
+    m_vk.df->vkUnmapMemory(m_vk.dev, set.instanceBufMem);
+    // until the swap the instances packed per frame reference the current BLASes
+    QVector<uint64_t> currentBlasHandles;
+    for (const RayMesh &mesh : m_meshes)
+        currentBlasHandles.append(mesh.blasHandle);
+    setInstanceBlasHandles(currentBlasHandles);
+
+    VkCommandBuffer cb = m_asyncQueue.begin();
+    if (!cb) {
+        releaseAccelerationStructureSet(&set);
+        return;
+    }
+
+    // There is only ever one build in flight, so alternating the slot is
+    // enough to have the builder's old scratch buffers released in time.
+    m_asyncBlasBuilder.record(cb, m_asyncBuildCount % BlasBuilder::MAX_FRAMES_IN_FLIGHT);
+
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV;
+    memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV;
+    m_vk.df->vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV,
+                                  0, 1, &memoryBarrier, 0, 0, 0, 0);
+
+    cmdBuildAccelerationStructure(cb, &tlasInfo, set.instanceBuf, 0, VK_FALSE, set.tlas, VK_NULL_HANDLE, set.scratchBuf, 0);
+
+    set.timelineValue = m_asyncQueue.submit();
+    if (!set.timelineValue) {
+        releaseAccelerationStructureSet(&set);
+        return;
+    }
+
+    ++m_asyncBuildCount;
+    m_asyncBuildTimer.start();
+}
+
+// The background build has completed: make it current and retire the old
+// acceleration structures once no frame in flight can reference them.
+void RaytracingWindow::finishAsyncBuild()
+{
+    AccelerationStructureSet &set(m_asyncBuild);
+    const BlasBuilder::Statistics &stats(m_asyncBlasBuilder.lastStatistics());
+    qDebug("background build of %d BLAS (%d wave(s)) and the TLAS completed in %lld ms, swapping in",
+           stats.buildCount, stats.waveCount, m_asyncBuildTimer.elapsed());
+
+    AccelerationStructureSet retired;
+    retired.blas.resize(set.blas.count());
+    QVector<uint64_t> blasHandles(set.blas.count());
+    for (int i = 0; i < set.blas.count(); ++i) {
+        RayMesh &mesh(m_meshes[size_t(i)]);
+        retired.blas[i] = { mesh.blas, mesh.blasMem, mesh.blasHandle, mesh.scratchSize };
+        mesh.blas = set.blas[i].as;
+        mesh.blasMem = set.blas[i].mem;
+        mesh.blasHandle = set.blas[i].handle;
+        mesh.scratchSize = set.blas[i].scratchSize;
+        mesh.buildFlags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_NV;
+        blasHandles[i] = mesh.blasHandle;
+    }
+    retired.tlas = m_tlas;
+    retired.tlasMem = m_tlasMem;
+    retired.framesUntilRelease = m_framesInFlight;
+    m_retiredAccelSets.append(retired);
+
+    m_tlas = set.tlas;
+    m_tlasMem = set.tlasMem;
+    m_tlasHandle = set.tlasHandle;
+
+    // the build was the only user of these
+    m_vk.destroyBuffer(set.instanceBuf, set.instanceBufMem);
+    m_vk.destroyBuffer(set.scratchBuf, set.scratchBufMem);
+    set = AccelerationStructureSet();
+
+    // TLAS rebuilds on the graphics queue must reference the new BLASes too.
+    // The new TLAS was built with the levels of detail selected back when the
+    // build started, have it refitted with the current ones.
+    m_tlasRefitAllowed = true;
+    if (m_scene.lodCount > 1)
+        m_needsTlasBuild = true;
+    if (m_options.animateInstances) {
+        setInstanceBlasHandles(blasHandles);
+    } else {
+        QByteArray instances(m_scene.instances.count() * int(sizeof(GeometryInstance)), Qt::Uninitialized);
+        packGeometryInstances(blasHandles, instances.data());
+        m_instanceBuf.update(0, instances.constData(), VkDeviceSize(instances.size()));
+    }
+
+    m_asyncBuildSwapped = true;
+}
+
+// Called on a worker thread during startup, so no QRhi, see
+// startBackgroundInit(). Can be called again on the GUI thread afterwards to
+// replace the pipeline (e.g. because a new ray type or material got added),
+// which waits for the GPU to become idle.
+void RaytracingWindow::createRayPipeline()
+{
+    QVulkanDeviceFunctions *df = m_vk.df;
+
+    if (m_rayPipeline) {
+        // the only QRhi use, never the case on the startup worker
+        Q_ASSERT(QThread::currentThread() == thread());
+        m_rhi->finish();
+        df->vkDestroyPipeline(m_vk.dev, m_rayPipeline, nullptr);
+        m_rayPipeline = VK_NULL_HANDLE;
+    }
+
+    // The shaders with the shading in the closest hit shader, the variant
+    // with the closest hit shader only reporting what was hit and the raygen
+    // shader doing the shading, the raygen shader taking the primary
+    // visibility from the G-buffer, the procedural hit group for spheres and
+    // the miss shader of the occlusion rays. All in the same pipeline; the
+    // shader binding table has the records for all of them and traceScene()
+    // picks a set via the region offsets. Each shader names the group it
+    // goes to: a group of its own, except for the intersection shader, which
+    // turns the sphere hit group into a procedural one, and the any-hit
+    // shader, part of all the triangle hit groups.
+    static const struct {
+        const char *spirv;
+        VkShaderStageFlagBits stage;
+        RayGroup group;
+    } shaders[] = {
+        { ":/raygen.spv", VK_SHADER_STAGE_RAYGEN_BIT_NV, RayGenGroup },
+        { ":/miss.spv", VK_SHADER_STAGE_MISS_BIT_NV, MissGroup },
+        { ":/closesthit.spv", VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV, HitGroup },
+        { ":/raygen_inline.spv", VK_SHADER_STAGE_RAYGEN_BIT_NV, InlineRayGenGroup },
+        { ":/miss_inline.spv", VK_SHADER_STAGE_MISS_BIT_NV, InlineMissGroup },
+        { ":/closesthit_inline.spv", VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV, InlineHitGroup },
+        { ":/raygen_hybrid.spv", VK_SHADER_STAGE_RAYGEN_BIT_NV, HybridRayGenGroup },
+        { ":/closesthit_sphere.spv", VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV, SphereHitGroup },
+        { ":/intersection_sphere.spv", VK_SHADER_STAGE_INTERSECTION_BIT_NV, SphereHitGroup },
+        { ":/miss_occlusion.spv", VK_SHADER_STAGE_MISS_BIT_NV, OcclusionMissGroup },
+        { ":/anyhit.spv", VK_SHADER_STAGE_ANY_HIT_BIT_NV, RayGroupCount }
+    };
+    const uint32_t shaderCount = sizeof(shaders) / sizeof(shaders[0]);
+    for (uint32_t &group : m_rayGroups)
+        group = VK_SHADER_UNUSED_NV;
+
+    VkShaderModule shaderModules[shaderCount];
+    VkPipelineShaderStageCreateInfo shaderStages[shaderCount] = {};
+    VkRayTracingShaderGroupCreateInfoNV shaderGroupInfo[shaderCount] = {};
+    uint32_t groupCount = 0;
+    uint32_t anyHitShader = VK_SHADER_UNUSED_NV;
+    for (uint32_t i = 0; i < shaderCount; ++i) {
+        const QByteArray spirv = getSpirv(QLatin1String(shaders[i].spirv));
+        VkShaderModuleCreateInfo shaderInfo = {};
+        shaderInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        shaderInfo.codeSize = size_t(spirv.size());
+        shaderInfo.pCode = reinterpret_cast<const quint32 *>(spirv.constData());
+        df->vkCreateShaderModule(m_vk.dev, &shaderInfo, nullptr, &shaderModules[i]);
+
+        shaderStages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[i].stage = shaders[i].stage;
+        shaderStages[i].module = shaderModules[i];
+        shaderStages[i].pName = "main";
+
+        // an intersection shader turns its (already added) hit group into a
+        // procedural one
+        if (shaders[i].stage == VK_SHADER_STAGE_INTERSECTION_BIT_NV) {
+            Q_ASSERT(m_rayGroups[shaders[i].group] != VK_SHADER_UNUSED_NV);
+            VkRayTracingShaderGroupCreateInfoNV &group(shaderGroupInfo[m_rayGroups[shaders[i].group]]);
+            group.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_PROCEDURAL_HIT_GROUP_NV;
+            group.intersectionShader = i;
+            continue;
+        }
+        if (shaders[i].stage == VK_SHADER_STAGE_ANY_HIT_BIT_NV) {
+            anyHitShader = i;
+            continue;
+        }
+
+        // otherwise one group per shader: raygen, miss, closesthit
+        m_rayGroups[shaders[i].group] = groupCount;
+        VkRayTracingShaderGroupCreateInfoNV &group(shaderGroupInfo[groupCount++]);
+        group.sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_NV;
+        group.generalShader = VK_SHADER_UNUSED_NV;
+        group.closestHitShader = VK_SHADER_UNUSED_NV;
+        group.anyHitShader = VK_SHADER_UNUSED_NV;
+        group.intersectionShader = VK_SHADER_UNUSED_NV;
+        if (shaders[i].stage == VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV) {
+            group.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_NV;
+            group.closestHitShader = i;
+        } else {
+            group.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_NV;
+            group.generalShader = i;
+        }
+    }
+
+    // the any-hit shader only runs for non-opaque geometry, see Scene::classifyOpacity()
+    for (uint32_t i = 0; i < groupCount; ++i) {
+        if (shaderGroupInfo[i].type == VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_NV)
+            shaderGroupInfo[i].anyHitShader = anyHitShader;
+    }
+
+    VkRayTracingPipelineCreateInfoNV rayPipelineInfo = {};
+    rayPipelineInfo.sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_NV;
+    rayPipelineInfo.stageCount = shaderCount;
+    rayPipelineInfo.pStages = shaderStages;
+    rayPipelineInfo.groupCount = groupCount;
+    rayPipelineInfo.pGroups = shaderGroupInfo;
+    rayPipelineInfo.maxRecursionDepth = 1;
+    rayPipelineInfo.layout = m_rayPipelineLayout;
+    VkResult err = createRayTracingPipelines(m_vk.dev, VK_NULL_HANDLE, 1, &rayPipelineInfo, nullptr, &m_rayPipeline);
+    if (err != VK_SUCCESS)
+        qFatal("Failed to create raytracing pipeline: %d", err);
+
+    for (uint32_t i = 0; i < shaderCount; ++i)
+        df->vkDestroyShaderModule(m_vk.dev, shaderModules[i], nullptr);
+
+    m_rayGroupCount = groupCount;
+    m_sbtDirty = true;
+}
+
+// Lays out the records for the current pipeline and queues them for upload to
+// m_sbtBuf. The buffer is only recreated when the table does not fit anymore.
+void RaytracingWindow::updateShaderBindingTable()
+{
+    const QRhiVulkanNativeHandles *h = static_cast<const QRhiVulkanNativeHandles *>(m_rhi->nativeHandles());
+
+    const uint32_t sghSize = m_raytracingProps.shaderGroupHandleSize;
+    QVector<quint8> shaderHandles;
+    shaderHandles.resize(int(sghSize * m_rayGroupCount));
+    VkResult err = getRayTracingShaderGroupHandles(h->dev, m_rayPipeline, 0, m_rayGroupCount,
+                                                   size_t(shaderHandles.size()), shaderHandles.data());
+    if (err != VK_SUCCESS)
+        qFatal("Failed to query shader group handles: %d", err);
+
+    m_sbt.clear();
+    // A set of records for shading in the closest hit shader, and one for
+    // shading in raygen. The miss and hit records of each are a group of
+    // their own, since their first record gets passed as the offset.
+    static const struct {
+        RayGroup rayGen;
+        RayGroup miss;
+        RayGroup hit;
+    } variants[] = {
+        { RayGenGroup, MissGroup, HitGroup },
+        { InlineRayGenGroup, InlineMissGroup, InlineHitGroup }
+    };
+    for (int i = 0; i < 2; ++i) {
+        SbtVariant &records(m_sbtVariants[i]);
+        records.rayGen = m_sbt.addRecord(ShaderBindingTable::RayGen, m_rayGroups[variants[i].rayGen]);
+        // miss index 0 is for the primary rays, 1 for the occlusion rays;
+        // those need no hit records of their own since they skip the closest
+        // hit shader (intersection and any-hit shaders still run, from the
+        // same records)
+        m_sbt.beginGroup(ShaderBindingTable::Miss);
+        records.miss = m_sbt.addRecord(ShaderBindingTable::Miss, m_rayGroups[variants[i].miss]);
+        m_sbt.addRecord(ShaderBindingTable::Miss, m_rayGroups[OcclusionMissGroup]);
+        // a hit record per level of detail (selected by instanceOffset), with the
+        // level as inline data; everything else the closest hit shader fetches
+        // per instance bindlessly
+        m_sbt.beginGroup(ShaderBindingTable::Hit);
+        records.hit = m_sbt.recordCount(ShaderBindingTable::Hit);
+        for (uint32_t lod = 0; lod < uint32_t(m_scene.lodCount); ++lod)
+            m_sbt.addRecord(ShaderBindingTable::Hit, m_rayGroups[variants[i].hit], QByteArray(reinterpret_cast<const char *>(&lod), sizeof(lod)));
+        // after the levels the one for spheres, see sphereHitRecord()
+        m_sbt.addRecord(ShaderBindingTable::Hit, m_rayGroups[SphereHitGroup]);
+    }
+    // primary visibility from the G-buffer
+    m_hybridRayGenRecord = m_sbt.addRecord(ShaderBindingTable::RayGen, m_rayGroups[HybridRayGenGroup]);
+    if (!m_sbt.build(shaderHandles.constData(), m_rayGroupCount))
+        qFatal("Failed to build shader binding table");
+
+    if (!m_sbtBuf.isValid() || m_sbt.size() > m_sbtBuf.size()) {
+        m_sbtBuf.destroy();
+        if (!m_sbtBuf.create(&m_vk, m_rayBufferPlacement, m_sbt.size(), VK_BUFFER_USAGE_RAY_TRACING_BIT_NV,
+                             m_framesInFlight, m_raytracingProps.shaderGroupHandleSize, MemoryTracker::ShaderBindingTable))
+        {
+            qFatal("Failed to create shader binding table buffer");
+        }
+    }
+    m_sbtBuf.update(0, m_sbt.data().constData(), m_sbt.size());
+
+    m_sbtDirty = false;
+}
+
+// Recreates the instance and shader binding table buffers with the given
+// placement, keeping their contents. Waits for the GPU to become idle.
+void RaytracingWindow::setRayBufferPlacement(DeviceBuffer::Placement placement)
+{
+    m_rhi->finish();
+
+    m_rayBufferPlacement = placement;
+    const VkDeviceSize instanceBufSize = m_instanceBuf.size();
+    const VkDeviceSize sbtBufSize = m_sbtBuf.size();
+    m_instanceBuf.destroy();
+    m_sbtBuf.destroy();
+    if (!m_instanceBuf.create(&m_vk, placement, instanceBufSize, VK_BUFFER_USAGE_RAY_TRACING_BIT_NV,
+                              m_framesInFlight, sizeof(GeometryInstance), MemoryTracker::Instances))
+    {
+        qFatal("Failed to create instance buffer");
+    }
+    if (!m_sbtBuf.create(&m_vk, placement, sbtBufSize, VK_BUFFER_USAGE_RAY_TRACING_BIT_NV,
+                         m_framesInFlight, m_raytracingProps.shaderGroupHandleSize, MemoryTracker::ShaderBindingTable))
+    {
+        qFatal("Failed to create shader binding table buffer");
+    }
+
+    m_needsTlasBuild = true;
+}
+
+// Queues the requested benchmarks, they run one after the other so that they
+// do not reset each other's GPU timer statistics. The sphere benchmark goes
+// first, it reports the initial BLAS builds.
+void RaytracingWindow::addBenchmarks()
+{
+    m_benchmarks.setGpuTimer(&m_gpuTimer);
+    if (m_options.benchmarkSpheres)
+        addSphereBenchmark();
+    if (m_options.benchmarkPlacement)
+        addPlacementBenchmark();
+    if (m_options.bindlessStress)
+        addBindlessStress();
+    if (m_options.benchmarkLod && m_scene.lodCount > 1)
+        addLodBenchmark();
+    if (m_options.benchmarkMultiView && m_viewCount > 1)
+        addMultiViewBenchmark();
+    if (m_options.benchmarkDenoise)
+        addDenoiseBenchmark();
+    if (m_options.benchmarkInlineShading)
+        addInlineShadingBenchmark();
+    if (m_options.benchmarkHybrid)
+        addHybridBenchmark();
+    if (m_options.benchmarkOcclusion)
+        addOcclusionBenchmark();
+    if (m_options.benchmarkAlpha)
+        addAlphaBenchmark();
+    if (m_options.benchmarkDeform && m_deformer.isValid())
+        addDeformBenchmark();
+    if (m_options.benchmarkDedup)
+        addDedupBenchmark();
+}
+
+// Renders a number of frames with the instance buffer and the SBT host visible,
+// then the same with them in device local memory, rebuilding the TLAS in every
+// frame, and reports the average GPU time of the TLAS build and the trace.
+void RaytracingWindow::addPlacementBenchmark()
+{
+    static const DeviceBuffer::Placement placements[] = { DeviceBuffer::HostVisible, DeviceBuffer::DeviceLocal };
+    static const char *placementNames[] = { "host visible", "device local" };
+
+    BenchmarkRunner::Benchmark b;
+    b.name = "placement";
+    b.phaseCount = int(sizeof(placements) / sizeof(placements[0]));
+    b.begin = [this](int phase) {
+        if (m_rayBufferPlacement != placements[phase])
+            setRayBufferPlacement(placements[phase]);
+    };
+    b.frame = [this](int) {
+        m_needsTlasBuild = true;
+    };
+    b.measured = [this](int phase) {
+        qDebug("placement benchmark [%s]: tlas build %.4f ms, trace %.4f ms (%d frames)",
+               placementNames[phase],
+               m_gpuTimer.averageMs("tlas build"),
+               m_gpuTimer.averageMs("trace"),
+               m_gpuTimer.sampleCount("trace"));
+    };
+    m_benchmarks.add(b);
+}
+
+void RaytracingWindow::addBindlessStress()
+{
+    BenchmarkRunner::Benchmark b;
+    b.name = "bindless stress";
+    b.measured = [this](int) {
+        qDebug("bindless stress test: %d meshes, %d instances, %d materials, %d textures, "
+               "1 descriptor set and 1 pipeline bind per frame, descriptor writes %lld us, trace %.4f ms (%d frames)",
+               int(m_meshes.size()), m_scene.instances.count(), m_scene.materials.count(), m_scene.textures.count(),
+               m_bindlessWriteTimeUs, m_gpuTimer.averageMs("trace"), m_gpuTimer.sampleCount("trace"));
+    };
+    m_benchmarks.add(b);
+}
+
+// Renders a number of frames with all instances using their most detailed
+// BLAS, then the same with the levels of detail selected based on projected
+// size, and reports the triangles referenced by the TLAS and the trace time.
+void RaytracingWindow::addLodBenchmark()
+{
+    BenchmarkRunner::Benchmark b;
+    b.name = "lod";
+    b.phaseCount = 2;
+    b.begin = [this](int phase) {
+        if (m_lodEnabled != (phase == 1)) {
+            m_lodEnabled = phase == 1;
+            m_lodSelectionDirty = true;
+        }
+    };
+    b.measured = [this](int) {
+        qDebug("lod benchmark [%s]: %lld triangles referenced by %d instances, tlas refit %.4f ms, trace %.4f ms (%d frames)",
+               m_lodEnabled ? "on" : "off", m_lodTrianglesReferenced, m_scene.instances.count(),
+               m_gpuTimer.averageMs("tlas refit"),
+               m_gpuTimer.averageMs("trace"),
+               m_gpuTimer.sampleCount("trace"));
+    };
+    m_benchmarks.add(b);
+}
+
+// Traces the views with one launch per view for a number of frames, then the
+// same with all views in a single launch, and reports the trace times.
+void RaytracingWindow::addMultiViewBenchmark()
+{
+    BenchmarkRunner::Benchmark b;
+    b.name = "multi-view";
+    b.phaseCount = 2;
+    b.begin = [this](int phase) {
+        m_multiViewSeparateLaunches = phase == 0;
+    };
+    b.measured = [this](int) {
+        qDebug("multi-view benchmark [%s]: %d views of %dx%d, trace %.4f ms (%d frames)",
+               m_multiViewSeparateLaunches ? "one launch per view" : "single launch",
+               m_viewCount, m_viewImageSize.width(), m_viewImageSize.height(),
+               m_gpuTimer.averageMs("trace"), m_gpuTimer.sampleCount("trace"));
+    };
+    m_benchmarks.add(b);
+}
+
+static const QSize inlineShadingBenchmarkSizes[] = { QSize(1280, 720), QSize(1920, 1080), QSize(3840, 2160) };
+
+// Traces at each resolution with the shading in the closest hit shader, then
+// in the raygen shader, for a number of frames each, and reports the trace
+// times side by side.
+void RaytracingWindow::addInlineShadingBenchmark()
+{
+    static const int SIZE_COUNT = sizeof(inlineShadingBenchmarkSizes) / sizeof(inlineShadingBenchmarkSizes[0]);
+
+    BenchmarkRunner::Benchmark b;
+    b.name = "shading";
+    b.phaseCount = 2 * SIZE_COUNT;
+    b.begin = [this](int phase) {
+        m_traceSizeOverride = inlineShadingBenchmarkSizes[phase / 2];
+        m_inlineShading = phase % 2;
+    };
+    b.measured = [this](int) {
+        const double ms = m_gpuTimer.averageMs("trace");
+        if (m_inlineShading) {
+            qDebug("shading benchmark: %dx%d, trace %.4f ms with shading in closest hit, %.4f ms in raygen (%d frames)",
+                   m_traceSizeOverride.width(), m_traceSizeOverride.height(),
+                   m_hitShadingBenchmarkMs, ms, m_gpuTimer.sampleCount("trace"));
+        } else {
+            m_hitShadingBenchmarkMs = ms;
+        }
+    };
+    b.report = [this] {
+        m_traceSizeOverride = QSize();
+        m_inlineShading = m_options.inlineShading;
+    };
+    m_benchmarks.add(b);
+}
+
+// Renders with traced primary rays for a number of frames, then with the
+// primary visibility rasterized into the G-buffer, and reports the GPU time
+// of both.
+void RaytracingWindow::addHybridBenchmark()
+{
+    BenchmarkRunner::Benchmark b;
+    b.name = "hybrid";
+    b.phaseCount = 2;
+    b.begin = [this](int phase) {
+        m_hybrid = phase == 1;
+    };
+    b.measured = [this](int) {
+        const double traceMs = m_gpuTimer.averageMs("trace");
+        if (m_hybrid) {
+            const double gbufferMs = m_gpuTimer.averageMs("gbuffer");
+            qDebug("hybrid benchmark: %dx%d, %s: traced primary rays %.4f ms, "
+                   "rasterized G-buffer %.4f ms + trace %.4f ms = %.4f ms (%d frames)",
+                   m_tex->pixelSize().width(), m_tex->pixelSize().height(),
+                   m_options.secondaryRays ? "shadow and AO rays" : "no secondary rays",
+                   m_tracedPrimariesBenchmarkMs, gbufferMs, traceMs, gbufferMs + traceMs,
+                   m_gpuTimer.sampleCount("trace"));
+        } else {
+            m_tracedPrimariesBenchmarkMs = traceMs;
+        }
+    };
+    b.report = [this] {
+        m_hybrid = m_options.hybrid;
+    };
+    m_benchmarks.add(b);
+}
+
+// Makes either the procedural or the triangulated spheres visible by masking
+// out the instances of the other, then has the TLAS rebuilt.
+void RaytracingWindow::showTriangulatedSpheres(bool triangulated)
+{
+    QVector<uint64_t> blasHandles;
+    for (const RayMesh &mesh : m_meshes)
+        blasHandles.append(mesh.blasHandle);
+    for (int i = 0; i < m_scene.instances.count(); ++i) {
+        const bool procedural = m_scene.meshes[m_scene.instances[i].mesh].isProcedural();
+        m_instanceTransforms.setMask(i, procedural != triangulated ? 0xFF : 0);
+    }
+    // animated instances get packed completely every frame anyway
+    if (!m_options.animateInstances) {
+        QByteArray instances(m_scene.instances.count() * int(sizeof(GeometryInstance)), Qt::Uninitialized);
+        packGeometryInstances(blasHandles, instances.data());
+        m_instanceBuf.update(0, instances.constData(), VkDeviceSize(instances.size()));
+    }
+    m_needsTlasBuild = true;
+    m_tlasRefitAllowed = false;
+}
+
+// Traces the procedural spheres for a number of frames, then their
+// triangulated equivalent, and reports the memory, build and trace time of both.
+void RaytracingWindow::addSphereBenchmark()
+{
+    BenchmarkRunner::Benchmark b;
+    b.name = "sphere";
+    b.phaseCount = 2;
+    b.begin = [this](int phase) {
+        showTriangulatedSpheres(phase == 1);
+    };
+    b.warmedUp = [this](int phase) {
+        if (phase == 0) {
+            // the initial builds, before their results get reset
+            m_sphereBenchmark[0].buildMs = m_gpuTimer.averageMs("blas build: aabbs");
+            m_sphereBenchmark[1].buildMs = m_gpuTimer.averageMs("blas build: triangles");
+        }
+    };
+    b.measured = [this](int phase) {
+        m_sphereBenchmark[phase].traceMs = m_gpuTimer.averageMs("trace");
+    };
+    b.report = [this] {
+        const SphereBenchmarkResult &aabbs(m_sphereBenchmark[0]);
+        const SphereBenchmarkResult &triangles(m_sphereBenchmark[1]);
+        const double mb = 1024.0 * 1024.0;
+        qDebug("sphere benchmark: %d spheres at %dx%d, %d frames each\n"
+               "  as AABBs: input %.1f MB, BLAS %.1f MB, build %.3f ms, trace %.4f ms\n"
+               "  as %lld triangles: input %.1f MB, BLAS %.1f MB, build %.3f ms, trace %.4f ms",
+               m_options.sphereCount, m_tex->pixelSize().width(), m_tex->pixelSize().height(),
+               BenchmarkRunner::MEASURED_FRAMES,
+               aabbs.inputBytes / mb, aabbs.blasBytes / mb, aabbs.buildMs, aabbs.traceMs,
+               triangles.triangleCount, triangles.inputBytes / mb, triangles.blasBytes / mb, triangles.buildMs, triangles.traceMs);
+    };
+    m_benchmarks.add(b);
+}
+
+// Traces the shadow and AO rays like primary rays (with the closest hit
+// shader running on the first hit) for a number of frames, then with the
+// occlusion ray type, and reports the trace time of both.
+void RaytracingWindow::addOcclusionBenchmark()
+{
+    BenchmarkRunner::Benchmark b;
+    b.name = "occlusion";
+    b.phaseCount = 2;
+    b.begin = [this](int phase) {
+        m_closestHitOcclusion = phase == 0;
+    };
+    b.measured = [this](int) {
+        const double traceMs = m_gpuTimer.averageMs("trace");
+        if (m_closestHitOcclusion) {
+            m_closestHitOcclusionBenchmarkMs = traceMs;
+        } else {
+            qDebug("occlusion benchmark: %dx%d, %d sample(s) per pixel with a shadow and an AO ray each: "
+                   "with the closest hit shader %.4f ms, occlusion rays %.4f ms (%d frames)",
+                   m_tex->pixelSize().width(), m_tex->pixelSize().height(), qMax(1, m_options.samplesPerPixel),
+                   m_closestHitOcclusionBenchmarkMs, traceMs, m_gpuTimer.sampleCount("trace"));
+        }
+    };
+    b.report = [this] {
+        m_closestHitOcclusion = false;
+    };
+    m_benchmarks.add(b);
+}
+
+// Makes either the classified alpha tested meshes or their unclassified
+// originals visible by masking out the instances of the other, then has the
+// TLAS rebuilt.
+void RaytracingWindow::showClassifiedAlpha(bool classified)
+{
+    QVector<uint64_t> blasHandles;
+    for (const RayMesh &mesh : m_meshes)
+        blasHandles.append(mesh.blasHandle);
+    for (int i = 0; i < m_scene.instances.count(); ++i) {
+        const SceneMesh &mesh(m_scene.meshes[m_scene.instances[i].mesh]);
+        m_instanceTransforms.setMask(i, !mesh.isAlphaTested() || mesh.classified == classified ? 0xFF : 0);
+    }
+    // animated instances get packed completely every frame anyway
+    if (!m_options.animateInstances) {
+        QByteArray instances(m_scene.instances.count() * int(sizeof(GeometryInstance)), Qt::Uninitialized);
+        packGeometryInstances(blasHandles, instances.data());
+        m_instanceBuf.update(0, instances.constData(), VkDeviceSize(instances.size()));
+    }
+    m_needsTlasBuild = true;
+    m_tlasRefitAllowed = false;
+}
+
+// Traces the alpha tested meshes with all their triangles non-opaque for a
+// number of frames, then split into opaque and alpha tested geometry by
+// Scene::classifyOpacity(), and reports the trace time and the any-hit
+// invocations of both. Those are counted in two more phases afterwards, to
+// keep the atomics out of the trace time.
+void RaytracingWindow::addAlphaBenchmark()
+{
+    BenchmarkRunner::Benchmark b;
+    b.name = "alpha test";
+    b.phaseCount = 4;
+    b.begin = [this](int phase) {
+        showClassifiedAlpha(phase % 2 == 1);
+    };
+    b.warmedUp = [this](int phase) {
+        if (phase >= 2) {
+            m_anyHitInvocations = 0;
+            m_anyHitFrames = 0;
+            m_countAnyHits = true;
+        }
+    };
+    b.measured = [this](int phase) {
+        if (phase < 2)
+            m_alphaBenchmark[phase].traceMs = m_gpuTimer.averageMs("trace");
+        else
+            m_countAnyHits = false;
+    };
+    // the counts of the last frames in flight are in by then
+    b.settleFrames = m_framesInFlight;
+    b.settled = [this](int phase) {
+        if (phase >= 2)
+            m_alphaBenchmark[phase - 2].anyHitsPerFrame = m_anyHitFrames ? double(m_anyHitInvocations) / m_anyHitFrames : 0.0;
+    };
+    b.report = [this] {
+        const AlphaBenchmarkResult &naive(m_alphaBenchmark[0]);
+        const AlphaBenchmarkResult &classified(m_alphaBenchmark[1]);
+        const Scene::OpacityStatistics &stats(m_scene.opacityStatistics);
+        const double mb = 1024.0 * 1024.0;
+        qDebug("alpha test benchmark: %dx%d, %d frames each\n"
+               "  all non-opaque: %lld triangles, BLAS %.1f MB, %.0f any-hit invocations per frame, trace %.4f ms\n"
+               "  classified: %lld of them non-opaque (%lld dropped), BLAS %.1f MB, "
+               "%.0f any-hit invocations per frame, trace %.4f ms",
+               m_tex->pixelSize().width(), m_tex->pixelSize().height(), BenchmarkRunner::MEASURED_FRAMES,
+               naive.nonOpaqueTriangles, naive.blasBytes / mb, naive.anyHitsPerFrame, naive.traceMs,
+               classified.nonOpaqueTriangles, stats.transparentTriangles, classified.blasBytes / mb,
+               classified.anyHitsPerFrame, classified.traceMs);
+    };
+    m_benchmarks.add(b);
+}
+
+// Skins the deformed meshes, then refits their BLASes, or every
+// rebuildInterval frames rebuilds them instead since refitting keeps the
+// tree's topology, which gets worse for tracing the further the vertices
+// move from where they were at the last build.
+void RaytracingWindow::deformMeshes(VkCommandBuffer cb, int frameSlot)
+{
+    if (m_deformedMeshCount == 0)
+        return;
+
+    // the previous frame's builds and traces may still be reading the vertices
+    m_frameGraph.access(&m_geometryState, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    m_frameGraph.flush(cb);
+    m_gpuTimer.begin(cb, "skinning");
+    m_deformer.record(cb, frameSlot, m_deformTimer.elapsed() / 1000.0f, m_deformedMeshCount);
+    m_gpuTimer.end(cb, "skinning");
+
+    const bool rebuild = m_options.rebuildInterval > 0 && ++m_framesSinceBlasRebuild >= m_options.rebuildInterval;
+    if (rebuild) {
+        m_framesSinceBlasRebuild = 0;
+        // the TLAS has been refit along with the BLASes
+        m_tlasRefitAllowed = false;
+    }
+    for (int i = 0; i < m_deformedMeshCount; ++i) {
+        const RayMesh &mesh(m_meshes[size_t(m_deformedMeshes[i])]);
+        const BlasBuilder::Build build = { mesh.blas, mesh.geometries, mesh.geometryCount, mesh.buildFlags, mesh.scratchSize };
+        if (rebuild)
+            m_blasBuilder.addBuild(build);
+        else
+            m_blasBuilder.addUpdate(build);
+    }
+    m_frameGraph.access(&m_geometryState, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV,
+                        VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV);
+    m_frameGraph.access(&m_blasState, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV,
+                        VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV);
+    m_frameGraph.flush(cb);
+    const char *timerName = rebuild ? "blas rebuild" : "blas refit";
+    m_gpuTimer.begin(cb, timerName);
+    m_blasBuilder.record(cb, frameSlot);
+    m_gpuTimer.end(cb, timerName);
+
+    if (m_options.hybrid || m_options.benchmarkHybrid) {
+        // QRhi knows nothing about the G-buffer pass's vertex input having
+        // been written by a compute shader
+        m_frameGraph.access(&m_geometryState, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                            VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+        m_frameGraph.flush(cb);
+    }
+
+    m_needsTlasBuild = true;
+}
+
+// Deforms an eighth, a quarter, half, and then all of the meshes, and
+// reports the skinning, BLAS refit and rebuild times for each vertex count.
+void RaytracingWindow::addDeformBenchmark()
+{
+    QVector<int> meshCounts;
+    for (int divisor : { 8, 4, 2, 1 }) {
+        // with too few meshes for this many steps some would be the same
+        const int meshCount = qMax(1, m_deformedMeshes.count() / divisor);
+        if (meshCounts.isEmpty() || meshCounts.last() != meshCount)
+            meshCounts.append(meshCount);
+    }
+
+    BenchmarkRunner::Benchmark b;
+    b.name = "deform";
+    b.phaseCount = meshCounts.count();
+    b.begin = [this, meshCounts](int phase) {
+        m_deformedMeshCount = meshCounts[phase];
+        m_framesSinceBlasRebuild = 0;
+        DeformBenchmarkResult result;
+        result.meshCount = m_deformedMeshCount;
+        for (int i = 0; i < m_deformedMeshCount; ++i)
+            result.vertexCount += m_scene.meshes[m_deformedMeshes[i]].vertexCount();
+        m_deformBenchmark.append(result);
+    };
+    b.measured = [this](int) {
+        DeformBenchmarkResult &result(m_deformBenchmark.last());
+        result.skinningMs = m_gpuTimer.averageMs("skinning");
+        result.refitMs = m_gpuTimer.averageMs("blas refit");
+        result.rebuildMs = m_gpuTimer.averageMs("blas rebuild");
+        result.rebuilds = m_gpuTimer.sampleCount("blas rebuild");
+        result.traceMs = m_gpuTimer.averageMs("trace");
+    };
+    b.report = [this] {
+        m_deformedMeshCount = m_deformedMeshes.count();
+        QByteArray lines;
+        for (const DeformBenchmarkResult &result : m_deformBenchmark) {
+            lines += QByteArray("\n  ") + QByteArray::number(result.meshCount) + " meshes, "
+                    + QByteArray::number(result.vertexCount) + " vertices: skinning "
+                    + QByteArray::number(result.skinningMs, 'f', 4) + " ms, refit "
+                    + QByteArray::number(result.refitMs, 'f', 4) + " ms, rebuild ";
+            if (result.rebuilds)
+                lines += QByteArray::number(result.rebuildMs, 'f', 4) + " ms (" + QByteArray::number(result.rebuilds) + "x)";
+            else
+                lines += "n/a";
+            lines += ", trace " + QByteArray::number(result.traceMs, 'f', 4) + " ms";
+        }
+        qDebug("deform benchmark: %d frames each, a full BLAS rebuild every %d frames%s",
+               BenchmarkRunner::MEASURED_FRAMES, m_options.rebuildInterval, lines.constData());
+    };
+    m_benchmarks.add(b);
+}
+
+// Rebuilds the BLASes every frame, once per mesh with shared geometry, then
+// once per mesh as loaded, and reports the build times along with the
+// memory the sharing saved.
+void RaytracingWindow::addDedupBenchmark()
+{
+    BenchmarkRunner::Benchmark b;
+    b.name = "geometry sharing";
+    b.phaseCount = 2;
+    b.begin = [this](int phase) {
+        m_dedupBenchmarking = true;
+        m_dedupPerCopy = phase == 1;
+    };
+    b.measured = [this](int) {
+        if (!m_dedupPerCopy) {
+            m_sharedBlasBuildBenchmarkMs = m_gpuTimer.averageMs("blas builds: shared");
+            return;
+        }
+        const double perCopyMs = m_gpuTimer.averageMs("blas builds: per copy");
+        const double mb = 1024.0 * 1024.0;
+        qint64 loadedVertices = 0;
+        for (const SceneMesh &mesh : m_scene.meshes)
+            loadedVertices += qint64(1 + mesh.duplicates) * mesh.vertexCount();
+        qDebug("geometry sharing benchmark: %d meshes loaded (%lld vertices), %d distinct, %d frames each\n"
+               "  BLAS builds: one per mesh loaded %.3f ms, shared %.3f ms, saved %.3f ms (%.1f%%)\n"
+               "  memory saved: vertex and index buffers %.1f MB, BLASes %.1f MB",
+               m_geometryRegistry.lastStatistics().meshCount, loadedVertices, m_geometryRegistry.geometryCount(),
+               BenchmarkRunner::MEASURED_FRAMES, perCopyMs, m_sharedBlasBuildBenchmarkMs, perCopyMs - m_sharedBlasBuildBenchmarkMs,
+               perCopyMs > 0 ? 100.0 * (perCopyMs - m_sharedBlasBuildBenchmarkMs) / perCopyMs : 0.0,
+               m_sharedBufferBytesSaved / mb, m_sharedBlasBytesSaved / mb);
+    };
+    b.report = [this] {
+        m_dedupBenchmarking = false;
+    };
+    m_benchmarks.add(b);
+}
+
+void RaytracingWindow::recordDedupBenchmark(VkCommandBuffer cb, int frameSlot)
+{
+    // Without sharing, each copy would have had its own BLAS built from the
+    // same input, which is the same work as rebuilding the shared one once
+    // per copy. The rounds rebuild the same BLASes, BlasBuilder::record()
+    // starting with a barrier makes each wait for the previous.
+    int rounds = 1;
+    if (m_dedupPerCopy) {
+        for (const SceneMesh &mesh : m_scene.meshes)
+            rounds = qMax(rounds, 1 + mesh.duplicates);
+    }
+
+    m_frameGraph.access(&m_blasState, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV,
+                        VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV);
+    m_frameGraph.flush(cb);
+    const char *timerName = m_dedupPerCopy ? "blas builds: per copy" : "blas builds: shared";
+    m_gpuTimer.begin(cb, timerName);
+    for (int round = 0; round < rounds; ++round) {
+        for (size_t i = 0; i < m_meshes.size(); ++i) {
+            const RayMesh &mesh(m_meshes[i]);
+            if (mesh.blas && m_scene.meshes[int(i)].duplicates >= round)
+                m_blasBuilder.addBuild({ mesh.blas, mesh.geometries, mesh.geometryCount, mesh.buildFlags, mesh.scratchSize });
+        }
+        m_blasBuilder.record(cb, frameSlot);
+    }
+    m_gpuTimer.end(cb, timerName);
+
+    // the BLASes referenced by the TLAS have been rebuilt
+    m_needsTlasBuild = true;
+    m_tlasRefitAllowed = false;
+}
+
+// Uploads the tiles the workers have finished into m_tex and draws that. A
+// new frame starts when the camera or the size changes; until its tiles
+// arrive, the ones of the previous frame stay on screen.
+void RaytracingWindow::renderTiles(QRhiCommandBuffer *cb)
+{
+    if (m_tileBenchmarkWorkers)
+        stepTileBenchmark();
+
+    QRhiResourceUpdateBatch *u = m_rhi->nextResourceUpdateBatch();
+    const QSize size = m_tex->pixelSize();
+    if (m_matricesChanged || !m_tileFarm->hasFrame() || m_tileFarm->camera().imageSize != size)
+        m_tileFrameDirty = true;
+    if (m_tileFrameDirty && m_tileFarm->isReady()) {
+        m_tileFrameDirty = false;
+        if (m_tileFarm->camera().imageSize != size) {
+            // m_tex has just been (re)created, there is nothing to keep
+            QImage blank(size, QImage::Format_RGBA8888);
+            blank.fill(Qt::white);
+            u->uploadTexture(m_tex.get(), blank);
+        }
+        SoftwareTracer::Camera camera;
+        camera.viewInverse = m_rayViewInverse;
+        camera.projInverse = m_rayProjInverse;
+        camera.imageSize = size;
+        camera.samplesPerPixel = m_options.samplesPerPixel;
+        camera.frame = ++m_frameIndex;
+        camera.secondaryRays = m_options.secondaryRays;
+        m_tileFarm->render(camera);
+    }
+
+    // tiles of a frame of a different size may still be arriving
+    const bool sizeMatches = m_tileFarm->camera().imageSize == size;
+    for (const TileCoordinator::CompletedTile &tile : m_tileFarm->takeCompletedTiles()) {
+        if (!sizeMatches)
+            continue;
+        QRhiTextureSubresourceUploadDescription desc(tile.image);
+        desc.setDestinationTopLeft(tile.rect.topLeft());
+        u->uploadTexture(m_tex.get(), QRhiTextureUploadDescription(QRhiTextureUploadEntry(0, 0, desc)));
+    }
+
+    drawTexturedQuad(cb, u);
+}
+
+// Renders the same frame with 1, 2, ... up to --benchmark-tile-workers
+// worker processes, restarting the workers for each count, and reports the
+// average frame time and the speedup over one worker. The first frame with
+// each count is not measured.
+void RaytracingWindow::stepTileBenchmark()
+{
+    static const int MEASURED_FRAMES = 3;
+    if (!m_tileFarm->hasFrame() || !m_tileFarm->isFrameComplete())
+        return;
+
+    const TileCoordinator::FrameStatistics &stats(m_tileFarm->lastFrameStatistics());
+    const int index = m_tileBenchmarkWorkers - 1;
+    if (m_tileBenchmarkFrame++ > 0) {
+        m_tileBenchmarkMs[index] += stats.ms / MEASURED_FRAMES;
+        m_tileBenchmarkStolen[index] += stats.stolenTiles;
+    }
+    m_tileFrameDirty = true;
+    if (m_tileBenchmarkFrame <= MEASURED_FRAMES)
+        return;
+
+    QByteArray perWorker;
+    for (int tiles : stats.tilesPerWorker)
+        perWorker += QByteArray(perWorker.isEmpty() ? "" : " ") + QByteArray::number(tiles);
+    qDebug("tile workers: %d, %.1f ms/frame, %d tiles, %.1f stolen per frame, tiles per worker (last frame): %s",
+           m_tileBenchmarkWorkers, m_tileBenchmarkMs[index], stats.tileCount,
+           m_tileBenchmarkStolen[index] / double(MEASURED_FRAMES), perWorker.constData());
+
+    if (m_tileBenchmarkWorkers == m_options.benchmarkTileWorkers) {
+        m_tileBenchmarkWorkers = 0;
+        qDebug("Tile worker scaling (%dx%d, %d spp):", m_tileFarm->camera().imageSize.width(),
+               m_tileFarm->camera().imageSize.height(), qMax(1, m_options.samplesPerPixel));
+        for (int i = 0; i < m_tileBenchmarkMs.count(); ++i) {
+            const double speedup = m_tileBenchmarkMs[i] > 0 ? m_tileBenchmarkMs[0] / m_tileBenchmarkMs[i] : 0.0;
+            qDebug("  %2d worker(s): %9.1f ms  speedup %5.2fx  efficiency %5.1f%%",
+                   i + 1, m_tileBenchmarkMs[i], speedup, 100.0 * speedup / (i + 1));
+        }
+        return;
+    }
+
+    ++m_tileBenchmarkWorkers;
+    m_tileBenchmarkFrame = 0;
+    m_tileFarm->start(m_tileBenchmarkWorkers, m_options.arguments);
+}
+
+static const QSize denoiseBenchmarkSizes[] = { QSize(1920, 1080), QSize(3840, 2160) };
+
+// Runs the denoiser with the configured (or 4) iterations on a 1080p, then
+// on a 4K image for a number of frames, in addition to the normal rendering,
+// and reports the time it takes per frame.
+void RaytracingWindow::addDenoiseBenchmark()
+{
+    BenchmarkRunner::Benchmark b;
+    b.name = "denoise";
+    b.phaseCount = int(sizeof(denoiseBenchmarkSizes) / sizeof(denoiseBenchmarkSizes[0]));
+    b.begin = [this](int phase) {
+        m_denoiseBenchmarkSize = denoiseBenchmarkSizes[phase];
+    };
+    b.measured = [this](int) {
+        qDebug("denoise benchmark: %dx%d, %d iteration(s): %.4f ms per frame (%d frames)",
+               m_denoiseBenchmarkSize.width(), m_denoiseBenchmarkSize.height(), m_benchmarkDenoiser.iterationCount(),
+               m_gpuTimer.averageMs("denoise benchmark"), m_gpuTimer.sampleCount("denoise benchmark"));
+    };
+    b.report = [this] {
+        m_denoiseBenchmarkSize = QSize();
+    };
+    m_benchmarks.add(b);
+}
+
+void RaytracingWindow::recordDenoiseBenchmark(VkCommandBuffer cb, int frameSlot)
+{
+    m_benchmarkDenoiser.prepare(m_denoiseBenchmarkSize, 1);
+
+    m_gpuTimer.begin(cb, "denoise benchmark");
+    m_benchmarkDenoiser.record(cb, &m_frameGraph, frameSlot, m_denoiseBenchmarkImageView, &m_denoiseBenchmarkImageState);
+    m_gpuTimer.end(cb, "denoise benchmark");
+}
+
+void RaytracingWindow::customRender()
+{
+    // a cleared frame until the workers are done, see startBackgroundInit()
+    if (!m_rayTracingReady && !pollStartup()) {
+        QRhiCommandBuffer *cb = m_sc->currentFrameCommandBuffer();
+        cb->beginPass(m_sc->currentFrameRenderTarget(), Qt::white, { 1.0f, 0 });
+        cb->endPass();
+        return;
+    }
+
+    releaseRetiredAccelerationStructures();
+
+    if (m_options.barrierStats && m_frameGraph.statistics().frames >= 300)
+        reportBarriers();
+
+    if (++m_memoryReportFrame % m_options.memoryReportInterval == 0) {
+        reportRhiMemory(); // the G-buffer may have been resized
+        if (!isView() && !m_options.memoryReportFile.isEmpty())
+            writeMemoryReport();
+    }
+
+    if (m_capture.isValid() && !m_captureReported) {
+        m_capture.beginFrame();
+        if (m_capture.isFinished()) {
+            reportCapture();
+            m_captureReported = true;
+        } else if (++m_captureReportFrame % 300 == 0) {
+            reportCapture();
+        }
+    }
+
+    if (m_asyncQueue.isValid())
+        stepAsyncBuild();
+
+    m_benchmarks.step();
+
+    QRhiResourceUpdateBatch *u = m_rhi->nextResourceUpdateBatch();
+    if (!m_vbufReady) {
+        m_vbufReady = true;
+        u->uploadStaticBuffer(m_quadVbuf.get(), quadVertexAndCoordData);
+        if (!isView())
+            uploadScene(u);
+    }
+    if (m_matricesChanged)
+        updateViewMatrices(u, m_sc->currentPixelSize());
+
+    QRhiCommandBuffer *cb = m_sc->currentFrameCommandBuffer();
+    cb->resourceUpdate(u);
+    u = nullptr;
+
+    const QSize outputSizeInPixels = m_sc->currentPixelSize();
+    // the quad scales the image to the window when tracing at a fixed size
+    const QSize traceSize = m_traceSizeOverride.isEmpty() ? outputSizeInPixels : m_traceSizeOverride;
+    if (m_tex->pixelSize() != traceSize) {
+        m_tex->setPixelSize(traceSize);
+        m_tex->create();
+        reportRhiMemory();
+    }
+
+    if (isView()) {
+        // the owner does all the uploads and builds, there is nothing to
+        // trace until it has submitted its first frame
+        const RaytracingWindow *owner = m_context->owner();
+        if (owner->m_sceneReady) {
+            traceScene(cb, owner);
+        } else {
+            cb->beginPass(m_sc->currentFrameRenderTarget(), Qt::white, { 1.0f, 0 });
+            cb->endPass();
+        }
+        return;
+    }
+
+    if (m_tileFarm) {
+        renderTiles(cb);
+        return;
+    }
+
+    if (m_scene.lodCount > 1 && (m_matricesChanged || m_lodSelectionDirty)) {
+        m_lodSelectionDirty = false;
+        if (selectLods(outputSizeInPixels))
+            m_needsTlasBuild = true;
+    }
+
+    if (m_residency.isEnabled()) {
+        CpuProfiler::Scope scope(&m_cpuProfiler, "blas residency");
+        updateResidency();
+    }
+
+    const QRhiVulkanNativeHandles *h = static_cast<const QRhiVulkanNativeHandles *>(m_rhi->nativeHandles());
+    QVulkanDeviceFunctions *df = vulkanInstance()->deviceFunctions(h->dev);
+
+    const int currentFrameSlot = m_rhi->currentFrameSlot();
+
+    if (m_sbtDirty)
+        updateShaderBindingTable();
+
+    {
+        // Uploads and acceleration structure builds
+        CpuProfiler::Scope scope(&m_cpuProfiler, "external: uploads and builds");
+        cb->beginExternal();
+        VkCommandBuffer commandBuffer = static_cast<const QRhiVulkanCommandBufferNativeHandles *>(cb->nativeHandles())->commandBuffer;
+
+        m_gpuTimer.beginFrame(commandBuffer, currentFrameSlot);
+        m_staging.beginFrame(currentFrameSlot);
+
+        if (m_options.animateInstances) {
+            animateInstances();
+            quint8 *p = m_instanceBuf.beginDirectWrite(currentFrameSlot, &m_staging);
+            if (p) {
+                m_instancePacker.pack(m_instanceTransforms, p);
+                m_needsTlasBuild = true;
+            }
+        }
+
+        m_instanceBuf.flush(commandBuffer, currentFrameSlot, &m_staging,
+                            VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV);
+        m_sbtBuf.flush(commandBuffer, currentFrameSlot, &m_staging,
+                       VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_ACCESS_SHADER_READ_BIT);
+
+        if (!m_materialTexturesReady) {
+            // QRhi has just uploaded them, from now on they are only ever
+            // sampled natively, so this is the only time they need declaring
+            m_materialTexturesReady = true;
+            for (size_t i = 0; i < m_materialTextures.size(); ++i) {
+                FrameGraph::Resource *state = &m_materialTextureStates[int(i)];
+                m_frameGraph.importTexture(state, m_materialTextures[i].get(),
+                                           VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+                m_frameGraph.access(state, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_ACCESS_SHADER_READ_BIT,
+                                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            }
+        }
+
+        if (m_asyncBuildSwapped) {
+            m_asyncBuildSwapped = false;
+            // The writes of the compute queue's builds are made available by
+            // the timeline semaphore signal that was observed on the host.
+            // Make them visible to the TLAS builds and traces on this queue.
+            m_frameGraph.externalAccess(&m_blasState, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0);
+            m_frameGraph.externalAccess(&m_tlasState, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0);
+        }
+
+        if (m_needsRayBuild) {
+            m_needsRayBuild = false;
+            m_needsTlasBuild = true;
+            m_tlasRefitAllowed = false;
+
+            // the vertex and index data may have just been uploaded by QRhi
+            m_frameGraph.externalAccess(&m_geometryState, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+            m_frameGraph.access(&m_geometryState, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV,
+                                VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV);
+
+            // the BLASes include the scratch memory BlasBuilder reuses, so
+            // consecutive builds wait for each other
+            const VkAccessFlags blasBuildAccess = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV
+                    | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV;
+            if (m_options.benchmarkSpheres) {
+                // one at a time, to time the procedural and the triangulated spheres separately
+                for (size_t i = 0; i < m_meshes.size(); ++i) {
+                    const RayMesh &mesh(m_meshes[i]);
+                    m_frameGraph.access(&m_blasState, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, blasBuildAccess);
+                    m_frameGraph.flush(commandBuffer);
+                    const char *timerName = m_scene.meshes[int(i)].isProcedural() ? "blas build: aabbs" : "blas build: triangles";
+                    m_blasBuilder.addBuild({ mesh.blas, mesh.geometries, mesh.geometryCount, mesh.buildFlags, mesh.scratchSize });
+                    m_gpuTimer.begin(commandBuffer, timerName);
+                    m_blasBuilder.record(commandBuffer, currentFrameSlot);
+                    m_gpuTimer.end(commandBuffer, timerName);
+                }
+            } else {
+                // build bottom level acceleration structures, all in one go;
+                // with a BLAS budget only those updateResidency() made resident
+                m_frameGraph.access(&m_blasState, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, blasBuildAccess);
+                m_frameGraph.flush(commandBuffer);
+                for (const RayMesh &mesh : m_meshes) {
+                    if (mesh.blas)
+                        m_blasBuilder.addBuild({ mesh.blas, mesh.geometries, mesh.geometryCount, mesh.buildFlags, mesh.scratchSize });
+                }
+                if (m_placeholderBlas)
+                    m_blasBuilder.addBuild({ m_placeholderBlas, &m_placeholderGeometry, 1, 0, m_placeholderScratchSize });
+                m_gpuTimer.begin(commandBuffer, "blas builds");
+                m_blasBuilder.record(commandBuffer, currentFrameSlot);
+                m_gpuTimer.end(commandBuffer, "blas builds");
+                m_blasStatsPending = true;
+            }
+
+            // the better quality build starts once this frame (and so the
+            // vertex data upload) has completed
+            if (m_asyncQueue.isValid())
+                m_asyncBuildDelay = m_framesInFlight;
+        } else if (m_needsTlasBuild && !m_streamIn.isEmpty()) {
+            // the meshes that have just become resident, see updateResidency()
+            for (int i : m_streamIn) {
+                const RayMesh &mesh(m_meshes[size_t(i)]);
+                m_blasBuilder.addBuild({ mesh.blas, mesh.geometries, mesh.geometryCount, mesh.buildFlags, mesh.scratchSize });
+            }
+            m_frameGraph.access(&m_blasState, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV,
+                                VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV);
+            m_frameGraph.flush(commandBuffer);
+            m_gpuTimer.begin(commandBuffer, "blas stream-in");
+            m_blasBuilder.record(commandBuffer, currentFrameSlot);
+            m_gpuTimer.end(commandBuffer, "blas stream-in");
+        } else if (m_deformer.isValid()) {
+            deformMeshes(commandBuffer, currentFrameSlot);
+        } else if (m_dedupBenchmarking) {
+            recordDedupBenchmark(commandBuffer, currentFrameSlot);
+        }
+
+        if (m_needsTlasBuild) {
+            m_needsTlasBuild = false;
+
+            // build top level acceleration structure
+            VkAccelerationStructureInfoNV buildInfo = {};
+            buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
+            buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_NV;
+            buildInfo.flags = m_tlasFlags;
+            buildInfo.instanceCount = uint32_t(m_scene.instances.count());
+            buildInfo.geometryCount = 0;
+            buildInfo.pGeometries = nullptr;
+            // when only the instances changed (e.g. a level of detail
+            // switch), update the TLAS in place instead of rebuilding it
+            const bool refit = m_tlasRefitAllowed && (m_tlasFlags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_NV);
+            const char *timerName = refit ? "tlas refit" : "tlas build";
+            // the previous frame's trace may still be reading the TLAS, the
+            // build overwrites it (and the scratch buffer)
+            m_frameGraph.access(&m_blasState, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV,
+                                VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV);
+            m_frameGraph.access(&m_tlasState, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV,
+                                VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV);
+            m_frameGraph.flush(commandBuffer);
+            m_gpuTimer.begin(commandBuffer, timerName);
+            cmdBuildAccelerationStructure(commandBuffer, &buildInfo, m_instanceBuf.buffer(currentFrameSlot), 0, refit ? VK_TRUE : VK_FALSE,
+                                          m_tlas, refit ? m_tlas : VK_NULL_HANDLE, m_scratchBuf, 0);
+            m_gpuTimer.end(commandBuffer, timerName);
+            m_tlasRefitAllowed = true;
+        }
+
+        cb->endExternal();
+    }
+
+    if (m_blasStatsPending && m_gpuTimer.sampleCount("blas builds")) {
+        m_blasStatsPending = false;
+        const BlasBuilder::Statistics &stats(m_blasBuilder.lastStatistics());
+        const double ms = m_gpuTimer.averageMs("blas builds");
+        qDebug("%d BLAS builds in %d wave(s): %.3f ms, %.0f builds/s, peak scratch usage %llu bytes (budget %llu)",
+               stats.buildCount, stats.waveCount, ms, ms > 0 ? stats.buildCount * 1000.0 / ms : 0.0,
+               stats.peakScratchSize, m_options.scratchBudget);
+    }
+
+    m_sceneReady = true;
+    traceScene(cb, this);
+}
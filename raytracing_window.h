@@ -52,16 +52,250 @@
 #define RAYTRACINGWINDOW_H
 
 #include "window.h"
+#include "shader_binding_table.h"
+#include "vulkan_device.h"
+#include "device_buffer.h"
+#include "staging_ring.h"
+#include "gpu_timer.h"
+#include "blas_builder.h"
+#include "scene.h"
+#include "async_compute_queue.h"
+#include "vertex_quantization.h"
+#include "instance_packer.h"
+#include "raytracing_context.h"
+#include "denoiser.h"
+#include "gbuffer_pass.h"
+#include "blas_residency.h"
+#include "tile_farm.h"
+#include "frame_capture.h"
+#include "frame_graph.h"
+#include "mesh_deformer.h"
+#include "geometry_registry.h"
+#include "memory_tracker.h"
+#include "benchmark_runner.h"
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QVector4D>
+#include <atomic>
+
+struct RaytracingOptions
+{
+    enum BufferPlacement {
+        AutoPlacement,
+        HostVisiblePlacement,
+        DeviceLocalPlacement
+    };
+    BufferPlacement bufferPlacement = AutoPlacement;
+    bool benchmarkPlacement = false;
+    int meshCount = 0; // 0 = the single triangle
+    VkDeviceSize scratchBudget = 32 * 1024 * 1024;
+    bool asyncBuilds = false;
+    int materialCount = 0; // 0 = whatever the scene comes with
+    bool bindlessStress = false;
+    enum PositionFormat {
+        FloatPositions,
+        Snorm16Positions,
+        Snorm16DecodedPositions // quantized, but decoded to float for the BLAS
+    };
+    PositionFormat positionFormat = FloatPositions; // quantized ones are opt-in, for large scan meshes
+    int instanceCount = 0; // 0 = one instance per mesh
+    bool animateInstances = false;
+    bool benchmarkPacking = false;
+    int lodCount = 1; // levels of detail per mesh
+    bool benchmarkLod = false;
+    bool cpuProfile = false;
+    QString cpuTraceFile;
+    int multiViewCount = 1; // 6 = cubemap faces, 2 = stereo pair, otherwise views around the scene
+    bool benchmarkMultiView = false;
+    int samplesPerPixel = 0; // 0 = one sample at the pixel center
+    int denoiseIterations = 0;
+    bool benchmarkDenoise = false;
+    bool inlineShading = false; // shade in raygen instead of closest hit
+    bool benchmarkInlineShading = false;
+    bool hybrid = false; // rasterized primary visibility, only secondary rays traced
+    bool secondaryRays = false; // shadows and ambient occlusion
+    bool benchmarkHybrid = false;
+    bool benchmarkOcclusion = false;
+    int sphereCount = 0; // procedural spheres instead of the meshes
+    bool triangulatedSpheres = false; // the same spheres as a triangle mesh
+    bool benchmarkSpheres = false;
+    VkDeviceSize blasBudget = 0; // 0 = all BLASes resident
+    int tileWorkerCount = 0; // traced on the CPU by worker processes instead, see TileCoordinator
+    int benchmarkTileWorkers = 0; // frame time with 1 to this many workers
+    QStringList arguments; // what the tile workers get
+    QString captureDirectory; // empty = no capture
+    int captureFrameCount = 0; // 0 = until closed
+    bool barrierStats = false;
+    bool unbatchedBarriers = false; // one vkCmdPipelineBarrier per dependency, for comparison
+    bool alphaTest = false; // cut-out materials, see Scene::cutOutMaterials()
+    bool benchmarkAlpha = false;
+    bool deform = false; // skin the meshes every frame, see MeshDeformer
+    int rebuildInterval = 60; // frames between full rebuilds of the deformed meshes' BLASes, 0 = refit only
+    bool benchmarkDeform = false;
+    int duplicateMeshes = 0; // copies of every mesh, see Scene::duplicateMeshes()
+    bool benchmarkDedup = false;
+    QString memoryReportFile; // empty = no JSON dumps, see MemoryTracker
+    int memoryReportInterval = 300; // frames
+
+    bool hasProceduralGeometry() const { return sphereCount > 0 && (!triangulatedSpheres || benchmarkSpheres); }
+    // the same for the same options, the tile workers rely on this;
+    // registry gets the meshes as loaded, before deduplication, and stays
+    // empty when there are no copies to share
+    Scene createScene(GeometryRegistry *registry = nullptr) const;
+};
+
+struct RayMesh
+{
+    std::unique_ptr<QRhiBuffer> vbuf; // positions only, or AABBs for procedural meshes
+    std::unique_ptr<QRhiBuffer> attrBuf; // normal xyz, uv, or the spheres
+    std::unique_ptr<QRhiBuffer> ibuf; // none for procedural meshes
+    // BLAS input for the alpha tested triangles when they do not start at
+    // the first triangle, see geometries
+    std::unique_ptr<QRhiBuffer> alphaIbuf;
+    std::unique_ptr<QRhiBuffer> restBuf; // for deformed meshes, MeshDeformer's input
+    QByteArray positionData; // until uploaded
+    QByteArray attributeData;
+    QByteArray restData;
+    QVector<quint32> alphaIndexData;
+    VkFormat positionFormat = VK_FORMAT_R32G32B32_SFLOAT;
+    VkDeviceSize positionStride = 3 * sizeof(float);
+    QMatrix4x4 positionTransform; // dequantization, folded into the instance transform
+    // The opaque triangles, then (for alpha tested meshes) the non-opaque
+    // ones running the any-hit shader. Either may be missing.
+    VkGeometryNV geometries[2];
+    uint32_t geometryCount = 1;
+    VkAccelerationStructureNV blas = VK_NULL_HANDLE;
+    VkDeviceMemory blasMem = VK_NULL_HANDLE;
+    uint64_t blasHandle = 0;
+    VkDeviceSize scratchSize = 0;
+    VkBuildAccelerationStructureFlagsNV buildFlags = 0;
+};
+
+// A complete set of acceleration structures, either being built on the
+// compute queue or retired and waiting for the frames in flight to finish.
+struct AccelerationStructureSet
+{
+    struct Blas {
+        VkAccelerationStructureNV as;
+        VkDeviceMemory mem;
+        uint64_t handle;
+        VkDeviceSize scratchSize;
+    };
+    QVector<Blas> blas; // one per mesh
+    VkAccelerationStructureNV tlas = VK_NULL_HANDLE;
+    VkDeviceMemory tlasMem = VK_NULL_HANDLE;
+    uint64_t tlasHandle = 0;
+    // these are only needed while building
+    VkBuffer instanceBuf = VK_NULL_HANDLE;
+    VkDeviceMemory instanceBufMem = VK_NULL_HANDLE;
+    VkBuffer scratchBuf = VK_NULL_HANDLE;
+    VkDeviceMemory scratchBufMem = VK_NULL_HANDLE;
+    uint64_t timelineValue = 0;
+    int framesUntilRelease = 0;
+};
 
 class RaytracingWindow : public Window
 {
 public:
+    // views traced in one launch, see raygen.rgen
+    static const int MAX_VIEWS = 8;
+
     ~RaytracingWindow();
 
+    void setOptions(const RaytracingOptions &options) {
+        m_options = options;
+        m_wantsComputeQueue = options.asyncBuilds;
+        m_wantsDescriptorIndexing = true;
+        if (options.cpuProfile) {
+            m_cpuProfiler.setTraceFileName(options.cpuTraceFile);
+            m_cpuProfiler.start();
+        }
+    }
+
+    // See RaytracingContext. Called by RaytracingContext::addWindow().
+    void setContext(RaytracingContext *context) {
+        m_context = context;
+        if (isView())
+            m_deviceShareWindow = context->owner();
+    }
+
     void customInit() override;
     void customRender() override;
 
 private:
+    bool isView() const { return m_context && m_context->owner() != this; }
+    bool isShared() const { return m_context && m_context->windowCount() > 1; }
+    void initView();
+    void startBackgroundInit();
+    void prepareGeometry();
+    void createRayPipelineLayout();
+    bool pollStartup();
+    void finishInit();
+    void createDescriptorSets(const RaytracingWindow *resources);
+    void uploadScene(QRhiResourceUpdateBatch *u);
+    void traceScene(QRhiCommandBuffer *cb, const RaytracingWindow *resources);
+    void drawTexturedQuad(QRhiCommandBuffer *cb, QRhiResourceUpdateBatch *u = nullptr);
+    QSize multiViewSize(const QSize &outputSizeInPixels) const;
+    void updateViewMatrices(QRhiResourceUpdateBatch *u, const QSize &outputSizeInPixels);
+    void addMultiViewBenchmark();
+    void addDenoiseBenchmark();
+    void recordDenoiseBenchmark(VkCommandBuffer cb, int frameSlot);
+    void addInlineShadingBenchmark();
+    QVector<GBufferPass::Instance> gbufferInstances() const;
+    void rasterizeGBuffer(QRhiCommandBuffer *cb);
+    void addHybridBenchmark();
+    // relative to the first hit record of the variant, see updateShaderBindingTable()
+    quint32 sphereHitRecord() const { return quint32(m_scene.lodCount); }
+    void showTriangulatedSpheres(bool triangulated);
+    void addSphereBenchmark();
+    void addOcclusionBenchmark();
+    void showClassifiedAlpha(bool classified);
+    void addAlphaBenchmark();
+    void deformMeshes(VkCommandBuffer cb, int frameSlot);
+    void addDeformBenchmark();
+    void addDedupBenchmark();
+    void recordDedupBenchmark(VkCommandBuffer cb, int frameSlot);
+    VkDeviceSize accelerationStructureSize(const VkAccelerationStructureInfoNV &info,
+                                           VkMemoryRequirements *scratchMemReq);
+    VkDeviceSize allocateAccelerationStructure(const VkAccelerationStructureInfoNV &info,
+                                               VkAccelerationStructureNV *as,
+                                               VkDeviceMemory *mem,
+                                               uint64_t *handle,
+                                               VkMemoryRequirements *scratchMemReq);
+    void setInstanceBlasHandles(const QVector<uint64_t> &blasHandles);
+    void packGeometryInstances(const QVector<uint64_t> &blasHandles, void *dst);
+    void animateInstances();
+    bool selectLods(const QSize &outputSizeInPixels);
+    void addLodBenchmark();
+    void runPackingBenchmark();
+    void releaseAccelerationStructureSet(AccelerationStructureSet *set);
+    void releaseRetiredAccelerationStructures();
+    void createPlaceholderBlas(VkMemoryRequirements *scratchMemReq);
+    bool availableDeviceMemory(VkDeviceSize *available) const;
+    void updateMemoryBudget();
+    void reportRhiMemory();
+    void writeMemoryReport();
+    void updateResidency();
+    void reportResidency();
+    void renderTiles(QRhiCommandBuffer *cb);
+    void stepTileBenchmark();
+    void reportCapture();
+    void reportBarriers();
+    void stepAsyncBuild();
+    void startAsyncBuild();
+    void finishAsyncBuild();
+    void createRayPipeline();
+    void updateShaderBindingTable();
+    void setRayBufferPlacement(DeviceBuffer::Placement placement);
+    void addBenchmarks();
+    void addPlacementBenchmark();
+    void addBindlessStress();
+
+    RaytracingOptions m_options;
+    RaytracingContext *m_context = nullptr;
+    bool m_sceneReady = false; // the first build has been submitted
+    VulkanDevice m_vk;
+    int m_framesInFlight = 0; // everything released or reused per frame slot follows this
     VkPhysicalDeviceRayTracingPropertiesNV m_raytracingProps;
     PFN_vkCreateAccelerationStructureNV createAccelerationStructure;
     PFN_vkDestroyAccelerationStructureNV destroyAccelerationStructure;
@@ -74,7 +308,6 @@ private:
     PFN_vkCmdTraceRaysNV cmdTraceRays;
 
     std::unique_ptr<QRhiBuffer> m_quadVbuf;
-    std::unique_ptr<QRhiBuffer> m_vbuf;
     bool m_vbufReady;
     std::unique_ptr<QRhiBuffer> m_ubuf;
     std::unique_ptr<QRhiTexture> m_tex;
@@ -82,14 +315,57 @@ private:
     std::unique_ptr<QRhiShaderResourceBindings> m_quadSrb;
     std::unique_ptr<QRhiGraphicsPipeline> m_quadPs;
 
+    std::unique_ptr<QRhiBuffer> m_instanceDataBuf;
+    std::unique_ptr<QRhiBuffer> m_materialBuf;
+    std::vector<std::unique_ptr<QRhiTexture>> m_materialTextures;
+    QVector<VkImageView> m_materialTextureViews;
+    VkSampler m_materialSampler = VK_NULL_HANDLE;
+    bool m_materialTexturesReady = false;
+    qint64 m_bindlessWriteTimeUs = 0;
+
     VkDescriptorPool m_rayDescPool = VK_NULL_HANDLE;
     VkDescriptorSetLayout m_rayDescSetLayout = VK_NULL_HANDLE;
     VkPipelineLayout m_rayPipelineLayout = VK_NULL_HANDLE;
     VkPipeline m_rayPipeline = VK_NULL_HANDLE;
-    VkDescriptorSet m_rayDescSet[2] = {};
-    VkAccelerationStructureNV m_blas = VK_NULL_HANDLE;
-    VkDeviceMemory m_blasMem = VK_NULL_HANDLE;
-    uint64_t m_blasHandle;
+    // The shader groups of m_rayPipeline, by name. createRayPipeline() fills
+    // in their indices as it appends them, the shader binding table looks
+    // them up here.
+    enum RayGroup {
+        RayGenGroup,
+        MissGroup,
+        HitGroup,
+        InlineRayGenGroup,
+        InlineMissGroup,
+        InlineHitGroup,
+        HybridRayGenGroup,
+        SphereHitGroup,
+        OcclusionMissGroup,
+        RayGroupCount
+    };
+    uint32_t m_rayGroups[RayGroupCount];
+    uint32_t m_rayGroupCount = 0;
+    QVector<VkDescriptorSet> m_rayDescSet; // one per frame slot
+    Scene m_scene;
+    std::vector<RayMesh> m_meshes;
+    BlasBuilder m_blasBuilder;
+    bool m_blasStatsPending = false;
+    InstanceTransforms m_instanceTransforms;
+    QVector<float> m_instanceRestY;
+    QVector<quint8> m_instanceLods;
+    QVector<QVector4D> m_instanceBounds; // bounding sphere in world space
+    bool m_lodEnabled = false;
+    bool m_lodSelectionDirty = false;
+    qint64 m_lodTrianglesReferenced = 0;
+    InstancePacker m_instancePacker;
+    QElapsedTimer m_animationTimer;
+    AsyncComputeQueue m_asyncQueue;
+    BlasBuilder m_asyncBlasBuilder;
+    AccelerationStructureSet m_asyncBuild;
+    QVector<AccelerationStructureSet> m_retiredAccelSets;
+    QElapsedTimer m_asyncBuildTimer;
+    int m_asyncBuildDelay = 0;
+    int m_asyncBuildCount = 0;
+    bool m_asyncBuildSwapped = false;
     VkAccelerationStructureNV m_tlas = VK_NULL_HANDLE;
     VkDeviceMemory m_tlasMem = VK_NULL_HANDLE;
     uint64_t m_tlasHandle;
@@ -100,14 +376,188 @@ private:
     VkBuffer m_scratchBuf = VK_NULL_HANDLE;
     VkDeviceMemory m_scratchBufMem = VK_NULL_HANDLE;
     bool m_needsRayBuild;
-    VkGeometryNV m_geometry;
-    VkBuffer m_instanceBuf = VK_NULL_HANDLE;
-    VkDeviceMemory m_instanceBufMem = VK_NULL_HANDLE;
-    VkBuffer m_sbtBuf = VK_NULL_HANDLE;
-    VkDeviceMemory m_sbtBufMem = VK_NULL_HANDLE;
+    bool m_needsTlasBuild = false;
+    VkBuildAccelerationStructureFlagsNV m_tlasFlags = 0;
+    bool m_tlasRefitAllowed = false;
+    DeviceBuffer::Placement m_rayBufferPlacement = DeviceBuffer::DeviceLocal;
+    StagingRing m_staging;
+    DeviceBuffer m_instanceBuf;
+    DeviceBuffer m_sbtBuf;
+    ShaderBindingTable m_sbt;
+    bool m_sbtDirty = false;
+    // the records of the shading variants: [0] in the closest hit shader,
+    // [1] in raygen; the miss and hit records each start a base aligned group
+    struct SbtVariant {
+        int rayGen;
+        int miss;
+        int hit;
+    } m_sbtVariants[2] = {};
+    int m_hybridRayGenRecord = 0;
+
+    GpuTimer m_gpuTimer;
+    BenchmarkRunner m_benchmarks; // see addBenchmarks()
+    // The synchronization state of what the natively recorded passes use,
+    // see FrameGraph. The BLASes include the placeholder and BlasBuilder's
+    // scratch memory, the TLAS m_scratchBuf. In a window sharing the scene,
+    // m_tlasState stands for everything the owner builds and uploads.
+    FrameGraph m_frameGraph;
+    FrameGraph::Resource m_geometryState; // the meshes' buffers
+    FrameGraph::Resource m_blasState;
+    FrameGraph::Resource m_tlasState;
+    FrameGraph::Resource m_outputState; // m_tex
+    QVector<FrameGraph::Resource> m_materialTextureStates;
 
     QVarLengthArray<VkImageView, 2> m_imageViews;
     VkImage m_lastImage = VK_NULL_HANDLE;
+
+    // with multiple views the trace goes to a layered image, one layer per
+    // view, which then gets copied into m_tex as tiles
+    int m_viewCount = 1;
+    QSize m_viewImageSize;
+    VkImage m_viewImage = VK_NULL_HANDLE;
+    VkDeviceMemory m_viewImageMem = VK_NULL_HANDLE;
+    VkImageView m_viewImageView = VK_NULL_HANDLE;
+    FrameGraph::Resource m_viewImageState;
+    struct RetiredImage {
+        VkImage image;
+        VkDeviceMemory mem;
+        VkImageView view;
+        int framesUntilRelease;
+    };
+    QVector<RetiredImage> m_retiredViewImages;
+    bool m_multiViewSeparateLaunches = false;
+
+    Denoiser m_denoiser;
+    quint32 m_frameIndex = 0;
+    Denoiser m_benchmarkDenoiser;
+    VkImage m_denoiseBenchmarkImage = VK_NULL_HANDLE;
+    VkDeviceMemory m_denoiseBenchmarkImageMem = VK_NULL_HANDLE;
+    VkImageView m_denoiseBenchmarkImageView = VK_NULL_HANDLE;
+    FrameGraph::Resource m_denoiseBenchmarkImageState;
+    QSize m_denoiseBenchmarkSize; // empty when not benchmarking
+
+    bool m_inlineShading = false;
+    QSize m_traceSizeOverride; // trace at this size instead of the window's
+    double m_hitShadingBenchmarkMs = 0;
+
+    bool m_hybrid = false;
+    GBufferPass m_gbuffer;
+    QVector<GBufferPass::Draw> m_gbufferDraws;
+    bool m_gbufferInstancesUploaded = false;
+    double m_tracedPrimariesBenchmarkMs = 0;
+
+    // [0] for the procedural spheres, [1] for the triangulated ones
+    struct SphereBenchmarkResult {
+        quint64 inputBytes = 0;
+        quint64 blasBytes = 0;
+        qint64 triangleCount = 0;
+        double buildMs = 0;
+        double traceMs = 0;
+    } m_sphereBenchmark[2];
+
+    bool m_closestHitOcclusion = false;
+    double m_closestHitOcclusionBenchmarkMs = 0;
+
+    // the any-hit shader's invocations per frame slot, counted while
+    // m_countAnyHits is set
+    VkBuffer m_anyHitCounterBuf = VK_NULL_HANDLE;
+    VkDeviceMemory m_anyHitCounterBufMem = VK_NULL_HANDLE;
+    quint32 *m_anyHitCounters = nullptr;
+    VkDeviceSize m_anyHitCounterStride = 0;
+    FrameGraph::Resource m_anyHitCounterState;
+    bool m_countAnyHits = false;
+    QVector<bool> m_anyHitsCounted;
+    quint64 m_anyHitInvocations = 0;
+    int m_anyHitFrames = 0;
+    // [0] for all triangles of the alpha tested meshes non-opaque, [1] for the classified ones
+    struct AlphaBenchmarkResult {
+        qint64 nonOpaqueTriangles = 0;
+        quint64 blasBytes = 0;
+        double anyHitsPerFrame = 0;
+        double traceMs = 0;
+    } m_alphaBenchmark[2];
+
+    // The first m_deformedMeshCount of m_deformedMeshes get skinned every
+    // frame and their BLASes refit, or rebuilt every rebuildInterval frames.
+    MeshDeformer m_deformer;
+    QVector<int> m_deformedMeshes; // in the order MeshDeformer has them
+    int m_deformedMeshCount = 0;
+    int m_framesSinceBlasRebuild = 0;
+    QElapsedTimer m_deformTimer;
+    struct DeformBenchmarkResult {
+        int meshCount = 0;
+        qint64 vertexCount = 0;
+        double skinningMs = 0;
+        double refitMs = 0;
+        double rebuildMs = 0;
+        int rebuilds = 0;
+        double traceMs = 0;
+    };
+    QVector<DeformBenchmarkResult> m_deformBenchmark;
+
+    // Meshes loaded more than once share buffers and BLASes, see
+    // Scene::deduplicateMeshes(); what the copies would have needed otherwise
+    GeometryRegistry m_geometryRegistry;
+    quint64 m_sharedBufferBytesSaved = 0;
+    quint64 m_sharedBlasBytesSaved = 0;
+    bool m_dedupBenchmarking = false;
+    bool m_dedupPerCopy = false; // rebuilding the BLASes once per copy
+    double m_sharedBlasBuildBenchmarkMs = 0;
+
+    // With a BLAS budget the meshes not in BlasResidency have no BLAS (see
+    // RayMesh::blas), their instances are masked out and point to the
+    // placeholder, a BLAS with a single inactive triangle.
+    BlasResidency m_residency;
+    PFN_vkGetPhysicalDeviceMemoryProperties2KHR getPhysicalDeviceMemoryProperties2 = nullptr;
+    VkAccelerationStructureNV m_placeholderBlas = VK_NULL_HANDLE;
+    VkDeviceMemory m_placeholderBlasMem = VK_NULL_HANDLE;
+    uint64_t m_placeholderBlasHandle = 0;
+    VkDeviceSize m_placeholderScratchSize = 0;
+    VkBuffer m_placeholderVertexBuf = VK_NULL_HANDLE;
+    VkDeviceMemory m_placeholderVertexBufMem = VK_NULL_HANDLE;
+    VkGeometryNV m_placeholderGeometry;
+    QVector<int> m_streamIn; // meshes to build in this frame
+    QVector<int> m_visibleMeshes;
+    qint64 m_residencyCpuTimeNs = 0;
+    int m_residencyFrame = 0;
+
+    std::unique_ptr<TileCoordinator> m_tileFarm;
+    bool m_tileFrameDirty = false;
+    int m_tileBenchmarkWorkers = 0; // 0 = not benchmarking
+    int m_tileBenchmarkFrame = 0;
+    QVector<double> m_tileBenchmarkMs; // per worker count
+    QVector<int> m_tileBenchmarkStolen;
+
+    // All device memory of the owner and its views, see MemoryTracker. The
+    // views report to the owner's.
+    MemoryTracker m_memoryTracker;
+    int m_memoryReportFrame = 0;
+
+    // The scene, the geometry and the ray tracing pipeline are created on
+    // m_startupPool's threads while the window shows placeholder frames, see
+    // startBackgroundInit(). Once m_scene is created, both tasks only read it
+    // (and m_options, m_positionFormat, m_vk). Concurrently, prepareGeometry()
+    // writes m_meshes, m_instanceTransforms, m_instanceRestY, m_instanceLods,
+    // m_instanceBounds, m_deformedMeshes, m_deformedMeshInput and
+    // m_geometryStats, and the pipeline task writes m_rayDescSetLayout,
+    // m_rayPipelineLayout, m_rayPipeline, m_rayGroups, m_rayGroupCount and
+    // m_sbtDirty. Neither touches the other's, and the GUI thread reads them
+    // only after the flags below have been set.
+    QThreadPool m_startupPool;
+    std::atomic<bool> m_geometryPrepared { false };
+    std::atomic<bool> m_pipelineCreated { false };
+    bool m_rayTracingReady = false;
+    RaytracingOptions::PositionFormat m_positionFormat = RaytracingOptions::FloatPositions;
+    struct GeometryStatistics {
+        VkDeviceSize positionBytes = 0;
+        VkDeviceSize floatPositionBytes = 0;
+        QuantizationError quantizationError;
+    } m_geometryStats;
+    QVector<MeshDeformer::Mesh> m_deformedMeshInput; // without the buffers yet
+
+    FrameCapture m_capture;
+    int m_captureReportFrame = 0;
+    bool m_captureReported = false;
 };
 
 #endif
@@ -0,0 +1,607 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "scene.h"
+#include "opacity_classifier.h"
+#include "geometry_registry.h"
+#include <QtMath>
+#include <QVector3D>
+#include <QColor>
+#include <QHash>
+#include <QRandomGenerator>
+#include <QElapsedTimer>
+#include <vector>
+
+// Smooth normals from the faces around each vertex, weighted by area.
+static void computeNormals(SceneMesh *mesh)
+{
+    const int stride = SceneMesh::FLOATS_PER_VERTEX;
+    float *v = mesh->vertices.data();
+    for (int i = 0; i < mesh->vertexCount(); ++i)
+        v[i * stride + 3] = v[i * stride + 4] = v[i * stride + 5] = 0.0f;
+
+    for (int t = 0; t < mesh->indices.count(); t += 3) {
+        const quint32 idx[3] = { mesh->indices[t], mesh->indices[t + 1], mesh->indices[t + 2] };
+        const QVector3D p0(v[idx[0] * stride], v[idx[0] * stride + 1], v[idx[0] * stride + 2]);
+        const QVector3D p1(v[idx[1] * stride], v[idx[1] * stride + 1], v[idx[1] * stride + 2]);
+        const QVector3D p2(v[idx[2] * stride], v[idx[2] * stride + 1], v[idx[2] * stride + 2]);
+        const QVector3D n = QVector3D::crossProduct(p1 - p0, p2 - p0);
+        for (quint32 i : idx) {
+            v[i * stride + 3] += n.x();
+            v[i * stride + 4] += n.y();
+            v[i * stride + 5] += n.z();
+        }
+    }
+
+    for (int i = 0; i < mesh->vertexCount(); ++i) {
+        const QVector3D n = QVector3D(v[i * stride + 3], v[i * stride + 4], v[i * stride + 5]).normalized();
+        v[i * stride + 3] = n.x();
+        v[i * stride + 4] = n.y();
+        v[i * stride + 5] = n.z();
+    }
+}
+
+void SceneMesh::boundingSphere(QVector3D *center, float *radius) const
+{
+    if (isProcedural()) {
+        QVector3D minPos(qInf(), qInf(), qInf());
+        QVector3D maxPos(-qInf(), -qInf(), -qInf());
+        for (int i = 0; i < sphereCount(); ++i) {
+            const float *s = spheres.constData() + i * FLOATS_PER_SPHERE;
+            for (int c = 0; c < 3; ++c) {
+                minPos[c] = qMin(minPos[c], s[c] - s[3]);
+                maxPos[c] = qMax(maxPos[c], s[c] + s[3]);
+            }
+        }
+        *center = (minPos + maxPos) * 0.5f;
+        float r = 0.0f;
+        for (int i = 0; i < sphereCount(); ++i) {
+            const float *s = spheres.constData() + i * FLOATS_PER_SPHERE;
+            r = qMax(r, (QVector3D(s[0], s[1], s[2]) - *center).length() + s[3]);
+        }
+        *radius = r;
+        return;
+    }
+
+    QVector3D minPos(qInf(), qInf(), qInf());
+    QVector3D maxPos(-qInf(), -qInf(), -qInf());
+    for (int i = 0; i < vertexCount(); ++i) {
+        const float *p = vertices.constData() + i * FLOATS_PER_VERTEX;
+        for (int c = 0; c < 3; ++c) {
+            minPos[c] = qMin(minPos[c], p[c]);
+            maxPos[c] = qMax(maxPos[c], p[c]);
+        }
+    }
+    *center = (minPos + maxPos) * 0.5f;
+    float r2 = 0.0f;
+    for (int i = 0; i < vertexCount(); ++i) {
+        const float *p = vertices.constData() + i * FLOATS_PER_VERTEX;
+        r2 = qMax(r2, (QVector3D(p[0], p[1], p[2]) - *center).lengthSquared());
+    }
+    *radius = qSqrt(r2);
+}
+
+SceneMesh SceneMesh::simplified(int gridResolution) const
+{
+    QVector3D minPos(qInf(), qInf(), qInf());
+    QVector3D maxPos(-qInf(), -qInf(), -qInf());
+    for (int i = 0; i < vertexCount(); ++i) {
+        const float *p = vertices.constData() + i * FLOATS_PER_VERTEX;
+        for (int c = 0; c < 3; ++c) {
+            minPos[c] = qMin(minPos[c], p[c]);
+            maxPos[c] = qMax(maxPos[c], p[c]);
+        }
+    }
+    const QVector3D extent = maxPos - minPos;
+
+    SceneMesh result;
+    QHash<quint64, quint32> cells;
+    QVector<int> mergedCount;
+    QVector<quint32> remap(vertexCount());
+    for (int i = 0; i < vertexCount(); ++i) {
+        const float *p = vertices.constData() + i * FLOATS_PER_VERTEX;
+        quint64 key = 0;
+        for (int c = 0; c < 3; ++c) {
+            const int cell = extent[c] > 0.0f ? int((p[c] - minPos[c]) / extent[c] * gridResolution) : 0;
+            key = (key << 21) | quint64(qBound(0, cell, gridResolution - 1));
+        }
+        auto it = cells.find(key);
+        if (it == cells.end()) {
+            it = cells.insert(key, quint32(mergedCount.count()));
+            mergedCount.append(0);
+            result.vertices.resize(result.vertices.count() + FLOATS_PER_VERTEX);
+        }
+        const quint32 merged = *it;
+        remap[i] = merged;
+        float *dst = result.vertices.data() + merged * FLOATS_PER_VERTEX;
+        for (int c = 0; c < FLOATS_PER_VERTEX; ++c)
+            dst[c] += p[c];
+        ++mergedCount[int(merged)];
+    }
+
+    for (int i = 0; i < mergedCount.count(); ++i) {
+        float *v = result.vertices.data() + i * FLOATS_PER_VERTEX;
+        for (int c = 0; c < FLOATS_PER_VERTEX; ++c)
+            v[c] /= mergedCount[i];
+    }
+
+    for (int t = 0; t < indices.count(); t += 3) {
+        const quint32 a = remap[int(indices[t])];
+        const quint32 b = remap[int(indices[t + 1])];
+        const quint32 c = remap[int(indices[t + 2])];
+        if (a != b && b != c && a != c)
+            result.indices.append({ a, b, c });
+    }
+
+    // collapsed completely, keep what we had
+    if (result.indices.isEmpty())
+        return *this;
+
+    computeNormals(&result);
+    return result;
+}
+
+// The vertices are on the sphere, so the triangles cut slightly into it. UVs
+// are spherical, like in shadeSphere() in shading.glsl.
+SceneMesh SceneMesh::triangulated() const
+{
+    static const float g = 1.618034f; // golden ratio
+    static const float corners[12][3] = {
+        { -1,  g,  0 }, {  1,  g,  0 }, { -1, -g,  0 }, {  1, -g,  0 },
+        {  0, -1,  g }, {  0,  1,  g }, {  0, -1, -g }, {  0,  1, -g },
+        {  g,  0, -1 }, {  g,  0,  1 }, { -g,  0, -1 }, { -g,  0,  1 }
+    };
+    // CCW when looking from the outside
+    static const quint32 faces[20][3] = {
+        { 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+        { 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+        { 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+        { 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 }
+    };
+
+    float unit[12][FLOATS_PER_VERTEX];
+    for (int i = 0; i < 12; ++i) {
+        const QVector3D n = QVector3D(corners[i][0], corners[i][1], corners[i][2]).normalized();
+        unit[i][0] = unit[i][3] = n.x();
+        unit[i][1] = unit[i][4] = n.y();
+        unit[i][2] = unit[i][5] = n.z();
+        unit[i][6] = qAtan2(n.z(), n.x()) / (2.0f * float(M_PI)) + 0.5f;
+        unit[i][7] = qAcos(n.y()) / float(M_PI);
+    }
+
+    SceneMesh result;
+    result.vertices.reserve(sphereCount() * 12 * FLOATS_PER_VERTEX);
+    result.indices.reserve(sphereCount() * 20 * 3);
+    for (int i = 0; i < sphereCount(); ++i) {
+        const float *s = spheres.constData() + i * FLOATS_PER_SPHERE;
+        const quint32 base = quint32(result.vertexCount());
+        for (const float *v : unit) {
+            result.vertices.append({ s[0] + s[3] * v[0], s[1] + s[3] * v[1], s[2] + s[3] * v[2] });
+            result.vertices.append({ v[3], v[4], v[5], v[6], v[7] });
+        }
+        for (const quint32 *f : faces)
+            result.indices.append({ base + f[0], base + f[1], base + f[2] });
+    }
+    return result;
+}
+
+static QImage makeCheckerTexture(int seed)
+{
+    static const int SIZE = 64;
+    const int squares = 2 << (seed % 4);
+    const QColor a = QColor::fromHsv((seed * 37) % 360, 160, 255);
+    const QColor b = QColor::fromHsv((seed * 37 + 180) % 360, 80, 160);
+    QImage image(SIZE, SIZE, QImage::Format_RGBA8888);
+    for (int y = 0; y < SIZE; ++y) {
+        for (int x = 0; x < SIZE; ++x) {
+            const bool odd = ((x * squares / SIZE) + (y * squares / SIZE)) & 1;
+            image.setPixelColor(x, y, odd ? a : b);
+        }
+    }
+    return image;
+}
+
+Scene Scene::createTriangle()
+{
+    Scene scene;
+    SceneMesh mesh;
+    mesh.vertices = {
+         0.0f,   1.0f,  0.0f,    0.0f, 0.0f, 1.0f,    0.5f, 0.0f,
+        -1.0f,  -1.0f,  0.0f,    0.0f, 0.0f, 1.0f,    0.0f, 1.0f,
+         1.0f,  -1.0f,  0.0f,    0.0f, 0.0f, 1.0f,    1.0f, 1.0f
+    };
+    mesh.indices = { 0, 1, 2 };
+    scene.meshes.append(mesh);
+    scene.instances.append({ 0, 0, QMatrix4x4() });
+    scene.createMaterials(1);
+    return scene;
+}
+
+// A UV sphere with a radius perturbed based on seed so that every mesh is
+// different (and so ends up in its own BLAS).
+static SceneMesh makeBlob(int seed, int rings)
+{
+    SceneMesh mesh;
+    const int sectors = rings * 2;
+    const float wobble = 0.05f + 0.1f * float(seed % 7) / 6.0f;
+    const float freq = float(2 + seed % 5);
+
+    for (int i = 0; i <= rings; ++i) {
+        const float theta = float(M_PI) * i / rings;
+        for (int j = 0; j <= sectors; ++j) {
+            const float phi = 2.0f * float(M_PI) * j / sectors;
+            const float r = 1.0f + wobble * qSin(freq * phi + seed) * qSin(theta);
+            mesh.vertices.append(r * qSin(theta) * qCos(phi));
+            mesh.vertices.append(r * qCos(theta));
+            mesh.vertices.append(r * qSin(theta) * qSin(phi));
+            mesh.vertices.append({ 0.0f, 0.0f, 0.0f }); // normal, calculated below
+            mesh.vertices.append(float(j) / sectors);
+            mesh.vertices.append(float(i) / rings);
+        }
+    }
+
+    // CCW when looking from the outside
+    for (int i = 0; i < rings; ++i) {
+        for (int j = 0; j < sectors; ++j) {
+            const quint32 a = quint32(i * (sectors + 1) + j);
+            const quint32 b = a + quint32(sectors + 1);
+            const quint32 c = b + 1;
+            const quint32 d = a + 1;
+            mesh.indices.append({ a, c, b });
+            mesh.indices.append({ a, d, c });
+        }
+    }
+
+    computeNormals(&mesh);
+    return mesh;
+}
+
+Scene Scene::createMeshGrid(int meshCount)
+{
+    Scene scene;
+    const int columns = qCeil(qSqrt(qreal(meshCount)));
+    const int rows = (meshCount + columns - 1) / columns;
+    // the default camera sees roughly [-2, 2] at z = 0
+    const float cell = 4.0f / qMax(columns, rows);
+
+    for (int i = 0; i < meshCount; ++i) {
+        scene.meshes.append(makeBlob(i, 6 + i % 11));
+        QMatrix4x4 m;
+        m.translate(-2.0f + cell * (i % columns + 0.5f), 2.0f - cell * (i / columns + 0.5f), 0.0f);
+        m.scale(cell * 0.4f);
+        scene.instances.append({ i, 0, m });
+    }
+
+    scene.createMaterials(qMin(meshCount, 16));
+    return scene;
+}
+
+Scene Scene::createSphereCloud(int sphereCount)
+{
+    Scene scene;
+    SceneMesh mesh;
+    // the same spheres every time, so that runs can be compared
+    QRandomGenerator rng(sphereCount);
+    // the default camera sees roughly [-2, 2] at z = 0; spread the spheres
+    // over that and a depth of 2, sized so that roughly 5% of it is filled
+    const float volume = 4.0f * 4.0f * 2.0f;
+    const float meanRadius = qPow(0.05f * volume / sphereCount * 3.0f / (4.0f * float(M_PI)), 1.0f / 3.0f);
+    mesh.spheres.reserve(sphereCount * SceneMesh::FLOATS_PER_SPHERE);
+    for (int i = 0; i < sphereCount; ++i) {
+        mesh.spheres.append({ float(rng.bounded(4.0) - 2.0), float(rng.bounded(4.0) - 2.0), float(rng.bounded(2.0) - 1.0),
+                              meanRadius * float(0.5 + rng.bounded(1.0)) });
+    }
+    scene.meshes.append(mesh);
+    scene.instances.append({ 0, 0, QMatrix4x4() });
+    scene.createMaterials(1);
+    return scene;
+}
+
+void Scene::createMaterials(int materialCount)
+{
+    materials.clear();
+    textures.clear();
+    for (int i = 0; i < materialCount; ++i) {
+        const QColor tint = QColor::fromHsv((i * 61) % 360, 40, 255);
+        SceneMaterial material = {};
+        material.baseColor[0] = float(tint.redF());
+        material.baseColor[1] = float(tint.greenF());
+        material.baseColor[2] = float(tint.blueF());
+        material.baseColor[3] = 1.0f;
+        material.texture = quint32(i);
+        material.uvScale = float(1 + i % 4);
+        materials.append(material);
+        textures.append(makeCheckerTexture(i));
+    }
+
+    for (int i = 0; i < instances.count(); ++i)
+        instances[i].material = i % materialCount;
+}
+
+void Scene::replicateInstances(int instanceCount)
+{
+    const int baseCount = instances.count();
+    if (!baseCount || instanceCount <= baseCount)
+        return;
+
+    const int copyCount = (instanceCount + baseCount - 1) / baseCount;
+    const int columns = qCeil(qSqrt(qreal(copyCount)));
+    const float cell = 4.0f / columns;
+
+    QVector<SceneInstance> replicated;
+    replicated.reserve(instanceCount);
+    for (int i = 0; i < instanceCount; ++i) {
+        const int copy = i / baseCount;
+        const SceneInstance &src(instances[i % baseCount]);
+        QMatrix4x4 m;
+        m.translate(-2.0f + cell * (copy % columns + 0.5f), 2.0f - cell * (copy / columns + 0.5f), 0.0f);
+        m.scale(cell / 4.0f);
+        replicated.append({ src.mesh, src.material, m * src.transform });
+    }
+    instances = replicated;
+}
+
+void Scene::duplicateMeshes(int copyCount)
+{
+    const int baseMeshCount = meshes.count();
+    const int baseInstanceCount = instances.count();
+    if (copyCount <= 1 || !baseMeshCount || !baseInstanceCount)
+        return;
+
+    meshes.reserve(baseMeshCount * copyCount);
+    for (int copy = 1; copy < copyCount; ++copy) {
+        for (int i = 0; i < baseMeshCount; ++i) {
+            const SceneMesh &src(meshes[i]);
+            SceneMesh mesh = src;
+            mesh.vertices = QVector<float>(src.vertices.cbegin(), src.vertices.cend());
+            mesh.indices = QVector<quint32>(src.indices.cbegin(), src.indices.cend());
+            mesh.spheres = QVector<float>(src.spheres.cbegin(), src.spheres.cend());
+            meshes.append(mesh);
+        }
+    }
+
+    replicateInstances(baseInstanceCount * copyCount);
+    for (int i = baseInstanceCount; i < instances.count(); ++i)
+        instances[i].mesh += (i / baseInstanceCount) * baseMeshCount;
+}
+
+void Scene::deduplicateMeshes(GeometryRegistry *registry)
+{
+    // the levels of detail of a mesh would not stay consecutive
+    Q_ASSERT(lodCount == 1);
+    const QVector<int> geometries = registry->addMeshes(meshes);
+
+    // the first mesh with each geometry stays
+    QHash<int, int> remaining;
+    QVector<int> remap(meshes.count());
+    QVector<SceneMesh> unique;
+    for (int i = 0; i < meshes.count(); ++i) {
+        const int index = remaining.value(geometries[i], -1);
+        if (index < 0) {
+            remap[i] = unique.count();
+            remaining.insert(geometries[i], unique.count());
+            unique.append(meshes[i]);
+        } else {
+            remap[i] = index;
+            unique[index].duplicates += 1 + meshes[i].duplicates;
+        }
+    }
+    if (unique.count() == meshes.count())
+        return;
+
+    meshes = unique;
+    for (SceneInstance &instance : instances)
+        instance.mesh = remap[instance.mesh];
+}
+
+void Scene::createLods(int levelCount)
+{
+    if (levelCount <= 1)
+        return;
+
+    QVector<SceneMesh> lods;
+    lods.reserve(meshes.count() * levelCount);
+    for (const SceneMesh &mesh : meshes) {
+        lods.append(mesh);
+        // halve the grid per level, starting from about half of what the
+        // original vertex density would be
+        int resolution = qMax(2, qCeil(qSqrt(qreal(mesh.vertexCount()))) / 2);
+        for (int level = 1; level < levelCount; ++level) {
+            lods.append(lods.last().simplified(resolution));
+            lods.last().duplicates = mesh.duplicates;
+            resolution = qMax(2, resolution / 2);
+        }
+    }
+    meshes = lods;
+
+    for (SceneInstance &instance : instances)
+        instance.mesh *= levelCount;
+    lodCount = levelCount;
+}
+
+void Scene::triangulateSpheres(bool keepProcedural)
+{
+    // the levels of detail are only ever created for triangle meshes
+    Q_ASSERT(lodCount == 1);
+    const int meshCount = meshes.count();
+    QVector<int> triangulatedMesh(meshCount, -1);
+    for (int i = 0; i < meshCount; ++i) {
+        if (!meshes[i].isProcedural())
+            continue;
+        if (keepProcedural) {
+            triangulatedMesh[i] = meshes.count();
+            meshes.append(meshes[i].triangulated());
+        } else {
+            meshes[i] = meshes[i].triangulated();
+        }
+    }
+
+    const int instanceCount = instances.count();
+    for (int i = 0; i < instanceCount; ++i) {
+        const int mesh = triangulatedMesh[instances[i].mesh];
+        if (mesh >= 0) {
+            SceneInstance copy = instances[i];
+            copy.mesh = mesh;
+            instances.append(copy);
+        }
+    }
+}
+
+void Scene::cutOutMaterials(float alphaCutoff)
+{
+    // a grid of round holes per texture, with a soft edge for the bilinear
+    // filter to make something of
+    static const int HOLES = 4;
+    static const float RADIUS = 0.3f; // relative to the cell
+    static const float EDGE = 0.1f;
+    for (int i = materials.count() > 1 ? 1 : 0; i < materials.count(); i += 2) {
+        SceneMaterial &material(materials[i]);
+        QImage &image(textures[int(material.texture)]);
+        image = image.convertToFormat(QImage::Format_RGBA8888);
+        const float cell = float(image.width()) / HOLES;
+        for (int y = 0; y < image.height(); ++y) {
+            uchar *line = image.scanLine(y);
+            for (int x = 0; x < image.width(); ++x) {
+                const float dx = (x + 0.5f) / cell - (qFloor((x + 0.5f) / cell) + 0.5f);
+                const float dy = (y + 0.5f) / cell - (qFloor((y + 0.5f) / cell) + 0.5f);
+                const float d = qSqrt(dx * dx + dy * dy);
+                line[x * 4 + 3] = uchar(qBound(0.0f, (d - RADIUS) / EDGE, 1.0f) * 255.0f);
+            }
+        }
+        material.alphaCutoff = alphaCutoff;
+    }
+}
+
+void Scene::classifyOpacity(bool keepUnclassified)
+{
+    // the levels of detail of a mesh must stay consecutive
+    Q_ASSERT(!keepUnclassified || lodCount == 1);
+    QElapsedTimer timer;
+    timer.start();
+    opacityStatistics = OpacityStatistics();
+
+    std::vector<OpacityClassifier> classifiers;
+    QVector<int> materialClassifier(materials.count(), -1);
+    for (int i = 0; i < materials.count(); ++i) {
+        const SceneMaterial &material(materials[i]);
+        if (material.alphaCutoff > 0.0f) {
+            materialClassifier[i] = int(classifiers.size());
+            classifiers.emplace_back(textures[int(material.texture)], material.uvScale, material.alphaCutoff);
+        }
+    }
+
+    // the alpha tested materials each mesh (and its levels of detail) is used with
+    QVector<QVector<int>> meshClassifiers(meshes.count());
+    for (const SceneInstance &instance : instances) {
+        const int classifier = materialClassifier[instance.material];
+        if (classifier < 0)
+            continue;
+        for (int lod = 0; lod < lodCount; ++lod) {
+            QVector<int> &used(meshClassifiers[instance.mesh + lod]);
+            if (!used.contains(classifier))
+                used.append(classifier);
+        }
+    }
+
+    const int meshCount = meshes.count();
+    QVector<int> unclassifiedMesh(meshCount, -1);
+    for (int i = 0; i < meshCount; ++i) {
+        if (meshClassifiers[i].isEmpty() || meshes[i].isProcedural())
+            continue;
+        if (keepUnclassified) {
+            SceneMesh copy = meshes[i];
+            copy.opaqueTriangleCount = 0;
+            unclassifiedMesh[i] = meshes.count();
+            meshes.append(copy);
+        }
+
+        SceneMesh &mesh(meshes[i]);
+        QVector<quint32> opaque;
+        QVector<quint32> mixed;
+        int transparent = 0;
+        for (int t = 0; t < mesh.triangleCount(); ++t) {
+            OpacityClassifier::Coverage coverage = classifiers[size_t(meshClassifiers[i][0])].classify(mesh, t);
+            for (int j = 1; j < meshClassifiers[i].count() && coverage != OpacityClassifier::Mixed; ++j)
+                coverage = OpacityClassifier::combine(coverage, classifiers[size_t(meshClassifiers[i][j])].classify(mesh, t));
+            const quint32 *tri = mesh.indices.constData() + t * 3;
+            if (coverage == OpacityClassifier::Opaque)
+                opaque.append({ tri[0], tri[1], tri[2] });
+            else if (coverage == OpacityClassifier::Mixed)
+                mixed.append({ tri[0], tri[1], tri[2] });
+            else
+                ++transparent;
+        }
+        // nothing visible at all: keep it for the any-hit shader to discard
+        // rather than having a mesh without triangles
+        if (opaque.isEmpty() && mixed.isEmpty()) {
+            mixed = mesh.indices;
+            transparent = 0;
+        }
+
+        opacityStatistics.opaqueTriangles += opaque.count() / 3;
+        opacityStatistics.mixedTriangles += mixed.count() / 3;
+        opacityStatistics.transparentTriangles += transparent;
+        mesh.opaqueTriangleCount = opaque.count() / 3;
+        mesh.indices = opaque + mixed;
+        mesh.classified = true;
+    }
+
+    const int instanceCount = instances.count();
+    for (int i = 0; i < instanceCount; ++i) {
+        const int mesh = unclassifiedMesh[instances[i].mesh];
+        if (mesh >= 0) {
+            SceneInstance copy = instances[i];
+            copy.mesh = mesh;
+            instances.append(copy);
+        }
+    }
+
+    opacityStatistics.classifyNs = timer.nsecsElapsed();
+}
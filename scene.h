@@ -0,0 +1,184 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <QVector>
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QImage>
+
+class GeometryRegistry;
+
+// CPU-side description of what gets put into the acceleration structures.
+// Positions follow the usual Qt conventions (Y up, front face CCW).
+
+struct SceneMesh
+{
+    // position xyz, normal xyz, uv
+    static const int FLOATS_PER_VERTEX = 8;
+    QVector<float> vertices;
+    QVector<quint32> indices;
+    // center xyz, radius. A mesh with spheres is procedural: it has no
+    // vertices and indices, the spheres are intersected in a shader.
+    static const int FLOATS_PER_SPHERE = 4;
+    QVector<float> spheres;
+    // Alpha testing, see Scene::classifyOpacity(): the first
+    // opaqueTriangleCount triangles are opaque, the rest need the any-hit
+    // shader. -1 when none of the mesh's materials is alpha tested.
+    // Unclassified meshes (the unsplit copies classifyOpacity() can keep for
+    // comparison) have all their triangles non-opaque.
+    int opaqueTriangleCount = -1;
+    bool classified = false;
+    // identical meshes merged into this one, see Scene::deduplicateMeshes()
+    int duplicates = 0;
+
+    int vertexCount() const { return vertices.count() / FLOATS_PER_VERTEX; }
+    int triangleCount() const { return indices.count() / 3; }
+    int sphereCount() const { return spheres.count() / FLOATS_PER_SPHERE; }
+    bool isProcedural() const { return !spheres.isEmpty(); }
+    bool isAlphaTested() const { return opaqueTriangleCount >= 0; }
+
+    // center and radius of a sphere enclosing all positions (or spheres)
+    void boundingSphere(QVector3D *center, float *radius) const;
+
+    // the spheres as a triangle mesh, an icosahedron per sphere
+    SceneMesh triangulated() const;
+
+    // Vertex clustering: merges all vertices within the same cell of a
+    // gridResolution^3 grid over the bounding box and drops the triangles
+    // that become degenerate. Normals are recalculated, UVs averaged.
+    SceneMesh simplified(int gridResolution) const;
+};
+
+// Laid out as the std430 Material struct in shading.glsl.
+struct SceneMaterial
+{
+    float baseColor[4];
+    quint32 texture;
+    float uvScale;
+    float alphaCutoff; // 0 = opaque, otherwise texels with less alpha are cut out
+    quint32 reserved;
+};
+
+struct SceneInstance
+{
+    int mesh;
+    int material;
+    QMatrix4x4 transform;
+};
+
+struct Scene
+{
+    QVector<SceneMesh> meshes;
+    QVector<SceneMaterial> materials;
+    QVector<QImage> textures;
+    QVector<SceneInstance> instances;
+    // meshes holds lodCount consecutive levels of detail per original mesh,
+    // SceneInstance::mesh refers to level 0
+    int lodCount = 1;
+
+    struct OpacityStatistics {
+        qint64 opaqueTriangles = 0;
+        qint64 mixedTriangles = 0;
+        qint64 transparentTriangles = 0; // dropped
+        qint64 classifyNs = 0;
+    } opacityStatistics; // of the last classifyOpacity()
+
+    static Scene createTriangle();
+    // meshCount distinct meshes, each instanced once, laid out on a grid
+    // covering the default view
+    static Scene createMeshGrid(int meshCount);
+    // sphereCount spheres of varying size scattered over the default view,
+    // all in one procedural mesh with a single instance
+    static Scene createSphereCloud(int sphereCount);
+
+    // replaces the materials with materialCount distinct ones, each with its
+    // own procedural texture, assigned to the instances round-robin
+    void createMaterials(int materialCount);
+
+    // repeats the instances until there are instanceCount of them, each copy
+    // of the original set shrunk into its own cell of a grid covering the view
+    void replicateInstances(int instanceCount);
+
+    // Appends copyCount - 1 copies of every mesh, as if each had been loaded
+    // from a file of its own (the data is not shared), and instances of them
+    // as with replicateInstances(instances.count() * copyCount), each copy of
+    // the original set referencing its own copies of the meshes.
+    void duplicateMeshes(int copyCount);
+
+    // Merges meshes with the same contents into one, according to registry,
+    // which gets a reference per mesh. The instances are remapped to the
+    // remaining meshes.
+    void deduplicateMeshes(GeometryRegistry *registry);
+
+    // replaces each mesh with levelCount progressively simplified versions of
+    // itself, level 0 being the original
+    void createLods(int levelCount);
+
+    // replaces the procedural meshes with their triangulated versions, or
+    // with keepProcedural appends those, along with a copy of each instance
+    // of a procedural mesh referencing the triangulated one instead
+    void triangulateSpheres(bool keepProcedural);
+
+    // cuts holes into the texture of every other material (or of the only
+    // one), leaves and fences more or less, to be alpha tested against alphaCutoff
+    void cutOutMaterials(float alphaCutoff);
+
+    // Classifies the triangles of the meshes with alpha tested materials
+    // (see OpacityClassifier) and reorders them: opaque ones first, then
+    // the mixed ones; the fully transparent ones are dropped. With
+    // keepUnclassified the original of each such mesh is appended, along
+    // with a copy of each of its instances referencing it instead.
+    void classifyOpacity(bool keepUnclassified);
+};
+
+#endif
@@ -0,0 +1,139 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "shader_binding_table.h"
+
+static inline VkDeviceSize alignUp(VkDeviceSize v, VkDeviceSize byteAlign)
+{
+    return (v + byteAlign - 1) & ~(byteAlign - 1);
+}
+
+void ShaderBindingTable::setDeviceLimits(uint32_t handleSize, uint32_t baseAlignment, uint32_t maxStride)
+{
+    m_handleSize = handleSize;
+    m_baseAlignment = baseAlignment;
+    m_maxStride = maxStride;
+}
+
+void ShaderBindingTable::clear()
+{
+    for (RegionData &r : m_regions)
+        r = RegionData();
+    m_data.clear();
+}
+
+int ShaderBindingTable::addRecord(Region region, uint32_t groupIndex, const QByteArray &inlineData)
+{
+    RegionData &r(m_regions[region]);
+    r.records.append({ groupIndex, inlineData, r.groupPending, 0 });
+    r.groupPending = false;
+    return r.records.count() - 1;
+}
+
+void ShaderBindingTable::setInlineData(Region region, int record, const QByteArray &inlineData)
+{
+    m_regions[region].records[record].inlineData = inlineData;
+}
+
+VkDeviceSize ShaderBindingTable::offset(Region region, int record) const
+{
+    const RegionData &r(m_regions[region]);
+    if (r.records.isEmpty())
+        return r.offset;
+    Q_ASSERT(record >= 0 && record < r.records.count());
+    const VkDeviceSize offset = r.records[record].offset;
+    // anything else would be an invalid shader binding offset
+    Q_ASSERT(offset % m_baseAlignment == 0);
+    return offset;
+}
+
+bool ShaderBindingTable::build(const quint8 *groupHandles, uint32_t groupCount)
+{
+    Q_ASSERT(m_handleSize && m_baseAlignment);
+
+    VkDeviceSize totalSize = 0;
+    for (int i = 0; i < RegionCount; ++i) {
+        RegionData &r(m_regions[i]);
+        VkDeviceSize recordSize = m_handleSize;
+        for (const Record &rec : r.records)
+            recordSize = qMax(recordSize, VkDeviceSize(m_handleSize + rec.inlineData.size()));
+        r.stride = alignUp(recordSize, i == RayGen ? m_baseAlignment : m_handleSize);
+        if (i != RayGen && r.stride > m_maxStride) {
+            qWarning("Shader binding table stride %llu exceeds maxShaderGroupStride %u",
+                     r.stride, m_maxStride);
+            return false;
+        }
+        r.offset = alignUp(totalSize, m_baseAlignment);
+        totalSize = r.offset;
+        for (Record &rec : r.records) {
+            if (rec.groupStart)
+                totalSize = alignUp(totalSize, m_baseAlignment);
+            rec.offset = totalSize;
+            totalSize += r.stride;
+        }
+    }
+
+    m_data.fill(0, int(totalSize));
+    quint8 *p = reinterpret_cast<quint8 *>(m_data.data());
+    for (const RegionData &r : m_regions) {
+        for (const Record &rec : r.records) {
+            if (rec.groupIndex >= groupCount) {
+                qWarning("Shader binding table refers to invalid shader group %u", rec.groupIndex);
+                return false;
+            }
+            quint8 *dst = p + rec.offset;
+            memcpy(dst, groupHandles + rec.groupIndex * m_handleSize, m_handleSize);
+            if (!rec.inlineData.isEmpty())
+                memcpy(dst + m_handleSize, rec.inlineData.constData(), size_t(rec.inlineData.size()));
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,123 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef SHADER_BINDING_TABLE_H
+#define SHADER_BINDING_TABLE_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QVulkanInstance>
+
+// Lays out a VK_NV_ray_tracing shader binding table. There are four regions
+// (ray generation, miss, hit, callable), each starting at a multiple of
+// shaderGroupBaseAlignment. A record is a shader group handle optionally
+// followed by inline data that the shaders can access via shaderRecordNV.
+// All records in a region share the same stride, which is a multiple of
+// shaderGroupHandleSize and large enough for the largest record. Ray
+// generation records are aligned to shaderGroupBaseAlignment individually
+// since each of them can be passed as raygenShaderBindingOffset. Records of
+// the other regions can be split into groups with beginGroup(), each group
+// starting at a multiple of shaderGroupBaseAlignment, so that one of several
+// sets of miss or hit records can be selected per trace.
+
+class ShaderBindingTable
+{
+public:
+    enum Region {
+        RayGen,
+        Miss,
+        Hit,
+        Callable,
+        RegionCount
+    };
+
+    void setDeviceLimits(uint32_t handleSize, uint32_t baseAlignment, uint32_t maxStride);
+
+    void clear();
+    // the next record added to region starts a new base aligned group
+    void beginGroup(Region region) { m_regions[region].groupPending = true; }
+    int addRecord(Region region, uint32_t groupIndex, const QByteArray &inlineData = QByteArray());
+    void setInlineData(Region region, int record, const QByteArray &inlineData);
+
+    // groupHandles is the result of vkGetRayTracingShaderGroupHandlesNV for
+    // all the groups (0..groupCount-1) of the pipeline
+    bool build(const quint8 *groupHandles, uint32_t groupCount);
+
+    const QByteArray &data() const { return m_data; }
+    VkDeviceSize size() const { return VkDeviceSize(m_data.size()); }
+
+    int recordCount(Region region) const { return m_regions[region].records.count(); }
+    // Only what vkCmdTraceRaysNV accepts as an offset: any ray generation
+    // record, the first record of the other regions or of a group in them.
+    VkDeviceSize offset(Region region, int record = 0) const;
+    VkDeviceSize stride(Region region) const { return m_regions[region].stride; }
+
+private:
+    struct Record {
+        uint32_t groupIndex;
+        QByteArray inlineData;
+        bool groupStart;
+        VkDeviceSize offset; // set by build()
+    };
+    struct RegionData {
+        QVector<Record> records;
+        bool groupPending = false;
+        VkDeviceSize offset = 0;
+        VkDeviceSize stride = 0;
+    };
+
+    uint32_t m_handleSize = 0;
+    uint32_t m_baseAlignment = 0;
+    uint32_t m_maxStride = 0;
+    RegionData m_regions[RegionCount];
+    QByteArray m_data;
+};
+
+#endif
@@ -0,0 +1,113 @@
+// Surface attributes, fetched either in closesthit.rchit or (with
+// INLINE_SHADING) in raygen.rgen, and the alpha test of anyhit.rahit. The
+// spheres of procedural meshes are read by intersection_sphere.rint and
+// closesthit_sphere.rchit.
+
+struct InstanceData
+{
+    uint mesh; // level of detail 0, the others follow
+    uint material;
+};
+
+struct Material
+{
+    vec4 baseColor;
+    uint texture;
+    float uvScale;
+    float alphaCutoff; // 0 for opaque materials
+    uint reserved;
+};
+
+// Everything is bindless: one descriptor set for all meshes and materials,
+// indexed by gl_InstanceCustomIndexNV and gl_PrimitiveID.
+layout(binding = 3, set = 0) readonly buffer Instances { InstanceData instances[]; };
+layout(binding = 4, set = 0) readonly buffer Materials { Material materials[]; };
+// normal xyz, uv (positions are only needed for the BLAS), or for
+// procedural meshes center xyz and radius per sphere, with no indices
+layout(binding = 5, set = 0) readonly buffer Attributes { float v[]; } attributes[];
+layout(binding = 6, set = 0) readonly buffer Indices { uint i[]; } indices[];
+layout(binding = 7, set = 0) uniform sampler2D textures[];
+
+const uint FLOATS_PER_VERTEX = 5;
+
+vec3 fetchNormal(uint mesh, uint index)
+{
+    const uint base = index * FLOATS_PER_VERTEX;
+    return vec3(attributes[nonuniformEXT(mesh)].v[base],
+                attributes[nonuniformEXT(mesh)].v[base + 1],
+                attributes[nonuniformEXT(mesh)].v[base + 2]);
+}
+
+vec2 fetchUV(uint mesh, uint index)
+{
+    const uint base = index * FLOATS_PER_VERTEX + 3;
+    return vec2(attributes[nonuniformEXT(mesh)].v[base],
+                attributes[nonuniformEXT(mesh)].v[base + 1]);
+}
+
+vec4 fetchSphere(uint mesh, uint primitive)
+{
+    const uint base = primitive * 4;
+    return vec4(attributes[nonuniformEXT(mesh)].v[base],
+                attributes[nonuniformEXT(mesh)].v[base + 1],
+                attributes[nonuniformEXT(mesh)].v[base + 2],
+                attributes[nonuniformEXT(mesh)].v[base + 3]);
+}
+
+// Returns the albedo at the hit point, normal is set to the world space normal.
+vec3 shade(uint instanceIndex, uint lod, uint primitive, vec2 baryCoord, mat3 worldToObject, out vec3 normal)
+{
+    const InstanceData instance = instances[instanceIndex];
+    const uint mesh = instance.mesh + lod;
+
+    const uint i0 = indices[nonuniformEXT(mesh)].i[3 * primitive];
+    const uint i1 = indices[nonuniformEXT(mesh)].i[3 * primitive + 1];
+    const uint i2 = indices[nonuniformEXT(mesh)].i[3 * primitive + 2];
+
+    // the attributes of vertex 1 and 2 are weighted by baryCoord.x and .y
+    const vec3 bary = vec3(1.0f - baryCoord.x - baryCoord.y, baryCoord.x, baryCoord.y);
+
+    const vec3 objectNormal = fetchNormal(mesh, i0) * bary.x + fetchNormal(mesh, i1) * bary.y + fetchNormal(mesh, i2) * bary.z;
+    // inverse transpose, since the object to world transform includes the
+    // non-uniform scale of the position dequantization
+    normal = normalize(objectNormal * worldToObject);
+    const vec2 uv = fetchUV(mesh, i0) * bary.x + fetchUV(mesh, i1) * bary.y + fetchUV(mesh, i2) * bary.z;
+
+    const Material material = materials[instance.material];
+    const vec3 texColor = textureLod(textures[nonuniformEXT(material.texture)], uv * material.uvScale, 0.0).rgb;
+
+    return material.baseColor.rgb * texColor;
+}
+
+// The alpha test of anyhit.rahit: true if the texture's alpha at the hit
+// point is at least the material's cutoff.
+bool alphaTest(uint instanceIndex, uint lod, uint primitive, vec2 baryCoord)
+{
+    const InstanceData instance = instances[instanceIndex];
+    const uint mesh = instance.mesh + lod;
+
+    const uint i0 = indices[nonuniformEXT(mesh)].i[3 * primitive];
+    const uint i1 = indices[nonuniformEXT(mesh)].i[3 * primitive + 1];
+    const uint i2 = indices[nonuniformEXT(mesh)].i[3 * primitive + 2];
+    const vec3 bary = vec3(1.0f - baryCoord.x - baryCoord.y, baryCoord.x, baryCoord.y);
+    const vec2 uv = fetchUV(mesh, i0) * bary.x + fetchUV(mesh, i1) * bary.y + fetchUV(mesh, i2) * bary.z;
+
+    const Material material = materials[instance.material];
+    return textureLod(textures[nonuniformEXT(material.texture)], uv * material.uvScale, 0.0).a >= material.alphaCutoff;
+}
+
+// Like shade(), for a hit on a sphere with the given object space normal. The
+// texture is mapped with spherical coordinates, like SceneMesh::triangulated().
+vec3 shadeSphere(uint instanceIndex, vec3 objectNormal, mat3 worldToObject, out vec3 normal)
+{
+    const InstanceData instance = instances[instanceIndex];
+    normal = normalize(objectNormal * worldToObject);
+    // 1 / 2pi and 1 / pi
+    const vec2 uv = vec2(atan(objectNormal.z, objectNormal.x) * 0.15915494 + 0.5,
+                         acos(clamp(objectNormal.y, -1.0, 1.0)) * 0.31830989);
+
+    const Material material = materials[instance.material];
+    const vec3 texColor = textureLod(textures[nonuniformEXT(material.texture)], uv * material.uvScale, 0.0).rgb;
+
+    return material.baseColor.rgb * texColor;
+}
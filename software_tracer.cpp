@@ -0,0 +1,341 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "software_tracer.h"
+#include <QVector4D>
+#include <QtMath>
+#include <algorithm>
+#include <cfloat>
+#include <numeric>
+
+// the same as in raygen.rgen
+static const QVector3D MISS_COLOR(0.0f, 0.0f, 0.2f);
+static const float AO_RADIUS = 0.25f;
+static const float T_MIN = 0.001f;
+static const float T_MAX = 10000.0f;
+
+static const int LEAF_SIZE = 4;
+
+void SoftwareTracer::build(const Scene &scene)
+{
+    m_triangles.clear();
+    m_attributes.clear();
+    m_nodes.clear();
+    m_materials = scene.materials;
+    m_textures.clear();
+    for (const QImage &texture : scene.textures)
+        m_textures.append(texture.convertToFormat(QImage::Format_RGBA8888));
+
+    QVector<SceneMesh> triangulated(scene.meshes.count());
+    for (int i = 0; i < scene.meshes.count(); ++i) {
+        if (scene.meshes[i].isProcedural())
+            triangulated[i] = scene.meshes[i].triangulated();
+    }
+
+    for (const SceneInstance &instance : scene.instances) {
+        const SceneMesh &mesh(scene.meshes[instance.mesh].isProcedural() ? triangulated[instance.mesh]
+                                                                         : scene.meshes[instance.mesh]);
+        // world space is Y down, like with the instance transforms in the TLAS
+        QMatrix4x4 transform;
+        transform.scale(1.0f, -1.0f, 1.0f);
+        transform *= instance.transform;
+        const QMatrix4x4 normalTransform = transform.inverted().transposed();
+        for (int i = 0; i < mesh.triangleCount(); ++i) {
+            QVector3D p[3];
+            TriangleAttributes attributes;
+            for (int corner = 0; corner < 3; ++corner) {
+                const float *v = mesh.vertices.constData() + mesh.indices[3 * i + corner] * SceneMesh::FLOATS_PER_VERTEX;
+                p[corner] = transform.map(QVector3D(v[0], v[1], v[2]));
+                attributes.normals[corner] = normalTransform.mapVector(QVector3D(v[3], v[4], v[5]));
+                attributes.uvs[corner][0] = v[6];
+                attributes.uvs[corner][1] = v[7];
+            }
+            attributes.material = instance.material;
+            m_triangles.append({ p[0], p[1] - p[0], p[2] - p[0] });
+            m_attributes.append(attributes);
+        }
+    }
+
+    const int count = m_triangles.count();
+    if (!count)
+        return;
+
+    QVector<QVector3D> centroids(count);
+    for (int i = 0; i < count; ++i)
+        centroids[i] = m_triangles[i].p0 + (m_triangles[i].e1 + m_triangles[i].e2) / 3.0f;
+    QVector<int> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    m_nodes.reserve(2 * count / LEAF_SIZE + 1);
+    buildNode(0, count, &centroids, &order);
+
+    // leaves refer to ranges of order, make those ranges of the triangles
+    QVector<Triangle> triangles(count);
+    QVector<TriangleAttributes> attributes(count);
+    for (int i = 0; i < count; ++i) {
+        triangles[i] = m_triangles[order[i]];
+        attributes[i] = m_attributes[order[i]];
+    }
+    m_triangles = triangles;
+    m_attributes = attributes;
+}
+
+// Median split along the longest axis of the centroid bounds. Quick to
+// build; the traversal is not what the tile farm is about.
+int SoftwareTracer::buildNode(int first, int count, QVector<QVector3D> *centroids, QVector<int> *order)
+{
+    const int index = m_nodes.count();
+    m_nodes.append(Node());
+
+    QVector3D min(FLT_MAX, FLT_MAX, FLT_MAX);
+    QVector3D max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    QVector3D centroidMin = min;
+    QVector3D centroidMax = max;
+    for (int i = first; i < first + count; ++i) {
+        const Triangle &t(m_triangles[(*order)[i]]);
+        const QVector3D corners[3] = { t.p0, t.p0 + t.e1, t.p0 + t.e2 };
+        for (const QVector3D &p : corners) {
+            for (int axis = 0; axis < 3; ++axis) {
+                min[axis] = qMin(min[axis], p[axis]);
+                max[axis] = qMax(max[axis], p[axis]);
+            }
+        }
+        const QVector3D &c((*centroids)[(*order)[i]]);
+        for (int axis = 0; axis < 3; ++axis) {
+            centroidMin[axis] = qMin(centroidMin[axis], c[axis]);
+            centroidMax[axis] = qMax(centroidMax[axis], c[axis]);
+        }
+    }
+    m_nodes[index].min = min;
+    m_nodes[index].max = max;
+
+    if (count <= LEAF_SIZE) {
+        m_nodes[index].first = first;
+        m_nodes[index].count = count;
+        return index;
+    }
+
+    const QVector3D extent = centroidMax - centroidMin;
+    const int axis = extent.x() > extent.y() ? (extent.x() > extent.z() ? 0 : 2) : (extent.y() > extent.z() ? 1 : 2);
+    const int half = count / 2;
+    std::nth_element(order->begin() + first, order->begin() + first + half, order->begin() + first + count,
+                     [centroids, axis](int a, int b) { return (*centroids)[a][axis] < (*centroids)[b][axis]; });
+    buildNode(first, half, centroids, order);
+    const int right = buildNode(first + half, count - half, centroids, order);
+    m_nodes[index].first = right;
+    m_nodes[index].count = 0;
+    return index;
+}
+
+// Closest hit within (T_MIN, tMax), or with anyHit the first one found.
+bool SoftwareTracer::intersect(const QVector3D &origin, const QVector3D &direction, float tMax, bool anyHit, Hit *hit) const
+{
+    if (m_nodes.isEmpty())
+        return false;
+
+    const QVector3D invDirection(1.0f / direction.x(), 1.0f / direction.y(), 1.0f / direction.z());
+    int stack[64];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    bool found = false;
+    hit->t = tMax;
+    while (stackSize) {
+        const int index = stack[--stackSize];
+        const Node &node(m_nodes[index]);
+        float t0 = T_MIN;
+        float t1 = hit->t;
+        for (int axis = 0; axis < 3; ++axis) {
+            float tNear = (node.min[axis] - origin[axis]) * invDirection[axis];
+            float tFar = (node.max[axis] - origin[axis]) * invDirection[axis];
+            if (tNear > tFar)
+                std::swap(tNear, tFar);
+            t0 = qMax(t0, tNear);
+            t1 = qMin(t1, tFar);
+        }
+        if (t0 > t1)
+            continue;
+
+        if (!node.count) {
+            stack[stackSize++] = node.first;
+            stack[stackSize++] = index + 1;
+            continue;
+        }
+
+        // Möller-Trumbore
+        for (int i = node.first; i < node.first + node.count; ++i) {
+            const Triangle &t(m_triangles[i]);
+            const QVector3D pv = QVector3D::crossProduct(direction, t.e2);
+            const float det = QVector3D::dotProduct(t.e1, pv);
+            if (qAbs(det) < 1e-12f)
+                continue;
+            const float invDet = 1.0f / det;
+            const QVector3D tv = origin - t.p0;
+            const float u = QVector3D::dotProduct(tv, pv) * invDet;
+            if (u < 0.0f || u > 1.0f)
+                continue;
+            const QVector3D qv = QVector3D::crossProduct(tv, t.e1);
+            const float v = QVector3D::dotProduct(direction, qv) * invDet;
+            if (v < 0.0f || u + v > 1.0f)
+                continue;
+            const float distance = QVector3D::dotProduct(t.e2, qv) * invDet;
+            if (distance <= T_MIN || distance >= hit->t)
+                continue;
+            *hit = { distance, i, u, v };
+            found = true;
+            if (anyHit)
+                return true;
+        }
+    }
+    return found;
+}
+
+// Returns the albedo, like shade() in shading.glsl.
+QVector3D SoftwareTracer::shade(const Hit &hit, QVector3D *normal) const
+{
+    const TriangleAttributes &attributes(m_attributes[hit.triangle]);
+    const float w = 1.0f - hit.u - hit.v;
+    *normal = (attributes.normals[0] * w + attributes.normals[1] * hit.u + attributes.normals[2] * hit.v).normalized();
+
+    const SceneMaterial &material(m_materials[attributes.material]);
+    QVector3D albedo(material.baseColor[0], material.baseColor[1], material.baseColor[2]);
+    if (int(material.texture) < m_textures.count()) {
+        const QImage &texture(m_textures[int(material.texture)]);
+        const float s = (attributes.uvs[0][0] * w + attributes.uvs[1][0] * hit.u + attributes.uvs[2][0] * hit.v) * material.uvScale;
+        const float t = (attributes.uvs[0][1] * w + attributes.uvs[1][1] * hit.u + attributes.uvs[2][1] * hit.v) * material.uvScale;
+        // nearest, repeat
+        const int x = ((qFloor(s * texture.width()) % texture.width()) + texture.width()) % texture.width();
+        const int y = ((qFloor(t * texture.height()) % texture.height()) + texture.height()) % texture.height();
+        const quint8 *texel = texture.constScanLine(y) + x * 4;
+        albedo *= QVector3D(texel[0], texel[1], texel[2]) / 255.0f;
+    }
+    return albedo;
+}
+
+static quint32 hash(quint32 x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+static float random(quint32 *state)
+{
+    *state = hash(*state);
+    return float(*state >> 8) * (1.0f / 16777216.0f);
+}
+
+// cosine weighted
+static QVector3D hemisphereDirection(const QVector3D &normal, quint32 *rngState)
+{
+    const float u1 = random(rngState);
+    const float u2 = random(rngState);
+    const float r = qSqrt(u1);
+    const float phi = 2.0f * float(M_PI) * u2;
+    const QVector3D tangent = QVector3D::crossProduct(normal, qAbs(normal.x()) > 0.5f ? QVector3D(0, 1, 0) : QVector3D(1, 0, 0)).normalized();
+    const QVector3D bitangent = QVector3D::crossProduct(normal, tangent);
+    return (tangent * (r * qCos(phi)) + bitangent * (r * qSin(phi)) + normal * qSqrt(qMax(0.0f, 1.0f - u1))).normalized();
+}
+
+void SoftwareTracer::traceTile(const Camera &camera, const QRect &tile, quint8 *rgba) const
+{
+    const QVector3D lightDir = QVector3D(0.4f, -0.6f, 0.7f).normalized();
+    const QVector3D origin = camera.viewInverse.map(QVector3D(0, 0, 0));
+    const float width = camera.imageSize.width();
+    const float height = camera.imageSize.height();
+    const int sampleCount = qMax(1, camera.samplesPerPixel);
+
+    for (int y = tile.top(); y <= tile.bottom(); ++y) {
+        for (int x = tile.left(); x <= tile.right(); ++x) {
+            quint32 rngState = hash(quint32(x) + quint32(width) * quint32(y)) ^ hash(camera.frame);
+            QVector3D color;
+            for (int s = 0; s < sampleCount; ++s) {
+                float offsetX = 0.5f;
+                float offsetY = 0.5f;
+                if (camera.samplesPerPixel > 0) {
+                    offsetX = random(&rngState);
+                    offsetY = random(&rngState);
+                }
+                const float dx = (x + offsetX) / width * 2.0f - 1.0f;
+                const float dy = (y + offsetY) / height * 2.0f - 1.0f;
+                const QVector4D target = camera.projInverse * QVector4D(dx, dy, 1.0f, 1.0f);
+                const QVector3D direction = camera.viewInverse.mapVector((target.toVector3D() / target.w()).normalized());
+
+                Hit hit;
+                if (!intersect(origin, direction, T_MAX, false, &hit)) {
+                    color += MISS_COLOR;
+                    continue;
+                }
+                QVector3D normal;
+                const QVector3D albedo = shade(hit, &normal);
+                const float diffuse = qMax(QVector3D::dotProduct(normal, lightDir), 0.0f);
+                float shadow = 1.0f;
+                float ao = 1.0f;
+                if (camera.secondaryRays) {
+                    // offset against self-intersection
+                    const QVector3D position = origin + direction * hit.t + normal * 0.001f;
+                    Hit occluder;
+                    if (diffuse > 0.0f && intersect(position, lightDir, T_MAX, true, &occluder))
+                        shadow = 0.0f;
+                    if (intersect(position, hemisphereDirection(normal, &rngState), AO_RADIUS, true, &occluder))
+                        ao = 0.0f;
+                }
+                color += albedo * (0.25f * ao + 0.75f * diffuse * shadow);
+            }
+            color /= float(sampleCount);
+
+            quint8 *dst = rgba + ((y - tile.top()) * tile.width() + (x - tile.left())) * 4;
+            for (int c = 0; c < 3; ++c)
+                dst[c] = quint8(qBound(0.0f, color[c], 1.0f) * 255.0f + 0.5f);
+            dst[3] = 255;
+        }
+    }
+}
@@ -0,0 +1,119 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef SOFTWARE_TRACER_H
+#define SOFTWARE_TRACER_H
+
+#include "scene.h"
+#include <QRect>
+
+// A CPU version of what raygen.rgen and the hit shaders do, for the tile
+// workers of TileCoordinator. All instances (at level of detail 0, spheres
+// triangulated) are flattened into one world space triangle list with a
+// bounding volume hierarchy over it. Same camera, lighting, jitter and
+// secondary rays as the GPU, but no back face culling and nearest texture
+// sampling, so the images are close, not identical.
+
+class SoftwareTracer
+{
+public:
+    struct Camera {
+        QMatrix4x4 viewInverse;
+        QMatrix4x4 projInverse;
+        QSize imageSize;
+        int samplesPerPixel = 0; // 0 = one sample at the pixel center
+        quint32 frame = 0; // varies the jitter and the secondary rays
+        bool secondaryRays = false;
+    };
+
+    void build(const Scene &scene);
+    int triangleCount() const { return m_triangles.count(); }
+
+    // writes tile.width() * tile.height() RGBA8 pixels to rgba
+    void traceTile(const Camera &camera, const QRect &tile, quint8 *rgba) const;
+
+private:
+    struct Hit {
+        float t;
+        int triangle;
+        float u;
+        float v;
+    };
+    bool intersect(const QVector3D &origin, const QVector3D &direction, float tMax, bool anyHit, Hit *hit) const;
+    QVector3D shade(const Hit &hit, QVector3D *normal) const;
+
+    // what the traversal touches, the rest is in TriangleAttributes
+    struct Triangle {
+        QVector3D p0;
+        QVector3D e1;
+        QVector3D e2;
+    };
+    struct TriangleAttributes {
+        QVector3D normals[3];
+        float uvs[3][2];
+        int material;
+    };
+    // children of an inner node are at index + 1 and at first
+    struct Node {
+        QVector3D min;
+        QVector3D max;
+        int first;
+        int count; // 0 for inner nodes
+    };
+    int buildNode(int first, int count, QVector<QVector3D> *centroids, QVector<int> *order);
+
+    QVector<Triangle> m_triangles;
+    QVector<TriangleAttributes> m_attributes;
+    QVector<Node> m_nodes;
+    QVector<SceneMaterial> m_materials;
+    QVector<QImage> m_textures;
+};
+
+#endif
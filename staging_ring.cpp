@@ -0,0 +1,146 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "staging_ring.h"
+
+static const VkDeviceSize STAGING_ALIGNMENT = 16;
+
+bool StagingRing::create(const VulkanDevice *vk, int framesInFlight, VkDeviceSize sizePerFrame)
+{
+    m_vk = vk;
+    m_framesInFlight = framesInFlight;
+    m_sizePerFrame = sizePerFrame;
+    m_head = 0;
+    return createBuffer();
+}
+
+bool StagingRing::createBuffer()
+{
+    VkResult err = m_vk->createBuffer(m_sizePerFrame * m_framesInFlight,
+                                      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                      &m_buf, &m_mem, MemoryTracker::Staging);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to create staging buffer: %d", err);
+        return false;
+    }
+
+    err = m_vk->df->vkMapMemory(m_vk->dev, m_mem, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void **>(&m_p));
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to map staging buffer: %d", err);
+        m_vk->destroyBuffer(m_buf, m_mem);
+        m_buf = VK_NULL_HANDLE;
+        m_mem = VK_NULL_HANDLE;
+        m_p = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+void StagingRing::destroy()
+{
+    if (!m_vk)
+        return;
+
+    for (const PendingRelease &r : m_pendingRelease)
+        m_vk->destroyBuffer(r.buf, r.mem);
+    m_pendingRelease.clear();
+
+    if (m_buf) {
+        m_vk->df->vkUnmapMemory(m_vk->dev, m_mem);
+        m_vk->destroyBuffer(m_buf, m_mem);
+        m_buf = VK_NULL_HANDLE;
+        m_mem = VK_NULL_HANDLE;
+        m_p = nullptr;
+    }
+}
+
+void StagingRing::beginFrame(int frameSlot)
+{
+    m_currentFrameSlot = frameSlot;
+    m_head = 0;
+
+    for (int i = m_pendingRelease.count() - 1; i >= 0; --i) {
+        const PendingRelease &r(m_pendingRelease[i]);
+        if (r.frameSlot == frameSlot) {
+            m_vk->destroyBuffer(r.buf, r.mem);
+            m_pendingRelease.removeAt(i);
+        }
+    }
+}
+
+quint8 *StagingRing::allocate(VkDeviceSize size, VkBuffer *buf, VkDeviceSize *offset)
+{
+    const VkDeviceSize alignedSize = (size + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+    // growing failed the last time, try again
+    if (!m_p && !createBuffer())
+        return nullptr;
+    if (m_head + alignedSize > m_sizePerFrame) {
+        // the frame's region is full; what got recorded already still refers
+        // to the old buffer so it can only go away when this slot is reused
+        m_vk->df->vkUnmapMemory(m_vk->dev, m_mem);
+        m_pendingRelease.append({ m_buf, m_mem, m_currentFrameSlot });
+        m_buf = VK_NULL_HANDLE;
+        m_mem = VK_NULL_HANDLE;
+        m_p = nullptr;
+        while (m_sizePerFrame < alignedSize)
+            m_sizePerFrame *= 2;
+        m_sizePerFrame *= 2;
+        m_head = 0;
+        if (!createBuffer())
+            return nullptr;
+    }
+
+    *buf = m_buf;
+    *offset = m_currentFrameSlot * m_sizePerFrame + m_head;
+    m_head += alignedSize;
+    return m_p + *offset;
+}
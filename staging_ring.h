@@ -0,0 +1,98 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef STAGING_RING_H
+#define STAGING_RING_H
+
+#include "vulkan_device.h"
+#include <QVector>
+
+// A persistently mapped, host visible buffer that is split into one region per
+// frame in flight. Allocations are linear within the current frame's region
+// and the region gets recycled when the frame slot comes around again (i.e.
+// when QRhi has waited for the fence of that slot). Running out of space
+// makes the ring grow; the old buffer is kept alive until the frames that
+// may still reference it have completed.
+
+class StagingRing
+{
+public:
+    bool create(const VulkanDevice *vk, int framesInFlight, VkDeviceSize sizePerFrame);
+    void destroy();
+
+    void beginFrame(int frameSlot);
+
+    // Returns a pointer to write the data to, buf and offset are then to be
+    // used as the source of a copy command recorded within the same frame.
+    quint8 *allocate(VkDeviceSize size, VkBuffer *buf, VkDeviceSize *offset);
+
+    VkDeviceSize sizePerFrame() const { return m_sizePerFrame; }
+
+private:
+    bool createBuffer();
+
+    struct PendingRelease {
+        VkBuffer buf;
+        VkDeviceMemory mem;
+        int frameSlot;
+    };
+
+    const VulkanDevice *m_vk = nullptr;
+    int m_framesInFlight = 0;
+    int m_currentFrameSlot = 0;
+    VkDeviceSize m_sizePerFrame = 0;
+    VkDeviceSize m_head = 0;
+    VkBuffer m_buf = VK_NULL_HANDLE;
+    VkDeviceMemory m_mem = VK_NULL_HANDLE;
+    quint8 *m_p = nullptr;
+    QVector<PendingRelease> m_pendingRelease;
+};
+
+#endif
@@ -0,0 +1,114 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "startup_timeline.h"
+#include <algorithm>
+
+void StartupTimeline::start()
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_clock.isValid())
+        return;
+    m_clock.start();
+    m_threads.append(QThread::currentThread());
+}
+
+void StartupTimeline::record(const char *name, qint64 beginNs, qint64 endNs)
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_finished || !m_clock.isValid())
+        return;
+    QThread *thread = QThread::currentThread();
+    int threadIndex = m_threads.indexOf(thread);
+    if (threadIndex < 0) {
+        threadIndex = m_threads.count();
+        m_threads.append(thread);
+    }
+    m_phases.append({ name, beginNs, endNs, threadIndex });
+}
+
+void StartupTimeline::finish(const char *name)
+{
+    mark(name);
+    QMutexLocker lock(&m_mutex);
+    if (m_finished || !m_clock.isValid())
+        return;
+    m_finished = true;
+    log();
+}
+
+void StartupTimeline::log() const
+{
+    QVector<Phase> phases = m_phases;
+    std::stable_sort(phases.begin(), phases.end(), [](const Phase &a, const Phase &b) {
+        return a.beginNs < b.beginNs;
+    });
+
+    // what the GUI thread spent without being able to present anything
+    qint64 guiNs = 0;
+    qint64 endNs = 0;
+    QByteArray lines;
+    for (const Phase &p : phases) {
+        const QByteArray thread = p.thread ? "worker " + QByteArray::number(p.thread) : QByteArray("gui");
+        if (p.endNs > p.beginNs) {
+            lines += QByteArray::asprintf("\n  %9.1f ms  %9.1f ms  %-9s %s", p.beginNs / 1000000.0,
+                                          (p.endNs - p.beginNs) / 1000000.0, thread.constData(), p.name);
+        } else {
+            lines += QByteArray::asprintf("\n  %9.1f ms  %12s  %-9s %s", p.beginNs / 1000000.0, "",
+                                          thread.constData(), p.name);
+        }
+        if (!p.thread)
+            guiNs += p.endNs - p.beginNs;
+        endNs = qMax(endNs, p.endNs);
+    }
+    qDebug("startup timeline (start, duration, thread, phase):%s\n"
+           "startup took %.1f ms, %.1f ms of that in the phases on the GUI thread",
+           lines.constData(), endNs / 1000000.0, guiNs / 1000000.0);
+}
@@ -0,0 +1,115 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef STARTUP_TIMELINE_H
+#define STARTUP_TIMELINE_H
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+
+// The phases of a window's initialization with their start and duration,
+// relative to when the timeline was started, and the thread they ran on
+// (the GUI thread, which started the timeline, or a worker). Logged once
+// by finish(). Thread safe.
+
+class StartupTimeline
+{
+public:
+    // does nothing when already started
+    void start();
+    qint64 now() const { return m_clock.isValid() ? m_clock.nsecsElapsed() : 0; }
+
+    // name must stay valid forever, i.e. should be a string literal
+    void record(const char *name, qint64 beginNs, qint64 endNs);
+    // a point in time rather than a phase
+    void mark(const char *name) { const qint64 t = now(); record(name, t, t); }
+    // marks name and logs the timeline, the first time only
+    void finish(const char *name);
+
+    class Scope
+    {
+    public:
+        Scope(StartupTimeline *timeline, const char *name)
+            : m_timeline(timeline),
+              m_name(name),
+              m_begin(timeline->now())
+        {
+        }
+        ~Scope()
+        {
+            m_timeline->record(m_name, m_begin, m_timeline->now());
+        }
+
+    private:
+        Q_DISABLE_COPY(Scope)
+        StartupTimeline *m_timeline;
+        const char *m_name;
+        qint64 m_begin;
+    };
+
+private:
+    struct Phase {
+        const char *name;
+        qint64 beginNs;
+        qint64 endNs;
+        int thread; // 0 = the GUI thread, index into m_threads
+    };
+    void log() const;
+
+    QElapsedTimer m_clock;
+    mutable QMutex m_mutex;
+    QVector<Phase> m_phases;
+    QVector<QThread *> m_threads;
+    bool m_finished = false;
+};
+
+#endif
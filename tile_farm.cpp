@@ -0,0 +1,381 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "tile_farm.h"
+#include "raytracing_window.h"
+#include <QCoreApplication>
+#include <QDataStream>
+
+static const QDataStream::Version STREAM_VERSION = QDataStream::Qt_5_15;
+
+static QDataStream &operator<<(QDataStream &stream, const SoftwareTracer::Camera &camera)
+{
+    return stream << camera.viewInverse << camera.projInverse << camera.imageSize
+                  << qint32(camera.samplesPerPixel) << camera.frame << camera.secondaryRays;
+}
+
+static QDataStream &operator>>(QDataStream &stream, SoftwareTracer::Camera &camera)
+{
+    qint32 samplesPerPixel;
+    stream >> camera.viewInverse >> camera.projInverse >> camera.imageSize
+           >> samplesPerPixel >> camera.frame >> camera.secondaryRays;
+    camera.samplesPerPixel = samplesPerPixel;
+    return stream;
+}
+
+template<typename... Args>
+static QByteArray message(TileMessage type, const Args &... args)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(STREAM_VERSION);
+    stream << quint8(type);
+    (void) std::initializer_list<int>{ (stream << args, 0)... };
+    return data;
+}
+
+TileCoordinator::TileCoordinator()
+{
+    connect(&m_server, &QLocalServer::newConnection, this, [this] {
+        while (QLocalSocket *socket = m_server.nextPendingConnection()) {
+            m_sockets.append(socket);
+            connect(socket, &QLocalSocket::readyRead, this, [this, socket] { onReadyRead(socket); });
+        }
+    });
+}
+
+TileCoordinator::~TileCoordinator()
+{
+    stop();
+}
+
+bool TileCoordinator::start(int workerCount, const QStringList &workerArguments)
+{
+    stop();
+
+    const QString serverName = QLatin1String("qrhivknvraytracing-tiles-") + QString::number(QCoreApplication::applicationPid());
+    QLocalServer::removeServer(serverName);
+    if (!m_server.listen(serverName)) {
+        qWarning("Failed to listen on %s: %s", qPrintable(serverName), qPrintable(m_server.errorString()));
+        return false;
+    }
+
+    m_workers.resize(size_t(workerCount));
+    for (int i = 0; i < workerCount; ++i) {
+        QProcess *process = new QProcess;
+        m_workers[size_t(i)].process.reset(process);
+        process->setProcessChannelMode(QProcess::ForwardedChannels);
+        connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, [this, i] {
+            onWorkerLost(i);
+        });
+        process->start(QCoreApplication::applicationFilePath(),
+                       workerArguments + QStringList { QLatin1String("--tile-worker"), serverName });
+    }
+    m_expectedWorkers = workerCount;
+    return true;
+}
+
+void TileCoordinator::stop()
+{
+    for (int i = 0; i < workerCount(); ++i) {
+        if (m_workers[size_t(i)].socket)
+            send(i, message(TileMessage::Quit));
+    }
+    for (Worker &worker : m_workers) {
+        // not interested in onWorkerLost() anymore
+        worker.process->disconnect(this);
+        if (worker.socket)
+            worker.socket->waitForBytesWritten(1000);
+        if (!worker.process->waitForFinished(3000)) {
+            worker.process->kill();
+            worker.process->waitForFinished();
+        }
+    }
+    m_workers.clear();
+    qDeleteAll(m_sockets);
+    m_sockets.clear();
+    m_server.close();
+    m_expectedWorkers = 0;
+    m_readyWorkers = 0;
+    m_frameId = 0;
+    m_tiles.clear();
+    m_completedTileCount = 0;
+    m_completedTiles.clear();
+}
+
+void TileCoordinator::render(const SoftwareTracer::Camera &camera)
+{
+    ++m_frameId;
+    m_camera = camera;
+    m_tiles.clear();
+    for (int y = 0; y < camera.imageSize.height(); y += TILE_SIZE) {
+        for (int x = 0; x < camera.imageSize.width(); x += TILE_SIZE)
+            m_tiles.append(QRect(x, y, TILE_SIZE, TILE_SIZE).intersected(QRect(QPoint(0, 0), camera.imageSize)));
+    }
+    m_completedTileCount = 0;
+    m_stolenTileCount = 0;
+    m_completedTiles.clear();
+
+    // contiguous runs of tiles, split evenly between the workers that are there
+    QVector<int> live;
+    for (int i = 0; i < workerCount(); ++i) {
+        Worker &worker(m_workers[size_t(i)]);
+        worker.tiles.clear();
+        worker.sentTiles.clear();
+        worker.completed = 0;
+        if (worker.socket)
+            live.append(i);
+    }
+    if (live.isEmpty())
+        return;
+    for (int i = 0; i < m_tiles.count(); ++i)
+        m_workers[size_t(live[int(qint64(i) * live.count() / m_tiles.count())])].tiles.push_back(i);
+
+    m_frameTimer.start();
+    const QByteArray frame = message(TileMessage::Frame, m_frameId, camera);
+    for (int i : live) {
+        send(i, frame);
+        dispatch(i);
+    }
+}
+
+QVector<TileCoordinator::CompletedTile> TileCoordinator::takeCompletedTiles()
+{
+    QVector<CompletedTile> tiles;
+    tiles.swap(m_completedTiles);
+    return tiles;
+}
+
+// Tops up the worker's queue, from its own tiles first, then by stealing
+// from the back of the longest queue of the others.
+void TileCoordinator::dispatch(int worker)
+{
+    Worker &w(m_workers[size_t(worker)]);
+    while (w.socket && w.inFlight < TILES_IN_FLIGHT) {
+        int tile;
+        if (!w.tiles.empty()) {
+            tile = w.tiles.front();
+            w.tiles.pop_front();
+        } else {
+            Worker *victim = nullptr;
+            for (Worker &other : m_workers) {
+                if (!other.tiles.empty() && (!victim || other.tiles.size() > victim->tiles.size()))
+                    victim = &other;
+            }
+            if (!victim)
+                return;
+            tile = victim->tiles.back();
+            victim->tiles.pop_back();
+            ++m_stolenTileCount;
+        }
+        send(worker, message(TileMessage::Tile, m_frameId, qint32(tile), m_tiles[tile]));
+        w.sentTiles.append(tile);
+        ++w.inFlight;
+    }
+}
+
+void TileCoordinator::send(int worker, const QByteArray &message)
+{
+    m_workers[size_t(worker)].socket->write(message);
+}
+
+void TileCoordinator::onReadyRead(QLocalSocket *socket)
+{
+    int worker = -1;
+    for (int i = 0; i < workerCount(); ++i) {
+        if (m_workers[size_t(i)].socket == socket)
+            worker = i;
+    }
+
+    QDataStream in(socket);
+    in.setVersion(STREAM_VERSION);
+    for (;;) {
+        in.startTransaction();
+        quint8 type;
+        qint64 pid = 0;
+        quint32 frameId = 0;
+        qint32 tile = 0;
+        QRect rect;
+        QByteArray pixels;
+        in >> type;
+        if (TileMessage(type) == TileMessage::Hello)
+            in >> pid;
+        else if (TileMessage(type) == TileMessage::TileDone)
+            in >> frameId >> tile >> rect >> pixels;
+        if (!in.commitTransaction())
+            return;
+
+        if (TileMessage(type) == TileMessage::Hello) {
+            for (int i = 0; i < workerCount(); ++i) {
+                Worker &w(m_workers[size_t(i)]);
+                if (!w.socket && w.process->processId() == pid) {
+                    w.socket = socket;
+                    worker = i;
+                    ++m_readyWorkers;
+                    // joining a frame in progress: stealing is all there is to do
+                    if (hasFrame() && !isFrameComplete()) {
+                        send(i, message(TileMessage::Frame, m_frameId, m_camera));
+                        dispatch(i);
+                    }
+                    break;
+                }
+            }
+            continue;
+        }
+        if (worker < 0 || TileMessage(type) != TileMessage::TileDone)
+            continue;
+
+        Worker &w(m_workers[size_t(worker)]);
+        --w.inFlight;
+        if (frameId == m_frameId) {
+            w.sentTiles.removeOne(tile);
+            ++w.completed;
+            ++m_completedTileCount;
+            const QImage image(reinterpret_cast<const uchar *>(pixels.constData()), rect.width(), rect.height(),
+                               QImage::Format_RGBA8888);
+            m_completedTiles.append({ rect, image.copy() });
+            if (isFrameComplete()) {
+                m_lastFrameStats.ms = m_frameTimer.nsecsElapsed() / 1000000.0;
+                m_lastFrameStats.tileCount = m_tiles.count();
+                m_lastFrameStats.stolenTiles = m_stolenTileCount;
+                m_lastFrameStats.tilesPerWorker.clear();
+                for (const Worker &other : m_workers)
+                    m_lastFrameStats.tilesPerWorker.append(other.completed);
+            }
+        }
+        dispatch(worker);
+    }
+}
+
+// A worker exited (or crashed): its tiles go to the others.
+void TileCoordinator::onWorkerLost(int worker)
+{
+    Worker &w(m_workers[size_t(worker)]);
+    qWarning("Tile worker %d is gone", worker);
+    --m_expectedWorkers;
+    if (!w.socket)
+        return;
+    --m_readyWorkers;
+    w.socket = nullptr;
+
+    int heir = -1;
+    for (int i = 0; i < workerCount(); ++i) {
+        if (m_workers[size_t(i)].socket) {
+            heir = i;
+            break;
+        }
+    }
+    if (heir < 0) {
+        qWarning("No tile workers left");
+        return;
+    }
+    Worker &h(m_workers[size_t(heir)]);
+    for (int tile : w.sentTiles)
+        h.tiles.push_back(tile);
+    for (int tile : w.tiles)
+        h.tiles.push_back(tile);
+    w.sentTiles.clear();
+    w.tiles.clear();
+    w.inFlight = 0;
+    dispatch(heir);
+}
+
+int runTileWorker(const QString &serverName, const RaytracingOptions &workerOptions)
+{
+    RaytracingOptions options = workerOptions;
+    options.lodCount = 1; // only level 0 gets traced
+
+    QElapsedTimer timer;
+    timer.start();
+    SoftwareTracer tracer;
+    tracer.build(options.createScene());
+    const qint64 pid = QCoreApplication::applicationPid();
+    qDebug("tile worker %lld: %d triangles, ready in %lld ms", pid, tracer.triangleCount(), timer.elapsed());
+
+    QLocalSocket socket;
+    socket.connectToServer(serverName);
+    if (!socket.waitForConnected(10000)) {
+        qWarning("Tile worker %lld: failed to connect to %s: %s", pid, qPrintable(serverName), qPrintable(socket.errorString()));
+        return 1;
+    }
+    socket.write(message(TileMessage::Hello, pid));
+
+    QDataStream in(&socket);
+    in.setVersion(STREAM_VERSION);
+    SoftwareTracer::Camera camera;
+    QByteArray pixels;
+    for (;;) {
+        in.startTransaction();
+        quint8 type;
+        quint32 frameId = 0;
+        qint32 tile = 0;
+        QRect rect;
+        in >> type;
+        if (TileMessage(type) == TileMessage::Frame)
+            in >> frameId >> camera;
+        else if (TileMessage(type) == TileMessage::Tile)
+            in >> frameId >> tile >> rect;
+        if (!in.commitTransaction()) {
+            if (!socket.waitForReadyRead(-1))
+                return 0; // the coordinator is gone
+            continue;
+        }
+
+        if (TileMessage(type) == TileMessage::Quit)
+            return 0;
+        if (TileMessage(type) != TileMessage::Tile)
+            continue;
+
+        pixels.resize(rect.width() * rect.height() * 4);
+        tracer.traceTile(camera, rect, reinterpret_cast<quint8 *>(pixels.data()));
+        socket.write(message(TileMessage::TileDone, frameId, tile, rect, pixels));
+        while (socket.bytesToWrite() > 0 && socket.waitForBytesWritten(-1)) { }
+    }
+}
@@ -0,0 +1,155 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef TILE_FARM_H
+#define TILE_FARM_H
+
+#include "software_tracer.h"
+#include <QObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QProcess>
+#include <QElapsedTimer>
+#include <deque>
+#include <memory>
+
+struct RaytracingOptions;
+
+// Offline rendering split into tiles, traced by worker processes running
+// SoftwareTracer. The workers are this executable again, started with the
+// same command line plus --tile-worker, so they create the same scene
+// (see RaytracingOptions::createScene()). They connect back to a
+// QLocalServer; the messages are QDataStream serialized TileMessage types.
+//
+// Each worker gets a contiguous run of tiles when a frame starts and
+// always has up to TILES_IN_FLIGHT of them queued, to hide the round
+// trip. A worker that runs out steals from the far end of whoever has
+// the most left, so tiles that take longer than others (geometry versus
+// sky) do not leave the rest waiting.
+
+enum class TileMessage : quint8 {
+    Hello, // worker: pid, sent once the scene is ready
+    Frame, // coordinator: frame id and SoftwareTracer::Camera
+    Tile, // coordinator: frame id, tile index, rect
+    TileDone, // worker: frame id, tile index, rect, RGBA8 pixels
+    Quit // coordinator
+};
+
+class TileCoordinator : public QObject
+{
+public:
+    static const int TILE_SIZE = 64;
+    static const int TILES_IN_FLIGHT = 2;
+
+    struct CompletedTile {
+        QRect rect;
+        QImage image;
+    };
+
+    struct FrameStatistics {
+        double ms = 0; // from render() until the last tile arrived
+        int tileCount = 0;
+        int stolenTiles = 0;
+        QVector<int> tilesPerWorker;
+    };
+
+    TileCoordinator();
+    ~TileCoordinator();
+
+    bool start(int workerCount, const QStringList &workerArguments);
+    void stop();
+    int workerCount() const { return int(m_workers.size()); }
+    // all (still running) workers connected and have their scene ready
+    bool isReady() const { return m_expectedWorkers > 0 && m_readyWorkers == m_expectedWorkers; }
+
+    // Starts tracing a new frame. Tiles still in flight for the previous one
+    // get dropped when they arrive.
+    void render(const SoftwareTracer::Camera &camera);
+    bool hasFrame() const { return m_frameId > 0; }
+    bool isFrameComplete() const { return m_completedTileCount == m_tiles.count(); }
+    const SoftwareTracer::Camera &camera() const { return m_camera; }
+
+    // the tiles of the current frame that arrived since the last call
+    QVector<CompletedTile> takeCompletedTiles();
+    const FrameStatistics &lastFrameStatistics() const { return m_lastFrameStats; }
+
+private:
+    struct Worker {
+        std::unique_ptr<QProcess> process;
+        QLocalSocket *socket = nullptr; // null until the hello, and once gone
+        std::deque<int> tiles; // of the current frame, not yet sent
+        QVector<int> sentTiles; // of the current frame, not yet done
+        int inFlight = 0; // including those of earlier frames
+        int completed = 0;
+    };
+    void onReadyRead(QLocalSocket *socket);
+    void onWorkerLost(int worker);
+    void dispatch(int worker);
+    void send(int worker, const QByteArray &message);
+
+    QLocalServer m_server;
+    std::vector<Worker> m_workers;
+    QVector<QLocalSocket *> m_sockets;
+    int m_expectedWorkers = 0;
+    int m_readyWorkers = 0;
+    quint32 m_frameId = 0;
+    SoftwareTracer::Camera m_camera;
+    QVector<QRect> m_tiles;
+    int m_completedTileCount = 0;
+    int m_stolenTileCount = 0;
+    QVector<CompletedTile> m_completedTiles;
+    QElapsedTimer m_frameTimer;
+    FrameStatistics m_lastFrameStats;
+};
+
+// The main function of a worker process, returns the exit code.
+int runTileWorker(const QString &serverName, const RaytracingOptions &options);
+
+#endif
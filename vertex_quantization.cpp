@@ -0,0 +1,208 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "vertex_quantization.h"
+#include <QtMath>
+
+static const float SNORM16_MAX = 32767.0f;
+
+QuantizedPositions QuantizedPositions::fromMesh(const SceneMesh &mesh)
+{
+    QuantizedPositions q;
+    const int vertexCount = mesh.vertexCount();
+    if (!vertexCount)
+        return q;
+
+    const float *v = mesh.vertices.constData();
+    QVector3D minPos(v[0], v[1], v[2]);
+    QVector3D maxPos = minPos;
+    for (int i = 1; i < vertexCount; ++i) {
+        const float *p = v + i * SceneMesh::FLOATS_PER_VERTEX;
+        for (int c = 0; c < 3; ++c) {
+            minPos[c] = qMin(minPos[c], p[c]);
+            maxPos[c] = qMax(maxPos[c], p[c]);
+        }
+    }
+
+    q.bias = (minPos + maxPos) * 0.5f;
+    q.scale = (maxPos - minPos) * 0.5f;
+    // flat along an axis (think of the triangle's Z): any scale works there
+    for (int c = 0; c < 3; ++c) {
+        if (q.scale[c] < 1e-6f)
+            q.scale[c] = 1.0f;
+    }
+
+    q.data.resize(vertexCount * 3);
+    qint16 *dst = q.data.data();
+    for (int i = 0; i < vertexCount; ++i) {
+        const float *p = v + i * SceneMesh::FLOATS_PER_VERTEX;
+        for (int c = 0; c < 3; ++c) {
+            const float n = qBound(-1.0f, (p[c] - q.bias[c]) / q.scale[c], 1.0f);
+            *dst++ = qint16(qRound(n * SNORM16_MAX));
+        }
+    }
+
+    return q;
+}
+
+QVector3D QuantizedPositions::position(int index) const
+{
+    const qint16 *p = data.constData() + index * 3;
+    return bias + scale * QVector3D(p[0] / SNORM16_MAX, p[1] / SNORM16_MAX, p[2] / SNORM16_MAX);
+}
+
+QMatrix4x4 QuantizedPositions::dequantizeTransform() const
+{
+    QMatrix4x4 m;
+    m.translate(bias);
+    m.scale(scale);
+    return m;
+}
+
+QVector<float> QuantizedPositions::decode() const
+{
+    QVector<float> result;
+    result.reserve(data.count());
+    for (qint16 c : data)
+        result.append(c / SNORM16_MAX);
+    return result;
+}
+
+// Möller-Trumbore, returns the distance or -1 when there is no hit
+static float intersect(const QVector3D &origin, const QVector3D &dir,
+                       const QVector3D &p0, const QVector3D &p1, const QVector3D &p2)
+{
+    const QVector3D e1 = p1 - p0;
+    const QVector3D e2 = p2 - p0;
+    const QVector3D pv = QVector3D::crossProduct(dir, e2);
+    const float det = QVector3D::dotProduct(e1, pv);
+    if (qAbs(det) < 1e-12f)
+        return -1.0f;
+    const float invDet = 1.0f / det;
+    const QVector3D tv = origin - p0;
+    const float u = QVector3D::dotProduct(tv, pv) * invDet;
+    if (u < 0.0f || u > 1.0f)
+        return -1.0f;
+    const QVector3D qv = QVector3D::crossProduct(tv, e1);
+    const float v = QVector3D::dotProduct(dir, qv) * invDet;
+    if (v < 0.0f || u + v > 1.0f)
+        return -1.0f;
+    return QVector3D::dotProduct(e2, qv) * invDet;
+}
+
+QuantizationError QuantizationError::measure(const SceneMesh &mesh, const QuantizedPositions &quantized, int maxRays)
+{
+    QuantizationError result;
+    const int vertexCount = mesh.vertexCount();
+    const float *v = mesh.vertices.constData();
+    auto floatPosition = [v](int i) {
+        const float *p = v + i * SceneMesh::FLOATS_PER_VERTEX;
+        return QVector3D(p[0], p[1], p[2]);
+    };
+
+    for (int i = 0; i < vertexCount; ++i)
+        result.maxPositionError = qMax(result.maxPositionError, (floatPosition(i) - quantized.position(i)).length());
+
+    const float diagonal = qMax(1e-6f, (quantized.scale * 2.0f).length());
+    const int triangleCount = mesh.triangleCount();
+    const int step = qMax(1, triangleCount / qMax(1, maxRays));
+    quint32 rng = 0x12345678u;
+    auto random = [&rng]() {
+        rng = rng * 1664525u + 1013904223u;
+        return float(rng >> 8) / float(1 << 24);
+    };
+
+    double totalError = 0;
+    for (int t = 0; t < triangleCount; t += step) {
+        const int i0 = int(mesh.indices[t * 3]);
+        const int i1 = int(mesh.indices[t * 3 + 1]);
+        const int i2 = int(mesh.indices[t * 3 + 2]);
+        const QVector3D p0 = floatPosition(i0), p1 = floatPosition(i1), p2 = floatPosition(i2);
+        const QVector3D normal = QVector3D::crossProduct(p1 - p0, p2 - p0).normalized();
+        if (normal.isNull())
+            continue;
+
+        float a = random(), b = random();
+        if (a + b > 1.0f) {
+            a = 1.0f - a;
+            b = 1.0f - b;
+        }
+        const QVector3D target = p0 + (p1 - p0) * a + (p2 - p0) * b;
+        const QVector3D origin = target + (normal + QVector3D(random(), random(), random()) * 0.5f) * diagonal;
+        const QVector3D dir = (target - origin).normalized();
+
+        const float tFloat = intersect(origin, dir, p0, p1, p2);
+        const float tQuant = intersect(origin, dir, quantized.position(i0), quantized.position(i1), quantized.position(i2));
+        result.rayCount += 1;
+        if ((tFloat < 0.0f) != (tQuant < 0.0f)) {
+            result.hitMismatches += 1;
+        } else if (tFloat >= 0.0f) {
+            const float err = qAbs(tFloat - tQuant) / diagonal;
+            result.maxHitDistanceError = qMax(result.maxHitDistanceError, err);
+            totalError += err;
+        }
+    }
+
+    const int hits = result.rayCount - result.hitMismatches;
+    result.avgHitDistanceError = hits ? totalError / hits : 0.0;
+    return result;
+}
+
+void QuantizationError::accumulate(const QuantizationError &other)
+{
+    const int hits = rayCount - hitMismatches;
+    const int otherHits = other.rayCount - other.hitMismatches;
+    if (hits + otherHits)
+        avgHitDistanceError = (avgHitDistanceError * hits + other.avgHitDistanceError * otherHits) / (hits + otherHits);
+    rayCount += other.rayCount;
+    hitMismatches += other.hitMismatches;
+    maxPositionError = qMax(maxPositionError, other.maxPositionError);
+    maxHitDistanceError = qMax(maxHitDistanceError, other.maxHitDistanceError);
+}
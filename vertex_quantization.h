@@ -0,0 +1,94 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef VERTEX_QUANTIZATION_H
+#define VERTEX_QUANTIZATION_H
+
+#include "scene.h"
+#include <QVector3D>
+
+// Positions stored as 3 x 16 bit SNORM, relative to the mesh bounds:
+// position = bias + scale * (q / 32767). Half the size of the float
+// positions, with the scale and bias folded into the instance transform so
+// that the BLAS can be built from the quantized data directly.
+
+struct QuantizedPositions
+{
+    static const int BYTES_PER_VERTEX = 3 * sizeof(qint16);
+
+    QVector<qint16> data; // xyz, tightly packed
+    QVector3D scale;
+    QVector3D bias;
+
+    static QuantizedPositions fromMesh(const SceneMesh &mesh);
+
+    int vertexCount() const { return data.count() / 3; }
+    QVector3D position(int index) const;
+    // maps the quantized object space to the mesh's object space
+    QMatrix4x4 dequantizeTransform() const;
+    // the positions decoded to floats, for when the BLAS cannot take SNORM16 input
+    QVector<float> decode() const;
+};
+
+// Compares ray hits against the float and the quantized version of each
+// triangle. The rays are aimed at random points inside the triangles.
+struct QuantizationError
+{
+    int rayCount = 0;
+    int hitMismatches = 0; // hit one version but not the other (near edges)
+    float maxPositionError = 0; // object space
+    float maxHitDistanceError = 0; // relative to the mesh bounds' diagonal
+    double avgHitDistanceError = 0;
+
+    static QuantizationError measure(const SceneMesh &mesh, const QuantizedPositions &quantized, int maxRays);
+    void accumulate(const QuantizationError &other);
+};
+
+#endif
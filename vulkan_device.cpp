@@ -0,0 +1,185 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "vulkan_device.h"
+
+void VulkanDevice::create(QVulkanInstance *inst, VkPhysicalDevice physicalDevice, VkDevice device)
+{
+    dev = device;
+    physDev = physicalDevice;
+    f = inst->functions();
+    df = inst->deviceFunctions(dev);
+    f->vkGetPhysicalDeviceProperties(physDev, &props);
+    f->vkGetPhysicalDeviceMemoryProperties(physDev, &memProps);
+}
+
+uint32_t VulkanDevice::findMemTypeIndex(uint32_t wantedBits, const VkMemoryRequirements &memReqs, bool *found) const
+{
+    uint32_t memTypeIndex = 0;
+    bool ok = false;
+    for (uint32_t i = 0; i < memProps.memoryTypeCount; ++i) {
+        if (memReqs.memoryTypeBits & (1 << i)) {
+            if ((memProps.memoryTypes[i].propertyFlags & wantedBits) == wantedBits) {
+                memTypeIndex = i;
+                ok = true;
+                break;
+            }
+        }
+    }
+    if (found)
+        *found = ok;
+    return memTypeIndex;
+}
+
+VkResult VulkanDevice::allocateMemory(const VkMemoryAllocateInfo &allocInfo, MemoryTracker::Category category,
+                                      VkDeviceMemory *mem) const
+{
+    VkResult err = df->vkAllocateMemory(dev, &allocInfo, nullptr, mem);
+    if (err == VK_SUCCESS && memoryTracker)
+        memoryTracker->allocated(*mem, category, allocInfo.memoryTypeIndex, allocInfo.allocationSize);
+    return err;
+}
+
+void VulkanDevice::freeMemory(VkDeviceMemory mem) const
+{
+    if (memoryTracker)
+        memoryTracker->freed(mem);
+    df->vkFreeMemory(dev, mem, nullptr);
+}
+
+VkResult VulkanDevice::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memFlags,
+                                    VkBuffer *buf, VkDeviceMemory *mem, MemoryTracker::Category category) const
+{
+    VkBufferCreateInfo bufInfo = {};
+    bufInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufInfo.size = size;
+    bufInfo.usage = usage;
+    VkResult err = df->vkCreateBuffer(dev, &bufInfo, nullptr, buf);
+    if (err != VK_SUCCESS)
+        return err;
+
+    VkMemoryRequirements bufMemReq;
+    df->vkGetBufferMemoryRequirements(dev, *buf, &bufMemReq);
+    VkMemoryAllocateInfo bufMemAllocInfo = {};
+    bufMemAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    bufMemAllocInfo.allocationSize = bufMemReq.size;
+    bufMemAllocInfo.memoryTypeIndex = findMemTypeIndex(memFlags, bufMemReq);
+    err = allocateMemory(bufMemAllocInfo, category, mem);
+    if (err != VK_SUCCESS) {
+        df->vkDestroyBuffer(dev, *buf, nullptr);
+        *buf = VK_NULL_HANDLE;
+        return err;
+    }
+
+    return df->vkBindBufferMemory(dev, *buf, *mem, 0);
+}
+
+void VulkanDevice::destroyBuffer(VkBuffer buf, VkDeviceMemory mem) const
+{
+    freeMemory(mem);
+    df->vkDestroyBuffer(dev, buf, nullptr);
+}
+
+VkResult VulkanDevice::createImage(uint32_t width, uint32_t height, uint32_t layerCount, VkFormat format, VkImageUsageFlags usage,
+                                   VkImage *image, VkDeviceMemory *mem, VkImageView *view,
+                                   MemoryTracker::Category category) const
+{
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = format;
+    imageInfo.extent = { width, height, 1 };
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = layerCount;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = usage;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkResult err = df->vkCreateImage(dev, &imageInfo, nullptr, image);
+    if (err != VK_SUCCESS)
+        return err;
+
+    VkMemoryRequirements imageMemReq;
+    df->vkGetImageMemoryRequirements(dev, *image, &imageMemReq);
+    VkMemoryAllocateInfo imageMemAllocInfo = {};
+    imageMemAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    imageMemAllocInfo.allocationSize = imageMemReq.size;
+    imageMemAllocInfo.memoryTypeIndex = findMemTypeIndex(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, imageMemReq);
+    err = allocateMemory(imageMemAllocInfo, category, mem);
+    if (err != VK_SUCCESS) {
+        df->vkDestroyImage(dev, *image, nullptr);
+        *image = VK_NULL_HANDLE;
+        return err;
+    }
+    err = df->vkBindImageMemory(dev, *image, *mem, 0);
+    if (err != VK_SUCCESS)
+        return err;
+
+    VkImageViewCreateInfo viewInfo = {};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = *image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+    viewInfo.format = format;
+    viewInfo.components.r = VK_COMPONENT_SWIZZLE_R;
+    viewInfo.components.g = VK_COMPONENT_SWIZZLE_G;
+    viewInfo.components.b = VK_COMPONENT_SWIZZLE_B;
+    viewInfo.components.a = VK_COMPONENT_SWIZZLE_A;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.layerCount = layerCount;
+    return df->vkCreateImageView(dev, &viewInfo, nullptr, view);
+}
+
+void VulkanDevice::destroyImage(VkImage image, VkDeviceMemory mem, VkImageView view) const
+{
+    df->vkDestroyImageView(dev, view, nullptr);
+    df->vkDestroyImage(dev, image, nullptr);
+    freeMemory(mem);
+}
@@ -0,0 +1,93 @@
+/****************************************************************************
+**
+** Copyright (C) 2020 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef VULKAN_DEVICE_H
+#define VULKAN_DEVICE_H
+
+#include <QVulkanInstance>
+#include <QVulkanFunctions>
+#include "memory_tracker.h"
+
+// The native device-level bits the raytracing code needs over and over again,
+// queried once after QRhi has created (or imported) the VkDevice.
+
+struct VulkanDevice
+{
+    void create(QVulkanInstance *inst, VkPhysicalDevice physicalDevice, VkDevice device);
+
+    // true for integrated GPUs where device local memory is also host visible
+    // and there is nothing to gain from staging
+    bool isUma() const { return props.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU; }
+
+    uint32_t findMemTypeIndex(uint32_t wantedBits, const VkMemoryRequirements &memReqs, bool *found = nullptr) const;
+    // vkAllocateMemory() and vkFreeMemory(), reporting to memoryTracker
+    VkResult allocateMemory(const VkMemoryAllocateInfo &allocInfo, MemoryTracker::Category category,
+                            VkDeviceMemory *mem) const;
+    void freeMemory(VkDeviceMemory mem) const;
+    VkResult createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memFlags,
+                          VkBuffer *buf, VkDeviceMemory *mem,
+                          MemoryTracker::Category category = MemoryTracker::Buffers) const;
+    void destroyBuffer(VkBuffer buf, VkDeviceMemory mem) const;
+    // a 2D array image in device local memory, view is a 2D array view of all layers
+    VkResult createImage(uint32_t width, uint32_t height, uint32_t layerCount, VkFormat format, VkImageUsageFlags usage,
+                         VkImage *image, VkDeviceMemory *mem, VkImageView *view,
+                         MemoryTracker::Category category = MemoryTracker::Images) const;
+    void destroyImage(VkImage image, VkDeviceMemory mem, VkImageView view) const;
+
+    VkDevice dev = VK_NULL_HANDLE;
+    VkPhysicalDevice physDev = VK_NULL_HANDLE;
+    QVulkanFunctions *f = nullptr;
+    QVulkanDeviceFunctions *df = nullptr;
+    VkPhysicalDeviceProperties props;
+    VkPhysicalDeviceMemoryProperties memProps;
+    MemoryTracker *memoryTracker = nullptr; // optional
+};
+
+#endif
@@ -50,18 +50,34 @@
 
 #include "window.h"
 #include <QPlatformSurfaceEvent>
+#include <QVulkanFunctions>
 
 Window::Window()
 {
     setSurfaceType(VulkanSurface);
 }
 
+Window::~Window()
+{
+    // an imported device must outlive everything QRhi created on it
+    if (m_ownDevice) {
+        m_rp.reset();
+        m_ds.reset();
+        m_sc.reset();
+        m_rhi.reset();
+        QVulkanInstance *inst = vulkanInstance();
+        inst->deviceFunctions(m_ownDevice)->vkDestroyDevice(m_ownDevice, nullptr);
+        inst->resetDeviceFunctions(m_ownDevice);
+    }
+}
+
 void Window::exposeEvent(QExposeEvent *)
 {
     // initialize and start rendering when the window becomes usable for graphics purposes
     if (isExposed() && !m_running) {
         m_running = true;
-        init();
+        ensureInitialized();
+        StartupTimeline::Scope scope(&m_startupTimeline, "swapchain");
         resizeSwapChain();
     }
 
@@ -104,6 +120,177 @@ bool Window::event(QEvent *e)
     return QWindow::event(e);
 }
 
+// QRhi creates the device with one graphics queue and no extension
+// features. Asynchronous compute and bindless resource access need more than
+// that, so in that case do it ourselves, making the same choices QRhi would
+// (first physical device, first graphics queue family that can present), and
+// import the result. Only descriptor indexing is mandatory when requested, the
+// compute queue is left null when not available.
+bool Window::createDevice(QRhiVulkanNativeHandles *importHandles)
+{
+    QVulkanInstance *inst = vulkanInstance();
+    QVulkanFunctions *f = inst->functions();
+
+    uint32_t physDevCount = 0;
+    f->vkEnumeratePhysicalDevices(inst->vkInstance(), &physDevCount, nullptr);
+    if (!physDevCount)
+        return false;
+    QVarLengthArray<VkPhysicalDevice, 4> physDevs(physDevCount);
+    f->vkEnumeratePhysicalDevices(inst->vkInstance(), &physDevCount, physDevs.data());
+    VkPhysicalDevice physDev = physDevs[0];
+
+    uint32_t queueFamilyCount = 0;
+    f->vkGetPhysicalDeviceQueueFamilyProperties(physDev, &queueFamilyCount, nullptr);
+    QVarLengthArray<VkQueueFamilyProperties, 4> queueFamilyProps(queueFamilyCount);
+    f->vkGetPhysicalDeviceQueueFamilyProperties(physDev, &queueFamilyCount, queueFamilyProps.data());
+    int gfxQueueFamilyIdx = -1;
+    for (uint32_t i = 0; i < queueFamilyCount; ++i) {
+        if ((queueFamilyProps[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) && inst->supportsPresent(physDev, i, this)) {
+            gfxQueueFamilyIdx = int(i);
+            break;
+        }
+    }
+    if (gfxQueueFamilyIdx < 0)
+        return false;
+
+    uint32_t extCount = 0;
+    f->vkEnumerateDeviceExtensionProperties(physDev, nullptr, &extCount, nullptr);
+    QVarLengthArray<VkExtensionProperties, 256> extProps(extCount);
+    f->vkEnumerateDeviceExtensionProperties(physDev, nullptr, &extCount, extProps.data());
+    QByteArrayList supportedExtensions;
+    for (const VkExtensionProperties &p : extProps)
+        supportedExtensions.append(QByteArray(p.extensionName));
+
+    QByteArrayList wantedExtensions = {
+        QByteArrayLiteral("VK_KHR_swapchain"),
+        QByteArrayLiteral("VK_KHR_get_memory_requirements2"),
+        QByteArrayLiteral("VK_NV_ray_tracing")
+    };
+    if (m_wantsDescriptorIndexing) {
+        wantedExtensions.append(QByteArrayLiteral("VK_KHR_maintenance3"));
+        wantedExtensions.append(QByteArrayLiteral("VK_EXT_descriptor_indexing"));
+    }
+
+    PFN_vkGetPhysicalDeviceFeatures2KHR getPhysicalDeviceFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(
+                inst->getInstanceProcAddr("vkGetPhysicalDeviceFeatures2KHR"));
+    if (!getPhysicalDeviceFeatures2)
+        return false;
+
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures = {};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+    indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    indexingFeatures.pNext = &timelineFeatures;
+    VkPhysicalDeviceFeatures2KHR features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+    features.pNext = &indexingFeatures;
+    getPhysicalDeviceFeatures2(physDev, &features);
+
+    // The second queue comes from the same family. The vertex and index
+    // buffers are created by QRhi with exclusive sharing mode, so this way
+    // there is no need for queue family ownership transfers.
+    bool computeQueue = false;
+    if (m_wantsComputeQueue) {
+        if (queueFamilyProps[gfxQueueFamilyIdx].queueCount < 2)
+            qWarning("Graphics queue family has only one queue");
+        else if (!supportedExtensions.contains(QByteArrayLiteral("VK_KHR_timeline_semaphore")) || !timelineFeatures.timelineSemaphore)
+            qWarning("Timeline semaphores are not supported");
+        else
+            computeQueue = true;
+    }
+    if (computeQueue)
+        wantedExtensions.append(QByteArrayLiteral("VK_KHR_timeline_semaphore"));
+    // optional, lets the BLAS residency budget follow what the driver reports
+    const bool memoryBudget = supportedExtensions.contains(QByteArrayLiteral("VK_EXT_memory_budget"));
+    if (memoryBudget)
+        wantedExtensions.append(QByteArrayLiteral("VK_EXT_memory_budget"));
+
+    QVarLengthArray<const char *, 8> extensions;
+    for (const QByteArray &ext : wantedExtensions) {
+        if (!supportedExtensions.contains(ext)) {
+            qWarning("Device extension %s is not supported", ext.constData());
+            return false;
+        }
+        extensions.append(ext.constData());
+    }
+
+    // Enable only what is used from the extension features, but whatever is
+    // supported from the core ones, except for the expensive bounds checking.
+    features.features.robustBufferAccess = VK_FALSE;
+    void **nextFeature = &features.pNext;
+    *nextFeature = nullptr;
+    if (m_wantsDescriptorIndexing) {
+        if (!indexingFeatures.runtimeDescriptorArray
+                || !indexingFeatures.shaderStorageBufferArrayNonUniformIndexing
+                || !indexingFeatures.shaderSampledImageArrayNonUniformIndexing)
+        {
+            qWarning("Descriptor indexing features are not supported");
+            return false;
+        }
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT supported = indexingFeatures;
+        indexingFeatures = {};
+        indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        indexingFeatures.runtimeDescriptorArray = supported.runtimeDescriptorArray;
+        indexingFeatures.shaderStorageBufferArrayNonUniformIndexing = supported.shaderStorageBufferArrayNonUniformIndexing;
+        indexingFeatures.shaderSampledImageArrayNonUniformIndexing = supported.shaderSampledImageArrayNonUniformIndexing;
+        *nextFeature = &indexingFeatures;
+        nextFeature = &indexingFeatures.pNext;
+    }
+    if (computeQueue) {
+        timelineFeatures.pNext = nullptr;
+        *nextFeature = &timelineFeatures;
+        nextFeature = &timelineFeatures.pNext;
+    }
+
+    const float queuePriorities[] = { 1.0f, 1.0f };
+    VkDeviceQueueCreateInfo queueInfo = {};
+    queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueInfo.queueFamilyIndex = uint32_t(gfxQueueFamilyIdx);
+    queueInfo.queueCount = computeQueue ? 2 : 1;
+    queueInfo.pQueuePriorities = queuePriorities;
+
+    VkDeviceCreateInfo devInfo = {};
+    devInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    devInfo.pNext = &features;
+    devInfo.queueCreateInfoCount = 1;
+    devInfo.pQueueCreateInfos = &queueInfo;
+    devInfo.enabledExtensionCount = uint32_t(extensions.count());
+    devInfo.ppEnabledExtensionNames = extensions.constData();
+
+    VkResult err = f->vkCreateDevice(physDev, &devInfo, nullptr, &m_ownDevice);
+    if (err != VK_SUCCESS) {
+        qWarning("Failed to create device: %d", err);
+        m_ownDevice = VK_NULL_HANDLE;
+        return false;
+    }
+
+    QVulkanDeviceFunctions *df = inst->deviceFunctions(m_ownDevice);
+    VkQueue gfxQueue;
+    df->vkGetDeviceQueue(m_ownDevice, uint32_t(gfxQueueFamilyIdx), 0, &gfxQueue);
+    if (computeQueue) {
+        df->vkGetDeviceQueue(m_ownDevice, uint32_t(gfxQueueFamilyIdx), 1, &m_computeQueue);
+        m_computeQueueFamilyIdx = uint32_t(gfxQueueFamilyIdx);
+    }
+    m_hasDescriptorIndexing = m_wantsDescriptorIndexing;
+    m_hasMemoryBudget = memoryBudget;
+
+    importHandles->physDev = physDev;
+    importHandles->dev = m_ownDevice;
+    importHandles->gfxQueueFamilyIdx = gfxQueueFamilyIdx;
+    importHandles->gfxQueue = gfxQueue;
+
+    return true;
+}
+
+void Window::ensureInitialized()
+{
+    if (!m_initialized) {
+        m_initialized = true;
+        m_startupTimeline.start();
+        init();
+    }
+}
+
 void Window::init()
 {
     QRhiVulkanInitParams params;
@@ -111,7 +298,27 @@ void Window::init()
     params.window = this;
     params.deviceExtensions = { "VK_KHR_get_memory_requirements2", "VK_NV_ray_tracing" };
 
-    m_rhi.reset(QRhi::create(QRhi::Vulkan, &params));
+    const qint64 beginNs = m_startupTimeline.now();
+    QRhiVulkanNativeHandles importHandles;
+    bool importDevice = false;
+    if (m_deviceShareWindow) {
+        m_deviceShareWindow->ensureInitialized();
+        const QRhiVulkanNativeHandles *h = static_cast<const QRhiVulkanNativeHandles *>(m_deviceShareWindow->m_rhi->nativeHandles());
+        importHandles.physDev = h->physDev;
+        importHandles.dev = h->dev;
+        importHandles.gfxQueueFamilyIdx = h->gfxQueueFamilyIdx;
+        importHandles.gfxQueue = h->gfxQueue;
+        m_hasDescriptorIndexing = m_deviceShareWindow->m_hasDescriptorIndexing;
+        m_hasMemoryBudget = m_deviceShareWindow->m_hasMemoryBudget;
+        importDevice = true;
+    } else {
+        const bool wantsOwnDevice = m_wantsComputeQueue || m_wantsDescriptorIndexing;
+        importDevice = wantsOwnDevice && createDevice(&importHandles);
+        if (wantsOwnDevice && !importDevice)
+            qWarning("Failed to create a device with the requested features, leaving device creation to QRhi");
+    }
+
+    m_rhi.reset(QRhi::create(QRhi::Vulkan, &params, QRhi::Flags(), importDevice ? &importHandles : nullptr));
 
     if (!m_rhi)
         qFatal("Failed to create RHI backend");
@@ -125,6 +332,8 @@ void Window::init()
     m_sc->setDepthStencil(m_ds.get());
     m_rp.reset(m_sc->newCompatibleRenderPassDescriptor());
     m_sc->setRenderPassDescriptor(m_rp.get());
+    m_startupTimeline.record(importDevice && !m_deviceShareWindow ? "device and QRhi" : "QRhi",
+                             beginNs, m_startupTimeline.now());
 
     customInit();
 }
@@ -148,6 +357,7 @@ void Window::resizeSwapChain()
 
     m_rayView = QMatrix4x4();
     m_rayView.translate(0, 0, -5);
+    m_rayView.rotate(m_viewRotation, 0, 1, 0);
     m_rayViewInverse = m_rayView.inverted();
 
     m_matricesChanged = true;
@@ -173,7 +383,15 @@ void Window::render()
         m_newlyExposed = false;
     }
 
-    QRhi::FrameOpResult r = m_rhi->beginFrame(m_sc.get());
+    m_cpuProfiler.nextFrame();
+    CpuProfiler::Scope frameScope(&m_cpuProfiler, "frame");
+
+    QRhi::FrameOpResult r;
+    {
+        // mostly waiting for the fence of the frame slot
+        CpuProfiler::Scope scope(&m_cpuProfiler, "beginFrame");
+        r = m_rhi->beginFrame(m_sc.get());
+    }
     if (r == QRhi::FrameOpSwapChainOutOfDate) {
         resizeSwapChain();
         if (!m_hasSwapChain)
@@ -186,9 +404,20 @@ void Window::render()
         return;
     }
 
-    customRender();
+    {
+        CpuProfiler::Scope scope(&m_cpuProfiler, "customRender");
+        customRender();
+    }
 
-    m_rhi->endFrame(m_sc.get());
+    {
+        // submit and present
+        CpuProfiler::Scope scope(&m_cpuProfiler, "endFrame");
+        m_rhi->endFrame(m_sc.get());
+    }
+    if (!m_firstFrameRendered) {
+        m_firstFrameRendered = true;
+        m_startupTimeline.mark("first frame submitted");
+    }
 
 #if 0
     m_rayView = QMatrix4x4();
@@ -53,14 +53,24 @@
 
 #include <QWindow>
 #include <QtGui/private/qrhivulkan_p.h>
+#include "cpu_profiler.h"
+#include "startup_timeline.h"
 
 class Window : public QWindow
 {
 public:
     Window();
+    ~Window();
 
     void releaseSwapChain();
 
+    // Creates the QRhi (and the device, if that is done here) right away,
+    // instead of waiting for the window to get exposed.
+    void ensureInitialized();
+
+    // rotates the camera around the Y axis
+    void setViewRotation(float degrees) { m_viewRotation = degrees; }
+
 protected:
     virtual void customInit();
     virtual void customRender();
@@ -77,7 +87,32 @@ protected:
     QMatrix4x4 m_rayView;
     QMatrix4x4 m_rayViewInverse;
 
+    // Set before the window gets exposed to have the VkDevice created here,
+    // with a second queue and timeline semaphores and/or descriptor indexing
+    // enabled, and then imported into QRhi. m_computeQueue stays null and
+    // m_hasDescriptorIndexing false when this is not possible.
+    bool m_wantsComputeQueue = false;
+    bool m_wantsDescriptorIndexing = false;
+    VkQueue m_computeQueue = VK_NULL_HANDLE;
+    uint32_t m_computeQueueFamilyIdx = 0;
+    bool m_hasDescriptorIndexing = false;
+    // VK_EXT_memory_budget is enabled whenever the device created here supports it
+    bool m_hasMemoryBudget = false;
+
+    // Set before the window gets exposed to use the VkDevice of another
+    // window (which then must outlive this one) instead of creating one.
+    // There is no second queue in this case.
+    Window *m_deviceShareWindow = nullptr;
+
+    // render() times its phases with this when started
+    CpuProfiler m_cpuProfiler;
+
+    // Started by ensureInitialized(), with the QRhi and swapchain creation
+    // and the first frame; the subclasses add their phases and finish it.
+    StartupTimeline m_startupTimeline;
+
 private:
+    bool createDevice(QRhiVulkanNativeHandles *importHandles);
     void init();
     void resizeSwapChain();
     void render();
@@ -85,9 +120,13 @@ private:
     void exposeEvent(QExposeEvent *) override;
     bool event(QEvent *) override;
 
+    bool m_initialized = false;
     bool m_running = false;
+    float m_viewRotation = 0.0f;
     bool m_notExposed = false;
     bool m_newlyExposed = false;
+    bool m_firstFrameRendered = false;
+    VkDevice m_ownDevice = VK_NULL_HANDLE;
 };
 
 #endif